@@ -14,6 +14,8 @@
 #include "input/input_context.h"
 #include "types/error.h"
 #include "app/paths.h"
+#include "app/setting.h"
+#include "app/statistics.h"
 #include "types/app_state.h"
 
 
@@ -91,10 +93,26 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_aidoo_retrorunner_RRNative_addVariable(JNIEnv *env, jclass clazz, jstring key, jstring value, jboolean notify_core) {
     DeclareEnvironment();
     JString keyVal(env, key);
-    JString valueVal(env, key);
+    JString valueVal(env, value);
     environment->UpdateVariable(keyVal.stdString(), valueVal.stdString(), notify_core);
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_aidoo_retrorunner_RRNative_loadVariables(JNIEnv *env, jclass clazz, jstring path, jboolean notify_core) {
+    DeclareEnvironment(false);
+    JString pathVal(env, path);
+    return environment->LoadVariablesFromFile(pathVal.stdString(), notify_core);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_aidoo_retrorunner_RRNative_saveVariables(JNIEnv *env, jclass clazz, jstring path, jboolean wait_for_result) {
+    auto app = AppContext::Current();
+    if (!app) return RRError::kAppNotRunning;
+    JString pathVal(env, path);
+    std::string savePath = pathVal.stdString();
+    return app->AddSaveVariablesCommand(savePath, wait_for_result);
+}
+
 
 std::unique_ptr<std::thread> emuThreadPtr = nullptr;
 
@@ -175,6 +193,104 @@ Java_com_aidoo_retrorunner_RRNative_setFastForward(JNIEnv *env, jclass clazz, jf
     LOGD_JNI("set game speed to x%f", multiplier);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setInputPollType(JNIEnv *env, jclass clazz, jint poll_type) {
+    Setting::Current()->SetInputPollType(poll_type);
+    auto app = AppContext::Current();
+    if (app.get() == nullptr) return;
+    auto input = app->GetInput();
+    if (input) input->SetPollType(poll_type);
+    LOGD_JNI("set input poll type to %d", poll_type);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setVideoFrameDedupe(JNIEnv *env, jclass clazz, jboolean enable) {
+    Setting::Current()->SetVideoFrameDedupe(enable);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setVideoFrameLatency(JNIEnv *env, jclass clazz, jint frames_in_flight, jint swap_interval) {
+    Setting::Current()->SetVideoFramesInFlight(std::min(2, std::max(0, frames_in_flight)));
+    Setting::Current()->SetVideoSwapInterval(std::max(0, swap_interval));
+    LOGD_JNI("set video frames in flight: %d, swap interval: %d", frames_in_flight, swap_interval);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setVulkanSwapchain(JNIEnv *env, jclass clazz, jint present_mode, jint image_count) {
+    Setting::Current()->SetVideoPresentMode(std::min(4, std::max(0, present_mode)));
+    Setting::Current()->SetVideoSwapchainImages(std::max(0, image_count));
+    LOGD_JNI("set vulkan present mode: %d, swapchain images: %d", present_mode, image_count);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_aidoo_retrorunner_RRNative_setVideoShaderPreset(JNIEnv *env, jclass clazz, jstring path) {
+    JString pathVal(env, path);
+    std::string presetPath = pathVal.stdString();
+    auto app = AppContext::Current();
+    //运行中需要在 emu 线程切换 pass 链
+    if (app) return app->AddLoadVideoShaderCommand(presetPath, false);
+    Setting::Current()->SetVideoShaderPreset(presetPath);
+    LOGD_JNI("set video shader preset: %s", presetPath.c_str());
+    return RRError::kSuccess;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setAudioDriver(JNIEnv *env, jclass clazz, jstring driver) {
+    JString audioDriver(env, driver);
+    Setting::Current()->SetAudioDriver(audioDriver.stdString());
+    LOGD_JNI("set audio driver to %s", audioDriver.cString());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setAudioDumpPath(JNIEnv *env, jclass clazz, jstring path) {
+    JString dumpPath(env, path);
+    Setting::Current()->SetAudioDumpPath(dumpPath.stdString());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setNullAudioTiming(JNIEnv *env, jclass clazz, jint burst_frames, jint jitter_us) {
+    Setting::Current()->SetNullAudioBurstFrames(std::max(1, burst_frames));
+    Setting::Current()->SetNullAudioJitter(std::max(0, jitter_us));
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setAudioResamplerQuality(JNIEnv *env, jclass clazz, jint quality) {
+    Setting::Current()->SetAudioResamplerQuality(quality);
+    LOGD_JNI("set audio resampler quality to %d", quality);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setAudioFloatOutput(JNIEnv *env, jclass clazz, jboolean enable) {
+    Setting::Current()->SetAudioFloatOutput(enable);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_setAudioTimeStretch(JNIEnv *env, jclass clazz, jboolean enable) {
+    Setting::Current()->SetAudioTimeStretch(enable);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_addAudioDspFilter(JNIEnv *env, jclass clazz, jstring preset_path) {
+    JString presetPath(env, preset_path);
+    Setting::Current()->AddAudioDspFilter(presetPath.stdString());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_clearAudioDspFilters(JNIEnv *env, jclass clazz) {
+    Setting::Current()->ClearAudioDspFilters();
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_aidoo_retrorunner_RRNative_getStatistics(JNIEnv *env, jclass clazz) {
+    std::string json = Statistics::Current()->ToJson();
+    return env->NewStringUTF(json.c_str());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_resetStatistics(JNIEnv *env, jclass clazz) {
+    Statistics::Current()->Reset();
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_aidoo_retrorunner_RRNative_updateButtonState(JNIEnv *env, jclass clazz, jint player, jint key, jboolean down) {
     auto app = AppContext::Current();
@@ -198,6 +314,50 @@ Java_com_aidoo_retrorunner_RRNative_updateAxisState(JNIEnv *env, jclass clazz, j
     }
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_updateKeyState(JNIEnv *env, jclass clazz, jint key_code, jint character, jint meta_state, jboolean down) {
+    auto app = AppContext::Current();
+    if (app) {
+        auto input = app->GetInput();
+        if (input) {
+            input->UpdateKey(key_code, character, meta_state, down);
+        }
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_updateMouseMotion(JNIEnv *env, jclass clazz, jint dx, jint dy) {
+    auto app = AppContext::Current();
+    if (app) {
+        auto input = app->GetInput();
+        if (input) {
+            input->UpdateMouseMotion(dx, dy);
+        }
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_updateMouseButton(JNIEnv *env, jclass clazz, jint button, jboolean down) {
+    auto app = AppContext::Current();
+    if (app) {
+        auto input = app->GetInput();
+        if (input) {
+            input->UpdateMouseButton(button, down);
+        }
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_aidoo_retrorunner_RRNative_updatePointerState(JNIEnv *env, jclass clazz, jint pointer_id, jfloat x, jfloat y, jboolean down) {
+    auto app = AppContext::Current();
+    if (app) {
+        auto input = app->GetInput();
+        if (input) {
+            input->UpdatePointer(pointer_id, x, y, down);
+        }
+    }
+}
+
 extern "C" JNIEXPORT jdouble JNICALL
 Java_com_aidoo_retrorunner_RRNative_getAspectRatio(JNIEnv *env, jclass clazz) {
     auto app = AppContext::Current();
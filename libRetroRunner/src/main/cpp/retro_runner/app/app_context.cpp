@@ -14,6 +14,7 @@
 #include "app_context.h"
 #include "paths.h"
 #include "setting.h"
+#include "statistics.h"
 
 #include <retro_runner/types/log.h>
 #include <retro_runner/types/app_state.h>
@@ -23,6 +24,7 @@
 #include <retro_runner/video/video_context.h>
 #include <retro_runner/input/input_context.h>
 #include <retro_runner/audio/audio_context.h>
+#include <retro_runner/audio/audio_callback_thread.h>
 #include <retro_runner/types/error.h>
 
 #ifdef ANDROID
@@ -124,6 +126,7 @@ namespace libRetroRunner {
         game_runtime_context_ = nullptr;
         emu_thread_id_ = -1;
         memset(&app_window_, 0, sizeof(app_window_));
+        audio_underrun_likely_ = &Statistics::Current()->GetCounter("audio.underrun_likely");
     }
 
     AppContext::~AppContext() {
@@ -183,16 +186,47 @@ namespace libRetroRunner {
         if (BIT_TEST(state_, AppState::kVideoReady) &&
             BIT_TEST(state_, AppState::kContentReady)) {
             //avoid emulator run too fast
-            speed_limiter_.CheckAndWait(game_runtime_context_->GetFps());
+            speed_limiter_.CheckAndWait(game_runtime_context_->GetFastForwardingFps());
 
             video_->Prepare();
-            core_->retro_run();
+            {
+                //核心使用音频回调时, 回调和 retro_run 不能同时执行
+                auto coreLock = lockCore();
+                if (audio_) {
+                    //核心在上一帧要求的音频延迟, 在 retro_run 之外调整缓冲区
+                    audio_->ApplyPendingLatency();
+                    audio_->SetPlaybackSpeed(game_runtime_context_->GetGameSpeed());
+                }
+                notifyAudioBufferStatus();
+                //上一帧中修改的选项, 在环境回调之外通知核心
+                if (environment_) environment_->DeliverVariablesUpdateDisplay();
+                input_->BeginFrame();
+                core_->retro_run();
+                //单个采样回调的音频在这一帧结束时一次性写入
+                if (audio_) audio_->Flush();
+            }
+            input_->EndFrame();
         } else {
             usleep(16000);
         }
         return true;
     }
 
+    std::unique_lock<std::mutex> AppContext::lockCore() {
+        if (audio_callback_thread_) return audio_callback_thread_->LockCore();
+        return {};
+    }
+
+    void AppContext::notifyAudioBufferStatus() {
+        auto callback = core_runtime_context_->GetAudioBufferStatusCallback();
+        if (!callback) return;
+        bool active = audio_ && audio_->IsActive();
+        unsigned occupancy = active ? audio_->GetBufferOccupancy() : 0;
+        bool underrunLikely = active && occupancy < AudioContext::kUnderrunLikelyOccupancy;
+        if (underrunLikely) audio_underrun_likely_->fetch_add(1, std::memory_order_relaxed);
+        callback(active, occupancy, underrunLikely);
+    }
+
     void AppContext::Pause() {
         BIT_SET(state_, AppState::kPaused);
         AddCommand(AppCommands::kDisableAudio);
@@ -217,6 +251,10 @@ namespace libRetroRunner {
         }
         //TODO: save sram, cheat code
         BIT_UNSET(state_, AppState::kRunning);
+        if (audio_callback_thread_) {
+            audio_callback_thread_->Stop();
+            audio_callback_thread_ = nullptr;
+        }
         if (BIT_TEST(state_, AppState::kContentReady)) {
             core_->retro_unload_game();
             BIT_UNSET(state_, AppState::kContentReady);
@@ -393,6 +431,7 @@ namespace libRetroRunner {
 
                 case AppCommands::kResetGame: {
                     if (BIT_TEST(state_, AppState::kContentReady)) {
+                        auto coreLock = lockCore();
                         core_->retro_reset();
                     }
                     break;
@@ -410,9 +449,11 @@ namespace libRetroRunner {
                     if (audio_) {
                         audio_->Start();
                     }
+                    if (audio_callback_thread_) audio_callback_thread_->SetEnabled(true);
                     break;
                 }
                 case AppCommands::kDisableAudio: {
+                    if (audio_callback_thread_) audio_callback_thread_->SetEnabled(false);
                     if (audio_) {
                         audio_->Stop();
                     }
@@ -454,6 +495,14 @@ namespace libRetroRunner {
                     commandLoadState(command);
                     break;
                 }
+                case AppCommands::kSaveVariables: {
+                    commandSaveVariables(command);
+                    break;
+                }
+                case AppCommands::kLoadVideoShader: {
+                    commandLoadVideoShader(command);
+                    break;
+                }
                 case AppCommands::kNone:
                 default:
                     break;
@@ -494,6 +543,16 @@ namespace libRetroRunner {
         return addCommandWithPath(savePath, AppCommands::kLoadSRAM, wait_for_result);
     }
 
+    int AppContext::AddSaveVariablesCommand(std::string &path, bool wait_for_result) {
+        std::string savePath = path;
+        return addCommandWithPath(savePath, AppCommands::kSaveVariables, wait_for_result);
+    }
+
+    int AppContext::AddLoadVideoShaderCommand(std::string &path, bool wait_for_result) {
+        std::string presetPath = path;
+        return addCommandWithPath(presetPath, AppCommands::kLoadVideoShader, wait_for_result);
+    }
+
     void AppContext::commandInitApp() {
         emu_thread_id_ = gettid();
         BIT_SET(state_, AppState::kRunning);
@@ -514,6 +573,13 @@ namespace libRetroRunner {
             core_->retro_set_audio_sample_batch(&retroCallbackAudioSampleBatch);
             core_->retro_set_input_poll(&retroCallbackInputPoll);
             core_->retro_set_input_state(&retroCallbackInputState);
+
+            //核心选项: 先加载核心的选项，再用单个游戏的选项覆盖, 核心登记选项时生效
+            //rom 旁边的旧文件仍然读取, 新位置的文件存在时覆盖它
+            environment_->LoadVariablesFromFile(core_runtime_context_->GetOptionsFilePath());
+            environment_->LoadVariablesFromFile(game_runtime_context_->GetLegacyOptionsFilePath());
+            environment_->LoadVariablesFromFile(core_runtime_context_->GetGameOptionsFilePath(game_runtime_context_->GetGamePath()));
+
             core_->retro_init();
             BIT_SET(state_, AppState::kCoreReady);
             LOGD_APP("core loaded: %s", core_path.c_str());
@@ -572,6 +638,22 @@ namespace libRetroRunner {
         LOGD_APP("content loaded");
     }
 
+    AudioConfig AppContext::makeAudioConfig() {
+        auto setting = Setting::Current();
+        AudioConfig config;
+        config.sampleRate = game_runtime_context_->GetSampleRate();
+        config.minimumLatency = core_runtime_context_->GetMinimumAudioLatency();
+        config.lowLatency = setting->UseLowLatency();
+        config.resamplerQuality = setting->GetAudioResamplerQuality();
+        config.floatOutput = setting->UseAudioFloatOutput();
+        config.timeStretch = setting->UseAudioTimeStretch();
+        config.dspFilters = setting->GetAudioDspFilters();
+        config.dumpPath = setting->GetAudioDumpPath();
+        config.nullBurstFrames = setting->GetNullAudioBurstFrames();
+        config.nullJitterUs = setting->GetNullAudioJitter();
+        return config;
+    }
+
     void AppContext::commandInitComponents() {
         if(!BIT_TEST(state_, AppState::kRunning)){
             LOGE_APP("emu is not ready to run, skip create components.");
@@ -583,10 +665,16 @@ namespace libRetroRunner {
 
         auto audio_driver = Setting::Current()->GetAudioDriver();
         audio_ = AudioContext::Create(audio_driver);
-        audio_->Init();
+        audio_->Init(makeAudioConfig());
+        if (core_runtime_context_->GetAudioCallback().callback) {
+            audio_callback_thread_ = std::make_unique<AudioCallbackThread>(core_runtime_context_->GetAudioCallback(), audio_);
+            audio_callback_thread_->Start();
+        }
         AddCommand(AppCommands::kEnableAudio);
 
         input_ = InputContext::Create(Setting::Current()->GetInputDriver());
+        input_->SetPollType(Setting::Current()->GetInputPollType());
+        input_->SetPollTypeOverride(core_runtime_context_->GetPollTypeOverride());
         input_->Init(core_runtime_context_->GetMaxUserCount());
         LOGD_APP("components initialized");
 
@@ -599,6 +687,8 @@ namespace libRetroRunner {
         std::shared_ptr<ParamCommand<std::string>> paramCommand = std::static_pointer_cast<ParamCommand<std::string>>(command);
         std::string savePath = paramCommand->GetArg();
 
+        //核心使用音频回调时, 回调线程可能正在修改 SRAM
+        auto coreLock = lockCore();
         size_t ramSize = core_->retro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
         unsigned char *ramData = (unsigned char *) core_->retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
         int ret = RRError::kSuccess;
@@ -622,6 +712,7 @@ namespace libRetroRunner {
 
     void AppContext::commandLoadSRAM(std::shared_ptr<Command> &command) {
         int ret = RRError::kSuccess;
+        auto coreLock = lockCore();
         size_t sramSize = core_->retro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
         void *sramState = core_->retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
 
@@ -653,6 +744,7 @@ namespace libRetroRunner {
         std::shared_ptr<ParamCommand<std::string>> paramCommand = std::static_pointer_cast<ParamCommand<std::string>>(command);
         std::string savePath = paramCommand->GetArg();
 
+        auto coreLock = lockCore();
         size_t stateSize = core_->retro_serialize_size();
         int ret = RRError::kSuccess;
         if (stateSize == 0) {
@@ -688,6 +780,7 @@ namespace libRetroRunner {
         auto data = Utils::readFileAsBytes(savePath);
 
         if (!data.empty()) {
+            auto coreLock = lockCore();
             if (!core_->retro_unserialize(&(data[0]), data.size())) {
                 LOGE_APP("can't unserialize state from %s ", savePath.c_str());
                 ret = RRError::kCannotWriteData;
@@ -706,6 +799,47 @@ namespace libRetroRunner {
         }
     }
 
+    void AppContext::commandSaveVariables(std::shared_ptr<Command> &command) {
+        std::shared_ptr<ParamCommand<std::string>> paramCommand = std::static_pointer_cast<ParamCommand<std::string>>(command);
+        std::string savePath = paramCommand->GetArg();
+        if (savePath.empty()) {
+            savePath = core_runtime_context_->GetGameOptionsFilePath(game_runtime_context_->GetGamePath());
+        }
+
+        int ret = RRError::kSuccess;
+        if (!environment_->SaveVariablesToFile(savePath)) {
+            ret = RRError::kCannotWriteData;
+        } else {
+            LOGD_APP("variables saved to %s", savePath.c_str());
+        }
+
+        if (command->GetCommandType() == CommandType::kThreadCommand) {
+            std::shared_ptr<ThreadCommand<int, std::string>> threadCommand = std::static_pointer_cast<ThreadCommand<int, std::string>>(command);
+            threadCommand->SetResult(ret);
+            threadCommand->Signal();
+        }
+    }
+
+    void AppContext::commandLoadVideoShader(std::shared_ptr<Command> &command) {
+        std::shared_ptr<ParamCommand<std::string>> paramCommand = std::static_pointer_cast<ParamCommand<std::string>>(command);
+        std::string presetPath = paramCommand->GetArg();
+        //视频还没有创建时只保存设置, 创建 pass 链时加载
+        Setting::Current()->SetVideoShaderPreset(presetPath);
+
+        int ret = RRError::kSuccess;
+        if (video_ && !video_->LoadShaderPreset(presetPath)) {
+            ret = RRError::kFailed;
+        } else {
+            LOGD_APP("video shader preset: %s", presetPath.c_str());
+        }
+
+        if (command->GetCommandType() == CommandType::kThreadCommand) {
+            std::shared_ptr<ThreadCommand<int, std::string>> threadCommand = std::static_pointer_cast<ThreadCommand<int, std::string>>(command);
+            threadCommand->SetResult(ret);
+            threadCommand->Signal();
+        }
+    }
+
 }
 
 namespace libRetroRunner {
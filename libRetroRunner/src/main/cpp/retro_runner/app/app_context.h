@@ -6,6 +6,8 @@
 #define _APP_H
 
 #include <string>
+#include <atomic>
+#include <mutex>
 #include <retro_runner/types/app_command.hpp>
 #include <retro_runner/runtime_contexts/core_context.h>
 #include <retro_runner/runtime_contexts/game_context.h>
@@ -21,6 +23,7 @@
 #endif
 
 namespace libRetroRunner {
+    struct AudioConfig;
 
     struct AppWindow {
 #ifdef ANDROID
@@ -129,6 +132,16 @@ namespace libRetroRunner {
 
         int AddLoadSRAMCommand(std::string &path, bool wait_for_result = false);
 
+        /**
+         * Save core variables to an option file, if path is empty, save to the per-game option file.
+         */
+        int AddSaveVariablesCommand(std::string &path, bool wait_for_result = false);
+
+        /**
+         * Apply a shader preset to the video, empty path for none.
+         */
+        int AddLoadVideoShaderCommand(std::string &path, bool wait_for_result = false);
+
     private:
         /**
          * Add a command to the command queue, if wait_for_result is true, this will block until the command is processed,
@@ -150,6 +163,9 @@ namespace libRetroRunner {
 
         void commandInitComponents();
 
+        /* audio settings and game parameters for AudioContext::Init */
+        AudioConfig makeAudioConfig();
+
         void commandSaveSRAM(std::shared_ptr<Command> &command);
 
         void commandLoadSRAM(std::shared_ptr<Command> &command);
@@ -158,6 +174,16 @@ namespace libRetroRunner {
 
         void commandLoadState(std::shared_ptr<Command> &command);
 
+        void commandSaveVariables(std::shared_ptr<Command> &command);
+
+        void commandLoadVideoShader(std::shared_ptr<Command> &command);
+
+        /* report audio buffer status to core before retro_run, RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK */
+        void notifyAudioBufferStatus();
+
+        /* keep the core audio callback out while calling into the core, empty lock when core doesn't use it */
+        std::unique_lock<std::mutex> lockCore();
+
     public:
         template<class T>
         void NotifyFrontend(FrontendNotify<T> *notify);
@@ -179,9 +205,14 @@ namespace libRetroRunner {
         std::shared_ptr<class VideoContext> video_;
         std::shared_ptr<class InputContext> input_;
         std::shared_ptr<class AudioContext> audio_;
+        /* RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, null when core renders audio in retro_run */
+        std::unique_ptr<class AudioCallbackThread> audio_callback_thread_;
 
         SpeedLimiter speed_limiter_;
 
+        /* frames reported to core as audio underrun likely */
+        std::atomic<int64_t> *audio_underrun_likely_ = nullptr;
+
         pid_t emu_thread_id_ = 0;
         FrontendNotifyCallback frontend_notify_ = nullptr;
 
@@ -11,11 +11,15 @@
 
 #include "setting.h"
 #include "../video/video_context.h"
+#include "../input/input_context.h"
+#include "../audio/audio_context.h"
 #include "app_context.h"
 #include "paths.h"
 #include "../vfs/vfs_context.h"
 
 #include <libretro_vulkan.h>
+#include <fstream>
+#include <file/file_path.h>
 
 #define POINTER_VAL(_TYPE_) (*((_TYPE_*)data))
 
@@ -28,7 +32,115 @@ rr_hardware_render_proc_address_t getHWProcAddress;
 namespace libRetroRunner {
 
     void Environment::UpdateVariable(const std::string &key, const std::string &value, bool notifyCore) {
+        //可能在JNI线程中调用, 这里只记录修改, 由模拟线程统一应用, 避免核心持有的value指针被其他线程改写
+        {
+            std::lock_guard<std::mutex> lock(pendingVariablesMutex_);
+            pendingVariables_.emplace_back(key, value);
+        }
+        hasPendingVariables_.store(true, std::memory_order_release);
+        if (notifyCore) {
+            variablesChanged.store(true, std::memory_order_release);
+        }
+    }
+
+    Variable *Environment::findVariable(std::string_view key) {
+        auto found = variables.find(key);
+        return found == variables.end() ? nullptr : found->second;
+    }
+
+    Variable &Environment::internVariable(std::string_view key) {
+        Variable *variable = findVariable(key);
+        if (variable == nullptr) {
+            variable = &variableStorage_.emplace_back();
+            variable->key = key;
+            variables.emplace(std::string_view(variable->key), variable);
+        }
+        return *variable;
+    }
+
+    void Environment::applyPendingVariables() {
+        if (!hasPendingVariables_.load(std::memory_order_acquire)) return;
+
+        std::vector<std::pair<std::string, std::string>> pending;
+        {
+            std::lock_guard<std::mutex> lock(pendingVariablesMutex_);
+            pending.swap(pendingVariables_);
+            hasPendingVariables_.store(false, std::memory_order_relaxed);
+        }
+        for (auto &item: pending) {
+            internVariable(item.first).value = std::move(item.second);
+        }
+        //核心根据新的值决定选项是否显示, 这里还在核心的环境回调里面, 等回调返回后再通知
+        variablesDisplayPending_ = true;
+    }
+
+    void Environment::DeliverVariablesUpdateDisplay() {
+        if (!variablesDisplayPending_) return;
+        variablesDisplayPending_ = false;
+        if (variablesUpdateDisplayCallback_) {
+            variablesUpdateDisplayCallback_();
+        }
+    }
 
+    static std::string_view trimOptionText(std::string_view text) {
+        auto start = text.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) return {};
+        auto end = text.find_last_not_of(" \t\r");
+        return text.substr(start, end - start + 1);
+    }
+
+    bool Environment::LoadVariablesFromFile(const std::string &path, bool notifyCore) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            LOGD_Env("no option file: %s", path.c_str());
+            return false;
+        }
+        //一次读取整个文件, 然后一次性提交, 后加载的文件会覆盖之前的值
+        std::vector<std::pair<std::string, std::string>> loaded;
+        std::string line;
+        while (std::getline(file, line)) {
+            std::string_view text = trimOptionText(line);
+            auto equal = text.find('=');
+            if (text.empty() || text[0] == '#' || equal == std::string_view::npos) continue;
+
+            std::string_view key = trimOptionText(text.substr(0, equal));
+            std::string_view value = trimOptionText(text.substr(equal + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (key.empty()) continue;
+            loaded.emplace_back(key, value);
+        }
+        if (loaded.empty()) return true;
+
+        {
+            std::lock_guard<std::mutex> lock(pendingVariablesMutex_);
+            for (auto &item: loaded) {
+                pendingVariables_.emplace_back(std::move(item));
+            }
+        }
+        hasPendingVariables_.store(true, std::memory_order_release);
+        if (notifyCore) {
+            variablesChanged.store(true, std::memory_order_release);
+        }
+        LOGD_Env("%zu options loaded from %s", loaded.size(), path.c_str());
+        return true;
+    }
+
+    bool Environment::SaveVariablesToFile(const std::string &path) {
+        //单个游戏的选项在 {system}/{core name}/ 下, 目录可能还不存在
+        size_t slash = path.find_last_of('/');
+        if (slash != std::string::npos && slash > 0) path_mkdir(path.substr(0, slash).c_str());
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            LOGW_Env("can't write option file: %s", path.c_str());
+            return false;
+        }
+        for (const auto &variable: variableStorage_) {
+            if (variable.value.empty()) continue;
+            file << variable.key << " = \"" << variable.value << "\"\n";
+        }
+        return file.good();
     }
 
     Environment::Environment() {
@@ -83,8 +195,14 @@ namespace libRetroRunner {
                 return false;
             }
             case RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK: {
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK -> [NO IMPL]");
-                return false;
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK");
+                auto keyboardCallback = static_cast<const struct retro_keyboard_callback *>(data);
+                retro_keyboard_event_t callback = keyboardCallback ? keyboardCallback->callback : nullptr;
+                auto core_ctx = core_runtime_context_.lock();
+                if (core_ctx) core_ctx->SetKeyboardCallback(callback);
+                auto input = AppContext::Current()->GetInput();
+                if (input) input->SetKeyboardCallback(callback);
+                return true;
             }
             case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE: {
                 LOGD_Env("call RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE -> disk control");
@@ -105,8 +223,9 @@ namespace libRetroRunner {
             }
             case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE: {
                 //LOGD_Env("call RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE");
-                POINTER_VAL(bool) = variablesChanged;
-                variablesChanged = false;
+                //先取标记再应用修改, 保证核心看到true时新的值已经生效
+                POINTER_VAL(bool) = variablesChanged.exchange(false, std::memory_order_acq_rel);
+                applyPendingVariables();
                 return true;
             }
             case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME: {
@@ -119,9 +238,13 @@ namespace libRetroRunner {
                 return false;
             }
             case RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK: {
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK -> [NO IMPL]");
-                //auto callback = static_cast<const struct retro_audio_callback *>(data);
-                return false;
+                //核心在回调中输出音频, 由音频生产线程调用, NULL 用来查询是否支持, 两个函数都为 NULL 表示取消
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK");
+                if (data == nullptr) return true;
+                auto callback = static_cast<const struct retro_audio_callback *>(data);
+                auto core_ctx = core_runtime_context_.lock();
+                if (core_ctx) core_ctx->SetAudioCallback(*callback);
+                return true;
             }
             case RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE: {
                 LOGD_Env("call RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE");
@@ -310,14 +433,15 @@ namespace libRetroRunner {
                 return false;
             }
             case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS: {
-                //TODO:返回前端是否支持以掩码的方式一次性获取所有的输入信息,如果返回true, 则需要在retro_input_state_t方法中检测RETRO_DEVICE_ID_JOYPAD_MASK并返回所有的输入
-                LOGD_Env("call RETRO_ENVIRONMENT_GET_INPUT_BITMASKS");
+                //返回前端是否支持以掩码的方式一次性获取所有的输入信息, 输入模块在RETRO_DEVICE_ID_JOYPAD_MASK时返回整个按键掩码
+                LOGD_Env("call RETRO_ENVIRONMENT_GET_INPUT_BITMASKS -> true");
+                if (data) POINTER_VAL(bool) = true;
                 return true;
             }
             case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION: {
-                //TODO:返回前端所支持的核心选项版本, 0, 1, 2, 不同的版本会有不同的核心选项组织方式
-                LOGD_Env("call RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION");
-                POINTER_VAL(unsigned) = 0;
+                //返回前端所支持的核心选项版本, 0, 1, 2, 不同的版本会有不同的核心选项组织方式
+                LOGD_Env("call RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION -> 2");
+                POINTER_VAL(unsigned) = 2;
                 return true;
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS: {
@@ -325,22 +449,18 @@ namespace libRetroRunner {
                     这个回调是为了用于取代 RETRO_ENVIRONMENT_SET_VARIABLES (RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION 返回 >= 1时)，
                     如果核心使用了新的版本返回选项，则需要实现这个回调, 其结构体为retro_core_option_definition，类似于json的实现
                  */
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS -> [NO IMPL]");
-                //auto request = static_cast<const struct retro_core_option_definition *>(data);
-                return false;
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS");
+                return cmdSetCoreOptions(static_cast<const struct retro_core_option_definition *>(data));
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL: {
-                /*TODO:RETRO_ENVIRONMENT_SET_CORE_OPTIONS的变体，用于支持多语言*/
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL -> [NO IMPL]");
-                //auto request = static_cast<const struct retro_core_options_intl *>(data);
-                return false;
+                /*RETRO_ENVIRONMENT_SET_CORE_OPTIONS的变体，用于支持多语言*/
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL");
+                return cmdSetCoreOptionsIntl(static_cast<const struct retro_core_options_intl *>(data));
 
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY: {
                 //用于控制核心选项的可见性
-                //LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY -> [NO IMPL]");
-                //auto request = static_cast<const struct retro_core_option_display *>(data);
-                return true;
+                return cmdSetCoreOptionsDisplay(static_cast<const struct retro_core_option_display *>(data));
             }
             case RETRO_ENVIRONMENT_GET_PREFERRED_HW_RENDER: {
                 //TODO:返回前端所期望的硬件渲染类型，在这里添加更多的类型
@@ -387,16 +507,22 @@ namespace libRetroRunner {
                 return true;
             }
             case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK: {
-                //向核心注册一个回调，用于核心通知前端音频缓冲区的状态，比如有时核心需要跳过一些音频帧
+                //核心注册一个回调, 前端在每次 retro_run 前报告音频缓冲区的状态, 核心可以据此跳帧, NULL 表示取消
                 LOGD_Env("call RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK");
-                auto request = static_cast<struct retro_audio_buffer_status_callback *>(data);
-                request->callback = &Environment::CoreCallbackNotifyAudioState;
-                return false;
+                auto request = static_cast<const struct retro_audio_buffer_status_callback *>(data);
+                auto core_ctx = core_runtime_context_.lock();
+                if (core_ctx) core_ctx->SetAudioBufferStatusCallback(request ? request->callback : nullptr);
+                return true;
             }
             case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY: {
-                //通知前端核心所需要的最小音频延迟
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY -> [NO IMPL]");
-                return false;
+                //通知前端核心所需要的最小音频延迟, NULL 或 0 表示使用默认值
+                unsigned latency = data ? POINTER_VAL(const unsigned) : 0;
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY -> %u ms", latency);
+                auto core_ctx = core_runtime_context_.lock();
+                if (core_ctx) core_ctx->SetMinimumAudioLatency(latency);
+                auto audio = AppContext::Current()->GetAudio();
+                if (audio) audio->SetMinimumLatency(latency);
+                return true;
             }
             case RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE: {
                 //通知前端核心是否应该快进, 比如有时核心需要跳过一些帧时
@@ -413,29 +539,33 @@ namespace libRetroRunner {
                 return false;
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2: {
-                //TODO:通知前端核心选项，用于替代 RETRO_ENVIRONMENT_SET_VARIABLES， 只在RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION返回 >= 2时使用
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2 -> [NO IMPL]");
-                //auto request = static_cast<const struct retro_core_options_v2 *>(data);
-                return false;
+                //通知前端核心选项，用于替代 RETRO_ENVIRONMENT_SET_VARIABLES， 只在RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION返回 >= 2时使用
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2");
+                return cmdSetCoreOptionsV2(static_cast<const struct retro_core_options_v2 *>(data));
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL: {
                 //TODO:通知前端核心选项，用于替代 RETRO_ENVIRONMENT_SET_VARIABLES， 只在RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION返回 >= 2时使用
                 //RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2 的变体，支持多语言
-                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL -> [NO IMPL]");
-                //auto request = static_cast<const struct retro_core_options_v2 *>(data);
-                return false;
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL");
+                auto request = static_cast<const struct retro_core_options_v2_intl *>(data);
+                if (request == nullptr) return false;
+                bool ret = cmdSetCoreOptionsV2(request->us);
+                if (request->local) {
+                    cmdSetCoreOptionsV2(request->local, true);
+                }
+                return ret;
             }
             case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK: {
                 //用于前端向核心通知哪些核心设置应该显示或者应该隐藏
-                LOGD_Env(
-                        "call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK -> [NO IMPL]");
-                return false;
+                LOGD_Env("call RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK");
+                auto request = static_cast<const struct retro_core_options_update_display_callback *>(data);
+                variablesUpdateDisplayCallback_ = request ? request->callback : nullptr;
+                return true;
             }
             case RETRO_ENVIRONMENT_SET_VARIABLE: {
                 //核心通知前端选项值发生变化。
                 LOGD_Env("call RETRO_ENVIRONMENT_SET_VARIABLE");
                 return cmdSetVariable(data);
-                return true;
             }
             case RETRO_ENVIRONMENT_GET_THROTTLE_STATE: {
                 //用于核心获取前端的帧率运行情況
@@ -486,6 +616,16 @@ namespace libRetroRunner {
                 //用于通知前端在后台存储存档的状态
                 break;
             }
+            case RETRO_ENVIRONMENT_POLL_TYPE_OVERRIDE: {
+                //核心要求的输入锁存时机, 0:不关心 1:early 2:normal 3:late
+                unsigned pollType = POINTER_VAL(unsigned);
+                LOGD_Env("call RETRO_ENVIRONMENT_POLL_TYPE_OVERRIDE -> %u", pollType);
+                auto core_ctx = core_runtime_context_.lock();
+                if (core_ctx) core_ctx->SetPollTypeOverride(pollType);
+                auto input = AppContext::Current()->GetInput();
+                if (input) input->SetPollTypeOverride(pollType);
+                return true;
+            }
             case RETRO_ENVIRONMENT_GET_APP_SANDBOX_DIRECTORY: {
                 if (!appSandBoxPath_.empty()){
                     POINTER_VAL(const char*) = appSandBoxPath_.c_str();
@@ -535,15 +675,17 @@ namespace libRetroRunner {
     }
 
     bool Environment::cmdGetVariable(void *data) {
+        //有的核心每帧都会调用, 这里不能分配内存也不输出日志
         auto request = static_cast<struct retro_variable *>(data);
-        auto foundVariable = variables.find(std::string(request->key));
+        if (request == nullptr || request->key == nullptr) return false;
 
-        if (foundVariable == variables.end()) {
-            LOGD_Env("call RETRO_ENVIRONMENT_GET_VARIABLE: %s -> null", request->key);
+        applyPendingVariables();
+        const Variable *variable = findVariable(request->key);
+        if (variable == nullptr) {
+            request->value = nullptr;
             return false;
         }
-        request->value = foundVariable->second.value.c_str();
-        LOGD_Env("call RETRO_ENVIRONMENT_GET_VARIABLE: %s -> %s", request->key, request->value);
+        request->value = variable->value.c_str();
         return true;
     }
 
@@ -552,36 +694,126 @@ namespace libRetroRunner {
         auto request = static_cast<const struct retro_variable *>(data);
         unsigned idx = 0;
         while (request[idx].key != nullptr) {
-            cmdSetVariable((void *) (&request[idx]));
+            addVariableDefinition(&request[idx]);
             idx++;
         }
+        //前端在核心登记选项之前设置的值
+        applyPendingVariables();
         return true;
     }
 
+    void Environment::addVariableDefinition(const struct retro_variable *definition) {
+        if (definition == nullptr || definition->key == nullptr) return;
+
+        //格式: "描述; 选项1|选项2|选项3", 第一个选项为默认值
+        std::string_view text(definition->value ? definition->value : "");
+        std::string_view options;
+        auto separator = text.find(';');
+        if (separator != std::string_view::npos) {
+            auto optionsStart = text.find_first_not_of(' ', separator + 1);
+            if (optionsStart != std::string_view::npos) options = text.substr(optionsStart);
+        }
+
+        Variable &variable = internVariable(definition->key);
+        variable.description = text.substr(0, separator);
+        variable.options = options;
+        variable.defaultValue = options.substr(0, options.find('|'));
+        if (variable.value.empty()) {
+            variable.value = variable.defaultValue;
+        }
+        LOGD_Env("core provide variable: %s -> %s: %s", variable.key.c_str(), variable.value.c_str(), variable.description.c_str());
+    }
+
     bool Environment::cmdSetVariable(void *data) {
+        //核心主动修改选项的值, data为空时用于检测前端是否支持
         auto request = static_cast<const struct retro_variable *>(data);
-        if (request && request->key != nullptr) {
-            std::string key(request->key);
-            std::string description(request->value);
-            std::string value(request->value);
+        if (request == nullptr) return true;
+        if (request->key == nullptr || request->value == nullptr) return false;
 
+        Variable *variable = findVariable(request->key);
+        if (variable == nullptr) return false;
+        variable->value = request->value;
+        LOGD_Env("core set variable: %s -> %s", variable->key.c_str(), variable->value.c_str());
+        return true;
+    }
 
-            auto firstValueStart = value.find(';') + 2;
-            auto firstValueEnd = value.find('|', firstValueStart);
-            value = value.substr(firstValueStart, firstValueEnd - firstValueStart);
+    static void assignVariableValues(Variable &variable, const struct retro_core_option_value *values, const char *defaultValue) {
+        variable.options.clear();
+        for (unsigned idx = 0; idx < RETRO_NUM_CORE_OPTION_VALUES_MAX && values[idx].value != nullptr; idx++) {
+            if (idx > 0) variable.options += '|';
+            variable.options += values[idx].value;
+        }
+        if (defaultValue != nullptr) {
+            variable.defaultValue = defaultValue;
+        } else {
+            variable.defaultValue = variable.options.substr(0, variable.options.find('|'));
+        }
+        if (variable.value.empty()) {
+            variable.value = variable.defaultValue;
+        }
+    }
 
-            auto currentVariable = variables[key];
-            currentVariable.key = key;
-            currentVariable.description = description.substr(0, description.find(';'));
-            currentVariable.options = description.substr(description.find(';') + 2);
+    bool Environment::cmdSetCoreOptions(const struct retro_core_option_definition *definitions, bool localized) {
+        if (definitions == nullptr) return false;
+        for (auto definition = definitions; definition->key != nullptr; definition++) {
+            //多语言版本只替换描述信息
+            Variable *variable = localized ? findVariable(definition->key) : &internVariable(definition->key);
+            if (variable == nullptr) continue;
+            if (definition->desc) variable->description = definition->desc;
+            if (definition->info) variable->info = definition->info;
+            if (!localized) assignVariableValues(*variable, definition->values, definition->default_value);
+        }
+        applyPendingVariables();
+        return true;
+    }
 
-            if (currentVariable.value.empty()) {
-                currentVariable.value = value;
+    bool Environment::cmdSetCoreOptionsIntl(const struct retro_core_options_intl *options) {
+        if (options == nullptr) return false;
+        bool ret = cmdSetCoreOptions(options->us);
+        if (options->local) {
+            cmdSetCoreOptions(options->local, true);
+        }
+        return ret;
+    }
+
+    bool Environment::cmdSetCoreOptionsV2(const struct retro_core_options_v2 *options, bool localized) {
+        if (options == nullptr) return false;
+        for (auto category = options->categories; category && category->key != nullptr; category++) {
+            VariableCategory *target = nullptr;
+            for (auto &item: variableCategories_) {
+                if (item.key == category->key) {
+                    target = &item;
+                    break;
+                }
             }
+            if (target == nullptr) {
+                if (localized) continue;
+                target = &variableCategories_.emplace_back();
+                target->key = category->key;
+            }
+            if (category->desc) target->description = category->desc;
+            if (category->info) target->info = category->info;
+        }
 
-            variables[key] = currentVariable;
-            LOGD_Env("core provide variable: %s -> %s: %s", key.c_str(), value.c_str(), description.c_str());
+        for (auto definition = options->definitions; definition && definition->key != nullptr; definition++) {
+            Variable *variable = localized ? findVariable(definition->key) : &internVariable(definition->key);
+            if (variable == nullptr) continue;
+            if (definition->desc) variable->description = definition->desc;
+            if (definition->info) variable->info = definition->info;
+            if (definition->category_key) variable->category = definition->category_key;
+            if (!localized) assignVariableValues(*variable, definition->values, definition->default_value);
         }
+        applyPendingVariables();
+        //返回true表示前端支持分类
+        return true;
+    }
+
+    bool Environment::cmdSetCoreOptionsDisplay(const struct retro_core_option_display *display) {
+        //用于控制核心选项的可见性
+        if (display == nullptr || display->key == nullptr) return false;
+        Variable *variable = findVariable(display->key);
+        if (variable == nullptr) return false;
+        variable->visible = display->visible;
         return true;
     }
 
@@ -694,10 +926,6 @@ namespace libRetroRunner {
         }
     }
 
-    void Environment::CoreCallbackNotifyAudioState(bool active, unsigned int occupancy, bool underrun_likely) {
-        //TODO: 核心通知前端音频状态
-    }
-
     retro_proc_address_t Environment::CoreCallbackGetProcAddress(const char *sym) {
         if (getHWProcAddress) {
             //LOGD_Env("get proc address: %s", sym);
@@ -708,10 +936,10 @@ namespace libRetroRunner {
         //return (retro_proc_address_t) eglGetProcAddress(sym);
     }
 
-    const std::string Environment::GetVariable(const std::string &key, const std::string &defaultValue) {
-        auto foundVariable = variables.find(key);
-        if (foundVariable != variables.end()) {
-            return foundVariable->second.value;
+    const std::string Environment::GetVariable(std::string_view key, const std::string &defaultValue) {
+        const Variable *variable = findVariable(key);
+        if (variable != nullptr) {
+            return variable->value;
         }
         return defaultValue;
     }
@@ -6,6 +6,11 @@
 #define _ENVIRONMENT_H
 
 #include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string_view>
 #include <unordered_map>
 
 #include <libretro-common/include/libretro.h>
@@ -27,14 +32,24 @@ namespace libRetroRunner {
 
         void UpdateVariable(const std::string &key, const std::string &value, bool notifyCore = false);
 
+        /**
+         * Load variables from an option file (key = "value" per line), values are applied like UpdateVariable.
+         * Can be called from any thread, eg: per-core file, then per-game file to override.
+         * @return false if the file can't be read
+         */
+        bool LoadVariablesFromFile(const std::string &path, bool notifyCore = false);
+
+        /**
+         * Save all variables to an option file, should be called in emu thread.
+         */
+        bool SaveVariablesToFile(const std::string &path);
+
         static uintptr_t CoreCallbackGetCurrentFrameBuffer();
 
         static bool CoreCallbackSetRumbleState(unsigned port, enum retro_rumble_effect effect, uint16_t strength);
 
         static void CoreCallbackLog(enum retro_log_level level, const char *fmt, ...);
 
-        static void CoreCallbackNotifyAudioState(bool active, unsigned occupancy, bool underrun_likely);
-
         static retro_proc_address_t CoreCallbackGetProcAddress(const char *sym);
 
     private:
@@ -48,6 +63,17 @@ namespace libRetroRunner {
 
         bool cmdSetVariable(void *data);
 
+        bool cmdSetCoreOptions(const struct retro_core_option_definition *definitions, bool localized = false);
+
+        bool cmdSetCoreOptionsIntl(const struct retro_core_options_intl *options);
+
+        bool cmdSetCoreOptionsV2(const struct retro_core_options_v2 *options, bool localized = false);
+
+        bool cmdSetCoreOptionsDisplay(const struct retro_core_option_display *display);
+
+        /* SET_VARIABLES 的单个定义, 格式: "描述; 选项1|选项2" */
+        void addVariableDefinition(const struct retro_variable *definition);
+
         void cmdSetControllers(void *data);
 
         bool cmdSetSystemAudioVideoInfo(void *data);
@@ -56,6 +82,15 @@ namespace libRetroRunner {
 
         bool cmdGetCurrentFrameBuffer(void *data);
 
+        /* 返回已登记的变量, 不存在时返回nullptr */
+        Variable *findVariable(std::string_view key);
+
+        /* 登记变量, key只会拷贝一次, 之后的查找都不会再分配内存 */
+        Variable &internVariable(std::string_view key);
+
+        /* 在模拟线程中应用JNI线程提交的变量修改 */
+        void applyPendingVariables();
+
     public:
 
         inline void SetGameRuntimeContext(const std::shared_ptr<class GameRuntimeContext>& game_runtime_context) {
@@ -66,7 +101,13 @@ namespace libRetroRunner {
             core_runtime_context_ = core_runtime_context;
         }
 
-        const std::string GetVariable(const std::string &key, const std::string &defaultValue = "");
+        const std::string GetVariable(std::string_view key, const std::string &defaultValue = "");
+
+        /**
+         * call the core's update display callback if variables changed since the last call.
+         * called by the emu thread before retro_run, never from inside an environment call, the core is not reentrant.
+         */
+        void DeliverVariablesUpdateDisplay();
 
         inline void SetAppSandBoxPath(const std::string &path) {
             appSandBoxPath_ = path;
@@ -74,8 +115,21 @@ namespace libRetroRunner {
         inline std::string& GetAppSandBoxPath() { return appSandBoxPath_; }
     private:
         std::string appSandBoxPath_;
-        bool variablesChanged = false;
-        std::unordered_map<std::string, struct Variable> variables;
+        std::atomic<bool> variablesChanged = false;
+
+        /* deque中的元素地址不会因为插入而变化, 所以索引可以直接引用其中的key */
+        std::deque<Variable> variableStorage_;
+        std::unordered_map<std::string_view, Variable *> variables;
+
+        /* JNI线程提交的修改, 由模拟线程在GET_VARIABLE_UPDATE/GET_VARIABLE时应用 */
+        std::mutex pendingVariablesMutex_;
+        std::vector<std::pair<std::string, std::string>> pendingVariables_;
+        std::atomic<bool> hasPendingVariables_ = false;
+
+        std::vector<VariableCategory> variableCategories_;
+        retro_core_options_update_display_callback_t variablesUpdateDisplayCallback_ = nullptr;
+        /* 变量修改后等待通知核心, 只在模拟线程访问 */
+        bool variablesDisplayPending_ = false;
 
         std::weak_ptr<class GameRuntimeContext> game_runtime_context_;
         std::weak_ptr<class CoreRuntimeContext> core_runtime_context_;
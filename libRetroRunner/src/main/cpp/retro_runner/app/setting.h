@@ -5,11 +5,17 @@
 #ifndef _SETTING_H
 #define _SETTING_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace libRetroRunner {
     /**
      * Global setting for app
+     * JNI threads write the settings while the emu thread, the video and audio threads read them:
+     * scalar values are atomic, the dsp filter list is copied under a lock.
+     * Strings are set before the components are created, or through an app command (shader preset).
      */
     class Setting {
     public:
@@ -40,6 +46,13 @@ namespace libRetroRunner {
             return audio_driver_;
         }
 
+        /**
+         * audio driver: android, file, null, used when audio is initialized
+         */
+        inline void SetAudioDriver(const std::string &driver) {
+            audio_driver_ = driver;
+        }
+
         /**
          * if use linear in video output.
          * @return linear
@@ -48,14 +61,190 @@ namespace libRetroRunner {
             return video_linear;
         }
 
+        /**
+         * hash software frames and skip upload and shader passes when a frame is identical to the previous one
+         */
+        inline bool UseVideoFrameDedupe() {
+            return video_frame_dedupe_;
+        }
+
+        inline void SetVideoFrameDedupe(bool enable) {
+            video_frame_dedupe_ = enable;
+        }
+
+        /**
+         * frames the GPU may lag behind the emu thread, 0: wait every frame (lowest latency), 1 or 2: more throughput
+         */
+        inline unsigned GetVideoFramesInFlight() {
+            return video_frames_in_flight_;
+        }
+
+        inline void SetVideoFramesInFlight(unsigned frames) {
+            video_frames_in_flight_ = frames;
+        }
+
+        /**
+         * swap interval of the window surface, 0: no vsync, 1: every vblank
+         */
+        inline int GetVideoSwapInterval() {
+            return video_swap_interval_;
+        }
+
+        inline void SetVideoSwapInterval(int interval) {
+            video_swap_interval_ = interval;
+        }
+
+        /**
+         * shader preset(.glslp) or single pass shader(.glsl) used by GLES video, empty for none
+         */
+        inline std::string &GetVideoShaderPreset() {
+            return video_shader_preset_;
+        }
+
+        inline void SetVideoShaderPreset(const std::string &path) {
+            video_shader_preset_ = path;
+        }
+
+        /**
+         * vulkan present mode, see VulkanPresentMode, 0: auto (FIFO, MAILBOX/IMMEDIATE when swap interval is 0)
+         */
+        inline unsigned GetVideoPresentMode() {
+            return video_present_mode_;
+        }
+
+        inline void SetVideoPresentMode(unsigned mode) {
+            video_present_mode_ = mode;
+        }
+
+        /**
+         * vulkan swapchain image count, 0: auto (frames in flight + 1), clamped to the surface limits
+         */
+        inline unsigned GetVideoSwapchainImages() {
+            return video_swapchain_images_;
+        }
+
+        inline void SetVideoSwapchainImages(unsigned count) {
+            video_swapchain_images_ = count;
+        }
+
+        /**
+         * when to latch input in a frame, see InputPollType
+         */
+        inline unsigned GetInputPollType() {
+            return input_poll_type_;
+        }
+
+        inline void SetInputPollType(unsigned type) {
+            input_poll_type_ = type;
+        }
+
+        /**
+         * audio resampler quality, see ResamplerQuality, used when audio is initialized
+         */
+        inline int GetAudioResamplerQuality() {
+            return audio_resampler_quality_;
+        }
+
+        inline void SetAudioResamplerQuality(int quality) {
+            audio_resampler_quality_ = quality;
+        }
+
+        /**
+         * output float audio when the device supports it, used when audio is initialized
+         */
+        inline bool UseAudioFloatOutput() {
+            return audio_float_output_;
+        }
+
+        inline void SetAudioFloatOutput(bool enable) {
+            audio_float_output_ = enable;
+        }
+
+        /**
+         * keep pitch when game speed is not 1.0, otherwise extra audio is dropped
+         */
+        inline bool UseAudioTimeStretch() {
+            return audio_time_stretch_;
+        }
+
+        inline void SetAudioTimeStretch(bool enable) {
+            audio_time_stretch_ = enable;
+        }
+
+        /**
+         * libretro .dsp presets applied in order, a non empty list enables the float audio pipeline
+         */
+        inline std::vector<std::string> GetAudioDspFilters() {
+            std::lock_guard<std::mutex> lock(audio_dsp_filters_mutex_);
+            return audio_dsp_filters_;
+        }
+
+        inline void AddAudioDspFilter(const std::string &preset) {
+            std::lock_guard<std::mutex> lock(audio_dsp_filters_mutex_);
+            audio_dsp_filters_.push_back(preset);
+        }
+
+        inline void ClearAudioDspFilters() {
+            std::lock_guard<std::mutex> lock(audio_dsp_filters_mutex_);
+            audio_dsp_filters_.clear();
+        }
+
+        /**
+         * output file of 'file' audio driver, .wav for wav, others for raw s16le stereo
+         */
+        inline std::string &GetAudioDumpPath() {
+            return audio_dump_path_;
+        }
+
+        inline void SetAudioDumpPath(const std::string &path) {
+            audio_dump_path_ = path;
+        }
+
+        /**
+         * frames consumed by each callback of 'null' audio driver
+         */
+        inline unsigned GetNullAudioBurstFrames() {
+            return null_audio_burst_frames_;
+        }
+
+        inline void SetNullAudioBurstFrames(unsigned frames) {
+            null_audio_burst_frames_ = frames;
+        }
+
+        /**
+         * max random offset(us) of each callback of 'null' audio driver
+         */
+        inline unsigned GetNullAudioJitter() {
+            return null_audio_jitter_us_;
+        }
+
+        inline void SetNullAudioJitter(unsigned us) {
+            null_audio_jitter_us_ = us;
+        }
+
     private:
         std::string video_driver_;
         std::string input_driver_;
         std::string audio_driver_;
 
-        bool low_latency_ = true;
-        int max_player_count_ = 4;
-        bool video_linear = false;
+        std::atomic<bool> low_latency_ = true;
+        std::atomic<int> max_player_count_ = 4;
+        std::atomic<bool> video_linear = false;
+        std::atomic<bool> video_frame_dedupe_ = false;
+        std::atomic<unsigned> video_frames_in_flight_ = 1;
+        std::atomic<int> video_swap_interval_ = 1;
+        std::atomic<unsigned> video_present_mode_ = 0;
+        std::atomic<unsigned> video_swapchain_images_ = 0;
+        std::string video_shader_preset_;
+        std::atomic<unsigned> input_poll_type_ = 2;
+        std::atomic<int> audio_resampler_quality_ = 2;
+        std::atomic<bool> audio_float_output_ = false;
+        std::atomic<bool> audio_time_stretch_ = true;
+        std::mutex audio_dsp_filters_mutex_;
+        std::vector<std::string> audio_dsp_filters_;
+        std::string audio_dump_path_;
+        std::atomic<unsigned> null_audio_burst_frames_ = 256;
+        std::atomic<unsigned> null_audio_jitter_us_ = 0;
     };
 
 }
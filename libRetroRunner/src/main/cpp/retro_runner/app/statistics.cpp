@@ -0,0 +1,116 @@
+//
+// Created by Aidoo.TK on 2024/12/2.
+//
+
+#include "statistics.h"
+#include <sstream>
+#include <algorithm>
+
+namespace libRetroRunner {
+
+    LatencyHistogram::LatencyHistogram() {
+        Reset();
+    }
+
+    void LatencyHistogram::Record(int64_t micros) {
+        if (micros < 0) micros = 0;
+        int bucket = 0;
+        while (bucket < kBucketCount - 1 && (micros >> (bucket + 1)) != 0) {
+            bucket++;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(micros, std::memory_order_relaxed);
+
+        int64_t currentMax = max_.load(std::memory_order_relaxed);
+        while (micros > currentMax && !max_.compare_exchange_weak(currentMax, micros, std::memory_order_relaxed)) {
+        }
+    }
+
+    void LatencyHistogram::Reset() {
+        for (auto &bucket: buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    double LatencyHistogram::GetMean() const {
+        uint64_t count = GetCount();
+        if (count == 0) return 0;
+        return (double) sum_.load(std::memory_order_relaxed) / (double) count;
+    }
+
+    int64_t LatencyHistogram::GetPercentile(double percent) const {
+        uint64_t count = GetCount();
+        if (count == 0) return 0;
+        auto target = (uint64_t) ((double) count * percent / 100.0);
+        uint64_t accumulated = 0;
+        for (int idx = 0; idx < kBucketCount; idx++) {
+            accumulated += buckets_[idx].load(std::memory_order_relaxed);
+            if (accumulated > target) {
+                int64_t upper = (int64_t(1) << (idx + 1)) - 1;
+                return std::min(upper, GetMax());
+            }
+        }
+        return GetMax();
+    }
+}
+
+namespace libRetroRunner {
+    static Statistics statistics;
+
+    Statistics *Statistics::Current() {
+        return &statistics;
+    }
+
+    std::atomic<int64_t> &Statistics::GetCounter(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return counters_.try_emplace(name, 0).first->second;
+    }
+
+    LatencyHistogram &Statistics::GetHistogram(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return histograms_.try_emplace(name).first->second;
+    }
+
+    void Statistics::Reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &counter: counters_) {
+            counter.second.store(0, std::memory_order_relaxed);
+        }
+        for (auto &histogram: histograms_) {
+            histogram.second.Reset();
+        }
+    }
+
+    std::string Statistics::ToJson() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostringstream out;
+        out << "{\"counters\":{";
+        bool first = true;
+        for (auto &counter: counters_) {
+            if (!first) out << ",";
+            first = false;
+            out << "\"" << counter.first << "\":" << counter.second.load(std::memory_order_relaxed);
+        }
+        out << "},\"histograms\":{";
+        first = true;
+        for (auto &item: histograms_) {
+            const LatencyHistogram &histogram = item.second;
+            if (!first) out << ",";
+            first = false;
+            out << "\"" << item.first << "\":{"
+                << "\"count\":" << histogram.GetCount()
+                << ",\"mean_us\":" << histogram.GetMean()
+                << ",\"p50_us\":" << histogram.GetPercentile(50)
+                << ",\"p90_us\":" << histogram.GetPercentile(90)
+                << ",\"p99_us\":" << histogram.GetPercentile(99)
+                << ",\"max_us\":" << histogram.GetMax()
+                << "}";
+        }
+        out << "}}";
+        return out.str();
+    }
+}
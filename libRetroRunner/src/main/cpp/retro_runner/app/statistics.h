@@ -0,0 +1,76 @@
+//
+// Created by Aidoo.TK on 2024/12/2.
+//
+
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace libRetroRunner {
+
+    /**
+     * Latency distribution in microseconds, bucket n holds values in [2^n, 2^(n+1)).
+     * Record() is lock free and can be called from any thread.
+     */
+    class LatencyHistogram {
+    public:
+        static constexpr int kBucketCount = 32;
+
+        LatencyHistogram();
+
+        void Record(int64_t micros);
+
+        void Reset();
+
+        inline uint64_t GetCount() const { return count_.load(std::memory_order_relaxed); }
+
+        inline int64_t GetMax() const { return max_.load(std::memory_order_relaxed); }
+
+        double GetMean() const;
+
+        /* approximate percentile (upper bound of the bucket), percent: [0, 100] */
+        int64_t GetPercentile(double percent) const;
+
+    private:
+        std::atomic<uint64_t> buckets_[kBucketCount];
+        std::atomic<uint64_t> count_;
+        std::atomic<int64_t> sum_;
+        std::atomic<int64_t> max_;
+    };
+
+    /**
+     * Global runtime statistics, counters and histograms are created by name.
+     * The returned references are valid for the whole process, get them once at init time and keep them,
+     * do not look them up in hot paths.
+     */
+    class Statistics {
+    public:
+        static Statistics *Current();
+
+        static inline int64_t NowMicros() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        std::atomic<int64_t> &GetCounter(const std::string &name);
+
+        LatencyHistogram &GetHistogram(const std::string &name);
+
+        /* reset all values, registered names are kept */
+        void Reset();
+
+        /* dump all values as json */
+        std::string ToJson();
+
+    private:
+        std::mutex mutex_;
+        std::map<std::string, std::atomic<int64_t>> counters_;
+        std::map<std::string, LatencyHistogram> histograms_;
+    };
+}
+
+#endif
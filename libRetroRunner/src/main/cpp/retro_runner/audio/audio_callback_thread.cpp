@@ -0,0 +1,93 @@
+//
+// Created by Aidoo.TK on 2024/12/8.
+//
+
+#include "audio_callback_thread.h"
+#include <chrono>
+#include "audio_context.h"
+#include "../types/log.h"
+#include "../app/statistics.h"
+
+#define LOGD_ACB(...) LOGD("[AudioCallback] " __VA_ARGS__)
+
+namespace libRetroRunner {
+    AudioCallbackThread::AudioCallbackThread(const struct retro_audio_callback &callback, std::shared_ptr<AudioContext> audio) :
+            callback_(callback), audio_(std::move(audio)) {
+        calls_ = &Statistics::Current()->GetCounter("audio.callback_calls");
+        underruns_ = &Statistics::Current()->GetCounter("audio.callback_underruns");
+        call_time_ = &Statistics::Current()->GetHistogram("audio.callback_time");
+    }
+
+    AudioCallbackThread::~AudioCallbackThread() {
+        Stop();
+    }
+
+    void AudioCallbackThread::Start() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            if (running_) return;
+            running_ = true;
+        }
+        thread_ = std::thread(&AudioCallbackThread::producerLoop, this);
+        LOGD_ACB("producer thread started.");
+    }
+
+    void AudioCallbackThread::Stop() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            running_ = false;
+        }
+        state_cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+            LOGD_ACB("producer thread stopped.");
+        }
+    }
+
+    void AudioCallbackThread::SetEnabled(bool enabled) {
+        //set_state 也是对核心的调用, 不能和 retro_run 或者回调同时执行
+        auto coreLock = LockCore();
+        if (enabled_.exchange(enabled) == enabled) return;
+        if (callback_.set_state) callback_.set_state(enabled);
+        coreLock.unlock();
+        state_cv_.notify_all();
+    }
+
+    void AudioCallbackThread::producerLoop() {
+        using namespace std::chrono;
+        bool filled = false;
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        while (running_) {
+            if (!enabled_ || !audio_->IsActive()) {
+                //音频暂停时不调用核心, 恢复后重新填充缓冲区
+                state_cv_.wait_for(lock, milliseconds(10));
+                filled = false;
+                continue;
+            }
+            unsigned occupancy = audio_->GetBufferOccupancy();
+            if (occupancy >= kTargetOccupancy) {
+                filled = true;
+                state_cv_.wait_for(lock, milliseconds(1));
+                continue;
+            }
+            //缓冲区填满过之后又被读空, 输出设备已经在播放空白
+            if (filled && occupancy == 0) underruns_->fetch_add(1, std::memory_order_relaxed);
+
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> coreLock(core_mutex_);
+                //等锁期间可能已经 set_state(false), 之后不能再调用回调
+                if (enabled_) {
+                    int64_t start = Statistics::NowMicros();
+                    callback_.callback();
+                    audio_->Flush();
+                    call_time_->Record(Statistics::NowMicros() - start);
+                    calls_->fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            lock.lock();
+            //核心这次没有输出音频, 避免空转
+            if (audio_->GetBufferOccupancy() <= occupancy) state_cv_.wait_for(lock, milliseconds(1));
+        }
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Created by Aidoo.TK on 2024/12/8.
+//
+
+#ifndef _AUDIO_CALLBACK_THREAD_H
+#define _AUDIO_CALLBACK_THREAD_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <libretro-common/include/libretro.h>
+
+namespace libRetroRunner {
+    class AudioContext;
+
+    class LatencyHistogram;
+
+    /*
+     * RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK
+     * 生产线程在音频缓冲区低于目标水位时调用核心的回调, 核心在回调中通过普通的音频接口输出采样
+     * 回调和 retro_run 不会同时执行, 模拟线程在 retro_run 期间持有 LockCore() 返回的锁
+     */
+    class AudioCallbackThread {
+    public:
+        /* buffer occupancy in percent the producer keeps, same as the set point of the rate control */
+        static constexpr unsigned kTargetOccupancy = 50;
+
+    public:
+        AudioCallbackThread(const struct retro_audio_callback &callback, std::shared_ptr<AudioContext> audio);
+
+        ~AudioCallbackThread();
+
+        void Start();
+
+        /* stop the thread and wait for it, the core callback is not called after it returns */
+        void Stop();
+
+        /* audio driver state, forwarded to core set_state */
+        void SetEnabled(bool enabled);
+
+        /* hold it while calling into the core from emu thread */
+        inline std::unique_lock<std::mutex> LockCore() { return std::unique_lock<std::mutex>(core_mutex_); }
+
+    private:
+        void producerLoop();
+
+    private:
+        struct retro_audio_callback callback_;
+        std::shared_ptr<AudioContext> audio_;
+
+        std::thread thread_;
+        std::mutex core_mutex_;
+        std::mutex state_mutex_;
+        std::condition_variable state_cv_;
+        bool running_ = false;          //protected by state_mutex_
+        std::atomic<bool> enabled_ = false;
+
+        std::atomic<int64_t> *calls_;
+        std::atomic<int64_t> *underruns_;
+        /* 每次调用核心回调的耗时 */
+        LatencyHistogram *call_time_;
+    };
+}
+
+#endif
@@ -5,21 +5,21 @@
 #include "audio_context.h"
 #include <retro_runner/types/log.h>
 #include "empty_audio_context.h"
+#include "file_audio_context.h"
+#include "null_audio_context.h"
 #include "oboe/oboe_audio_context.h"
 
 namespace libRetroRunner {
-    AudioContext::AudioContext() {
-
-    }
-
-    AudioContext::~AudioContext() {
-
-    }
-
     std::shared_ptr<AudioContext> AudioContext::Create(std::string &driver) {
         if (driver == "android") {
             LOGD("[AUDIO] Create audio context for driver 'android'.");
             return std::make_shared<OboeAudioContext>();
+        } else if (driver == "file") {
+            LOGD("[AUDIO] Create audio context for driver 'file'.");
+            return std::make_shared<FileAudioContext>();
+        } else if (driver == "null") {
+            LOGD("[AUDIO] Create audio context for driver 'null'.");
+            return std::make_shared<NullAudioContext>();
         }
         LOGW("[INPUT] Unsupported audio driver '%s', empty audio context will be used.", driver.c_str());
         return std::make_shared<EmptyAudioContext>();
@@ -8,15 +8,32 @@
 #include <libretro-common/include/libretro.h>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace libRetroRunner {
+
+    /* 初始化音频需要的设置与游戏参数, 由 AppContext 在模拟线程收集, 音频驱动不直接读取 Setting 和 AppContext */
+    struct AudioConfig {
+        double sampleRate = 0;                  //核心采样率
+        unsigned minimumLatency = 0;            //ms, 初始化之前核心通过 RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY 设置的值
+        bool lowLatency = true;
+        int resamplerQuality = 2;               //ResamplerQuality
+        bool floatOutput = false;
+        bool timeStretch = true;
+        std::vector<std::string> dspFilters;    //libretro .dsp presets
+        std::string dumpPath;                   //'file' driver
+        unsigned nullBurstFrames = 256;         //'null' driver
+        unsigned nullJitterUs = 0;              //'null' driver
+    };
+
     class AudioContext {
     public:
-        AudioContext();
+        //构造和析构在头文件中, null/file 驱动在主机上编译时不需要链接 audio_context.cpp(依赖 oboe)
+        AudioContext() = default;
 
-        virtual ~AudioContext();
+        virtual ~AudioContext() = default;
 
-        virtual void Init() = 0;
+        virtual void Init(const AudioConfig &config) = 0;
 
         virtual void Start() = 0;
 
@@ -28,6 +45,27 @@ namespace libRetroRunner {
 
         virtual void OnAudioSampleBatch(const int16_t *data, size_t frames) = 0;
 
+        /* called in emu thread after retro_run, write samples staged in this frame */
+        virtual void Flush() {}
+
+        /* RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY, 0 for default, called from the core's environment callback */
+        virtual void SetMinimumLatency(unsigned int ms) {}
+
+        /* resize the buffer for the latency set by SetMinimumLatency, called in emu thread before retro_run */
+        virtual void ApplyPendingLatency() {}
+
+        /* game speed, called in emu thread before retro_run */
+        virtual void SetPlaybackSpeed(double speed) {}
+
+        /* audio is playing */
+        virtual bool IsActive() { return false; }
+
+        /* buffered audio in percent [0, 100], also called by the audio callback thread while the emu thread writes */
+        virtual unsigned GetBufferOccupancy() { return 0; }
+
+        /* occupancy below it is reported to core as underrun likely */
+        static constexpr unsigned kUnderrunLikelyOccupancy = 25;
+
 
         static std::shared_ptr<AudioContext> Create(std::string &driver);
     };
@@ -0,0 +1,190 @@
+//
+// Created by Aidoo.TK on 2024/12/24.
+//
+
+#include "audio_pipeline.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "../types/log.h"
+#include "../app/statistics.h"
+
+#define LOGD_AP(...) LOGD("[AudioPipeline] " __VA_ARGS__)
+#define LOGE_AP(...) LOGE("[AudioPipeline] " __VA_ARGS__)
+
+namespace libRetroRunner {
+    AudioPipeline::AudioPipeline() {
+        fifoWrites = &Statistics::Current()->GetCounter("audio.fifo_writes");
+        fifoSamples = &Statistics::Current()->GetCounter("audio.fifo_samples");
+        fifoOverrunSamples = &Statistics::Current()->GetCounter("audio.fifo_overrun_samples");
+        resampleTime = &Statistics::Current()->GetHistogram("audio.resample_time");
+        timeStretchTime = &Statistics::Current()->GetHistogram("audio.time_stretch_time");
+    }
+
+    void AudioPipeline::Init(double coreRate, double deviceRate, double latencyMs, int quality, bool stretch) {
+        if (coreRate <= 0 || deviceRate <= 0) {
+            LOGE_AP("invalid sample rate, core: %f, device: %f", coreRate, deviceRate);
+            return;
+        }
+        coreSampleRate = coreRate;
+        latency = latencyMs;
+        latencyPending = false;
+        int audioBufferSize = bufferSizeForLatency(latency);
+
+        //核心采样率到设备采样率的转换由我们自己的重采样完成
+        double baseConversionFactor = coreRate / deviceRate;
+        resampler = Resampler::Create(quality, baseConversionFactor);
+        rateControl.Reset(baseConversionFactor);
+
+        timeStretchEnabled = stretch;
+        stretching = false;
+        if (timeStretchEnabled) timeStretch.Init(coreRate);
+        stagedSamples = 0;
+
+        auto fifo = std::make_unique<oboe::FifoBuffer>(2, audioBufferSize);
+        auto streamBuffer = std::unique_ptr<int16_t[]>(new int16_t[audioBufferSize]);
+        {
+            std::lock_guard<std::mutex> lock(fifoMutex);
+            audioFifoBuffer = std::move(fifo);
+            audioStreamBuffer = std::move(streamBuffer);
+            streamBufferFrames = audioBufferSize / 2;
+        }
+        LOGD_AP("core sample rate: %f, device sample rate: %f, latency: %f ms, resampler quality: %d", coreRate, deviceRate, latency, quality);
+    }
+
+    void AudioPipeline::Destroy() {
+        stagedSamples = 0;
+        std::lock_guard<std::mutex> lock(fifoMutex);
+        audioFifoBuffer = nullptr;
+        audioStreamBuffer = nullptr;
+        streamBufferFrames = 0;
+    }
+
+    int AudioPipeline::bufferSizeForLatency(double latencyMs) const {
+        //stereo int16 samples
+        double sampleRateDivisor = 500.0 / latencyMs;
+        return ((int) (coreSampleRate / sampleRateDivisor)) / 2 * 2;
+    }
+
+    unsigned AudioPipeline::GetBufferOccupancy() {
+        //音频回调线程也会调用, FIFO 不能在读取期间被替换
+        std::lock_guard<std::mutex> lock(fifoMutex);
+        if (!audioFifoBuffer) return 0;
+        uint32_t capacity = audioFifoBuffer->getBufferCapacityInFrames();
+        if (capacity == 0) return 0;
+        uint32_t available = audioFifoBuffer->getFullFramesAvailable() + stagedSamples.load(std::memory_order_relaxed);
+        return std::min(100u, available * 100 / capacity);
+    }
+
+    void AudioPipeline::SetLatency(double latencyMs) {
+        //在核心的环境回调中调用, 这里只记录, 下一帧 retro_run 之前再调整缓冲区
+        latency = latencyMs;
+        latencyPending = true;
+    }
+
+    void AudioPipeline::ApplyPendingLatency() {
+        if (!latencyPending) return;
+        latencyPending = false;
+        if (!audioFifoBuffer) return;
+        int audioBufferSize = bufferSizeForLatency(latency);
+        if (audioBufferSize == (int) audioFifoBuffer->getBufferCapacityInFrames()) return;
+
+        auto fifo = std::make_unique<oboe::FifoBuffer>(2, audioBufferSize);
+        auto streamBuffer = std::unique_ptr<int16_t[]>(new int16_t[audioBufferSize]);
+        {
+            //设备回调只在拿到锁时读FIFO, 替换期间输出静音, 不需要停止输出流
+            std::lock_guard<std::mutex> lock(fifoMutex);
+            //已经缓冲的音频搬到新的FIFO, 写入线程持有核心锁, 这时不会写入
+            int32_t kept = audioFifoBuffer->read(streamBuffer.get(), audioBufferSize);
+            fifo->write(streamBuffer.get(), kept);
+            audioFifoBuffer = std::move(fifo);
+            audioStreamBuffer = std::move(streamBuffer);
+            streamBufferFrames = audioBufferSize / 2;
+        }
+        LOGD_AP("latency: %f ms, audio buffer resized to %d samples", latency, audioBufferSize);
+    }
+
+    void AudioPipeline::OnAudioSample(int16_t left, int16_t right) {
+        size_t staged = stagedSamples.load(std::memory_order_relaxed);
+        stagingBuffer[staged] = left;
+        stagingBuffer[staged + 1] = right;
+        stagedSamples.store(staged + 2, std::memory_order_relaxed);
+        if (staged + 2 >= kStagingBufferSize) {
+            Flush();
+        }
+    }
+
+    void AudioPipeline::OnAudioSampleBatch(const int16_t *data, size_t frames) {
+        //保持采样顺序, 先写入暂存的采样
+        Flush();
+        if (!audioFifoBuffer) return;
+        writeFifo(data, frames * 2);
+    }
+
+    void AudioPipeline::Flush() {
+        size_t staged = stagedSamples.load(std::memory_order_relaxed);
+        if (staged == 0) return;
+        if (audioFifoBuffer) {
+            writeFifo(stagingBuffer, staged);
+        }
+        stagedSamples.store(0, std::memory_order_relaxed);
+    }
+
+    void AudioPipeline::writeFifo(const int16_t *data, size_t samples) {
+        fifoWrites->fetch_add(1, std::memory_order_relaxed);
+        fifoSamples->fetch_add(samples, std::memory_order_relaxed);
+        if (!stretching) {
+            int32_t written = audioFifoBuffer->write(data, samples);
+            if (written < (int32_t) samples) fifoOverrunSamples->fetch_add(samples - written, std::memory_order_relaxed);
+            return;
+        }
+        int64_t stretchStart = Statistics::NowMicros();
+        size_t frames = samples / 2;
+        const size_t stretchFrames = sizeof(stretchBuffer) / sizeof(int16_t) / 2;
+        while (frames > 0) {
+            size_t consumed = 0;
+            size_t produced = timeStretch.Process(data, frames, consumed, stretchBuffer, stretchFrames);
+            if (produced > 0) {
+                int32_t written = audioFifoBuffer->write(stretchBuffer, produced * 2);
+                if (written < (int32_t) produced * 2) fifoOverrunSamples->fetch_add(produced * 2 - written, std::memory_order_relaxed);
+            }
+            data += consumed * 2;
+            frames -= consumed;
+        }
+        timeStretchTime->Record(Statistics::NowMicros() - stretchStart);
+    }
+
+    void AudioPipeline::SetPlaybackSpeed(double speed) {
+        bool stretch = timeStretchEnabled && std::abs(speed - 1.0) > 0.01;
+        if (stretch != stretching) {
+            //切换前把暂存的采样按原来的方式写完
+            Flush();
+            timeStretch.Reset();
+            stretching = stretch;
+            LOGD_AP("time stretch: %d, speed: %f", stretch, speed);
+        }
+        if (stretch) timeStretch.SetSpeed(speed);
+    }
+
+    int32_t AudioPipeline::Render(int16_t *output, int32_t frames) {
+        //模拟线程正在替换FIFO时不等待, 这一次输出静音
+        std::unique_lock<std::mutex> lock(fifoMutex, std::try_to_lock);
+        if (!lock.owns_lock() || !audioFifoBuffer) {
+            memset(output, 0, (size_t) frames * 2 * sizeof(int16_t));
+            return 0;
+        }
+
+        uint32_t available = audioFifoBuffer->getFullFramesAvailable();
+        double finalConversionFactor = rateControl.NextRatio(available, audioFifoBuffer->getBufferCapacityInFrames(), frames);
+        int32_t currentFramesToSubmit = rateControl.InputFrames(frames, finalConversionFactor, streamBufferFrames);
+
+        //读出音频数据, 不够的部分补 0
+        int32_t read = audioFifoBuffer->readNow(audioStreamBuffer.get(), currentFramesToSubmit * 2);
+
+        //重采样后输出, 取整的误差由 resampler 内部的位置吸收
+        int64_t resampleStart = Statistics::NowMicros();
+        resampler->resample(audioStreamBuffer.get(), currentFramesToSubmit, output, frames, finalConversionFactor);
+        resampleTime->Record(Statistics::NowMicros() - resampleStart);
+        return currentFramesToSubmit - read / 2;
+    }
+}
@@ -0,0 +1,120 @@
+//
+// Created by Aidoo.TK on 2024/12/24.
+//
+
+#ifndef _AUDIO_PIPELINE_H
+#define _AUDIO_PIPELINE_H
+
+#include <oboe/FifoBuffer.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "rate_control.h"
+#include "resampler/resampler.h"
+#include "time_stretch.h"
+
+namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /**
+     * 核心音频到设备的公共路径, 输出驱动(oboe, null)共用:
+     * 暂存 -> time stretch -> FIFO -> 速率控制 -> 重采样
+     * OnAudioSample ... ApplyPendingLatency 由调用核心的线程(持有核心锁)调用, Render 由设备回调线程调用,
+     * GetBufferOccupancy 可以在任何线程调用. 不依赖平台, 主机测试直接使用.
+     */
+    class AudioPipeline {
+    public:
+        static constexpr size_t kStagingBufferSize = 2048;   //int16 samples, 1024 stereo frames
+
+    public:
+        AudioPipeline();
+
+        /**
+         * @param coreRate    核心采样率
+         * @param deviceRate  设备采样率
+         * @param latencyMs   FIFO 长度, ms
+         * @param quality     ResamplerQuality
+         * @param stretch     游戏速度不是 1.0 时保持音调
+         */
+        void Init(double coreRate, double deviceRate, double latencyMs, int quality, bool stretch);
+
+        void Destroy();
+
+        void OnAudioSample(int16_t left, int16_t right);
+
+        void OnAudioSampleBatch(const int16_t *data, size_t frames);
+
+        /* 把暂存的单个采样写入FIFO */
+        void Flush();
+
+        void SetPlaybackSpeed(double speed);
+
+        /* 记录新的 FIFO 长度(ms), 可以在核心的环境回调中调用, 由 ApplyPendingLatency 生效 */
+        void SetLatency(double latencyMs);
+
+        /* 替换为新长度的FIFO, 在 retro_run 之外调用 */
+        void ApplyPendingLatency();
+
+        /**
+         * 设备回调, 输出 frames 帧交错立体声. FIFO 正在被替换时输出静音.
+         * @return FIFO 中缺少的输入帧数, 缺少的部分按静音重采样, 0 表示没有欠载
+         */
+        int32_t Render(int16_t *output, int32_t frames);
+
+        /* FIFO 与暂存区中的音频, 百分比 [0, 100] */
+        unsigned GetBufferOccupancy();
+
+    private:
+        /* FIFO 容纳 latency(ms) 需要的 int16 采样数 */
+        int bufferSizeForLatency(double latencyMs) const;
+
+        /* 写入FIFO, 游戏速度不是1.0时先经过 time stretch */
+        void writeFifo(const int16_t *data, size_t samples);
+
+    private:
+        /* 调节输出速度，以防止缓冲区空白或者溢出引起杂音或者爆音 */
+        AudioRateControl rateControl;
+        std::unique_ptr<Resampler> resampler;
+
+        std::unique_ptr<oboe::FifoBuffer> audioFifoBuffer;
+        std::unique_ptr<int16_t[]> audioStreamBuffer;
+        /* audioStreamBuffer 能容纳的帧数 */
+        int32_t streamBufferFrames = 0;
+
+        /*
+         * retro_audio_sample_t 的采样先暂存, 在帧结束或者暂存区满时批量写入FIFO
+         * 只有调用核心的线程写入, 其他线程计算水位时读取 stagedSamples
+         */
+        int16_t stagingBuffer[kStagingBufferSize];
+        std::atomic<size_t> stagedSamples = 0;
+
+        /*
+         * 替换或释放 audioFifoBuffer 时持有, 其他线程通过 GetBufferOccupancy 读取 FIFO 时也持有
+         * Render 只 try_lock, 拿不到时输出静音; FIFO 的写入和替换都在持有核心锁的线程, 互相不需要这个锁
+         */
+        std::mutex fifoMutex;
+
+        double coreSampleRate = 0;
+        double latency = 0;
+        /* SetLatency 之后还没有调整缓冲区 */
+        bool latencyPending = false;
+
+        /* 快进/慢放时保持音调, 在模拟线程把核心的音频变为正常速度后再写入FIFO */
+        bool timeStretchEnabled = false;
+        bool stretching = false;
+        TimeStretch timeStretch;
+        int16_t stretchBuffer[TimeStretch::kMaxHopFrames * 4 * 2];
+
+        /* FIFO写入次数与写入的采样数, 用来对比单采样回调和批量写入的开销 */
+        std::atomic<int64_t> *fifoWrites;
+        std::atomic<int64_t> *fifoSamples;
+        /* FIFO 满时丢弃的采样 */
+        std::atomic<int64_t> *fifoOverrunSamples;
+        /* 每次回调重采样的耗时 */
+        LatencyHistogram *resampleTime;
+        LatencyHistogram *timeStretchTime;
+    };
+}
+
+#endif
@@ -0,0 +1,124 @@
+//
+// Created by Aidoo.TK on 2024/12/5.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "dsp_chain.h"
+#include "../types/log.h"
+#include "../app/statistics.h"
+
+#define LOGD_DSP(...) LOGD("[DSP] " __VA_ARGS__)
+#define LOGE_DSP(...) LOGE("[DSP] " __VA_ARGS__)
+
+namespace libRetroRunner {
+
+    AudioDspChain::~AudioDspChain() {
+        Clear();
+    }
+
+    size_t AudioDspChain::Load(const std::vector<std::string> &presets, float sampleRate, size_t maxFrames) {
+        Clear();
+        max_frames_ = std::max<size_t>(maxFrames, 1);
+        for (auto &preset: presets) {
+            retro_dsp_filter_t *filter = retro_dsp_filter_new(preset.c_str(), nullptr, sampleRate);
+            if (!filter) {
+                LOGE_DSP("failed to load dsp preset: %s", preset.c_str());
+                continue;
+            }
+            size_t latency = 0;
+            if (!measureLatency(filter, latency)) {
+                LOGE_DSP("dsp preset %s outputs nothing after %zu frames, skipped", preset.c_str(), kMaxFilterLatency);
+                retro_dsp_filter_free(filter);
+                continue;
+            }
+            //统计名称使用不带扩展名的文件名
+            std::string name = preset.substr(preset.find_last_of("/\\") + 1);
+            name = name.substr(0, name.find_last_of('.'));
+            LatencyHistogram *cost = &Statistics::Current()->GetHistogram("audio.dsp." + name);
+
+            //FIFO 先放入 latency 帧静音, 之后每次回调取走的帧数总能满足
+            size_t fifoFrames = latency + max_frames_ + kMaxChunkFrames;
+            stages_.push_back({name, filter, cost, latency, std::vector<float>(fifoFrames * 2, 0.0f), fifoFrames, 0, latency});
+            LOGD_DSP("dsp preset loaded: %s, sample rate: %f, latency: %zu frames", preset.c_str(), sampleRate, latency);
+        }
+        return stages_.size();
+    }
+
+    bool AudioDspChain::measureLatency(retro_dsp_filter_t *filter, size_t &latency) {
+        //静音不会改变滤镜的状态(分块滤镜刚好处理完一个块), 探测的输出丢弃
+        float silence[2];
+        for (size_t fed = 1; fed <= kMaxFilterLatency; fed++) {
+            silence[0] = silence[1] = 0.0f;
+            retro_dsp_data data{};
+            data.input = silence;
+            data.input_frames = 1;
+            retro_dsp_filter_process(filter, &data);
+            if (data.output_frames > 0) {
+                latency = fed - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void AudioDspChain::pushFifo(Stage &stage, const float *samples, size_t frames) {
+        //容量按 Load 时的最大帧数计算, 不会写满
+        frames = std::min(frames, stage.fifoFrames - stage.available);
+        if (frames == 0) return;
+        size_t writePos = (stage.readPos + stage.available) % stage.fifoFrames;
+        size_t first = std::min(frames, stage.fifoFrames - writePos);
+        std::memcpy(stage.fifo.data() + writePos * 2, samples, first * 2 * sizeof(float));
+        std::memcpy(stage.fifo.data(), samples + first * 2, (frames - first) * 2 * sizeof(float));
+        stage.available += frames;
+    }
+
+    void AudioDspChain::popFifo(Stage &stage, float *samples, size_t frames) {
+        size_t count = std::min(frames, stage.available);
+        size_t first = std::min(count, stage.fifoFrames - stage.readPos);
+        std::memcpy(samples, stage.fifo.data() + stage.readPos * 2, first * 2 * sizeof(float));
+        std::memcpy(samples + first * 2, stage.fifo.data(), (count - first) * 2 * sizeof(float));
+        stage.readPos = (stage.readPos + count) % stage.fifoFrames;
+        stage.available -= count;
+        //FIFO 预先放入了一个块的静音, 正常不会不够
+        if (count < frames) {
+            std::memset(samples + count * 2, 0, (frames - count) * 2 * sizeof(float));
+        }
+    }
+
+    void AudioDspChain::Process(float *samples, size_t frames) {
+        if (stages_.empty()) return;
+        if (frames > max_frames_) {
+            for (size_t offset = 0; offset < frames; offset += max_frames_) {
+                Process(samples + offset * 2, std::min(max_frames_, frames - offset));
+            }
+            return;
+        }
+        for (auto &stage: stages_) {
+            int64_t start = Statistics::NowMicros();
+            for (size_t offset = 0; offset < frames; offset += kMaxChunkFrames) {
+                retro_dsp_data data{};
+                data.input = samples + offset * 2;
+                data.input_frames = (unsigned) std::min(kMaxChunkFrames, frames - offset);
+                retro_dsp_filter_process(stage.filter, &data);
+                //有的滤镜在原地处理, 有的输出到自己的缓冲区, 分块的滤镜每次输出 0 或者整块
+                pushFifo(stage, data.output, data.output_frames);
+            }
+            popFifo(stage, samples, frames);
+            stage.cost->Record(Statistics::NowMicros() - start);
+        }
+    }
+
+    size_t AudioDspChain::GetLatency() const {
+        size_t latency = 0;
+        for (auto &stage: stages_) latency += stage.latency;
+        return latency;
+    }
+
+    void AudioDspChain::Clear() {
+        for (auto &stage: stages_) {
+            retro_dsp_filter_free(stage.filter);
+        }
+        stages_.clear();
+    }
+}
@@ -0,0 +1,80 @@
+//
+// Created by Aidoo.TK on 2024/12/5.
+//
+
+#ifndef _DSP_CHAIN_H
+#define _DSP_CHAIN_H
+
+#include <string>
+#include <vector>
+#include <audio/dsp_filter.h>
+
+namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /**
+     * A chain of libretro .dsp presets, each preset is one stage, processed in order.
+     * Stages are created in Load(), Process() runs on the audio thread and does not allocate.
+     * Block based filters (eq) only output whole blocks, each stage keeps its output in a FIFO primed with
+     * one block of silence and Process() takes exactly the requested frames from it, so the chain adds
+     * one block of delay per block based stage instead of gaps.
+     */
+    class AudioDspChain {
+    public:
+        /* frames passed to a filter in one call, eq writes its output to a fixed buffer of 4096 frames */
+        static constexpr size_t kMaxChunkFrames = 1024;
+        /* a filter that outputs nothing after this many frames is not loaded */
+        static constexpr size_t kMaxFilterLatency = 16384;
+
+    public:
+        AudioDspChain() = default;
+
+        ~AudioDspChain();
+
+        AudioDspChain(const AudioDspChain &) = delete;
+
+        AudioDspChain &operator=(const AudioDspChain &) = delete;
+
+        /**
+         * presets that fail to load are skipped, returns the number of loaded stages.
+         * @param maxFrames  max frames of one Process() call, the FIFOs are sized for it
+         */
+        size_t Load(const std::vector<std::string> &presets, float sampleRate, size_t maxFrames);
+
+        /* interleaved stereo float, processed in place, frames <= maxFrames of Load() */
+        void Process(float *samples, size_t frames);
+
+        /* total delay of the chain in frames */
+        size_t GetLatency() const;
+
+        void Clear();
+
+        inline bool IsEmpty() const { return stages_.empty(); }
+
+    private:
+        struct Stage {
+            std::string name;
+            retro_dsp_filter_t *filter;
+            LatencyHistogram *cost;     //每次回调的耗时
+            size_t latency;             //输出前需要的输入帧数减一, 逐帧处理的滤镜为 0
+
+            /* 滤镜的输出, interleaved stereo 环形缓冲区 */
+            std::vector<float> fifo;
+            size_t fifoFrames;          //容量
+            size_t readPos;
+            size_t available;
+        };
+
+        /* 逐帧送入静音直到滤镜有输出, 得到它的分块延迟 */
+        static bool measureLatency(retro_dsp_filter_t *filter, size_t &latency);
+
+        static void pushFifo(Stage &stage, const float *samples, size_t frames);
+
+        static void popFifo(Stage &stage, float *samples, size_t frames);
+
+        std::vector<Stage> stages_;
+        size_t max_frames_ = 0;
+    };
+}
+
+#endif
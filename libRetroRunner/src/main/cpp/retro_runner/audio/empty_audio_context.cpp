@@ -13,7 +13,7 @@ namespace libRetroRunner {
 
     }
 
-    void EmptyAudioContext::Init() {
+    void EmptyAudioContext::Init(const AudioConfig &config) {
 
     }
 
@@ -13,7 +13,7 @@ namespace libRetroRunner {
 
         ~EmptyAudioContext();
 
-         void Init() override;
+         void Init(const AudioConfig &config) override;
 
          void Start() override;
 
@@ -0,0 +1,143 @@
+//
+// Created by Aidoo.TK on 2024/12/6.
+//
+
+#include "file_audio_context.h"
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include "../types/log.h"
+#include "../app/statistics.h"
+
+#define LOGD_FA(...) LOGD("[FileAudio] " __VA_ARGS__)
+#define LOGW_FA(...) LOGW("[FileAudio] " __VA_ARGS__)
+#define LOGE_FA(...) LOGE("[FileAudio] " __VA_ARGS__)
+
+namespace libRetroRunner {
+
+    static bool hasWavExtension(const std::string &path) {
+        if (path.size() < 4) return false;
+        std::string ext = path.substr(path.size() - 4);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == ".wav";
+    }
+
+    static void putLE16(uint8_t *dst, uint16_t value) {
+        dst[0] = value & 0xff;
+        dst[1] = (value >> 8) & 0xff;
+    }
+
+    static void putLE32(uint8_t *dst, uint32_t value) {
+        putLE16(dst, value & 0xffff);
+        putLE16(dst + 2, value >> 16);
+    }
+
+    FileAudioContext::FileAudioContext() {
+        written_samples_ = &Statistics::Current()->GetCounter("audio.file_written_samples");
+        dropped_samples_ = &Statistics::Current()->GetCounter("audio.file_dropped_samples");
+    }
+
+    FileAudioContext::~FileAudioContext() {
+        Destroy();
+    }
+
+    void FileAudioContext::Init(const AudioConfig &config) {
+        const std::string &path = config.dumpPath;
+        if (path.empty()) {
+            LOGE_FA("audio dump path is not set, samples will be dropped.");
+            return;
+        }
+        file_ = fopen(path.c_str(), "wb");
+        if (file_ == nullptr) {
+            LOGE_FA("can't open %s for writing.", path.c_str());
+            return;
+        }
+        sample_rate_ = (uint32_t) config.sampleRate;
+        wav_ = hasWavExtension(path);
+        data_bytes_ = 0;
+        if (wav_) writeWavHeader(0);
+
+        write_chunk_ = std::unique_ptr<int16_t[]>(new int16_t[kWriteChunkSize]);
+        running_ = true;
+        writer_ = std::thread(&FileAudioContext::writerLoop, this);
+        LOGD_FA("dump audio to %s, format: %s, sample rate: %u", path.c_str(), wav_ ? "wav" : "raw", sample_rate_);
+    }
+
+    void FileAudioContext::Start() {
+
+    }
+
+    void FileAudioContext::Stop() {
+
+    }
+
+    void FileAudioContext::Destroy() {
+        if (writer_.joinable()) {
+            running_ = false;
+            writer_.join();
+        }
+        if (file_ == nullptr) return;
+        if (wav_) {
+            //wav 的长度字段只有32位
+            writeWavHeader((uint32_t) std::min<uint64_t>(data_bytes_, 0xffffffffu - 36));
+        }
+        fclose(file_);
+        file_ = nullptr;
+        LOGD_FA("audio dump closed, %llu bytes written.", (unsigned long long) data_bytes_);
+    }
+
+    void FileAudioContext::OnAudioSample(int16_t left, int16_t right) {
+        int16_t samples[2] = {left, right};
+        pushSamples(samples, 2);
+    }
+
+    void FileAudioContext::OnAudioSampleBatch(const int16_t *data, size_t frames) {
+        pushSamples(data, frames * 2);
+    }
+
+    void FileAudioContext::pushSamples(const int16_t *data, size_t count) {
+        if (!running_) return;
+        size_t written = ring_.push(data, count);
+        if (written < count) {
+            //写入线程跟不上, 丢弃放不下的采样, 每次都写入整帧所以声道不会错位
+            dropped_samples_->fetch_add(count - written, std::memory_order_relaxed);
+        }
+    }
+
+    void FileAudioContext::writerLoop() {
+        while (true) {
+            //先读取退出标志, 保证退出前队列中的采样都已写入
+            bool exiting = !running_;
+            size_t count = ring_.pop(write_chunk_.get(), kWriteChunkSize);
+            if (count > 0) {
+                size_t written = fwrite(write_chunk_.get(), sizeof(int16_t), count, file_);
+                data_bytes_ += written * sizeof(int16_t);
+                written_samples_->fetch_add(written, std::memory_order_relaxed);
+                continue;
+            }
+            if (exiting) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        fflush(file_);
+    }
+
+    void FileAudioContext::writeWavHeader(uint32_t dataSize) {
+        uint8_t header[44];
+        memcpy(header, "RIFF", 4);
+        putLE32(header + 4, 36 + dataSize);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        putLE32(header + 16, 16);                       //fmt chunk size
+        putLE16(header + 20, 1);                        //PCM
+        putLE16(header + 22, 2);                        //channels
+        putLE32(header + 24, sample_rate_);
+        putLE32(header + 28, sample_rate_ * 2 * sizeof(int16_t));
+        putLE16(header + 32, 2 * sizeof(int16_t));      //block align
+        putLE16(header + 34, 16);                       //bits per sample
+        memcpy(header + 36, "data", 4);
+        putLE32(header + 40, dataSize);
+
+        fseek(file_, 0, SEEK_SET);
+        fwrite(header, 1, sizeof(header), file_);
+        fseek(file_, 0, SEEK_END);
+    }
+}
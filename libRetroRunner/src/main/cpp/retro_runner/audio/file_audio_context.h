@@ -0,0 +1,67 @@
+//
+// Created by Aidoo.TK on 2024/12/6.
+//
+
+#ifndef _FILE_AUDIO_CONTEXT_H
+#define _FILE_AUDIO_CONTEXT_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include "audio_context.h"
+#include "../utils/spsc_ring.hpp"
+
+namespace libRetroRunner {
+
+    /*
+     * 把核心输出的音频写入文件, 路径以 .wav 结尾时写 wav, 否则写 raw(s16le stereo)
+     * 模拟线程只把采样放入无锁队列, 磁盘写入全部在后台线程完成
+     */
+    class FileAudioContext : public AudioContext {
+    public:
+        static constexpr size_t kRingSize = 1 << 20;      //int16 samples, ~10s at 48000Hz stereo
+        static constexpr size_t kWriteChunkSize = 8192;   //int16 samples per fwrite
+
+    public:
+        FileAudioContext();
+
+        ~FileAudioContext() override;
+
+        void Init(const AudioConfig &config) override;
+
+        void Start() override;
+
+        void Stop() override;
+
+        void Destroy() override;
+
+        void OnAudioSample(int16_t left, int16_t right) override;
+
+        void OnAudioSampleBatch(const int16_t *data, size_t frames) override;
+
+    private:
+        void writerLoop();
+
+        /* 写入 wav 头, dataSize 为 0 时作为占位, 结束时回填 */
+        void writeWavHeader(uint32_t dataSize);
+
+        void pushSamples(const int16_t *data, size_t count);
+
+    private:
+        FILE *file_ = nullptr;
+        bool wav_ = false;
+        uint32_t sample_rate_ = 0;
+        uint64_t data_bytes_ = 0;
+
+        spsc_ring<int16_t, kRingSize> ring_;
+        std::unique_ptr<int16_t[]> write_chunk_;
+        std::thread writer_;
+        std::atomic<bool> running_ = false;
+
+        std::atomic<int64_t> *written_samples_;
+        std::atomic<int64_t> *dropped_samples_;
+    };
+}
+
+#endif
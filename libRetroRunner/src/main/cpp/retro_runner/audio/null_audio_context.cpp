@@ -0,0 +1,139 @@
+//
+// Created by Aidoo.TK on 2024/12/6.
+//
+
+#include "null_audio_context.h"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include "../types/log.h"
+#include "../app/statistics.h"
+
+#define LOGD_NA(...) LOGD("[NullAudio] " __VA_ARGS__)
+#define LOGE_NA(...) LOGE("[NullAudio] " __VA_ARGS__)
+
+namespace libRetroRunner {
+    NullAudioContext::NullAudioContext(bool manualClock) : manual_clock_(manualClock) {
+        callbacks_ = &Statistics::Current()->GetCounter("audio.null_callbacks");
+        underruns_ = &Statistics::Current()->GetCounter("audio.null_underruns");
+        underrun_frames_ = &Statistics::Current()->GetCounter("audio.null_underrun_frames");
+        callback_interval_ = &Statistics::Current()->GetHistogram("audio.null_callback_interval");
+    }
+
+    NullAudioContext::~NullAudioContext() {
+        Destroy();
+    }
+
+    void NullAudioContext::Init(const AudioConfig &config) {
+        if (config.sampleRate <= 0) {
+            LOGE_NA("invalid sample rate: %f", config.sampleRate);
+            return;
+        }
+        burst_frames_ = std::max(1u, config.nullBurstFrames);
+        jitter_us_ = config.nullJitterUs;
+        burst_buffer_ = std::unique_ptr<int16_t[]>(new int16_t[burst_frames_ * 2]);
+        double latency = std::max(kDefaultLatency, (double) config.minimumLatency);
+        pipeline_.Init(config.sampleRate, kDeviceSampleRate, latency, config.resamplerQuality, config.timeStretch);
+
+        if (!manual_clock_) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = true;
+            }
+            device_ = std::thread(&NullAudioContext::deviceLoop, this);
+        }
+        LOGD_NA("burst: %u frames, jitter: %u us, latency: %f ms, manual clock: %d", burst_frames_, jitter_us_, latency, manual_clock_);
+    }
+
+    void NullAudioContext::Start() {
+        active_ = true;
+        cv_.notify_all();
+    }
+
+    void NullAudioContext::Stop() {
+        active_ = false;
+    }
+
+    void NullAudioContext::Destroy() {
+        active_ = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (device_.joinable()) device_.join();
+        pipeline_.Destroy();
+        burst_buffer_ = nullptr;
+    }
+
+    void NullAudioContext::OnAudioSample(int16_t left, int16_t right) {
+        pipeline_.OnAudioSample(left, right);
+    }
+
+    void NullAudioContext::OnAudioSampleBatch(const int16_t *data, size_t frames) {
+        pipeline_.OnAudioSampleBatch(data, frames);
+    }
+
+    void NullAudioContext::Flush() {
+        pipeline_.Flush();
+    }
+
+    void NullAudioContext::SetMinimumLatency(unsigned int ms) {
+        pipeline_.SetLatency(std::max(kDefaultLatency, (double) ms));
+    }
+
+    void NullAudioContext::ApplyPendingLatency() {
+        pipeline_.ApplyPendingLatency();
+    }
+
+    void NullAudioContext::SetPlaybackSpeed(double speed) {
+        pipeline_.SetPlaybackSpeed(speed);
+    }
+
+    unsigned NullAudioContext::GetBufferOccupancy() {
+        return pipeline_.GetBufferOccupancy();
+    }
+
+    int32_t NullAudioContext::RunCallback() {
+        if (!burst_buffer_) return 0;
+        int32_t missing = pipeline_.Render(burst_buffer_.get(), (int32_t) burst_frames_);
+        if (missing > 0) {
+            underruns_->fetch_add(1, std::memory_order_relaxed);
+            underrun_frames_->fetch_add(missing, std::memory_order_relaxed);
+        }
+        callbacks_->fetch_add(1, std::memory_order_relaxed);
+        return missing;
+    }
+
+    void NullAudioContext::deviceLoop() {
+        using namespace std::chrono;
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> jitter(-(int) jitter_us_, (int) jitter_us_);
+        //按累计的帧数计算回调时间, 抖动不会累积成时钟漂移
+        const double framePeriodUs = 1000000.0 / kDeviceSampleRate;
+        uint64_t framesPlayed = 0;
+        steady_clock::time_point clockStart = steady_clock::now();
+        int64_t lastCallback = 0;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            if (!active_) {
+                //设备暂停, 恢复后重新开始计时
+                cv_.wait(lock, [this] { return !running_ || active_; });
+                framesPlayed = 0;
+                clockStart = steady_clock::now();
+                lastCallback = 0;
+                continue;
+            }
+            int64_t dueUs = (int64_t) ((framesPlayed + burst_frames_) * framePeriodUs) + jitter(random);
+            auto due = clockStart + microseconds(std::max<int64_t>(dueUs, 0));
+            if (cv_.wait_until(lock, due, [this] { return !running_ || !active_; })) continue;
+
+            RunCallback();
+            int64_t now = Statistics::NowMicros();
+            if (lastCallback > 0) callback_interval_->Record(now - lastCallback);
+            lastCallback = now;
+            framesPlayed += burst_frames_;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+//
+// Created by Aidoo.TK on 2024/12/6.
+//
+
+#ifndef _NULL_AUDIO_CONTEXT_H
+#define _NULL_AUDIO_CONTEXT_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "audio_context.h"
+#include "audio_pipeline.h"
+
+namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /*
+     * 不输出声音的音频设备, 后台线程按设备采样率模拟硬件时钟, 每次回调取走 burst 帧
+     * 和 oboe 驱动走同一条 FIFO, 速率控制和重采样的路径, 只是没有真正的输出流
+     * 回调时间可以加入随机抖动, 随机数种子固定, 同样的设置每次运行的结果相同
+     * 用来在没有音频硬件的环境下验证速率控制, 欠载处理和音画同步
+     */
+    class NullAudioContext : public AudioContext {
+    public:
+        static constexpr double kDefaultLatency = 64.0;
+        /* 模拟设备的采样率, 与常见的设备原生采样率一致, 核心音频需要经过重采样 */
+        static constexpr double kDeviceSampleRate = 48000.0;
+
+    public:
+        /* manualClock: 不启动设备线程, 由调用者通过 RunCallback() 驱动设备, 用于确定性的测试 */
+        explicit NullAudioContext(bool manualClock = false);
+
+        ~NullAudioContext() override;
+
+        void Init(const AudioConfig &config) override;
+
+        void Start() override;
+
+        void Stop() override;
+
+        void Destroy() override;
+
+        void OnAudioSample(int16_t left, int16_t right) override;
+
+        void OnAudioSampleBatch(const int16_t *data, size_t frames) override;
+
+        void Flush() override;
+
+        void SetMinimumLatency(unsigned int ms) override;
+
+        void ApplyPendingLatency() override;
+
+        void SetPlaybackSpeed(double speed) override;
+
+        inline bool IsActive() override { return active_; }
+
+        unsigned GetBufferOccupancy() override;
+
+        /* 一次设备回调, 取走 burst 帧, 返回缺少的输入帧数. 设备线程调用, manualClock 时由调用者调用 */
+        int32_t RunCallback();
+
+        inline unsigned GetBurstFrames() const { return burst_frames_; }
+
+        /* 最后一次回调的输出 */
+        inline const int16_t *GetBurstBuffer() const { return burst_buffer_.get(); }
+
+    private:
+        void deviceLoop();
+
+    private:
+        AudioPipeline pipeline_;
+        std::unique_ptr<int16_t[]> burst_buffer_;
+
+        const bool manual_clock_;
+        unsigned burst_frames_ = 256;
+        unsigned jitter_us_ = 0;
+
+        std::thread device_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool running_ = false;              //protected by mutex_
+        std::atomic<bool> active_ = false;
+
+        std::atomic<int64_t> *callbacks_;
+        std::atomic<int64_t> *underruns_;
+        std::atomic<int64_t> *underrun_frames_;
+        /* 实际回调间隔 */
+        LatencyHistogram *callback_interval_;
+    };
+}
+
+#endif
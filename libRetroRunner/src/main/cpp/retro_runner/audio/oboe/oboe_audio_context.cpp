@@ -3,9 +3,8 @@
 //
 #include "oboe_audio_context.h"
 #include "../../types/log.h"
-#include "../../app/app_context.h"
-#include "../../app/environment.h"
-#include "../../app/setting.h"
+#include <audio/conversion/s16_to_float.h>
+#include <audio/conversion/float_to_s16.h>
 
 #define LOGD_OBOE(...) LOGD("[OboeAudio] " __VA_ARGS__)
 #define LOGW_OBOE(...) LOGW("[OboeAudio] " __VA_ARGS__)
@@ -15,58 +14,72 @@
 
 namespace libRetroRunner {
     OboeAudioContext::OboeAudioContext() {
-
     }
 
     OboeAudioContext::~OboeAudioContext() {
-        audioStream->requestStop();
+        if (audioStream) audioStream->requestStop();
     }
 
     void OboeAudioContext::Start() {
         audioStream->requestStart();
+        active = true;
     }
 
     void OboeAudioContext::Stop() {
+        active = false;
         audioStream->requestStop();
     }
 
+    unsigned OboeAudioContext::GetBufferOccupancy() {
+        return pipeline.GetBufferOccupancy();
+    }
+
+    void OboeAudioContext::SetMinimumLatency(unsigned int ms) {
+        pipeline.SetLatency(std::max(defaultLatency, (double) ms));
+    }
+
+    void OboeAudioContext::ApplyPendingLatency() {
+        pipeline.ApplyPendingLatency();
+    }
+
     void OboeAudioContext::OnAudioSample(int16_t left, int16_t right) {
-        audioFifoBuffer->write(&left, 1);
-        audioFifoBuffer->write(&right, 1);
+        pipeline.OnAudioSample(left, right);
     }
 
     void OboeAudioContext::OnAudioSampleBatch(const int16_t *data, size_t frames) {
-        audioFifoBuffer->write(data, frames * 2);
+        pipeline.OnAudioSampleBatch(data, frames);
     }
 
-    void OboeAudioContext::Init() {
-        auto setting = Setting::Current();
-        auto gameCtx = AppContext::Current()->GetGameRuntimeContext();
+    void OboeAudioContext::Flush() {
+        pipeline.Flush();
+    }
 
+    void OboeAudioContext::SetPlaybackSpeed(double speed) {
+        pipeline.SetPlaybackSpeed(speed);
+    }
 
-        bool preferLowLatency = setting->UseLowLatency();
-        bool useLowLatency = false;
+    void OboeAudioContext::Init(const AudioConfig &config) {
+        bool preferLowLatency = config.lowLatency;
         LOGD_OBOE("prefer low latency: %d", preferLowLatency);
         if (oboe::AudioStreamBuilder::isAAudioRecommended() && preferLowLatency) {
             bufferSizeInVideoFrame = 4;
-            useLowLatency = true;
         } else {
             bufferSizeInVideoFrame = 8;
-            useLowLatency = false;
         }
-        float sampleRate = gameCtx->GetSampleRate();
-        double maxLatency = std::max(bufferSizeInVideoFrame / 60.0 * 1000, 32.0);
-        double sampleRateDivisor = 500.0 / maxLatency;
-        int audioBufferSize = ((int) (sampleRate / sampleRateDivisor)) / 2 * 2;
+        defaultLatency = std::max(bufferSizeInVideoFrame / 60.0 * 1000, 32.0);
+        //核心可以通过 RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY 要求更大的延迟
+        double maxLatency = std::max(defaultLatency, (double) config.minimumLatency);
+
+        floatPipeline = config.floatOutput || !config.dspFilters.empty();
 
         oboe::AudioStreamBuilder streamBuilder;
-        streamBuilder.setFormat(oboe::AudioFormat::I16);
+        streamBuilder.setFormat(floatPipeline ? oboe::AudioFormat::Float : oboe::AudioFormat::I16);
         streamBuilder.setChannelCount(2);
         streamBuilder.setDirection(oboe::Direction::Output);
         streamBuilder.setDataCallback(this);
         streamBuilder.setErrorCallback(this);
 
-        streamBuilder.setSampleRate(sampleRate);
+        //不指定采样率, 使用设备原生采样率, 避免 oboe 再做一次转换
         streamBuilder.setPerformanceMode(oboe::PerformanceMode::LowLatency);
 
         oboe::Result result = streamBuilder.openManagedStream(audioStream);
@@ -76,66 +89,63 @@ namespace libRetroRunner {
             latencyTuner = nullptr;
             return;
         }
-
-        //double latency = sampleRate / (double) sampleRate;  //延迟计算
-        audioFifoBuffer = std::make_unique<oboe::FifoBuffer>(2, audioBufferSize);
-        audioStreamBuffer = std::unique_ptr<uint16_t[]>(new uint16_t[audioBufferSize]);
         latencyTuner = std::make_unique<oboe::LatencyTuner>(*audioStream);
 
+        int32_t deviceSampleRate = audioStream->getSampleRate();
+        pipeline.Init(config.sampleRate, deviceSampleRate, maxLatency, config.resamplerQuality, config.timeStretch);
+
+        if (floatPipeline) {
+            convert_s16_to_float_init_simd();
+            convert_float_to_s16_init_simd();
+            streamIsFloat = audioStream->getFormat() == oboe::AudioFormat::Float;
+            //按输出流的最大回调帧数准备好中间缓冲区
+            scratchFrames = std::max(audioStream->getBufferCapacityInFrames(), 4096);
+            dspChain.Load(config.dspFilters, (float) deviceSampleRate, scratchFrames);
+            resampleBuffer = std::unique_ptr<int16_t[]>(new int16_t[scratchFrames * 2]);
+            floatBuffer = std::unique_ptr<float[]>(new float[scratchFrames * 2]);
+            LOGD_OBOE("float pipeline, float output: %d", streamIsFloat);
+        }
+
     }
 
     oboe::DataCallbackResult OboeAudioContext::onAudioReady(oboe::AudioStream *oboeStream, void *audioData, int32_t numFrames) {
-        double dynamicBufferFactor = calculateDynamicConversionFactor(0.001 * numFrames);
-        double finalConversionFactor = baseConversionFactor * dynamicBufferFactor * playbackSpeed;
-
-        // 使用低延迟时，numFrames 非常低（~100），动态缓冲区缩放不适用于舍入。
-        // 通过跟踪“小数”帧，我们可以将错误保持在较小水平。
-        framesToSubmit += numFrames * finalConversionFactor;
-        int32_t currentFramesToSubmit = std::round(framesToSubmit);
-        framesToSubmit -= currentFramesToSubmit;
-
-        //读出音频数据
-        audioFifoBuffer->readNow(audioStreamBuffer.get(), currentFramesToSubmit * 2);
-
-        //重采样后输出
-        auto outputArray = reinterpret_cast<int16_t *>(audioData);
-        resampler.resample(reinterpret_cast<const int16_t *>(audioStreamBuffer.get()), currentFramesToSubmit, outputArray, numFrames);
+        if (floatPipeline) {
+            renderFloat(audioData, numFrames);
+        } else {
+            pipeline.Render(reinterpret_cast<int16_t *>(audioData), numFrames);
+        }
 
         latencyTuner->tune();
 
         return oboe::DataCallbackResult::Continue;
     }
 
-    void OboeAudioContext::onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) {
-        AudioStreamErrorCallback::onErrorAfterClose(oboeStream, error);
-    }
-
-    double OboeAudioContext::calculateDynamicConversionFactor(double dt) {
-        double framesCapacityInBuffer = audioFifoBuffer->getBufferCapacityInFrames();
-        double framesAvailableInBuffer = audioFifoBuffer->getFullFramesAvailable();
-
-        // 误差用与一半缓冲区利用率的标准化距离表示。范围 [-1.0, 1.0]
-        double errorMeasure = (framesCapacityInBuffer - 2.0f * framesAvailableInBuffer) / framesCapacityInBuffer;
+    void OboeAudioContext::renderFloat(void *audioData, int32_t numFrames) {
+        int32_t frames = std::min(numFrames, scratchFrames);
+        pipeline.Render(resampleBuffer.get(), frames);
 
-        errorIntegral += errorMeasure * dt;
+        //设备支持 float 时直接在输出缓冲区上处理
+        float *samples = streamIsFloat ? reinterpret_cast<float *>(audioData) : floatBuffer.get();
+        convert_s16_to_float(samples, resampleBuffer.get(), frames * 2, 1.0f);
+        dspChain.Process(samples, frames);
 
-        // 人耳在 1000-2000 Hz 的声音频率内内解析度约为 3.6 Hz
-        // 由于它会不断变化，所以我们应尽量将其保持在非常低的值。
-        double proportionalAdjustment = std::clamp(kp * errorMeasure, -maxp, maxp);
-
-        // 高低Ki的值 ，即使超过了耳朵的阈值，也会更安全
-        // 我们需要测试这个值，让它收敛的速度足够慢，以致于无法察觉或听到任何杂音
-        double integralAdjustment = std::clamp(ki * errorIntegral, -maxi, maxi);
-
-        double finalAdjustment = proportionalAdjustment + integralAdjustment;
+        if (streamIsFloat) {
+            std::fill(samples + frames * 2, samples + numFrames * 2, 0.0f);
+        } else {
+            auto outputArray = reinterpret_cast<int16_t *>(audioData);
+            convert_float_to_s16(outputArray, samples, frames * 2);
+            std::fill(outputArray + frames * 2, outputArray + numFrames * 2, 0);
+        }
+    }
 
-        return 1.0 - (finalAdjustment);
+    void OboeAudioContext::onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) {
+        AudioStreamErrorCallback::onErrorAfterClose(oboeStream, error);
     }
 
     void OboeAudioContext::Destroy() {
-        audioStream->requestStop();
-        audioFifoBuffer = nullptr;
-        audioStreamBuffer = nullptr;
+        if (audioStream) audioStream->requestStop();
+        dspChain.Clear();
+        pipeline.Destroy();
         latencyTuner = nullptr;
     }
 
@@ -6,19 +6,21 @@
 #define _OBOE_AUDIO_CONTEXT_H
 
 #include <oboe/Oboe.h>
-#include <oboe/FifoBuffer.h>
+#include <atomic>
 
 #include "../audio_context.h"
-#include "../resampler/linear_resampler.h"
+#include "../audio_pipeline.h"
+#include "../dsp_chain.h"
 
 namespace libRetroRunner {
+
     class OboeAudioContext : public AudioContext, oboe::AudioStreamDataCallback, oboe::AudioStreamErrorCallback {
     public :
         OboeAudioContext();
 
         ~OboeAudioContext() override;
 
-        void Init() override;
+        void Init(const AudioConfig &config) override;
 
         void Start() override;
 
@@ -30,36 +32,46 @@ namespace libRetroRunner {
 
         void OnAudioSampleBatch(const int16_t *data, size_t frames) override;
 
+        void Flush() override;
+
+        void SetMinimumLatency(unsigned int ms) override;
+
+        void ApplyPendingLatency() override;
+
+        void SetPlaybackSpeed(double speed) override;
+
+        inline bool IsActive() override { return active; }
+
+        unsigned GetBufferOccupancy() override;
+
     public:
         oboe::DataCallbackResult onAudioReady(oboe::AudioStream *oboeStream, void *audioData, int32_t numFrames) override;
 
         void onErrorAfterClose(oboe::AudioStream *oboeStream, oboe::Result error) override;
 
     private:
-        /*
-         * 调节输出速度，以防止缓冲区空白或者溢出引起杂音或者爆音
-         */
-        double calculateDynamicConversionFactor(double dt);
+        /* float 管线: 重采样 -> float -> dsp -> 输出, 不分配内存 */
+        void renderFloat(void *audioData, int32_t numFrames);
 
     private:
-        const double kp = 0.006;
-        const double ki = 0.00002;
-        const double maxp = 0.003;
-        const double maxi = 0.02;
-
-        double baseConversionFactor = 1.0;
-        double framesToSubmit = 0.0;
-        double errorIntegral = 0.0;
-        double playbackSpeed = 1.0;
+        /* 暂存, FIFO, 速率控制和重采样, 与 null 驱动共用 */
+        AudioPipeline pipeline;
 
         oboe::ManagedStream audioStream;
-        std::unique_ptr<oboe::FifoBuffer> audioFifoBuffer;
-        std::unique_ptr<uint16_t[]> audioStreamBuffer;
         std::unique_ptr<oboe::LatencyTuner> latencyTuner;
 
-
+        std::atomic<bool> active = false;
+        double defaultLatency = 32.0;
         int bufferSizeInVideoFrame;
-        LinearResampler resampler;
+
+        /* float pipeline, 使用 dsp 或者设置要求 float 输出时开启 */
+        bool floatPipeline = false;
+        /* 设备是否接受 float 输出, 否则转换回 int16 */
+        bool streamIsFloat = false;
+        AudioDspChain dspChain;
+        int32_t scratchFrames = 0;
+        std::unique_ptr<int16_t[]> resampleBuffer;
+        std::unique_ptr<float[]> floatBuffer;
     };
 }
 #endif
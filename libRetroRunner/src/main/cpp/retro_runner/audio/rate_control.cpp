@@ -0,0 +1,48 @@
+//
+// Created by Aidoo.TK on 2024/12/23.
+//
+
+#include "rate_control.h"
+#include <math.h>
+#include <algorithm>
+
+namespace libRetroRunner {
+
+    void AudioRateControl::Reset(double ratio) {
+        base_ratio_ = ratio;
+        error_integral_ = 0.0;
+        frames_to_submit_ = 0.0;
+    }
+
+    double AudioRateControl::NextRatio(uint32_t available, uint32_t capacity, int32_t outputFrames) {
+        if (capacity == 0) return base_ratio_;
+        //积分的时间单位是 1000 个输出帧, kI 按此整定
+        double dt = 0.001 * outputFrames;
+
+        // 误差用与一半缓冲区利用率的标准化距离表示。范围 [-1.0, 1.0]
+        double errorMeasure = ((double) capacity - 2.0 * available) / capacity;
+
+        error_integral_ += errorMeasure * dt;
+
+        // 人耳在 1000-2000 Hz 的声音频率内内解析度约为 3.6 Hz
+        // 由于它会不断变化，所以我们应尽量将其保持在非常低的值。
+        double proportionalAdjustment = std::clamp(kP * errorMeasure, -kMaxP, kMaxP);
+
+        // 高低Ki的值 ，即使超过了耳朵的阈值，也会更安全
+        // 我们需要测试这个值，让它收敛的速度足够慢，以致于无法察觉或听到任何杂音
+        double integralAdjustment = std::clamp(kI * error_integral_, -kMaxI, kMaxI);
+
+        //缓冲区低于一半时误差为正, 少读一些输入让缓冲区回升
+        return base_ratio_ * (1.0 - (proportionalAdjustment + integralAdjustment));
+    }
+
+    int32_t AudioRateControl::InputFrames(int32_t outputFrames, double ratio, int32_t maxFrames) {
+        // 使用低延迟时，numFrames 非常低（~100），动态缓冲区缩放不适用于舍入。
+        // 通过跟踪“小数”帧，我们可以将错误保持在较小水平。
+        frames_to_submit_ += outputFrames * ratio;
+        auto frames = (int32_t) lround(frames_to_submit_);
+        frames = std::clamp(frames, 0, maxFrames);
+        frames_to_submit_ -= frames;
+        return frames;
+    }
+}
@@ -0,0 +1,50 @@
+//
+// Created by Aidoo.TK on 2024/12/23.
+//
+
+#ifndef _RATE_CONTROL_H
+#define _RATE_CONTROL_H
+
+#include <stdint.h>
+
+namespace libRetroRunner {
+
+    /**
+     * Dynamic rate control of the audio output, used by the audio callback only.
+     * A PI controller on the FIFO fill scales the nominal resampling ratio by a few per mille,
+     * so the FIFO stays about half full when the core and the output device clocks drift apart.
+     * The input frames of each callback are the output frames times the ratio, rounded with the error
+     * carried to the next callback, so short callbacks do not lose the fraction.
+     */
+    class AudioRateControl {
+    public:
+        static constexpr double kP = 0.006;
+        static constexpr double kI = 0.00002;
+        /* 比例项最多调整 0.3%, 积分项最多 2%, 比例项的变化在人耳的分辨率以下 */
+        static constexpr double kMaxP = 0.003;
+        static constexpr double kMaxI = 0.02;
+
+    public:
+        /* ratio: nominal input rate / output rate, clears the controller state */
+        void Reset(double ratio);
+
+        /**
+         * ratio of a callback producing outputFrames.
+         * @param available  frames in the FIFO before the callback reads
+         * @param capacity   frames the FIFO can hold
+         */
+        double NextRatio(uint32_t available, uint32_t capacity, int32_t outputFrames);
+
+        /* input frames to read for outputFrames at ratio, at most maxFrames */
+        int32_t InputFrames(int32_t outputFrames, double ratio, int32_t maxFrames);
+
+        inline double GetBaseRatio() const { return base_ratio_; }
+
+    private:
+        double base_ratio_ = 1.0;
+        double error_integral_ = 0.0;
+        double frames_to_submit_ = 0.0;
+    };
+}
+
+#endif
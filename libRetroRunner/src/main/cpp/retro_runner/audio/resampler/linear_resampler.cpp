@@ -2,29 +2,46 @@
 // Created by Aidoo.TK on 2024/11/12.
 //
 
-#include <cmath>
 #include <algorithm>
 #include "linear_resampler.h"
 
 namespace libRetroRunner {
 
-    void LinearResampler::resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames) {
-        double outputTime = 0;
-        double outputTimeStep = 1.0 / sinkFrames;
-
-        double floatingPart, integerPart;
+    void LinearResampler::resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) {
+        //回调很短时取整后可能没有输入, 输出仍然来自历史, 不能补 0
+        inputFrames = std::max(inputFrames, 0);
+        //位置 0,1 是上一次调用的最后两帧, 位置 n+2 是这一次的第 n 帧
+        auto frameAt = [&](int32_t index) -> const int16_t * {
+            if (index < kHistoryFrames) return history + index * 2;
+            return source + (index - kHistoryFrames) * 2;
+        };
+        const int32_t lastIndex = inputFrames + kHistoryFrames - 1;
+        double pos = position;
 
         while (sinkFrames > 0) {
-            floatingPart = std::modf(outputTime * inputFrames, &integerPart);
-
-            int32_t floorFrame = integerPart;
-            int32_t ceilFrame = std::min(floorFrame + 1, inputFrames - 1);
-
-            *sink++ = source[ceilFrame * 2] * (floatingPart) + source[floorFrame * 2] * (1.0 - floatingPart);
-            *sink++ = source[ceilFrame * 2 + 1] * (floatingPart) + source[floorFrame * 2 + 1] * (1.0 - floatingPart);
-            outputTime += outputTimeStep;
+            auto index = std::min((int32_t) pos, lastIndex);
+            auto fraction = (float) (pos - index);
+            const int16_t *frame0 = frameAt(index);
+            const int16_t *frame1 = frameAt(std::min(index + 1, lastIndex));
+
+            *sink++ = (int16_t) (frame0[0] + (frame1[0] - frame0[0]) * fraction);
+            *sink++ = (int16_t) (frame0[1] + (frame1[1] - frame0[1]) * fraction);
+            pos += ratio;
             sinkFrames--;
         }
+
+        for (int32_t idx = 0; idx < kHistoryFrames; idx++) {
+            const int16_t *frame = frameAt(inputFrames + idx);
+            history[idx * 2] = frame[0];
+            history[idx * 2 + 1] = frame[1];
+        }
+        //正常情况下位置只会在 1.0 附近摆动, 输入不足或过多时拉回来
+        position = std::clamp(pos - inputFrames, 0.5, 1.5);
+    }
+
+    void LinearResampler::reset() {
+        std::fill(history, history + kHistoryFrames * 2, 0);
+        position = 1.0;
     }
 
 }
@@ -11,11 +11,21 @@ namespace libRetroRunner {
 
     class LinearResampler : public Resampler {
     public:
-        void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames) override;
+        void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) override;
+
+        void reset() override;
 
         LinearResampler() = default;
 
         virtual ~LinearResampler() = default;
+
+    private:
+        static constexpr int kHistoryFrames = 2;
+
+        /* 上一次调用的最后两帧, interleaved */
+        int16_t history[kHistoryFrames * 2] = {0};
+        /* 下一个输出的位置, 0 是 history 的第一帧 */
+        double position = 1.0;
     };
 
 }
@@ -0,0 +1,57 @@
+//
+// Created by Aidoo.TK on 2024/12/4.
+//
+
+#ifndef _POLYPHASE_RESAMPLER_H
+#define _POLYPHASE_RESAMPLER_H
+
+#include <vector>
+#include "resampler.h"
+
+namespace libRetroRunner {
+
+    /**
+     * Fixed point polyphase FIR resampler, Q15 coefficients, linear interpolation between adjacent phases.
+     * The sum of |coefficients| of a phase stays below 2 up to 32 taps, so the int32 dot product does not overflow.
+     * Output is delayed by taps/2 + 1 input frames.
+     */
+    class PolyphaseResampler : public Resampler {
+    public:
+        static constexpr int kPhaseCount = 256;
+        static constexpr int kCoefficientBits = 15;
+        static constexpr int kPhaseFractionBits = 15;
+
+        /**
+         * @param taps  filter length, multiple of 8
+         * @param ratio nominal input rate / output rate, used to lower the cutoff when downsampling
+         */
+        PolyphaseResampler(int taps, double ratio);
+
+        ~PolyphaseResampler() override = default;
+
+        void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) override;
+
+        void reset() override;
+
+    private:
+        void buildCoefficients(double ratio);
+
+        void ensureCapacity(int32_t inputFrames);
+
+    private:
+        int taps;
+        int halfTaps;
+        /* taps + 1, 多一帧用来吸收输入帧数取整的误差 */
+        int historyFrames;
+        /* (kPhaseCount + 1) * taps, 最后一个相位等于下一帧的相位0 */
+        std::vector<int16_t> coefficients;
+
+        /* 按声道分开的输入, 前 historyFrames 帧是上一次调用留下的历史 */
+        std::vector<int16_t> leftHistory;
+        std::vector<int16_t> rightHistory;
+        /* 下一个输出在 history 中的位置 */
+        double position;
+    };
+}
+
+#endif
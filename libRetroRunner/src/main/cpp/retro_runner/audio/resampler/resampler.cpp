@@ -0,0 +1,27 @@
+//
+// Created by Aidoo.TK on 2024/12/4.
+//
+
+#include "resampler.h"
+#include "linear_resampler.h"
+#include "polyphase_resampler.h"
+#include "sinc_resampler.h"
+
+namespace libRetroRunner {
+
+    std::unique_ptr<Resampler> Resampler::Create(int quality, double ratio) {
+        switch (quality) {
+            case kResamplerLinear:
+                return std::make_unique<LinearResampler>();
+            case kResamplerLow:
+                return std::make_unique<PolyphaseResampler>(8, ratio);
+            case kResamplerMedium:
+                return std::make_unique<PolyphaseResampler>(16, ratio);
+            case kResamplerHigh:
+                return std::make_unique<PolyphaseResampler>(32, ratio);
+            case kResamplerBest:
+            default:
+                return std::make_unique<SincResampler>(64, ratio);
+        }
+    }
+}
@@ -6,14 +6,40 @@
 #define _RESAMPLER_H
 
 #include <cstdint>
+#include <memory>
 
 namespace libRetroRunner {
 
+    /* 重采样质量, 数值越大越好, 消耗也越大 */
+    enum ResamplerQuality {
+        kResamplerLinear = 0,
+        kResamplerLow = 1,          //polyphase 8 taps
+        kResamplerMedium = 2,       //polyphase 16 taps
+        kResamplerHigh = 3,         //polyphase 32 taps
+        kResamplerBest = 4,         //float sinc 64 taps
+    };
+
+    /**
+     * Streaming resampler for interleaved stereo int16.
+     * Implementations keep phase and history across calls, so consecutive blocks are continuous.
+     */
     class Resampler {
     public:
-        virtual void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames) = 0;
+        /**
+         * consume all inputFrames and produce exactly sinkFrames.
+         * ratio is input frames per output frame, it may change between calls.
+         * inputFrames should be sinkFrames * ratio rounded, with the rounding error carried to the next call,
+         * the resampler follows ratio and absorbs that rounding error instead of stretching each block.
+         */
+        virtual void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) = 0;
+
+        /* drop history, call it when the stream restarts */
+        virtual void reset() {}
 
         virtual ~Resampler() = default;
+
+        /* ratio: nominal input rate / output rate */
+        static std::unique_ptr<Resampler> Create(int quality, double ratio);
     };
 }
 
@@ -0,0 +1,78 @@
+//
+// Created by Aidoo.TK on 2024/12/4.
+//
+
+#ifndef _RESAMPLER_KERNELS_H
+#define _RESAMPLER_KERNELS_H
+
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RR_RESAMPLER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RR_RESAMPLER_SSE2 1
+#endif
+
+namespace libRetroRunner {
+
+    /* sum(a[i] * b[i]), count must be a multiple of 8 */
+    static inline int32_t DotProductS16(const int16_t *a, const int16_t *b, int count) {
+#if defined(RR_RESAMPLER_NEON)
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int idx = 0; idx < count; idx += 8) {
+            int16x8_t va = vld1q_s16(a + idx);
+            int16x8_t vb = vld1q_s16(b + idx);
+            sum = vmlal_s16(sum, vget_low_s16(va), vget_low_s16(vb));
+            sum = vmlal_s16(sum, vget_high_s16(va), vget_high_s16(vb));
+        }
+        int32x2_t half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+        return vget_lane_s32(vpadd_s32(half, half), 0);
+#elif defined(RR_RESAMPLER_SSE2)
+        __m128i sum = _mm_setzero_si128();
+        for (int idx = 0; idx < count; idx += 8) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + idx));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + idx));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(va, vb));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+#else
+        int32_t sum = 0;
+        for (int idx = 0; idx < count; idx++) {
+            sum += (int32_t) a[idx] * b[idx];
+        }
+        return sum;
+#endif
+    }
+
+    /* sum(a[i] * b[i]), count must be a multiple of 4 */
+    static inline float DotProductF32(const float *a, const float *b, int count) {
+#if defined(RR_RESAMPLER_NEON)
+        float32x4_t sum = vdupq_n_f32(0);
+        for (int idx = 0; idx < count; idx += 4) {
+            sum = vmlaq_f32(sum, vld1q_f32(a + idx), vld1q_f32(b + idx));
+        }
+        float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+        return vget_lane_f32(vpadd_f32(half, half), 0);
+#elif defined(RR_RESAMPLER_SSE2)
+        __m128 sum = _mm_setzero_ps();
+        for (int idx = 0; idx < count; idx += 4) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + idx), _mm_loadu_ps(b + idx)));
+        }
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+#else
+        float sum = 0;
+        for (int idx = 0; idx < count; idx++) {
+            sum += a[idx] * b[idx];
+        }
+        return sum;
+#endif
+    }
+}
+
+#endif
@@ -2,45 +2,128 @@
 // Created by Aidoo.TK on 2024/11/12.
 //
 
+#include <cmath>
+#include <cstring>
 #include <algorithm>
 #include "sinc_resampler.h"
+#include "resampler_kernels.h"
 
 namespace libRetroRunner {
 
-    SincResampler::SincResampler(const int taps)
-            : halfTaps(taps / 2) {}
+    /**
+     * 音频回调中的 ratio 只在标称值附近由缓冲区水位控制微调(OboeAudioContext 最多约 2.3%),
+     * 截止频率按可能的最大 ratio 计算, 降采样时 ratio 变大也不会混叠
+     */
+    static constexpr double kRatioMargin = 0.025;
 
-    void SincResampler::resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames) {
-        double outputTime = 0;
-        double outputTimeStep = 1.0f / sinkFrames;
-
-        while (sinkFrames > 0) {
-            int32_t prevInputIndex = outputTime * inputFrames;
+    SincResampler::SincResampler(int taps, double ratio) {
+        this->taps = std::max(4, (taps + 3) / 4 * 4);
+        halfTaps = this->taps / 2;
+        historyFrames = this->taps + 1;
+        coefficients.resize((kPhaseCount + 1) * this->taps);
+        coefficientDeltas.resize(kPhaseCount * this->taps);
+        buildCoefficients(ratio * (1.0 + kRatioMargin));
+        //预留足够大的空间, 避免在音频回调中分配内存
+        ensureCapacity(4096);
+        reset();
+    }
 
-            int32_t leftResult = 0;
-            int32_t rightResult = 0;
-            float gain = 0.1;
+    double SincResampler::besselI0(double x) {
+        double sum = 1.0;
+        double term = 1.0;
+        double halfX = x / 2.0;
+        for (int k = 1; k < 50; k++) {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+            if (term < sum * 1e-12) break;
+        }
+        return sum;
+    }
 
-            auto startFrame = std::max(prevInputIndex - halfTaps + 1, 0);
-            auto endFrame = std::min(prevInputIndex + halfTaps, inputFrames - 1);
+    void SincResampler::buildCoefficients(double ratio) {
+        //过渡带随 taps 变窄, 降采样时截止频率按 ratio 降低到输出的奈奎斯特频率以下
+        double rolloff = std::clamp(1.0 - 4.0 / taps, 0.5, 0.95);
+        double cutoff = 0.5 * rolloff;
+        if (ratio > 1.0) cutoff /= ratio;
 
-            for (int32_t currentInputIndex = startFrame; currentInputIndex <= endFrame; currentInputIndex++) {
-                float sincCoefficient = sinc(outputTime * inputFrames - currentInputIndex);
-                gain += sincCoefficient;
-                leftResult += source[currentInputIndex * 2] * sincCoefficient;
-                rightResult += source[currentInputIndex * 2 + 1] * sincCoefficient;
+        double windowScale = 1.0 / besselI0(kKaiserBeta);
+        for (int phase = 0; phase <= kPhaseCount; phase++) {
+            double fraction = (double) phase / kPhaseCount;
+            float *row = &coefficients[phase * taps];
+            double sum = 0;
+            for (int tap = 0; tap < taps; tap++) {
+                double distance = tap - (halfTaps - 1) - fraction;
+                double x = 2.0 * cutoff * distance;
+                double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+                double t = distance / halfTaps;
+                double window = std::abs(t) >= 1.0 ? 0.0 : besselI0(kKaiserBeta * std::sqrt(1.0 - t * t)) * windowScale;
+                row[tap] = (float) (sinc * window);
+                sum += row[tap];
+            }
+            for (int tap = 0; tap < taps; tap++) {
+                row[tap] = (float) (row[tap] / sum);
             }
+        }
+        for (int phase = 0; phase < kPhaseCount; phase++) {
+            for (int tap = 0; tap < taps; tap++) {
+                coefficientDeltas[phase * taps + tap] = coefficients[(phase + 1) * taps + tap] - coefficients[phase * taps + tap];
+            }
+        }
+    }
 
-            outputTime += outputTimeStep;
-            *sink++ = leftResult / gain;
-            *sink++ = rightResult / gain;
-            sinkFrames--;
+    void SincResampler::ensureCapacity(int32_t inputFrames) {
+        size_t required = historyFrames + inputFrames;
+        if (leftHistory.size() < required) {
+            leftHistory.resize(required, 0);
+            rightHistory.resize(required, 0);
         }
     }
 
-    float SincResampler::sinc(float x) {
-        if (abs(x) < 1.0e-9) return 1.0;
-        return sinf(x * PI_F) / (x * PI_F);
+    void SincResampler::reset() {
+        std::fill(leftHistory.begin(), leftHistory.end(), 0.0f);
+        std::fill(rightHistory.begin(), rightHistory.end(), 0.0f);
+        position = historyFrames - halfTaps - 1;
+    }
+
+    void SincResampler::resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) {
+        //回调很短时取整后可能没有输入, 输出仍然来自历史, 不能补 0
+        inputFrames = std::max(inputFrames, 0);
+        ensureCapacity(inputFrames);
+
+        float *left = leftHistory.data();
+        float *right = rightHistory.data();
+        for (int32_t idx = 0; idx < inputFrames; idx++) {
+            left[historyFrames + idx] = source[idx * 2];
+            right[historyFrames + idx] = source[idx * 2 + 1];
+        }
+
+        double pos = position;
+        const int32_t minIndex = halfTaps - 1;
+        const int32_t maxIndex = historyFrames + inputFrames - halfTaps - 1;
+
+        while (sinkFrames > 0) {
+            auto index = (int32_t) pos;
+            double phasePosition = (pos - index) * kPhaseCount;
+            auto phase = std::min((int32_t) phasePosition, kPhaseCount - 1);
+            auto phaseFraction = (float) (phasePosition - phase);
+            index = std::clamp(index, minIndex, maxIndex);
+
+            const float *row = &coefficients[phase * taps];
+            const float *delta = &coefficientDeltas[phase * taps];
+            int32_t start = index - halfTaps + 1;
+            float leftValue = DotProductF32(row, left + start, taps) + phaseFraction * DotProductF32(delta, left + start, taps);
+            float rightValue = DotProductF32(row, right + start, taps) + phaseFraction * DotProductF32(delta, right + start, taps);
+
+            *sink++ = (int16_t) std::clamp(std::lround(leftValue), -32768L, 32767L);
+            *sink++ = (int16_t) std::clamp(std::lround(rightValue), -32768L, 32767L);
+            pos += ratio;
+            sinkFrames--;
+        }
+
+        std::memmove(left, left + inputFrames, historyFrames * sizeof(float));
+        std::memmove(right, right + inputFrames, historyFrames * sizeof(float));
+        double center = historyFrames - halfTaps - 1;
+        position = std::clamp(pos - inputFrames, center - 0.5, center + 0.5);
     }
 
 }
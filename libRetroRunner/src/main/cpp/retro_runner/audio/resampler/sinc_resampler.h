@@ -6,23 +6,54 @@
 #ifndef _SINC_RESAMPLER_H
 #define _SINC_RESAMPLER_H
 
+#include <vector>
 #include "resampler.h"
 
 namespace libRetroRunner {
 
-class SincResampler : public Resampler {
-public:
-    void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames) override;
-    SincResampler(const int taps);
-    ~SincResampler() = default;
+    /**
+     * Float windowed-sinc resampler, Kaiser window, coefficients are interpolated between adjacent phases.
+     * The table is built once in the constructor for the nominal ratio, resample() never allocates or rebuilds it.
+     * Output is delayed by taps/2 + 1 input frames.
+     */
+    class SincResampler : public Resampler {
+    public:
+        static constexpr int kPhaseCount = 128;
 
-private:
-    static float sinc(float x);
+        /**
+         * @param taps  filter length, multiple of 4
+         * @param ratio nominal input rate / output rate
+         */
+        SincResampler(int taps, double ratio);
 
-private:
-    static constexpr float PI_F = 3.14159265358979f;
-    int halfTaps;
-};
+        ~SincResampler() override = default;
+
+        void resample(const int16_t *source, int32_t inputFrames, int16_t *sink, int32_t sinkFrames, double ratio) override;
+
+        void reset() override;
+
+    private:
+        /* 按 ratio 计算截止频率, 只在构造时调用, 不能在音频回调中调用 */
+        void buildCoefficients(double ratio);
+
+        void ensureCapacity(int32_t inputFrames);
+
+        static double besselI0(double x);
+
+    private:
+        static constexpr double kKaiserBeta = 8.0;   //约 80dB 阻带衰减
+
+        int taps;
+        int halfTaps;
+        int historyFrames;
+
+        /* (kPhaseCount + 1) * taps, 以及相邻相位的差值, 用来做相位间线性插值 */
+        std::vector<float> coefficients;
+        std::vector<float> coefficientDeltas;
+        std::vector<float> leftHistory;
+        std::vector<float> rightHistory;
+        double position;
+    };
 
 }
 
@@ -0,0 +1,151 @@
+//
+// Created by Aidoo.TK on 2024/12/7.
+//
+
+#include "time_stretch.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "resampler/resampler_kernels.h"
+
+namespace libRetroRunner {
+
+    void TimeStretch::Init(double sampleRate) {
+        //hop 10ms, 相关计算要求长度是4的倍数
+        hop_frames_ = std::clamp((int) (sampleRate * 0.010) / 4 * 4, 64, (int) kMaxHopFrames);
+        window_frames_ = hop_frames_ * 2;
+        search_frames_ = std::max(8, (int) (sampleRate * 0.005));
+
+        //periodic hann, 50% 重叠时相加为1
+        window_.resize(window_frames_);
+        for (int idx = 0; idx < window_frames_; idx++) {
+            window_[idx] = 0.5f - 0.5f * cosf(2.0f * (float) M_PI * idx / window_frames_);
+        }
+
+        //最快速度时下一段的位置在一个 hop 的 kMaxSpeed 倍之后, 再留出一次写入的空间
+        capacity_frames_ = window_frames_ + search_frames_ * 2 + (size_t) ceil(hop_frames_ * kMaxSpeed) + 4096;
+        input_.assign(capacity_frames_ * 2, 0.0f);
+        mono_.assign(capacity_frames_, 0.0f);
+        overlap_.assign(hop_frames_ * 2, 0.0f);
+        target_.assign(hop_frames_, 0.0f);
+        speed_ = 1.0;
+        Reset();
+    }
+
+    void TimeStretch::SetSpeed(double speed) {
+        speed_ = std::clamp(speed, kMinSpeed, kMaxSpeed);
+    }
+
+    void TimeStretch::Reset() {
+        buffered_frames_ = 0;
+        nominal_ = 0;
+        first_segment_ = true;
+        std::fill(overlap_.begin(), overlap_.end(), 0.0f);
+    }
+
+    size_t TimeStretch::Process(const int16_t *input, size_t inputFrames, size_t &consumed, int16_t *output, size_t outputFrames) {
+        consumed = 0;
+        size_t produced = 0;
+        if (!IsInitialized()) return 0;
+
+        while (true) {
+            while (produced + hop_frames_ <= outputFrames && runHop(output + produced * 2)) {
+                produced += hop_frames_;
+            }
+            if (consumed == inputFrames || produced + hop_frames_ > outputFrames) break;
+
+            compact();
+            size_t count = std::min(capacity_frames_ - buffered_frames_, inputFrames - consumed);
+            if (count == 0) break;
+            const int16_t *src = input + consumed * 2;
+            float *dst = input_.data() + buffered_frames_ * 2;
+            float *mono = mono_.data() + buffered_frames_;
+            for (size_t idx = 0; idx < count; idx++) {
+                float left = src[idx * 2] * (1.0f / 32768.0f);
+                float right = src[idx * 2 + 1] * (1.0f / 32768.0f);
+                dst[idx * 2] = left;
+                dst[idx * 2 + 1] = right;
+                mono[idx] = (left + right) * 0.5f;
+            }
+            buffered_frames_ += count;
+            consumed += count;
+        }
+        return produced;
+    }
+
+    void TimeStretch::compact() {
+        double first = nominal_ - search_frames_;
+        if (first < 1.0) return;
+        size_t discard = std::min((size_t) first, buffered_frames_);
+        size_t remain = buffered_frames_ - discard;
+        memmove(input_.data(), input_.data() + discard * 2, remain * 2 * sizeof(float));
+        memmove(mono_.data(), mono_.data() + discard, remain * sizeof(float));
+        buffered_frames_ = remain;
+        nominal_ -= discard;
+    }
+
+    bool TimeStretch::runHop(int16_t *output) {
+        size_t nominal = (size_t) nominal_;
+        size_t start = nominal;
+        if (first_segment_) {
+            if (buffered_frames_ < nominal + window_frames_) return false;
+        } else {
+            if (buffered_frames_ < nominal + search_frames_ + window_frames_) return false;
+            start = nominal + findBestOffset(nominal);
+        }
+
+        const float *segment = input_.data() + start * 2;
+        const float *window = window_.data();
+        float *overlap = overlap_.data();
+        for (int idx = 0; idx < hop_frames_; idx++) {
+            float left = overlap[idx * 2] + segment[idx * 2] * window[idx];
+            float right = overlap[idx * 2 + 1] + segment[idx * 2 + 1] * window[idx];
+            output[idx * 2] = (int16_t) std::clamp(lrintf(left * 32768.0f), -32768L, 32767L);
+            output[idx * 2 + 1] = (int16_t) std::clamp(lrintf(right * 32768.0f), -32768L, 32767L);
+        }
+        const float *tail = segment + hop_frames_ * 2;
+        for (int idx = 0; idx < hop_frames_; idx++) {
+            overlap[idx * 2] = tail[idx * 2] * window[hop_frames_ + idx];
+            overlap[idx * 2 + 1] = tail[idx * 2 + 1] * window[hop_frames_ + idx];
+        }
+        //下一段要和这一段自然延续的部分衔接
+        memcpy(target_.data(), mono_.data() + start + hop_frames_, hop_frames_ * sizeof(float));
+
+        first_segment_ = false;
+        nominal_ += hop_frames_ * speed_;
+        return true;
+    }
+
+    int TimeStretch::findBestOffset(size_t nominal) {
+        const float *target = target_.data();
+        int lowest = -std::min(search_frames_, (int) nominal);
+        int best = 0;
+        float bestScore = -1e30f;
+
+        auto score = [&](int offset) {
+            const float *candidate = mono_.data() + nominal + offset;
+            float correlation = DotProductF32(target, candidate, hop_frames_);
+            float energy = DotProductF32(candidate, candidate, hop_frames_);
+            return correlation / sqrtf(energy + 1e-9f);
+        };
+
+        //先以4帧为步长粗搜, 再在最佳位置附近逐帧细搜
+        for (int offset = lowest; offset <= search_frames_; offset += 4) {
+            float value = score(offset);
+            if (value > bestScore) {
+                bestScore = value;
+                best = offset;
+            }
+        }
+        int coarse = best;
+        for (int offset = std::max(lowest, coarse - 3); offset <= std::min(search_frames_, coarse + 3); offset++) {
+            if (offset == coarse) continue;
+            float value = score(offset);
+            if (value > bestScore) {
+                bestScore = value;
+                best = offset;
+            }
+        }
+        return best;
+    }
+}
@@ -0,0 +1,82 @@
+//
+// Created by Aidoo.TK on 2024/12/7.
+//
+
+#ifndef _TIME_STRETCH_H
+#define _TIME_STRETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace libRetroRunner {
+
+    /**
+     * WSOLA time-stretch for interleaved stereo int16, keeps pitch while changing speed.
+     * Output segments of 20ms are overlap-added with a Hann window every 10ms, each segment
+     * is searched in +-5ms around its nominal position for the best match of the previous one.
+     * Added latency is about one window plus the search range. Process() does not allocate.
+     */
+    class TimeStretch {
+    public:
+        static constexpr double kMinSpeed = 0.25;
+        static constexpr double kMaxSpeed = 8.0;
+        /* Process() needs room for at least this many output frames to make progress */
+        static constexpr size_t kMaxHopFrames = 1024;
+
+    public:
+        TimeStretch() = default;
+
+        TimeStretch(const TimeStretch &) = delete;
+
+        TimeStretch &operator=(const TimeStretch &) = delete;
+
+        /* allocate buffers for the sample rate, speed is reset to 1.0 */
+        void Init(double sampleRate);
+
+        /* speed > 1 consumes input faster than it outputs, clamped to [kMinSpeed, kMaxSpeed] */
+        void SetSpeed(double speed);
+
+        /* drop buffered audio, the next output starts from new input */
+        void Reset();
+
+        /**
+         * consume input and write stretched output.
+         * @param consumed      frames of input consumed, the rest should be passed again
+         * @param outputFrames  capacity of output, should be >= kMaxHopFrames
+         * @return frames written to output
+         */
+        size_t Process(const int16_t *input, size_t inputFrames, size_t &consumed, int16_t *output, size_t outputFrames);
+
+        inline bool IsInitialized() const { return hop_frames_ > 0; }
+
+    private:
+        /* output one hop if there is enough input */
+        bool runHop(int16_t *output);
+
+        /* offset to the nominal position with the best normalized correlation to target_ */
+        int findBestOffset(size_t nominal);
+
+        /* drop input before the search range of the next segment */
+        void compact();
+
+    private:
+        int hop_frames_ = 0;        //synthesis hop, half of the window
+        int window_frames_ = 0;
+        int search_frames_ = 0;
+        double speed_ = 1.0;
+        size_t capacity_frames_ = 0;
+
+        std::vector<float> window_;
+        std::vector<float> input_;      //stereo
+        std::vector<float> mono_;       //(l + r) / 2 of input_, for correlation
+        std::vector<float> overlap_;    //stereo, windowed second half of the previous segment
+        std::vector<float> target_;     //mono, natural continuation of the previous segment
+
+        size_t buffered_frames_ = 0;
+        double nominal_ = 0;            //analysis position of the next segment in input_
+        bool first_segment_ = true;
+    };
+}
+
+#endif
@@ -6,10 +6,21 @@
 #define _INPUT_CONTEXT_H
 
 #include <stdint.h>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <libretro-common/include/libretro.h>
 
 namespace libRetroRunner {
+
+    /* 输入锁存的时机, 数值与 RETRO_ENVIRONMENT_POLL_TYPE_OVERRIDE 相同 */
+    enum InputPollType {
+        kInputPollDontCare = 0,
+        kInputPollEarly = 1,        //retro_run 之前
+        kInputPollNormal = 2,       //核心调用 input_poll 时
+        kInputPollLate = 3,         //这一帧中核心第一次调用 input_state 时
+    };
+
     class InputContext {
     public:
         InputContext();
@@ -28,7 +39,45 @@ namespace libRetroRunner {
 
         virtual void Destroy() = 0;
 
+        /* keyboard event, keycode: android key code, character: utf32, metaState: android meta state */
+        virtual void UpdateKey(unsigned int keycode, unsigned int character, unsigned int metaState, bool pressed) {}
+
+        /* relative mouse motion in pixels */
+        virtual void UpdateMouseMotion(int dx, int dy) {}
+
+        /* button: RETRO_DEVICE_ID_MOUSE_*, wheel ids are handled as one shot events */
+        virtual void UpdateMouseButton(unsigned int button, bool pressed) {}
+
+        /* touch pointer, pointerId: android pointer id, x/y: [-1, 1] in game screen */
+        virtual void UpdatePointer(unsigned int pointerId, float x, float y, bool pressed) {}
+
+        /* core keyboard callback, called in emu thread */
+        inline void SetKeyboardCallback(retro_keyboard_event_t callback) { keyboard_callback_ = callback; }
+
+        /* called in emu thread before retro_run */
+        virtual void BeginFrame() {}
+
+        /* called in emu thread after retro_run returns, before the frame is uploaded and presented */
+        virtual void EndFrame() {}
+
+        /* poll type selected by frontend */
+        inline void SetPollType(unsigned type) { poll_type_ = type; }
+
+        /* poll type required by core, 0 means don't care */
+        inline void SetPollTypeOverride(unsigned type) { poll_type_override_ = type; }
+
+        inline unsigned GetPollType() const {
+            unsigned type = poll_type_override_;
+            if (type == kInputPollDontCare) type = poll_type_;
+            return type == kInputPollDontCare ? kInputPollNormal : type;
+        }
+
         static std::shared_ptr<InputContext> Create(std::string &driver);
+
+    protected:
+        std::atomic<unsigned> poll_type_ = kInputPollNormal;
+        std::atomic<unsigned> poll_type_override_ = kInputPollDontCare;
+        std::atomic<retro_keyboard_event_t> keyboard_callback_ = nullptr;
     };
 }
 #endif
@@ -8,6 +8,7 @@
 
 #include <retro_runner/app/environment.h>
 #include <retro_runner/app/app_context.h>
+#include <retro_runner/app/statistics.h>
 
 #define LOGD_SInput(...) LOGD("[INPUT] "  __VA_ARGS__)
 
@@ -15,7 +16,27 @@ namespace libRetroRunner {
 
     SoftwareInput::SoftwareInput() {
         max_user_ = 0;
-        std::memset(keyboard_state, false, 256);
+        std::memset(keyboard_state_, false, sizeof(keyboard_state_));
+        pending_key_count_ = 0;
+        std::memset(pointers_, 0, sizeof(pointers_));
+        std::memset(button_map_, kUnmappedButton, sizeof(button_map_));
+        for (unsigned port = 0; port < kMaxPorts; port++) {
+            published_buttons_[port].store(0, std::memory_order_relaxed);
+            for (unsigned axis = 0; axis < kMaxAxes; axis++) {
+                published_axes_[port][axis].store(0, std::memory_order_relaxed);
+            }
+        }
+        std::memset(frame_buttons_, 0, sizeof(frame_buttons_));
+        std::memset(frame_axes_, 0, sizeof(frame_axes_));
+        pending_input_time_.store(0, std::memory_order_relaxed);
+
+        //输入从JNI写入到被核心锁存, 以及到这一帧 retro_run 返回的延迟(不含上传和显示)
+        latch_latency_ = &Statistics::Current()->GetHistogram("input.latch_latency");
+        latch_to_frame_end_ = &Statistics::Current()->GetHistogram("input.latch_to_frame_end");
+        //事件队列满时丢弃的事件数
+        dropped_events_ = &Statistics::Current()->GetCounter("input.dropped_events");
+
+        initKeyboardMap();
     }
 
     SoftwareInput::~SoftwareInput() {
@@ -23,8 +44,8 @@ namespace libRetroRunner {
     }
 
     void SoftwareInput::initDefaultButtonMap() {
-        for (int idx = 0; idx < max_user_; idx++) {
-            std::map<unsigned, unsigned> &map = button_map[idx];
+        for (unsigned idx = 0; idx < kMaxPorts; idx++) {
+            uint8_t *map = button_map_[idx];
             for (int retro_key_id = 0; retro_key_id < 16; retro_key_id++) {
                 map[retro_key_id] = retro_key_id;
             }
@@ -51,17 +72,86 @@ namespace libRetroRunner {
         }
     }
 
-    void SoftwareInput::Init(int max_user) {
-        max_user_ = max_user;
-        for (int idx = 0; idx < max_user_; idx++) {
-            button_state[idx] = std::vector<bool>(256);
-            axis_state[idx] = std::vector<float>(8);
+    void SoftwareInput::initKeyboardMap() {
+        std::memset(keyboard_map_, 0, sizeof(keyboard_map_));   //RETROK_UNKNOWN
+        uint16_t *map = keyboard_map_;
+#ifdef ANDROID
+        for (int idx = 0; idx < 26; idx++) {
+            map[AKEYCODE_A + idx] = RETROK_a + idx;
+        }
+        for (int idx = 0; idx < 10; idx++) {
+            map[AKEYCODE_0 + idx] = RETROK_0 + idx;
+            map[AKEYCODE_NUMPAD_0 + idx] = RETROK_KP0 + idx;
         }
+        for (int idx = 0; idx < 12; idx++) {
+            map[AKEYCODE_F1 + idx] = RETROK_F1 + idx;
+        }
+        map[AKEYCODE_SPACE] = RETROK_SPACE;
+        map[AKEYCODE_ENTER] = RETROK_RETURN;
+        map[AKEYCODE_DEL] = RETROK_BACKSPACE;
+        map[AKEYCODE_FORWARD_DEL] = RETROK_DELETE;
+        map[AKEYCODE_TAB] = RETROK_TAB;
+        map[AKEYCODE_ESCAPE] = RETROK_ESCAPE;
+        map[AKEYCODE_SHIFT_LEFT] = RETROK_LSHIFT;
+        map[AKEYCODE_SHIFT_RIGHT] = RETROK_RSHIFT;
+        map[AKEYCODE_CTRL_LEFT] = RETROK_LCTRL;
+        map[AKEYCODE_CTRL_RIGHT] = RETROK_RCTRL;
+        map[AKEYCODE_ALT_LEFT] = RETROK_LALT;
+        map[AKEYCODE_ALT_RIGHT] = RETROK_RALT;
+        map[AKEYCODE_META_LEFT] = RETROK_LMETA;
+        map[AKEYCODE_META_RIGHT] = RETROK_RMETA;
+        map[AKEYCODE_DPAD_UP] = RETROK_UP;
+        map[AKEYCODE_DPAD_DOWN] = RETROK_DOWN;
+        map[AKEYCODE_DPAD_LEFT] = RETROK_LEFT;
+        map[AKEYCODE_DPAD_RIGHT] = RETROK_RIGHT;
+        map[AKEYCODE_PAGE_UP] = RETROK_PAGEUP;
+        map[AKEYCODE_PAGE_DOWN] = RETROK_PAGEDOWN;
+        map[AKEYCODE_MOVE_HOME] = RETROK_HOME;
+        map[AKEYCODE_MOVE_END] = RETROK_END;
+        map[AKEYCODE_INSERT] = RETROK_INSERT;
+        map[AKEYCODE_CAPS_LOCK] = RETROK_CAPSLOCK;
+        map[AKEYCODE_NUM_LOCK] = RETROK_NUMLOCK;
+        map[AKEYCODE_SCROLL_LOCK] = RETROK_SCROLLOCK;
+        map[AKEYCODE_SYSRQ] = RETROK_SYSREQ;
+        map[AKEYCODE_BREAK] = RETROK_BREAK;
+        map[AKEYCODE_MENU] = RETROK_MENU;
+        map[AKEYCODE_COMMA] = RETROK_COMMA;
+        map[AKEYCODE_PERIOD] = RETROK_PERIOD;
+        map[AKEYCODE_GRAVE] = RETROK_BACKQUOTE;
+        map[AKEYCODE_MINUS] = RETROK_MINUS;
+        map[AKEYCODE_EQUALS] = RETROK_EQUALS;
+        map[AKEYCODE_LEFT_BRACKET] = RETROK_LEFTBRACKET;
+        map[AKEYCODE_RIGHT_BRACKET] = RETROK_RIGHTBRACKET;
+        map[AKEYCODE_BACKSLASH] = RETROK_BACKSLASH;
+        map[AKEYCODE_SEMICOLON] = RETROK_SEMICOLON;
+        map[AKEYCODE_APOSTROPHE] = RETROK_QUOTE;
+        map[AKEYCODE_SLASH] = RETROK_SLASH;
+        map[AKEYCODE_AT] = RETROK_AT;
+        map[AKEYCODE_PLUS] = RETROK_PLUS;
+        map[AKEYCODE_STAR] = RETROK_ASTERISK;
+        map[AKEYCODE_POUND] = RETROK_HASH;
+        map[AKEYCODE_NUMPAD_DIVIDE] = RETROK_KP_DIVIDE;
+        map[AKEYCODE_NUMPAD_MULTIPLY] = RETROK_KP_MULTIPLY;
+        map[AKEYCODE_NUMPAD_SUBTRACT] = RETROK_KP_MINUS;
+        map[AKEYCODE_NUMPAD_ADD] = RETROK_KP_PLUS;
+        map[AKEYCODE_NUMPAD_DOT] = RETROK_KP_PERIOD;
+        map[AKEYCODE_NUMPAD_ENTER] = RETROK_KP_ENTER;
+        map[AKEYCODE_NUMPAD_EQUALS] = RETROK_KP_EQUALS;
+#endif
+    }
 
+    void SoftwareInput::Init(int max_user) {
+        if (max_user > (int) kMaxPorts) {
+            LOGD_SInput("max user %d is larger than %u, clamped.", max_user, kMaxPorts);
+            max_user = kMaxPorts;
+        }
+        //先准备好映射表, 再开放端口给JNI线程
         initDefaultButtonMap();
+        max_user_ = max_user;
 
         auto app = AppContext::Current();
         auto coreCtx = app->GetCoreRuntimeContext();
+        SetKeyboardCallback(coreCtx->GetKeyboardCallback());
         int device = RETRO_DEVICE_JOYPAD;
         auto supportControllers = coreCtx->GetSupportControllers();
 
@@ -83,38 +173,56 @@ namespace libRetroRunner {
          * id: 按键索引, eg:RETRO_DEVICE_ID_JOYPAD_A
          * @see libretro.h:381
          */
+        if (port >= kMaxPorts) return 0;
+        if (!frame_latched_) latchInput();
         switch (device) {
             case RETRO_DEVICE_JOYPAD: {
-                auto states = button_state[port];
                 if (id == RETRO_DEVICE_ID_JOYPAD_MASK) {
-                    int16_t ret = 0;
-                    for (unsigned i = 0; i < 16; i++) {
-                        if (states[i]) {
-                            ret |= (1 << i);
-                        }
-                    }
-                    return ret;
+                    return (int16_t) (frame_buttons_[port] & 0xffff);
                 }
-                return states[id] ? 1 : 0;
+                if (id >= 32) return 0;
+                return (frame_buttons_[port] >> id) & 1;
             }
             case RETRO_DEVICE_ANALOG: {
-                int16_t ret = 0;
-                if (index > 3 || id > 1) return ret;
+                if (index > 3 || id > 1) return 0;
                 /* index: 0-3 analog
                  * id: analog key id: RETRO_DEVICE_ID_ANALOG_X 0, RETRO_DEVICE_ID_ANALOG_Y 1
                  */
-                auto axis = axis_state[port];
-                int retro_device_id = (index * 2) + id;
-                float value = axis[retro_device_id];
-                ret = 0x7fff * value;
-                return ret;
+                return frame_axes_[port][(index * 2) + id];
+            }
+            case RETRO_DEVICE_MOUSE: {
+                if (port != 0) return 0;
+                switch (id) {
+                    case RETRO_DEVICE_ID_MOUSE_X:
+                        return (int16_t) frame_mouse_dx_;
+                    case RETRO_DEVICE_ID_MOUSE_Y:
+                        return (int16_t) frame_mouse_dy_;
+                    default:
+                        if (id >= 32) return 0;
+                        return ((mouse_buttons_ | frame_mouse_pulses_) >> id) & 1;
+                }
+            }
+            case RETRO_DEVICE_POINTER: {
+                if (port != 0) return 0;
+                if (id == RETRO_DEVICE_ID_POINTER_COUNT) return (int16_t) frame_pointer_count_;
+                if (index >= frame_pointer_count_) return 0;
+                const PointerSlot &pointer = pointers_[frame_pointers_[index]];
+                switch (id) {
+                    case RETRO_DEVICE_ID_POINTER_X:
+                        return pointer.x;
+                    case RETRO_DEVICE_ID_POINTER_Y:
+                        return pointer.y;
+                    case RETRO_DEVICE_ID_POINTER_PRESSED:
+                        return 1;
+                    default:
+                        return 0;
+                }
+            }
+            case RETRO_DEVICE_KEYBOARD: {
+                //键盘不区分端口
+                if (id >= RETROK_LAST) return 0;
+                return keyboard_state_[id];
             }
-            case RETRO_DEVICE_MOUSE:
-                break;
-            case RETRO_DEVICE_POINTER:
-                break;
-            case RETRO_DEVICE_KEYBOARD:
-                break;
             case RETRO_DEVICE_LIGHTGUN:
                 break;
         }
@@ -123,7 +231,15 @@ namespace libRetroRunner {
     }
 
     void SoftwareInput::Destroy() {
-        std::memset(keyboard_state, false, 256);
+        events_.clear();
+        std::memset(keyboard_state_, false, sizeof(keyboard_state_));
+        pending_key_count_ = 0;
+        std::memset(pointers_, 0, sizeof(pointers_));
+        mouse_buttons_ = 0;
+        frame_mouse_pulses_ = 0;
+        frame_mouse_dx_ = 0;
+        frame_mouse_dy_ = 0;
+        frame_pointer_count_ = 0;
     }
 
     void SoftwareInput::UpdateAxis(unsigned int port, unsigned int analog, unsigned int key, float value) {
@@ -131,25 +247,229 @@ namespace libRetroRunner {
         if (analog > 3 || key > 1) return;
         if (value > 1.0 || value < -1.0) return;
         int retro_device_id = (analog * 2) + key;
-        axis_state[port][retro_device_id] = value;
+        published_axes_[port][retro_device_id].store((int16_t) (0x7fff * value), std::memory_order_release);
+        markInputChanged();
     }
 
     bool SoftwareInput::UpdateButton(unsigned int port, unsigned int button, bool pressed) {
         if (port >= max_user_) return false;
-        auto map = button_map[port];
 
-        int mappedButton = button;
-        auto map_record = map.find(button);
-        if (map_record != map.end()) {
-            mappedButton = map_record->second;
+        unsigned mappedButton = button < kButtonMapSize ? button_map_[port][button] : kUnmappedButton;
+        if (mappedButton == kUnmappedButton) {
+            mappedButton = button;
+        }
+        if (mappedButton >= 32) return false;
+
+        uint32_t bit = 1u << mappedButton;
+        if (pressed) {
+            published_buttons_[port].fetch_or(bit, std::memory_order_release);
+        } else {
+            published_buttons_[port].fetch_and(~bit, std::memory_order_release);
         }
-        button_state[port][mappedButton] = pressed;
+        markInputChanged();
         return true;
     }
 
+    void SoftwareInput::UpdateKey(unsigned int keycode, unsigned int character, unsigned int metaState, bool pressed) {
+        InputEvent event{};
+        event.type = kEventKey;
+        event.pressed = pressed;
+        event.code = keycode < kKeyboardMapSize ? keyboard_map_[keycode] : RETROK_UNKNOWN;
+        event.character = character;
+#ifdef ANDROID
+        uint16_t modifiers = RETROKMOD_NONE;
+        if (metaState & AMETA_SHIFT_ON) modifiers |= RETROKMOD_SHIFT;
+        if (metaState & AMETA_CTRL_ON) modifiers |= RETROKMOD_CTRL;
+        if (metaState & AMETA_ALT_ON) modifiers |= RETROKMOD_ALT;
+        if (metaState & AMETA_META_ON) modifiers |= RETROKMOD_META;
+        if (metaState & AMETA_NUM_LOCK_ON) modifiers |= RETROKMOD_NUMLOCK;
+        if (metaState & AMETA_CAPS_LOCK_ON) modifiers |= RETROKMOD_CAPSLOCK;
+        if (metaState & AMETA_SCROLL_LOCK_ON) modifiers |= RETROKMOD_SCROLLOCK;
+        event.modifiers = modifiers;
+#endif
+        //没有对应按键也没有字符的事件对核心没有意义
+        if (event.code == RETROK_UNKNOWN && character == 0) return;
+        pushEvent(event);
+    }
+
+    void SoftwareInput::UpdateMouseMotion(int dx, int dy) {
+        InputEvent event{};
+        event.type = kEventMouseMotion;
+        event.x = dx;
+        event.y = dy;
+        pushEvent(event);
+    }
+
+    void SoftwareInput::UpdateMouseButton(unsigned int button, bool pressed) {
+        if (button >= 32) return;
+        InputEvent event{};
+        event.type = kEventMouseButton;
+        event.code = button;
+        event.pressed = pressed;
+        pushEvent(event);
+    }
+
+    void SoftwareInput::UpdatePointer(unsigned int pointerId, float x, float y, bool pressed) {
+        if (pointerId >= kMaxPointers) return;
+        if (x > 1.0f) x = 1.0f;
+        if (x < -1.0f) x = -1.0f;
+        if (y > 1.0f) y = 1.0f;
+        if (y < -1.0f) y = -1.0f;
+        InputEvent event{};
+        event.type = kEventPointer;
+        event.code = pointerId;
+        event.pressed = pressed;
+        event.x = (int32_t) (0x7fff * x);
+        event.y = (int32_t) (0x7fff * y);
+        pushEvent(event);
+    }
+
+    void SoftwareInput::pushEvent(const InputEvent &event) {
+        if (!events_.push(event)) {
+            dropped_events_->fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        markInputChanged();
+    }
+
+    void SoftwareInput::processEvents() {
+        for (auto &pointer: pointers_) {
+            if (pointer.releasePending) {
+                pointer.pressed = false;
+                pointer.releasePending = false;
+            }
+            pointer.pressedThisLatch = false;
+        }
+        frame_mouse_dx_ = 0;
+        frame_mouse_dy_ = 0;
+        frame_mouse_pulses_ = 0;
+
+        bool hasKeyboardCallback = keyboard_callback_.load(std::memory_order_acquire) != nullptr;
+        InputEvent event;
+        while (events_.pop(event)) {
+            switch (event.type) {
+                case kEventKey: {
+                    if (event.code < RETROK_LAST) keyboard_state_[event.code] = event.pressed;
+                    //锁存可能发生在核心的 input_poll/input_state 中, 回调留到下一次 retro_run 之前
+                    if (hasKeyboardCallback) {
+                        if (pending_key_count_ < kEventQueueSize) pending_keys_[pending_key_count_++] = event;
+                        else dropped_events_->fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+                }
+                case kEventMouseMotion: {
+                    frame_mouse_dx_ += event.x;
+                    frame_mouse_dy_ += event.y;
+                    break;
+                }
+                case kEventMouseButton: {
+                    uint32_t bit = 1u << event.code;
+                    bool isWheel = event.code == RETRO_DEVICE_ID_MOUSE_WHEELUP || event.code == RETRO_DEVICE_ID_MOUSE_WHEELDOWN ||
+                                   event.code == RETRO_DEVICE_ID_MOUSE_HORIZ_WHEELUP || event.code == RETRO_DEVICE_ID_MOUSE_HORIZ_WHEELDOWN;
+                    if (isWheel) {
+                        if (event.pressed) frame_mouse_pulses_ |= bit;
+                    } else if (event.pressed) {
+                        mouse_buttons_ |= bit;
+                    } else {
+                        mouse_buttons_ &= ~bit;
+                    }
+                    break;
+                }
+                case kEventPointer: {
+                    PointerSlot &pointer = pointers_[event.code];
+                    pointer.x = (int16_t) event.x;
+                    pointer.y = (int16_t) event.y;
+                    if (event.pressed) {
+                        if (!pointer.pressed) pointer.pressedThisLatch = true;
+                        pointer.pressed = true;
+                        pointer.releasePending = false;
+                    } else if (pointer.pressed) {
+                        //保证快速点击至少被核心看到一次
+                        if (pointer.pressedThisLatch) pointer.releasePending = true;
+                        else pointer.pressed = false;
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (frame_mouse_dx_ > 0x7fff) frame_mouse_dx_ = 0x7fff;
+        if (frame_mouse_dx_ < -0x7fff) frame_mouse_dx_ = -0x7fff;
+        if (frame_mouse_dy_ > 0x7fff) frame_mouse_dy_ = 0x7fff;
+        if (frame_mouse_dy_ < -0x7fff) frame_mouse_dy_ = -0x7fff;
+
+        frame_pointer_count_ = 0;
+        for (unsigned idx = 0; idx < kMaxPointers; idx++) {
+            if (pointers_[idx].pressed) frame_pointers_[frame_pointer_count_++] = idx;
+        }
+    }
+
     void SoftwareInput::Poll() {
+        switch (GetPollType()) {
+            case kInputPollEarly:
+                //已经在 BeginFrame 中锁存
+                break;
+            case kInputPollLate:
+                //推迟到第一次 State 调用
+                frame_latched_ = false;
+                break;
+            default:
+                latchInput();
+                break;
+        }
+    }
+
+    void SoftwareInput::BeginFrame() {
+        frame_latched_ = false;
+        if (GetPollType() == kInputPollEarly) {
+            latchInput();
+        }
+        dispatchKeyboardEvents();
+    }
+
+    void SoftwareInput::dispatchKeyboardEvents() {
+        unsigned count = pending_key_count_;
+        pending_key_count_ = 0;
+        retro_keyboard_event_t keyboardCallback = keyboard_callback_.load(std::memory_order_acquire);
+        if (!keyboardCallback) return;
+        for (unsigned idx = 0; idx < count; idx++) {
+            const InputEvent &event = pending_keys_[idx];
+            keyboardCallback(event.pressed, event.code, event.character, event.modifiers);
+        }
+    }
+
+    void SoftwareInput::EndFrame() {
+        if (frame_input_time_ != 0) {
+            latch_to_frame_end_->Record(Statistics::NowMicros() - frame_input_time_);
+            frame_input_time_ = 0;
+        }
+    }
+
+    void SoftwareInput::latchInput() {
+        //先取时间戳再读状态, 之后到达的输入会记在下一帧
+        int64_t inputTime = pending_input_time_.exchange(0, std::memory_order_acq_rel);
+
+        unsigned maxUser = max_user_;
+        for (unsigned port = 0; port < maxUser; port++) {
+            frame_buttons_[port] = published_buttons_[port].load(std::memory_order_acquire);
+            for (unsigned axis = 0; axis < kMaxAxes; axis++) {
+                frame_axes_[port][axis] = published_axes_[port][axis].load(std::memory_order_acquire);
+            }
+        }
+        processEvents();
+        frame_latched_ = true;
+
+        if (inputTime != 0) {
+            latch_latency_->Record(Statistics::NowMicros() - inputTime);
+            if (frame_input_time_ == 0) frame_input_time_ = inputTime;
+        }
+    }
 
+    void SoftwareInput::markInputChanged() {
+        if (pending_input_time_.load(std::memory_order_relaxed) != 0) return;
+        int64_t expected = 0;
+        pending_input_time_.compare_exchange_strong(expected, Statistics::NowMicros(), std::memory_order_acq_rel);
     }
 
 
-}
\ No newline at end of file
+}
@@ -5,11 +5,27 @@
 #ifndef _SOFTWARE_INPUT_H
 #define _SOFTWARE_INPUT_H
 
-#include <map>
+#include <atomic>
 #include "input_context.h"
+#include "../utils/spsc_ring.hpp"
 
 namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /*
+     * JNI线程只写 published 的原子状态, 模拟线程在 Poll() 时拷贝一份快照, 核心在这一帧内只读快照
+     * 键盘/鼠标/触摸是事件, 通过无锁队列交给模拟线程, 在锁存时处理, 事件需要由同一个线程(UI线程)发送
+     */
     class SoftwareInput : public InputContext {
+    public:
+        static constexpr unsigned kMaxPorts = 8;
+        static constexpr unsigned kMaxAxes = 8;             //4个摇杆, 每个x, y
+        static constexpr unsigned kButtonMapSize = 256;      //按键映射表大小, 超出的按键会被忽略
+        static constexpr uint8_t kUnmappedButton = 0xff;
+        static constexpr unsigned kKeyboardMapSize = 512;    //android keycode -> RETROK
+        static constexpr unsigned kMaxPointers = 10;
+        static constexpr unsigned kEventQueueSize = 1024;
+
     public:
         SoftwareInput();
 
@@ -27,16 +43,102 @@ namespace libRetroRunner {
 
         void Destroy() override;
 
+        void UpdateKey(unsigned int keycode, unsigned int character, unsigned int metaState, bool pressed) override;
+
+        void UpdateMouseMotion(int dx, int dy) override;
+
+        void UpdateMouseButton(unsigned int button, bool pressed) override;
+
+        void UpdatePointer(unsigned int pointerId, float x, float y, bool pressed) override;
+
+        void BeginFrame() override;
+
+        void EndFrame() override;
+
     private:
+        enum EventType : uint8_t {
+            kEventKey,
+            kEventMouseMotion,
+            kEventMouseButton,
+            kEventPointer,
+        };
+
+        struct InputEvent {
+            EventType type;
+            bool pressed;
+            uint16_t modifiers;     //RETROKMOD
+            uint32_t code;          //RETROK, mouse button id or pointer id
+            uint32_t character;
+            int32_t x;              //mouse delta or pointer position
+            int32_t y;
+        };
+
+        struct PointerSlot {
+            int16_t x;
+            int16_t y;
+            bool pressed;
+            bool pressedThisLatch;  //按下后还没被核心看到
+            bool releasePending;    //同一帧内按下又抬起, 下一次锁存再抬起
+        };
+
         void initDefaultButtonMap();
 
+        void initKeyboardMap();
+
+        void pushEvent(const InputEvent &event);
+
+        /* 处理队列中的键盘/鼠标/触摸事件, 只在模拟线程调用 */
+        void processEvents();
+
+        /* 在 retro_run 之前调用核心的键盘回调, 不能在 input_poll/input_state 里面调用, 核心不可重入 */
+        void dispatchKeyboardEvents();
+
+        /* 拷贝JNI线程发布的状态作为这一帧的快照 */
+        void latchInput();
+
+        /* 记录这次修改的时间, 只保留最早一次未被锁存的修改 */
+        void markInputChanged();
+
     private:
-        unsigned max_user_;
-        bool keyboard_state[256]; //state for keyboard keys
-        std::map<unsigned, std::map<unsigned, unsigned> > button_map;    //button map for each player
-        std::map<unsigned, std::vector<bool> > button_state;             //button state for each player
-        std::map<unsigned, std::vector<float> > axis_state;              //axis state for each player
+        std::atomic<unsigned> max_user_;
+        uint16_t keyboard_map_[kKeyboardMapSize];
+
+        /* button map for each player, button -> retro joypad id */
+        uint8_t button_map_[kMaxPorts][kButtonMapSize];
+
+        /* written by JNI threads, bit n = RETRO_DEVICE_ID_JOYPAD n */
+        std::atomic<uint32_t> published_buttons_[kMaxPorts];
+        std::atomic<int16_t> published_axes_[kMaxPorts][kMaxAxes];
+
+        /* snapshot taken at Poll(), read by core */
+        uint32_t frame_buttons_[kMaxPorts];
+        int16_t frame_axes_[kMaxPorts][kMaxAxes];
+        bool frame_latched_ = false;
+
+        /* keyboard, mouse and pointer events, JNI thread -> emu thread */
+        spsc_ring<InputEvent, kEventQueueSize> events_;
+        std::atomic<int64_t> *dropped_events_;
+
+        /* state owned by emu thread */
+        bool keyboard_state_[RETROK_LAST];
+        /* key events latched but not delivered to the core keyboard callback yet */
+        InputEvent pending_keys_[kEventQueueSize];
+        unsigned pending_key_count_ = 0;
+        uint32_t mouse_buttons_ = 0;
+        uint32_t frame_mouse_pulses_ = 0;   //wheel events in this frame
+        int32_t frame_mouse_dx_ = 0;
+        int32_t frame_mouse_dy_ = 0;
+        PointerSlot pointers_[kMaxPointers];
+        unsigned frame_pointers_[kMaxPointers];   //pressed pointer slots, in order
+        unsigned frame_pointer_count_ = 0;
+
+        /* time(us) of the earliest input not latched yet, 0 for none */
+        std::atomic<int64_t> pending_input_time_;
+        /* time(us) of the earliest input latched in this frame, 0 for none */
+        int64_t frame_input_time_ = 0;
 
+        LatencyHistogram *latch_latency_;
+        LatencyHistogram *latch_to_frame_end_;
     };
 }
 #endif
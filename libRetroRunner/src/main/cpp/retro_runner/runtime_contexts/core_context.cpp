@@ -22,6 +22,28 @@ namespace libRetroRunner {
         negotiation_interface_ = nullptr;
     }
 
+    std::string CoreRuntimeContext::GetCoreName() const {
+        std::string coreName = core_path_;
+        size_t pos = coreName.find_last_of('/');
+        if (pos != std::string::npos) coreName = coreName.substr(pos + 1);
+        pos = coreName.find_last_of('.');
+        if (pos != std::string::npos) coreName = coreName.substr(0, pos);
+        return coreName;
+    }
+
+    std::string CoreRuntimeContext::GetOptionsFilePath() const {
+        return system_path_ + "/" + GetCoreName() + ".opt";
+    }
+
+    std::string CoreRuntimeContext::GetGameOptionsFilePath(const std::string &gamePath) const {
+        std::string romName = gamePath;
+        size_t pos = romName.find_last_of('/');
+        if (pos != std::string::npos) romName = romName.substr(pos + 1);
+        pos = romName.find_last_of('.');
+        if (pos != std::string::npos && pos > 0) romName = romName.substr(0, pos);
+        return system_path_ + "/" + GetCoreName() + "/" + romName + ".opt";
+    }
+
     CoreRuntimeContext::~CoreRuntimeContext() {
         render_hw_context_destroy_ = nullptr;
         render_hw_context_reset_ = nullptr;
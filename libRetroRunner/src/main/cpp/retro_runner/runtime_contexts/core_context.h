@@ -28,6 +28,15 @@ namespace libRetroRunner {
 
         inline std::string GetSystemPath() const { return system_path_; }
 
+        /* core file name without "lib" path and extension */
+        std::string GetCoreName() const;
+
+        /* 核心的选项文件, 存放在system目录下: {system}/{core name}.opt */
+        std::string GetOptionsFilePath() const;
+
+        /* 单个游戏的选项文件, 和 RetroArch 一样按核心分目录: {system}/{core name}/{rom name}.opt, 不写到 rom 所在的目录 */
+        std::string GetGameOptionsFilePath(const std::string &gamePath) const;
+
 
 
         inline const std::map<unsigned int, std::string> &GetSupportControllers() { return support_controllers_; }
@@ -40,6 +49,16 @@ namespace libRetroRunner {
 
         inline int GetPixelFormat() const { return pixel_format_; }
 
+        inline unsigned GetPollTypeOverride() const { return poll_type_override_; }
+
+        inline retro_keyboard_event_t GetKeyboardCallback() const { return keyboard_callback_; }
+
+        inline retro_audio_buffer_status_callback_t GetAudioBufferStatusCallback() const { return audio_buffer_status_callback_; }
+
+        inline unsigned GetMinimumAudioLatency() const { return minimum_audio_latency_; }
+
+        inline const struct retro_audio_callback &GetAudioCallback() const { return audio_callback_; }
+
         inline int GetRenderContextType() const { return render_context_type_; }
 
         inline int GetRenderMajorVersion() const { return render_major_version_; }
@@ -72,6 +91,16 @@ namespace libRetroRunner {
 
         inline void SetPixelFormat(int pixel_format) { pixel_format_ = pixel_format; }
 
+        inline void SetPollTypeOverride(unsigned poll_type) { poll_type_override_ = poll_type; }
+
+        inline void SetKeyboardCallback(retro_keyboard_event_t keyboard_callback) { keyboard_callback_ = keyboard_callback; }
+
+        inline void SetAudioBufferStatusCallback(retro_audio_buffer_status_callback_t callback) { audio_buffer_status_callback_ = callback; }
+
+        inline void SetMinimumAudioLatency(unsigned latency) { minimum_audio_latency_ = latency; }
+
+        inline void SetAudioCallback(const struct retro_audio_callback &callback) { audio_callback_ = callback; }
+
         inline void SetRenderContextType(int render_context_type) { render_context_type_ = render_context_type; }
 
         inline void SetRenderMajorVersion(int render_major_version) { render_major_version_ = render_major_version; }
@@ -108,6 +137,16 @@ namespace libRetroRunner {
 
 
         int pixel_format_;
+        /* RETRO_ENVIRONMENT_POLL_TYPE_OVERRIDE, 0: don't care */
+        unsigned poll_type_override_ = 0;
+        /* RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK */
+        retro_keyboard_event_t keyboard_callback_ = nullptr;
+        /* RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, called before each retro_run */
+        retro_audio_buffer_status_callback_t audio_buffer_status_callback_ = nullptr;
+        /* RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY, ms */
+        unsigned minimum_audio_latency_ = 0;
+        /* RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, the core renders audio when the callback is called */
+        struct retro_audio_callback audio_callback_ = {nullptr, nullptr};
 
         int render_context_type_;
         int render_major_version_;
@@ -21,6 +21,10 @@ namespace libRetroRunner {
         return game_path_ + ".state" + std::to_string(slot);
     }
 
+    std::string GameRuntimeContext::GetLegacyOptionsFilePath() const {
+        return game_path_ + ".opt";
+    }
+
     GameRuntimeContext::~GameRuntimeContext() = default;
 }
 
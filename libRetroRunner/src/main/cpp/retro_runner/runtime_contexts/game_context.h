@@ -49,6 +49,9 @@ namespace libRetroRunner {
 
         std::string GetSaveStateFilePath(int slot);
 
+        /* 旧版本存放在 rom 旁边的选项文件, 只读取, 新的位置见 CoreRuntimeContext::GetGameOptionsFilePath */
+        std::string GetLegacyOptionsFilePath() const;
+
         // Setters
         inline void SetGamePath(std::string game_path) { game_path_ = game_path; }
 
@@ -44,7 +44,11 @@ namespace libRetroRunner {
 
         kLoadCheats,
         kSaveCheats,
-        kSaveCheatsAsync
+        kSaveCheatsAsync,
+
+        kSaveVariables,
+
+        kLoadVideoShader
     };
 
     enum CommandType {
@@ -17,10 +17,14 @@
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
 #else
-#define LOGI(...) printf(__VA_ARGS__)
-#define LOGD(...) printf(__VA_ARGS__)
-#define LOGW(...) printf(__VA_ARGS__)
-#define LOGE(...) printf(__VA_ARGS__)
+
+#include <stdio.h>
+
+//主机上编译测试时输出到 stdout, 和 logcat 一样每条一行
+#define LOGI(...) (printf(__VA_ARGS__), printf("\n"))
+#define LOGD(...) (printf(__VA_ARGS__), printf("\n"))
+#define LOGW(...) (printf(__VA_ARGS__), printf("\n"))
+#define LOGE(...) (printf(__VA_ARGS__), printf("\n"))
 
 #endif
 
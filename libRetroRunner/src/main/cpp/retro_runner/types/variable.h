@@ -12,7 +12,20 @@ struct Variable {
     std::string key;
     std::string value;
     std::string description;
+    /* 可选值, 以'|'分隔 */
     std::string options;
+    std::string defaultValue;
+    /* core options v1/v2 */
+    std::string info;
+    std::string category;
+    bool visible = true;
+};
+
+/* core options v2 的分类 */
+struct VariableCategory {
+    std::string key;
+    std::string description;
+    std::string info;
 };
 
 
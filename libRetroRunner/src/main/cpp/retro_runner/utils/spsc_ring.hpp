@@ -0,0 +1,94 @@
+//
+// Created by Aidoo.TK on 2024/12/3.
+//
+
+#ifndef _SPSC_RING_HPP
+#define _SPSC_RING_HPP
+
+#include <atomic>
+#include <algorithm>
+#include <stddef.h>
+
+/**
+ * Fixed size lock free ring for one producer thread and one consumer thread.
+ * No allocation after construction, push fails when the ring is full.
+ * @tparam T        trivially copyable element
+ * @tparam Capacity must be a power of 2
+ */
+template<typename T, size_t Capacity>
+class spsc_ring {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+public:
+    spsc_ring() = default;
+
+    spsc_ring(const spsc_ring &) = delete;
+
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    /* producer thread only */
+    bool push(const T &value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= Capacity) {
+            return false;
+        }
+        buffer_[tail & (Capacity - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer thread only */
+    bool pop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = buffer_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* producer thread only, returns the number of elements written */
+    size_t push(const T *values, size_t count) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t space = Capacity - (tail - head_.load(std::memory_order_acquire));
+        count = std::min(count, space);
+        size_t offset = tail & (Capacity - 1);
+        size_t first = std::min(count, Capacity - offset);
+        std::copy(values, values + first, buffer_ + offset);
+        std::copy(values + first, values + count, buffer_);
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /* consumer thread only, returns the number of elements read */
+    size_t pop(T *values, size_t count) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t available = tail_.load(std::memory_order_acquire) - head;
+        count = std::min(count, available);
+        size_t offset = head & (Capacity - 1);
+        size_t first = std::min(count, Capacity - offset);
+        std::copy(buffer_ + offset, buffer_ + offset + first, values);
+        std::copy(buffer_, buffer_ + (count - first), values + first);
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    /* consumer thread only, drop all pending elements */
+    void clear() {
+        head_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    T buffer_[Capacity];
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+#endif
@@ -3,8 +3,10 @@
 //
 #include "frame_buffer_object.h"
 #include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 #include <stdexcept>
 #include "../../types/log.h"
+#include "../../app/statistics.h"
 
 #define LOGD_FBO(...) LOGD("[VIDEO] " __VA_ARGS__)
 #define LOGW_FBO(...) LOGW("[VIDEO] " __VA_ARGS__)
@@ -25,9 +27,10 @@ namespace libRetroRunner {
         Destroy();
     }
 
-    void GLFrameBufferObject::Create(bool includeDepth, bool includeStencil) {
+    bool GLFrameBufferObject::Create(bool includeDepth, bool includeStencil) {
         Destroy();
         depth = includeDepth;
+        stencil = includeDepth && includeStencil;
 
         glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -44,7 +47,17 @@ namespace libRetroRunner {
         glBindTexture(GL_TEXTURE_2D, texture_id);
 
         //glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8_OES, width, height);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_OES, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        switch (format) {
+            case kFrameBufferRGBA16F:
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+                break;
+            case kFrameBufferSRGB8A8:
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                break;
+            default:
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_OES, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                break;
+        }
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, linear ? GL_LINEAR : GL_NEAREST);
@@ -82,14 +95,16 @@ namespace libRetroRunner {
         }
 
         int frameBufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-        if (frameBufferStatus != GL_FRAMEBUFFER_COMPLETE) {
+        bool complete = frameBufferStatus == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete) {
             LOGE_FBO("Error creating framebuffer %d not complete, status: %d, error: %d, %s", frame_buffer, frameBufferStatus, glGetError(), glGetString(glGetError()));
         }
 
         glBindTexture(GL_TEXTURE_2D, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
-        LOGD_FBO("Frame buffer created, id:%d, size:%d x %d", frame_buffer, width, height);
+        LOGD_FBO("Frame buffer created, id:%d, size:%d x %d, format: %d", frame_buffer, width, height, format);
+        return complete;
     }
 
     void GLFrameBufferObject::Destroy() {
@@ -97,6 +112,7 @@ namespace libRetroRunner {
             glDeleteRenderbuffers(1, &depth_buffer);
             depth_buffer = 0;
             depth = false;
+            stencil = false;
         }
         if (texture_id > 0) {
             glDeleteTextures(1, &texture_id);
@@ -128,5 +144,53 @@ namespace libRetroRunner {
     void GLFrameBufferObject::SetPixelFormat(unsigned int format) {
         this->pixel_format = format;
     }
+
+    void GLFrameBufferObject::SetFormat(GLFrameBufferFormat format) {
+        this->format = format;
+    }
+}
+
+namespace libRetroRunner {
+    GLFrameBufferPool::GLFrameBufferPool() {
+        created_ = &Statistics::Current()->GetCounter("video.framebuffers_created");
+        reused_ = &Statistics::Current()->GetCounter("video.framebuffers_reused");
+    }
+
+    GLFrameBufferPool::~GLFrameBufferPool() {
+        Trim();
+    }
+
+    std::unique_ptr<GLFrameBufferObject> GLFrameBufferPool::Acquire(unsigned width, unsigned height, GLFrameBufferFormat format, bool includeDepth, bool includeStencil) {
+        bool stencil = includeDepth && includeStencil;
+        for (auto it = free_.begin(); it != free_.end(); it++) {
+            GLFrameBufferObject *fbo = it->get();
+            if (fbo->GetWidth() == width && fbo->GetHeight() == height && fbo->GetFormat() == format &&
+                fbo->HasDepth() == includeDepth && fbo->HasStencil() == stencil) {
+                std::unique_ptr<GLFrameBufferObject> ret = std::move(*it);
+                free_.erase(it);
+                reused_->fetch_add(1, std::memory_order_relaxed);
+                return ret;
+            }
+        }
+
+        std::unique_ptr<GLFrameBufferObject> fbo = std::make_unique<GLFrameBufferObject>();
+        fbo->SetSize(width, height);
+        fbo->SetLinear(false);
+        fbo->SetFormat(format);
+        if (!fbo->Create(includeDepth, includeStencil)) {
+            return nullptr;
+        }
+        created_->fetch_add(1, std::memory_order_relaxed);
+        return fbo;
+    }
+
+    void GLFrameBufferPool::Release(std::unique_ptr<GLFrameBufferObject> frameBuffer) {
+        if (frameBuffer) free_.push_back(std::move(frameBuffer));
+    }
+
+    void GLFrameBufferPool::Trim() {
+        if (!free_.empty()) LOGD_FBO("destroy %zu unused frame buffers", free_.size());
+        free_.clear();
+    }
 }
 
@@ -7,9 +7,19 @@
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <memory>
+#include <vector>
+#include <atomic>
 
 
 namespace libRetroRunner {
+    /* color format of the framebuffer texture, float and srgb need GLES3 */
+    enum GLFrameBufferFormat {
+        kFrameBufferRGBA8 = 0,
+        kFrameBufferRGBA16F,
+        kFrameBufferSRGB8A8,
+    };
+
     class GLFrameBufferObject {
     public:
         GLFrameBufferObject();
@@ -22,7 +32,10 @@ namespace libRetroRunner {
 
         void SetPixelFormat(unsigned int format);
 
-        void Create(bool includeDepth, bool includeStencil);
+        void SetFormat(GLFrameBufferFormat format);
+
+        /* return false if the framebuffer is not complete */
+        bool Create(bool includeDepth, bool includeStencil);
 
         void Destroy();
 
@@ -39,12 +52,26 @@ namespace libRetroRunner {
             return height;
         }
 
+        inline GLFrameBufferFormat GetFormat() const {
+            return format;
+        }
+
+        inline bool HasDepth() const {
+            return depth;
+        }
+
+        inline bool HasStencil() const {
+            return stencil;
+        }
+
     private:
         /** not used, we use RGBA8888 for all platforms.*/
         unsigned int pixel_format;
 
-        bool linear;
-        bool depth;
+        GLFrameBufferFormat format = kFrameBufferRGBA8;
+        bool linear = false;
+        bool depth = false;
+        bool stencil = false;
 
         GLuint frame_buffer = 0;
         GLuint texture_id = 0;
@@ -53,6 +80,31 @@ namespace libRetroRunner {
         unsigned height = 0;
 
     };
+
+    /**
+     * Framebuffers released by a pass chain are kept here and handed out again to a chain with the
+     * same sizes and formats, so reloading a preset or resizing the surface does not reallocate them.
+     */
+    class GLFrameBufferPool {
+    public:
+        GLFrameBufferPool();
+
+        ~GLFrameBufferPool();
+
+        /* a pooled framebuffer with the same size and format, or a new one, null if creating failed */
+        std::unique_ptr<GLFrameBufferObject> Acquire(unsigned width, unsigned height, GLFrameBufferFormat format, bool includeDepth, bool includeStencil);
+
+        void Release(std::unique_ptr<GLFrameBufferObject> frameBuffer);
+
+        /* destroy the framebuffers which are not acquired again, called after a chain is built */
+        void Trim();
+
+    private:
+        std::vector<std::unique_ptr<GLFrameBufferObject>> free_;
+
+        std::atomic<int64_t> *created_;
+        std::atomic<int64_t> *reused_;
+    };
 }
 
 #endif
@@ -3,6 +3,7 @@
 //
 
 #include <android/bitmap.h>
+#include <algorithm>
 #include <libretro-common/include/libretro.h>
 #include "shader_pass.h"
 #include "shaders.h"
@@ -101,31 +102,20 @@ namespace libRetroRunner {
             -1.0F, +1.0F,  //左上
     };
 
-    GLfloat glTextureCoordVBOData[48] = {
-            0.0F, 0.0F,  //左下
-            0.0F, 1.0F, //左上
-            1.0F, 1.0F, //右上
-            1.0F, 0.0F, //右下
-
-            0.0F, 0.0F, //左下
-            0.0F, 1.0F, //左上
-            1.0F, 1.0F, //右上
-            1.0F, 0.0F, //右下
-
-            0.0F, 0.0F,  //左下
-            0.0F, 1.0F, //左上
-            1.0F, 1.0F, //右上
-            1.0F, 0.0F, //右下
-
+    /* texture coordinates of the corners, vertex i uses corner (i + rotation) % 4 */
+    GLfloat glTextureCornerData[8] = {
             0.0F, 0.0F,  //左下
             0.0F, 1.0F, //左上
             1.0F, 1.0F, //右上
             1.0F, 0.0F, //右下
+    };
 
-            0.0F, 0.0F,  //左下
-            0.0F, 1.0F, //左上
-            1.0F, 1.0F, //右上
-            1.0F, 0.0F, //右下
+    /* positions are already in clip space */
+    const GLfloat glIdentityMatrix[16] = {
+            1.0F, 0.0F, 0.0F, 0.0F,
+            0.0F, 1.0F, 0.0F, 0.0F,
+            0.0F, 0.0F, 1.0F, 0.0F,
+            0.0F, 0.0F, 0.0F, 1.0F,
     };
 
 
@@ -147,9 +137,9 @@ namespace libRetroRunner {
                                 shaderType, buf);
                         free(buf);
                     }
-                    glDeleteShader(shader);
-                    shader = 0;
                 }
+                glDeleteShader(shader);
+                shader = 0;
             }
         }
         return shader;
@@ -166,11 +156,22 @@ namespace libRetroRunner {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         return buffer;
     }
+
+    /* default shaders and RetroArch shaders name the same input differently */
+    static GLint _attribLocation(GLuint program, const char *name, const char *alternative) {
+        GLint location = glGetAttribLocation(program, name);
+        return location >= 0 ? location : glGetAttribLocation(program, alternative);
+    }
+
+    static GLint _uniformLocation(GLuint program, const char *name, const char *alternative) {
+        GLint location = glGetUniformLocation(program, name);
+        return location >= 0 ? location : glGetUniformLocation(program, alternative);
+    }
 }
 
 //GLShaderPass定义
 namespace libRetroRunner {
-    GLShaderPass::GLShaderPass(const char *vertexShaderCode, char *fragmentShaderCode) {
+    GLShaderPass::GLShaderPass(const char *vertexShaderCode, const char *fragmentShaderCode) {
         pixelFormat = RETRO_PIXEL_FORMAT_UNKNOWN;
         const char *finalVertexShaderCode = vertexShaderCode ? vertexShaderCode : default_vertex_shader.c_str();
         const char *finalFragmentShaderCode = fragmentShaderCode ? fragmentShaderCode : default_fragment_shader.c_str();
@@ -210,10 +211,26 @@ namespace libRetroRunner {
 
         if (program) {
             program_id_ = program;
-            attr_position_ = glGetAttribLocation(program, "a_position");
-            attr_coordinate_ = glGetAttribLocation(program, "a_texCoord");
-            attr_texture_ = glGetUniformLocation(program, "u_texture");
-            attr_flip_ = glGetUniformLocation(program, "u_flipVertical");
+            attr_position_ = _attribLocation(program, "a_position", "VertexCoord");
+            attr_coordinate_ = _attribLocation(program, "a_texCoord", "TexCoord");
+            attr_color_ = glGetAttribLocation(program, "COLOR");
+            attr_texture_ = _uniformLocation(program, "u_texture", "Texture");
+            attr_swap_red_blue_ = glGetUniformLocation(program, "u_swapRedBlue");
+            attr_force_opaque_ = glGetUniformLocation(program, "u_forceOpaque");
+            uniform_mvp_ = glGetUniformLocation(program, "MVPMatrix");
+            uniform_input_size_ = glGetUniformLocation(program, "InputSize");
+            uniform_texture_size_ = glGetUniformLocation(program, "TextureSize");
+            uniform_output_size_ = glGetUniformLocation(program, "OutputSize");
+            uniform_frame_count_ = glGetUniformLocation(program, "FrameCount");
+            uniform_frame_direction_ = glGetUniformLocation(program, "FrameDirection");
+            if (attr_position_ < 0 || attr_coordinate_ < 0) {
+                LOGW_SP("shader pass program %d has no position(%d) or texture coordinate(%d) attribute", program, attr_position_, attr_coordinate_);
+            }
+
+            vbo_position_ = _createVBO(glPositionVBOData, sizeof(glPositionVBOData));
+            if (!vbo_position_) {
+                LOGE_SP("create position vbo failed.");
+            }
             LOGD_SP("shader pass program id: %d", program_id_);
         }
     }
@@ -246,66 +263,190 @@ namespace libRetroRunner {
 
     }
 
-    void GLShaderPass::CreateFrameBuffer(int width, int height, bool linear, bool includeDepth, bool includeStencil) {
-        if (pixelFormat == RETRO_PIXEL_FORMAT_UNKNOWN) {
-            LOGE_SP("pixel format is unknow, can't create frame buffer for %d", pixelFormat);
-            return;
+    void GLShaderPass::BindSemantics(unsigned index, const std::vector<std::string> &aliases) {
+        semantic_uniforms_.clear();
+        history_depth_ = 0;
+        if (!program_id_) return;
+
+        GLint maxUnits = 8;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+        GLint units = 1;    //0 用于 Source
+        auto bind = [&](SemanticSource source, unsigned sourceIndex, const std::string &prefix) {
+            SemanticUniform uniform{source, sourceIndex,
+                                    glGetUniformLocation(program_id_, (prefix + "Texture").c_str()),
+                                    glGetUniformLocation(program_id_, (prefix + "TextureSize").c_str()),
+                                    glGetUniformLocation(program_id_, (prefix + "InputSize").c_str())};
+            if (uniform.texture < 0 && uniform.textureSize < 0 && uniform.inputSize < 0) return false;
+            if (uniform.texture >= 0 && units++ >= maxUnits) {
+                LOGW_SP("too many textures in program %d, %sTexture is not bound", program_id_, prefix.c_str());
+                uniform.texture = -1;
+            }
+            semantic_uniforms_.push_back(uniform);
+            return true;
+        };
+
+        bind(kSemanticOriginal, 0, "Orig");
+        bind(kSemanticOriginal, 0, "PassPrev" + std::to_string(index + 1));
+        for (unsigned i = 0; i < kMaxHistory; i++) {
+            if (bind(kSemanticHistory, i, i == 0 ? std::string("Prev") : "Prev" + std::to_string(i))) {
+                history_depth_ = i + 1;
+            }
         }
-        if (frameBuffer != nullptr && width == frameBuffer->GetWidth() && height == frameBuffer->GetHeight()) {
-            LOGW_SP("frame buffer size not change, reuse it.");
-            return;
+        for (unsigned i = 0; i < index && i < aliases.size(); i++) {
+            bind(kSemanticPass, i, "Pass" + std::to_string(i + 1));
+            bind(kSemanticPass, i, "PassPrev" + std::to_string(index - i));
+            if (!aliases[i].empty()) bind(kSemanticPass, i, aliases[i]);
         }
-        GL_CHECK("GLShaderPass::frameBuffer->Create 0");
-        LOGD_SP("create frame buffer: %d x %d, depth: %d, stencil: %d, linear: %d", width, height, includeDepth, includeStencil, linear);
-        frameBuffer = std::make_unique<GLFrameBufferObject>();
-        frameBuffer->SetSize(width, height);
-        frameBuffer->SetLinear(linear);
-        frameBuffer->Create(includeDepth, includeStencil);
-        GL_CHECK("GLShaderPass::frameBuffer->Create 1");
-        if (!vbo_position_) {
-            vbo_position_ = _createVBO(glPositionVBOData, sizeof(glPositionVBOData));
-            GL_CHECK("GLShaderPass::_createVBO vbo_position_");
+        for (unsigned i = 0; i < aliases.size(); i++) {
+            bind(kSemanticFeedback, i, "PassFeedback" + std::to_string(i));
+            if (!aliases[i].empty()) bind(kSemanticFeedback, i, aliases[i] + "Feedback");
         }
-        if (!vbo_position_) {
-            LOGE_SP("create position vbo failed.");
+        LOGD_SP("shader pass %u: %zu semantic uniforms, history: %u", index, semantic_uniforms_.size(), history_depth_);
+    }
+
+    bool GLShaderPass::UsesFeedback(unsigned index) {
+        for (auto &uniform: semantic_uniforms_) {
+            if (uniform.source == kSemanticFeedback && uniform.index == index) return true;
         }
+        return false;
+    }
 
-        if (!vbo_texture_coordinate_) {
-            vbo_texture_coordinate_ = _createVBO(glTextureCoordVBOData, sizeof(glTextureCoordVBOData));
-            GL_CHECK("GLShaderPass::_createVBO vbo_texture_coordinate_");
+    void GLShaderPass::ComputeOutputSize(unsigned sourceWidth, unsigned sourceHeight, unsigned viewportWidth, unsigned viewportHeight, unsigned *width, unsigned *height) {
+        auto scale = [](GLShaderScaleType type, float factor, unsigned source, unsigned viewport) {
+            float size = factor * (float) source;
+            if (type == kScaleTypeViewport) size = factor * (float) viewport;
+            else if (type == kScaleTypeAbsolute) size = factor;
+            return size < 1.0f ? 1u : (unsigned) size;
+        };
+        *width = scale(scale_type_x_, scale_x_, sourceWidth, viewportWidth);
+        *height = scale(scale_type_y_, scale_y_, sourceHeight, viewportHeight);
+    }
+
+    void GLShaderPass::SetOutputSize(unsigned width, unsigned height) {
+        output_width_ = std::min(width, GetWidth());
+        output_height_ = std::min(height, GetHeight());
+    }
+
+    void GLShaderPass::SetFrameBuffer(std::unique_ptr<GLFrameBufferObject> frameBuffer) {
+        this->frameBuffer = std::move(frameBuffer);
+        output_width_ = GetWidth();
+        output_height_ = GetHeight();
+    }
+
+    std::unique_ptr<GLFrameBufferObject> GLShaderPass::ReleaseFrameBuffer() {
+        output_width_ = 0;
+        output_height_ = 0;
+        return std::move(frameBuffer);
+    }
+
+    void GLShaderPass::SetFeedbackBuffer(std::unique_ptr<GLFrameBufferObject> frameBuffer) {
+        feedbackBuffer = std::move(frameBuffer);
+        feedback_width_ = feedbackBuffer ? feedbackBuffer->GetWidth() : 0;
+        feedback_height_ = feedbackBuffer ? feedbackBuffer->GetHeight() : 0;
+    }
+
+    std::unique_ptr<GLFrameBufferObject> GLShaderPass::ReleaseFeedbackBuffer() {
+        feedback_width_ = 0;
+        feedback_height_ = 0;
+        return std::move(feedbackBuffer);
+    }
+
+    void GLShaderPass::SwapFeedback() {
+        if (!feedbackBuffer) return;
+        std::swap(frameBuffer, feedbackBuffer);
+        std::swap(output_width_, feedback_width_);
+        std::swap(output_height_, feedback_height_);
+    }
+
+    GLPassTexture GLShaderPass::GetOutput() {
+        GLPassTexture output;
+        if (frameBuffer) {
+            output.texture = frameBuffer->GetTexture();
+            output.width = output_width_;
+            output.height = output_height_;
+            output.textureWidth = frameBuffer->GetWidth();
+            output.textureHeight = frameBuffer->GetHeight();
         }
-        if (!vbo_texture_coordinate_) {
-            LOGE_SP("create position vbo failed.");
+        return output;
+    }
+
+    GLPassTexture GLShaderPass::GetFeedback() {
+        GLPassTexture output;
+        if (feedbackBuffer) {
+            output.texture = feedbackBuffer->GetTexture();
+            output.width = feedback_width_;
+            output.height = feedback_height_;
+            output.textureWidth = feedbackBuffer->GetWidth();
+            output.textureHeight = feedbackBuffer->GetHeight();
         }
-        GL_CHECK("GLShaderPass::CreateFrameBuffer");
+        return output;
+    }
+
+    void GLShaderPass::Render(const GLPassTexture &source, const GLPassSemantics *semantics) {
+        drawTexture(source, semantics, GetFrameBuffer(), output_width_, output_height_, 0, false, false);
+    }
+
+    void GLShaderPass::RenderOnScreen(const GLPassTexture &source, const GLPassSemantics *semantics, int width, int height, unsigned int rotation) {
+        //软件渲染的画面在 framebuffer 中是上下颠倒的, 显示时翻转
+        drawTexture(source, semantics, 0, width, height, rotation, !hardware_accelerated_, false);
+    }
+
+    void GLShaderPass::CopyTo(const GLPassTexture &source, GLFrameBufferObject *target) {
+        drawTexture(source, nullptr, target->GetFrameBuffer(), source.width, source.height, 0, false, false);
+    }
+
+    void GLShaderPass::FillTexture(GLuint textureId, unsigned width, unsigned height) {
+        GLPassTexture source;
+        source.texture = textureId;
+        source.width = source.textureWidth = width;
+        source.height = source.textureHeight = height;
+        SetOutputSize(width, height);
+        drawTexture(source, nullptr, GetFrameBuffer(), output_width_, output_height_, 0, false, true);
     }
 
     void GLShaderPass::DrawOnScreen(int width, int height, unsigned int rotation) {
-        drawTexture(0, width, height, rotation);
+        RenderOnScreen(GetOutput(), nullptr, width, height, rotation);
     }
 
-    void GLShaderPass::FillTexture(GLuint textureId) {
-        drawTexture(textureId);
+    void GLShaderPass::updateTextureCoordinates(float maxU, float maxV, unsigned int rotation, bool flip) {
+        if (vbo_texture_coordinate_ && maxU == coord_max_u_ && maxV == coord_max_v_ && rotation == coord_rotation_ && flip == coord_flip_) return;
+        GLfloat data[12];
+        for (unsigned i = 0; i < 6; i++) {
+            const GLfloat *corner = &glTextureCornerData[((i + rotation) % 4) * 2];
+            data[i * 2] = corner[0] * maxU;
+            data[i * 2 + 1] = (flip ? 1.0F - corner[1] : corner[1]) * maxV;
+        }
+        if (!vbo_texture_coordinate_) {
+            glGenBuffers(1, &vbo_texture_coordinate_);
+        }
+        //重新指定整个 buffer, 驱动可以分配新的存储, 不用等待上一次绘制
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_texture_coordinate_);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+        coord_max_u_ = maxU;
+        coord_max_v_ = maxV;
+        coord_rotation_ = rotation;
+        coord_flip_ = flip;
     }
 
-    //when textureId is not 0, means draw the textureId to framebuffer of this pass.
-    //otherwise, draw the texture of current pass to screen.
-    //we should deal the following attributes: size, rotation, position...
-    void GLShaderPass::drawTexture(GLuint textureId, int width, int height, unsigned int rotation) {
+    void GLShaderPass::applySampler() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler_linear_ ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler_linear_ ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler_wrap_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler_wrap_);
+    }
+
+    //draw source into frameBuffer(0 for screen) at width x height.
+    //only the valid region of source is sampled, rotation and flip apply to the texture coordinates.
+    //swizzle: fix-up of the game texture, only when it is drawn into pass 0.
+    void GLShaderPass::drawTexture(const GLPassTexture &source, const GLPassSemantics *semantics, GLuint frameBuffer, int width, int height,
+                                   unsigned int rotation, bool flip, bool swizzle) {
         GL_CHECK("GLShaderPass::drawTexture 0")
-        bool renderToScreen = textureId == 0;
-        if (renderToScreen) {
-            glViewport(0, 0, width, height);
-            GL_CHECK2("glViewport ", "  %d x %d", width, height)
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            GL_CHECK("GLShaderPass::drawTexture 2")
-        } else {
-            glViewport(0, 0, frameBuffer->GetWidth(), frameBuffer->GetHeight());
-            GL_CHECK2("glViewport ", "  %d x %d", frameBuffer->GetWidth(), frameBuffer->GetHeight())
-            glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->GetFrameBuffer());
-            GL_CHECK("GLShaderPass::drawTexture 3")
-        }
+        if (!program_id_ || attr_position_ < 0 || attr_coordinate_ < 0) return;
 
+        glViewport(0, 0, width, height);
+        GL_CHECK2("glViewport ", "  %d x %d", width, height)
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        GL_CHECK("GLShaderPass::drawTexture 2")
 
         glUseProgram(program_id_);
         GL_CHECK2("glUseProgram ", " id : %d", program_id_)
@@ -315,41 +456,74 @@ namespace libRetroRunner {
         glVertexAttribPointer(attr_position_, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
         GL_CHECK("glBindBuffer vbo_position_")
         //vertex
+        float maxU = source.textureWidth ? (float) source.width / (float) source.textureWidth : 1.0f;
+        float maxV = source.textureHeight ? (float) source.height / (float) source.textureHeight : 1.0f;
+        updateTextureCoordinates(maxU, maxV, rotation, flip);
         glBindBuffer(GL_ARRAY_BUFFER, vbo_texture_coordinate_);
         glEnableVertexAttribArray(attr_coordinate_);
-        if (renderToScreen) {
-            glVertexAttribPointer(attr_coordinate_, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void *) (2 * rotation * sizeof(GLfloat)));
-        } else
-            glVertexAttribPointer(attr_coordinate_, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void *) 0);
-
+        glVertexAttribPointer(attr_coordinate_, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void *) 0);
         GL_CHECK("glBindBuffer vbo_texture_coordinate_")
-        //flip
-        glEnableVertexAttribArray(attr_flip_);
-        if (renderToScreen && !hardware_accelerated_) {
-            glUniform1i(attr_flip_, true);
-        } else {
-            glUniform1i(attr_flip_, false);
+        if (attr_color_ >= 0) {
+            glDisableVertexAttribArray(attr_color_);
+            glVertexAttrib4f(attr_color_, 1.0F, 1.0F, 1.0F, 1.0F);
         }
 
+        //swizzle only applies to the input texture, the framebuffer texture is always RGBA
+        if (attr_swap_red_blue_ >= 0) glUniform1i(attr_swap_red_blue_, swizzle && input_swap_red_blue_);
+        if (attr_force_opaque_ >= 0) glUniform1i(attr_force_opaque_, swizzle && input_force_opaque_);
+
+        if (uniform_mvp_ >= 0) glUniformMatrix4fv(uniform_mvp_, 1, GL_FALSE, glIdentityMatrix);
+        if (uniform_input_size_ >= 0) glUniform2f(uniform_input_size_, (float) source.width, (float) source.height);
+        if (uniform_texture_size_ >= 0) glUniform2f(uniform_texture_size_, (float) source.textureWidth, (float) source.textureHeight);
+        if (uniform_output_size_ >= 0) glUniform2f(uniform_output_size_, (float) width, (float) height);
+        if (uniform_frame_count_ >= 0) {
+            unsigned frameCount = semantics ? semantics->frameCount : 0;
+            glUniform1i(uniform_frame_count_, (GLint) (frame_count_mod_ ? frameCount % frame_count_mod_ : frameCount));
+        }
+        if (uniform_frame_direction_ >= 0) glUniform1i(uniform_frame_direction_, 1);
 
         glActiveTexture(GL_TEXTURE0);
         GL_CHECK("glActiveTexture(GL_TEXTURE0)")
-        if (renderToScreen) {
-            glBindTexture(GL_TEXTURE_2D, frameBuffer->GetTexture());
-            glUniform1i(attr_texture_, 0);
-        } else {
-            glBindTexture(GL_TEXTURE_2D, textureId);
-            glUniform1i(attr_texture_, 0);
-        }
+        glBindTexture(GL_TEXTURE_2D, source.texture);
+        applySampler();
+        glUniform1i(attr_texture_, 0);
         GL_CHECK("glBindTexture 2")
 
+        GLint unit = 1;
+        if (semantics) {
+            static const GLPassTexture empty;
+            for (auto &uniform: semantic_uniforms_) {
+                const std::vector<GLPassTexture> *textures = nullptr;
+                if (uniform.source == kSemanticHistory) textures = &semantics->history;
+                else if (uniform.source == kSemanticPass) textures = &semantics->passes;
+                else if (uniform.source == kSemanticFeedback) textures = &semantics->feedback;
+                const GLPassTexture &texture = textures == nullptr ? semantics->original :
+                                               uniform.index < textures->size() ? (*textures)[uniform.index] : empty;
+                if (uniform.texture >= 0) {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, texture.texture);
+                    applySampler();
+                    glUniform1i(uniform.texture, unit);
+                    unit++;
+                }
+                if (uniform.textureSize >= 0) glUniform2f(uniform.textureSize, (float) texture.textureWidth, (float) texture.textureHeight);
+                if (uniform.inputSize >= 0) glUniform2f(uniform.inputSize, (float) texture.width, (float) texture.height);
+            }
+            GL_CHECK("bind semantic textures")
+        }
+
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 6);
         GL_CHECK("glDrawArrays 2")
 
         glDisableVertexAttribArray(attr_position_);
         glDisableVertexAttribArray(attr_coordinate_);
 
-
+        while (unit > 1) {
+            unit--;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -357,10 +531,15 @@ namespace libRetroRunner {
     }
 
     void GLShaderPass::DrawToFile(const std::string &path) {
+        if (frameBuffer == nullptr) {
+            LOGE_SP("no frame buffer to dump.");
+            return;
+        }
         glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->GetFrameBuffer());
         LOGW_SP("dump framebuffer to file: %s", path.c_str());
-        int width = frameBuffer->GetWidth();
-        int height = frameBuffer->GetHeight();
+        //只保存有效区域
+        int width = output_width_;
+        int height = output_height_;
         GLubyte *pixels = (GLubyte *) malloc(width * height * 4);
         if (pixels == nullptr) {
             LOGE_SP("malloc buffer for dump failed.");
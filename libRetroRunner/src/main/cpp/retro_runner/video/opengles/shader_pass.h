@@ -2,8 +2,10 @@
  * Created by Aidoo.TK on 2024/11/5.
  *
  * we create framebuffer to each shader pass.
- * draw the texture of game to pass 0, then each pass draw the it's texture to the framebuffer
- * of next pass. After done all pass drawing. We draw the final one to the screen.
+ * draw the texture of game to pass 0, then each pass draw the output of previous pass to it's framebuffer.
+ * After done all pass drawing. We draw the final one to the screen.
+ * Framebuffers are allocated at the largest size the pass may output, a pass only renders to the
+ * bottom left [0, output width) x [0, output height) region and the next pass samples that region.
 */
 
 #ifndef _SHADER_PASS_H
@@ -11,39 +13,114 @@
 
 #include <GLES2/gl2.h>
 #include <string>
+#include <vector>
 #include "frame_buffer_object.h"
+#include "shader_preset.h"
 
 namespace libRetroRunner {
+    /* a texture sampled by a pass, the content is the [0, width) x [0, height) region of the texture */
+    struct GLPassTexture {
+        GLuint texture = 0;
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned textureWidth = 0;
+        unsigned textureHeight = 0;
+    };
+
+    /* textures of the chain a preset pass may sample besides its source */
+    struct GLPassSemantics {
+        GLPassTexture original;                 //pass 0 的输出(游戏画面)
+        std::vector<GLPassTexture> history;     //之前帧的 original, [0] 为上一帧
+        std::vector<GLPassTexture> passes;      //本帧各 pass 的输出, 按预设中的序号, 禁用的 pass 等于它的输入
+        std::vector<GLPassTexture> feedback;    //上一帧各 pass 的输出
+        unsigned frameCount = 0;
+    };
+
     class GLShaderPass {
     public:
+        /* PrevTexture, Prev1Texture ... Prev6Texture */
+        static constexpr unsigned kMaxHistory = 7;
 
-        GLShaderPass(const char *vertexShaderCode, char *fragmentShaderCode);
+        GLShaderPass(const char *vertexShaderCode, const char *fragmentShaderCode);
 
         ~GLShaderPass();
 
         void Destroy();
 
-        void CreateFrameBuffer(int width, int height, bool linear, bool includeDepth, bool includeStencil);
+        /**
+         * look up the uniforms of RetroArch GLSL shaders besides Texture, InputSize, TextureSize, OutputSize,
+         * FrameCount, FrameDirection and MVPMatrix:
+         *  Orig*, Prev*, Prev1* ... Prev6*: original of this frame and history frames.
+         *  PassN*: output of shaderN-1 in this frame, PassPrevN*: output of N passes before, <alias>*.
+         *  PassFeedbackN*, <alias>Feedback*: output of shaderN in last frame.
+         * each of them has Texture, TextureSize and InputSize.
+         * @param index   index of this pass in the preset
+         * @param aliases aliases of all passes in the preset
+         */
+        void BindSemantics(unsigned index, const std::vector<std::string> &aliases);
+
+        /* if this pass samples the output of preset pass 'index' of last frame */
+        bool UsesFeedback(unsigned index);
+
+        /* size this pass outputs for a source, not clamped to the framebuffer */
+        void ComputeOutputSize(unsigned sourceWidth, unsigned sourceHeight, unsigned viewportWidth, unsigned viewportHeight, unsigned *width, unsigned *height);
+
+        /* clamped to the framebuffer */
+        void SetOutputSize(unsigned width, unsigned height);
+
+        void SetFrameBuffer(std::unique_ptr<GLFrameBufferObject> frameBuffer);
+
+        std::unique_ptr<GLFrameBufferObject> ReleaseFrameBuffer();
+
+        void SetFeedbackBuffer(std::unique_ptr<GLFrameBufferObject> frameBuffer);
+
+        std::unique_ptr<GLFrameBufferObject> ReleaseFeedbackBuffer();
+
+        /* output of last frame becomes the feedback, this frame is rendered into the other framebuffer */
+        void SwapFeedback();
 
-        /*draw the texture with id of 'textureId' to current framebuffer.*/
-        void FillTexture(GLuint textureId);
+        GLPassTexture GetOutput();
+
+        GLPassTexture GetFeedback();
+
+        /* draw source into the framebuffer of this pass at the output size */
+        void Render(const GLPassTexture &source, const GLPassSemantics *semantics);
 
         /**
-         * draw current framebuffer to screen
+         * draw source to screen
          * @param width  screen width
          * @param height  screen height
          * @param rotation  game video rotation
          * @see GLESVideoContext::game_video_ration_
          */
+        void RenderOnScreen(const GLPassTexture &source, const GLPassSemantics *semantics, int width, int height, unsigned rotation = 0);
+
+        /* draw source into target without scaling, used to keep history frames */
+        void CopyTo(const GLPassTexture &source, GLFrameBufferObject *target);
+
+        /*draw the texture with id of 'textureId' (width x height) to current framebuffer.*/
+        void FillTexture(GLuint textureId, unsigned width, unsigned height);
+
+        /*draw the output of current framebuffer to screen.*/
         void DrawOnScreen(int width, int height, unsigned int rotation = 0);
 
-        /*draw the texture of current framebuffer to file.*/
+        /*draw the output of current framebuffer to file.*/
         void DrawToFile(const std::string &path);
 
     private:
-        void drawTexture(GLuint textureId, int width = 0, int height = 0, unsigned rotation = 0);
+        void drawTexture(const GLPassTexture &source, const GLPassSemantics *semantics, GLuint frameBuffer, int width, int height,
+                         unsigned rotation, bool flip, bool swizzle);
+
+        /* texture coordinates of the quad, rotated, flipped and scaled to the valid region of the source */
+        void updateTextureCoordinates(float maxU, float maxV, unsigned rotation, bool flip);
+
+        void applySampler();
 
     public:
+        inline bool IsValid() {
+            return program_id_ != 0;
+        }
+
         inline void SetPixelFormat(int format) {
             pixelFormat = format;
         }
@@ -52,6 +129,74 @@ namespace libRetroRunner {
             hardware_accelerated_ = accelerated;
         }
 
+        /**
+         * swizzle and alpha fix-up of the texture passed to FillTexture,
+         * used when the game texture is uploaded in core's native format.
+         */
+        inline void SetInputSwizzle(bool swapRedBlue, bool forceOpaque) {
+            input_swap_red_blue_ = swapRedBlue;
+            input_force_opaque_ = forceOpaque;
+        }
+
+        /* filter and wrap mode used when this pass samples its inputs */
+        inline void SetSampler(bool linear, GLenum wrap) {
+            sampler_linear_ = linear;
+            sampler_wrap_ = wrap;
+        }
+
+        inline void SetScale(bool hasScale, GLShaderScaleType typeX, GLShaderScaleType typeY, float scaleX, float scaleY) {
+            has_scale_ = hasScale;
+            scale_type_x_ = typeX;
+            scale_type_y_ = typeY;
+            scale_x_ = scaleX;
+            scale_y_ = scaleY;
+        }
+
+        /* the last pass without scale draws to screen directly */
+        inline bool HasScale() {
+            return has_scale_;
+        }
+
+        /* output size depends on the screen */
+        inline bool IsViewportScaled() {
+            return has_scale_ && (scale_type_x_ == kScaleTypeViewport || scale_type_y_ == kScaleTypeViewport);
+        }
+
+        inline void SetFrameCountMod(unsigned mod) {
+            frame_count_mod_ = mod;
+        }
+
+        inline void SetFrameBufferFormat(GLFrameBufferFormat format) {
+            frame_buffer_format_ = format;
+        }
+
+        inline GLFrameBufferFormat GetFrameBufferFormat() {
+            return frame_buffer_format_;
+        }
+
+        /* index in the preset, -1 for the pass of game image */
+        inline void SetPresetIndex(int index) {
+            preset_index_ = index;
+        }
+
+        inline int GetPresetIndex() {
+            return preset_index_;
+        }
+
+        /* output of last frame is sampled by some pass, keep it in a feedback framebuffer */
+        inline void SetNeedFeedback(bool need) {
+            need_feedback_ = need;
+        }
+
+        inline bool NeedFeedback() {
+            return need_feedback_;
+        }
+
+        /* history frames sampled by this pass, 0 for none */
+        inline unsigned GetHistoryDepth() {
+            return history_depth_;
+        }
+
         //以下为shader相关
         inline GLuint GetProgramId() {
             return program_id_;
@@ -65,15 +210,15 @@ namespace libRetroRunner {
             return fragment_shader_;
         }
 
-        inline GLuint GetAttrPosition() {
+        inline GLint GetAttrPosition() {
             return attr_position_;
         }
 
-        inline GLuint GetAttrCoordinate() {
+        inline GLint GetAttrCoordinate() {
             return attr_coordinate_;
         }
 
-        inline GLuint GetAttrTexture() {
+        inline GLint GetAttrTexture() {
             return attr_texture_;
         }
         //以下为framebuffer相关
@@ -107,7 +252,27 @@ namespace libRetroRunner {
         }
 
     private:
+        enum SemanticSource {
+            kSemanticOriginal,
+            kSemanticHistory,
+            kSemanticPass,
+            kSemanticFeedback,
+        };
+
+        struct SemanticUniform {
+            SemanticSource source;
+            unsigned index;
+            GLint texture;
+            GLint textureSize;
+            GLint inputSize;
+        };
+
         std::unique_ptr<GLFrameBufferObject> frameBuffer;
+        std::unique_ptr<GLFrameBufferObject> feedbackBuffer;
+        unsigned output_width_ = 0;
+        unsigned output_height_ = 0;
+        unsigned feedback_width_ = 0;
+        unsigned feedback_height_ = 0;
 
         /** core pixel format,
          * only used to detect if the core pixel format is set.
@@ -118,15 +283,45 @@ namespace libRetroRunner {
         GLuint vertex_shader_ = 0;
         GLuint fragment_shader_ = 0;
 
-        GLuint attr_position_;
-        GLuint attr_coordinate_;
-        GLuint attr_texture_;
-        GLuint attr_flip_;
+        /* default shaders use a_position/a_texCoord/u_texture, preset shaders VertexCoord/TexCoord/Texture */
+        GLint attr_position_ = -1;
+        GLint attr_coordinate_ = -1;
+        GLint attr_color_ = -1;
+        GLint attr_texture_ = -1;
+        GLint attr_swap_red_blue_ = -1;
+        GLint attr_force_opaque_ = -1;
+        GLint uniform_mvp_ = -1;
+        GLint uniform_input_size_ = -1;
+        GLint uniform_texture_size_ = -1;
+        GLint uniform_output_size_ = -1;
+        GLint uniform_frame_count_ = -1;
+        GLint uniform_frame_direction_ = -1;
+        std::vector<SemanticUniform> semantic_uniforms_;
+        unsigned history_depth_ = 0;
 
         GLuint vbo_position_ = 0;
         GLuint vbo_texture_coordinate_ = 0;
+        /* parameters of the coordinates in vbo_texture_coordinate_, rebuilt when changed */
+        float coord_max_u_ = -1.0f;
+        float coord_max_v_ = -1.0f;
+        unsigned coord_rotation_ = 0;
+        bool coord_flip_ = false;
 
         bool hardware_accelerated_ = false;
+        bool input_swap_red_blue_ = false;
+        bool input_force_opaque_ = false;
+
+        bool sampler_linear_ = false;
+        GLenum sampler_wrap_ = GL_CLAMP_TO_EDGE;
+        bool has_scale_ = false;
+        GLShaderScaleType scale_type_x_ = kScaleTypeSource;
+        GLShaderScaleType scale_type_y_ = kScaleTypeSource;
+        float scale_x_ = 1.0f;
+        float scale_y_ = 1.0f;
+        unsigned frame_count_mod_ = 0;
+        GLFrameBufferFormat frame_buffer_format_ = kFrameBufferRGBA8;
+        int preset_index_ = -1;
+        bool need_feedback_ = false;
     };
 
 }
@@ -0,0 +1,220 @@
+//
+// Created by Aidoo.TK on 2024/12/20.
+//
+
+#include "shader_preset.h"
+#include <fstream>
+#include <sstream>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <file/config_file.h>
+#include <file/file_path.h>
+#include "../../types/log.h"
+
+#define LOGD_PRESET(...) LOGD("[VIDEO]:[PRESET] " __VA_ARGS__)
+#define LOGW_PRESET(...) LOGW("[VIDEO]:[PRESET] " __VA_ARGS__)
+#define LOGE_PRESET(...) LOGE("[VIDEO]:[PRESET] " __VA_ARGS__)
+
+namespace libRetroRunner {
+
+    static bool parseScaleType(const char *value, GLShaderScaleType *type) {
+        if (strcmp(value, "source") == 0) {
+            *type = kScaleTypeSource;
+        } else if (strcmp(value, "viewport") == 0) {
+            *type = kScaleTypeViewport;
+        } else if (strcmp(value, "absolute") == 0) {
+            *type = kScaleTypeAbsolute;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parseWrapMode(const char *value, GLShaderWrapMode *mode) {
+        if (strcmp(value, "clamp_to_edge") == 0) {
+            *mode = kWrapClampToEdge;
+        } else if (strcmp(value, "clamp_to_border") == 0) {
+            *mode = kWrapClampToBorder;
+        } else if (strcmp(value, "repeat") == 0) {
+            *mode = kWrapRepeat;
+        } else if (strcmp(value, "mirrored_repeat") == 0) {
+            *mode = kWrapMirroredRepeat;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool endsWith(const std::string &value, const char *suffix) {
+        size_t length = strlen(suffix);
+        return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+    }
+
+    bool GLShaderPreset::loadShaderSource(const std::string &path, std::string &source) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            LOGE_PRESET("can't open shader: %s", path.c_str());
+            return false;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        source = content.str();
+        if (source.empty()) {
+            LOGE_PRESET("shader is empty: %s", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool GLShaderPreset::Load(const std::string &path) {
+        path_ = path;
+        passes_.clear();
+
+        //单个 .glsl 文件作为只有一个 pass 的预设
+        if (endsWith(path, ".glsl")) {
+            GLShaderPassConfig pass;
+            pass.path = path;
+            if (!loadShaderSource(path, pass.source)) return false;
+            passes_.push_back(std::move(pass));
+            return true;
+        }
+
+        config_file_t *conf = config_file_new_from_path_to_string(path.c_str());
+        if (conf == nullptr) {
+            LOGE_PRESET("can't open shader preset: %s", path.c_str());
+            return false;
+        }
+        unsigned count = 0;
+        if (!config_get_uint(conf, "shaders", &count) || count == 0) {
+            LOGE_PRESET("no shaders in preset: %s", path.c_str());
+            config_file_free(conf);
+            return false;
+        }
+
+        char key[64];
+        char value[PATH_MAX];
+        if (config_get_array(conf, "textures", value, sizeof(value))) {
+            LOGW_PRESET("lookup textures are not supported, ignored: %s", value);
+        }
+
+        bool ok = true;
+        for (unsigned i = 0; i < count && ok; i++) {
+            GLShaderPassConfig pass;
+            bool flag;
+            float number;
+
+            snprintf(key, sizeof(key), "shader%u", i);
+            if (!config_get_path(conf, key, value, sizeof(value))) {
+                LOGE_PRESET("%s not found in preset", key);
+                ok = false;
+                break;
+            }
+            char resolved[PATH_MAX];
+            fill_pathname_resolve_relative(resolved, path.c_str(), value, sizeof(resolved));
+            pass.path = resolved;
+
+            snprintf(key, sizeof(key), "enabled%u", i);
+            if (config_get_bool(conf, key, &flag)) pass.enabled = flag;
+            //禁用的 pass 不读取源码, 文件不存在也不影响预设
+            if (pass.enabled && !loadShaderSource(pass.path, pass.source)) {
+                ok = false;
+                break;
+            }
+
+            snprintf(key, sizeof(key), "alias%u", i);
+            if (config_get_array(conf, key, value, sizeof(value))) pass.alias = value;
+
+            snprintf(key, sizeof(key), "filter_linear%u", i);
+            if (config_get_bool(conf, key, &flag)) pass.filterLinear = flag ? 1 : 0;
+
+            snprintf(key, sizeof(key), "wrap_mode%u", i);
+            if (config_get_array(conf, key, value, sizeof(value)) && !parseWrapMode(value, &pass.wrapMode)) {
+                LOGW_PRESET("unknown %s: %s", key, value);
+            }
+
+            //scale_typeN 同时设置 x 与 y, scale_type_xN/scale_type_yN 单独覆盖
+            snprintf(key, sizeof(key), "scale_type%u", i);
+            if (config_get_array(conf, key, value, sizeof(value))) {
+                if (parseScaleType(value, &pass.scaleTypeX)) {
+                    pass.scaleTypeY = pass.scaleTypeX;
+                    pass.hasScale = true;
+                } else {
+                    LOGW_PRESET("unknown %s: %s", key, value);
+                }
+            }
+            snprintf(key, sizeof(key), "scale_type_x%u", i);
+            if (config_get_array(conf, key, value, sizeof(value)) && parseScaleType(value, &pass.scaleTypeX)) pass.hasScale = true;
+            snprintf(key, sizeof(key), "scale_type_y%u", i);
+            if (config_get_array(conf, key, value, sizeof(value)) && parseScaleType(value, &pass.scaleTypeY)) pass.hasScale = true;
+
+            snprintf(key, sizeof(key), "scale%u", i);
+            if (config_get_float(conf, key, &number)) {
+                pass.scaleX = number;
+                pass.scaleY = number;
+            }
+            snprintf(key, sizeof(key), "scale_x%u", i);
+            if (config_get_float(conf, key, &number)) pass.scaleX = number;
+            snprintf(key, sizeof(key), "scale_y%u", i);
+            if (config_get_float(conf, key, &number)) pass.scaleY = number;
+            if (pass.scaleX <= 0 || pass.scaleY <= 0) {
+                LOGW_PRESET("invalid scale of shader%u: %f x %f, use 1.0", i, pass.scaleX, pass.scaleY);
+                pass.scaleX = pass.scaleX > 0 ? pass.scaleX : 1.0f;
+                pass.scaleY = pass.scaleY > 0 ? pass.scaleY : 1.0f;
+            }
+
+            snprintf(key, sizeof(key), "float_framebuffer%u", i);
+            if (config_get_bool(conf, key, &flag)) pass.floatFramebuffer = flag;
+            snprintf(key, sizeof(key), "srgb_framebuffer%u", i);
+            if (config_get_bool(conf, key, &flag)) pass.srgbFramebuffer = flag;
+            snprintf(key, sizeof(key), "frame_count_mod%u", i);
+            config_get_uint(conf, key, &pass.frameCountMod);
+
+            LOGD_PRESET("shader%u: %s, enabled: %d, scale: %d/%d %.2f x %.2f", i, pass.path.c_str(), pass.enabled,
+                        pass.hasScale ? pass.scaleTypeX : -1, pass.hasScale ? pass.scaleTypeY : -1, pass.scaleX, pass.scaleY);
+            passes_.push_back(std::move(pass));
+        }
+        config_file_free(conf);
+
+        if (!ok) passes_.clear();
+        return ok;
+    }
+
+    std::string GLShaderPreset::BuildStageSource(const std::string &source, bool vertex, int glesVersion) {
+        std::string body = source;
+        std::string version;
+
+        //#version 必须是第一条语句, 取出后放回开头, 原位置留空行保持行号
+        size_t pos = body.find("#version");
+        if (pos != std::string::npos && (pos == 0 || body[pos - 1] == '\n')) {
+            size_t end = body.find('\n', pos);
+            if (end == std::string::npos) end = body.size();
+            std::string line = body.substr(pos, end - pos);
+            body.erase(pos, end - pos);
+
+            int number = 0;
+            sscanf(line.c_str(), "#version %d", &number);
+            bool es = line.find(" es") != std::string::npos;
+            if (glesVersion >= 3 && (number >= 130 || (es && number >= 300))) {
+                version = "#version 300 es";
+            } else {
+                version = "#version 100";
+            }
+        }
+
+        //#pragma parameter 中的字符串部分驱动不能解析, 参数使用 shader 中的默认值
+        pos = 0;
+        while ((pos = body.find("#pragma parameter", pos)) != std::string::npos) {
+            size_t end = body.find('\n', pos);
+            if (end == std::string::npos) end = body.size();
+            body.erase(pos, end - pos);
+        }
+
+        std::string result;
+        result.reserve(body.size() + 64);
+        if (!version.empty()) result.append(version).append("\n");
+        result.append(vertex ? "#define VERTEX\n" : "#define FRAGMENT\n");
+        result.append(body);
+        return result;
+    }
+}
@@ -0,0 +1,80 @@
+//
+// Created by Aidoo.TK on 2024/12/20.
+//
+
+#ifndef _SHADER_PRESET_H
+#define _SHADER_PRESET_H
+
+#include <string>
+#include <vector>
+
+namespace libRetroRunner {
+
+    enum GLShaderScaleType {
+        kScaleTypeSource = 0,   //输入尺寸的倍数
+        kScaleTypeViewport,     //屏幕尺寸的倍数
+        kScaleTypeAbsolute,     //固定像素
+    };
+
+    enum GLShaderWrapMode {
+        kWrapClampToEdge = 0,
+        kWrapClampToBorder,     //GLES 不支持, 按 clamp_to_edge 处理
+        kWrapRepeat,
+        kWrapMirroredRepeat,
+    };
+
+    /* one shaderN entry of a preset, keys are the same as RetroArch .glslp */
+    struct GLShaderPassConfig {
+        std::string path;
+        std::string source;     //VERTEX 和 FRAGMENT 在同一个文件中, 用 #if defined(VERTEX) 区分
+        std::string alias;
+
+        bool enabled = true;    //enabledN = false 的 pass 不编译, 它的输出等于输入
+        int filterLinear = -1;  //-1: 未设置, 使用 Setting::GetVideoUseLinear
+        GLShaderWrapMode wrapMode = kWrapClampToEdge;
+
+        /* no scale_type: source x1, or the viewport directly when it is the last pass */
+        bool hasScale = false;
+        GLShaderScaleType scaleTypeX = kScaleTypeSource;
+        GLShaderScaleType scaleTypeY = kScaleTypeSource;
+        float scaleX = 1.0f;
+        float scaleY = 1.0f;
+
+        bool floatFramebuffer = false;
+        bool srgbFramebuffer = false;
+        unsigned frameCountMod = 0;
+    };
+
+    /**
+     * GLSL shader preset (.glslp), a single .glsl file is loaded as a preset with one pass.
+     * Shaders use the RetroArch GLSL interface, see GLShaderPass for the supported uniforms.
+     * Lookup textures(textures = ...) and #pragma parameter values are not supported, shaders use their defaults.
+     */
+    class GLShaderPreset {
+    public:
+        bool Load(const std::string &path);
+
+        inline const std::string &GetPath() const {
+            return path_;
+        }
+
+        inline const std::vector<GLShaderPassConfig> &GetPasses() const {
+            return passes_;
+        }
+
+        /**
+         * source of one stage: VERTEX or FRAGMENT is defined after #version,
+         * desktop versions are mapped to "100" or "300 es" by the context version.
+         */
+        static std::string BuildStageSource(const std::string &source, bool vertex, int glesVersion);
+
+    private:
+        static bool loadShaderSource(const std::string &path, std::string &source);
+
+    private:
+        std::string path_;
+        std::vector<GLShaderPassConfig> passes_;
+    };
+}
+
+#endif
@@ -15,15 +15,10 @@ const std::string default_vertex_shader =
                 attribute vec4 a_position;
                 attribute vec2 a_texCoord;
                 varying vec2 v_texCoord;
-                uniform bool u_flipVertical;
 
                 void main() {
                     gl_Position = a_position;
-                    if (u_flipVertical) {
-                        v_texCoord = vec2(a_texCoord.x, 1.0 - a_texCoord.y);
-                    } else {
-                        v_texCoord = a_texCoord;
-                    }
+                    v_texCoord = a_texCoord;
                 }
 
         );
@@ -32,10 +27,19 @@ const std::string default_vertex_shader =
 const std::string default_fragment_shader =
         GLSL(
                 uniform sampler2D u_texture;
+                uniform bool u_swapRedBlue;
+                uniform bool u_forceOpaque;
                 varying vec2 v_texCoord;
 
                 void main() {
-                    gl_FragColor = texture2D(u_texture, v_texCoord);
+                    vec4 color = texture2D(u_texture, v_texCoord);
+                    if (u_swapRedBlue) {
+                        color = color.bgra;
+                    }
+                    if (u_forceOpaque) {
+                        color.a = 1.0;
+                    }
+                    gl_FragColor = color;
                 }
 
         );
@@ -2,10 +2,14 @@
 // Created by Aidoo.TK on 2024/11/5.
 //
 #include "texture.h"
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 #include <GLES2/gl2ext.h>
 #include <libretro-common/include/libretro.h>
+#include <string.h>
+#include <stdio.h>
 #include "../../types/log.h"
+#include "../pixel_converter.h"
+#include "../../app/statistics.h"
 
 #define LOGD_TB(...) LOGD("[VIDEO] " __VA_ARGS__)
 #define LOGW_TB(...) LOGW("[VIDEO] " __VA_ARGS__)
@@ -14,66 +18,68 @@
 
 namespace libRetroRunner {
 
-    void convertXRGB8888ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer) {
-        const unsigned int *src = (const unsigned int *) data;
-        unsigned char *dst = buffer;
-        for (unsigned int i = 0; i < width * height; i++) {
-            unsigned int pixel = src[i];
-            *dst++ = (pixel >> 16) & 0xFF;
-            *dst++ = (pixel >> 8) & 0xFF;
-            *dst++ = pixel & 0xFF;
-            *dst++ = (pixel >> 24) & 0xFF;
-        }
+    static bool hasGLExtension(const char *name) {
+        const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+        return extensions && strstr(extensions, name) != nullptr;
     }
 
-    void convertRGB565ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer) {
-        //LOGD_TB("convertRGB565ToRGBA8888: %d x %d", width, height);
-
-        const unsigned short *src = (const unsigned short *) data;
-        unsigned char *dst = buffer;
-        for (unsigned int heightIdx = 0; heightIdx < height; heightIdx++) {
-            for (unsigned int rowIdx = 0; rowIdx < width; rowIdx++) {
-                unsigned short pixel = src[heightIdx * width + rowIdx];
-                dst = buffer + (heightIdx * width + rowIdx) * 4;
-                //Red
-                *dst = ((pixel & 0xF800) >> 11) << 3;
-                dst++;
-                //Green
-                *dst = (((pixel & 0x7E0) >> 5) << 2);
-                dst++;
-                //Blue
-                *dst = (((pixel & 0x1F)) << 3);
-                dst++;
-                *dst = 0xFF;
-            }
-        }
+    static bool isGLES3() {
+        const char *version = (const char *) glGetString(GL_VERSION);
+        int major = 0;
+        return version && sscanf(version, "OpenGL ES %d", &major) == 1 && major >= 3;
     }
 
-    void convert0RGB1555ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer) {
-        const unsigned short *src = (const unsigned short *) data;
-        unsigned char *dst = buffer;
-        for (unsigned int i = 0; i < width * height; i++) {
-            unsigned short pixel = src[i];
-            *dst++ = ((pixel >> 10) & 0x1F) << 3;
-            *dst++ = ((pixel >> 5) & 0x1F) << 3;
-            *dst++ = (pixel & 0x1F) << 3;
-            *dst++ = (pixel >> 15) ? 0xFF : 0;
-        }
+    /* the largest alignment allowed by GL_UNPACK_ALIGNMENT that divides pitch */
+    static GLint unpackAlignment(size_t pitch) {
+        if ((pitch & 7) == 0) return 8;
+        if ((pitch & 3) == 0) return 4;
+        if ((pitch & 1) == 0) return 2;
+        return 1;
     }
 
     GLTextureObject::~GLTextureObject() {
         Destroy();
     }
 
-    void GLTextureObject::Create(unsigned int width, unsigned int height) {
+    void GLTextureObject::Create(unsigned int width, unsigned int height, int pixelFormat) {
         this->texture_width_ = width;
         this->texture_height_ = height;
+        this->pixel_format_ = pixelFormat;
         if (buffer_) {
             delete[] buffer_;
             buffer_ = nullptr;
         }
+        unpack_row_length_ = isGLES3() || hasGLExtension("GL_EXT_unpack_subimage");
+
+        GLint internalFormat;
+        if (pixelFormat == RETRO_PIXEL_FORMAT_RGB565) {
+            upload_mode_ = kUploadRGB565;
+            internalFormat = GL_RGB;
+            gl_format_ = GL_RGB;
+            gl_type_ = GL_UNSIGNED_SHORT_5_6_5;
+            bytes_per_pixel_ = 2;
+        } else if (pixelFormat == RETRO_PIXEL_FORMAT_XRGB8888) {
+            //小端下 XRGB8888 的内存顺序为 B G R X
+            if (hasGLExtension("GL_EXT_texture_format_BGRA8888")) {
+                upload_mode_ = kUploadBGRA8888;
+                internalFormat = GL_BGRA_EXT;
+                gl_format_ = GL_BGRA_EXT;
+            } else {
+                upload_mode_ = kUploadRawXRGB8888;
+                internalFormat = GL_RGBA;
+                gl_format_ = GL_RGBA;
+            }
+            gl_type_ = GL_UNSIGNED_BYTE;
+            bytes_per_pixel_ = 4;
+        } else {
+            upload_mode_ = kUploadConvert;
+            internalFormat = GL_RGBA8_OES;
+            gl_format_ = GL_RGBA;
+            gl_type_ = GL_UNSIGNED_BYTE;
+            bytes_per_pixel_ = 4;
+        }
+
         bool linear = true;
-        buffer_ = new unsigned char[width * height * 4];
         glGenTextures(1, &textureId_);
 
         glBindTexture(GL_TEXTURE_2D, textureId_);
@@ -82,45 +88,182 @@ namespace libRetroRunner {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, linear ? GL_LINEAR : GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, linear ? GL_LINEAR : GL_NEAREST);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8_OES, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, gl_format_, gl_type_, 0);
 
 
         glBindTexture(GL_TEXTURE_2D, 0);
 
-        LOGD_TB("texture created: %d, width:%u, height:%u", textureId_, width, height);
+        if (!upload_time_) {
+            upload_time_ = &Statistics::Current()->GetHistogram("video.texture_upload_time");
+            pbo_waits_ = &Statistics::Current()->GetCounter("video.pbo_waits");
+        }
+        use_pbo_ = isGLES3();
+        if (use_pbo_) createPixelBuffers((size_t) width * height * bytes_per_pixel_);
+
+        LOGD_TB("texture created: %d, width:%u, height:%u, pixel format: %d, upload mode: %d, pbo: %d", textureId_, width, height, pixelFormat, upload_mode_, use_pbo_);
     }
 
-    void GLTextureObject::WriteTextureData(const void *data, unsigned int width, unsigned int height, int pixelFormat) {
-        if (width != this->texture_width_ || height != this->texture_height_) {
-            if (buffer_) {
-                delete[] buffer_;
-                buffer_ = new unsigned char[width * height * 4];
-                LOGW("[VIDEO] texture size changed: %d, width:%u, height:%u", textureId_, width, height);
+    void GLTextureObject::createPixelBuffers(size_t size) {
+        destroyPixelBuffers();
+        //之前遗留的错误不能算到这里
+        while (glGetError() != GL_NO_ERROR) {}
+        pbo_size_ = size;
+        glGenBuffers(kPBOCount, pbos_);
+        for (unsigned i = 0; i < kPBOCount; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos_[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) pbo_size_, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pbo_index_ = 0;
+        if (glGetError() != GL_NO_ERROR) {
+            LOGW_TB("create pixel buffers failed, upload from client memory.");
+            destroyPixelBuffers();
+            use_pbo_ = false;
+        }
+    }
+
+    void GLTextureObject::destroyPixelBuffers() {
+        for (unsigned i = 0; i < kPBOCount; i++) {
+            if (pbo_fences_[i]) {
+                glDeleteSync((GLsync) pbo_fences_[i]);
+                pbo_fences_[i] = nullptr;
+            }
+        }
+        if (pbos_[0]) {
+            glDeleteBuffers(kPBOCount, pbos_);
+            for (unsigned int &pbo: pbos_) pbo = 0;
+        }
+    }
+
+    bool GLTextureObject::writePixels(const void *data, unsigned int width, unsigned int height, size_t pitch, unsigned char *dst, size_t rowBytes) {
+        if (upload_mode_ == kUploadConvert) {
+            if (!ConvertToRGBA8888(pixel_format_, data, width, height, pitch, dst, rowBytes)) {
+                LOGE_TB("unsupported pixel format: %d", pixel_format_);
+                return false;
             }
+            return true;
+        }
+        if (pitch == rowBytes) {
+            memcpy(dst, data, rowBytes * height);
+            return true;
         }
-        switch (pixelFormat) {
-            case RETRO_PIXEL_FORMAT_XRGB8888:
-                convertXRGB8888ToRGBA8888(data, width, height, buffer_);
-                break;
-            case RETRO_PIXEL_FORMAT_RGB565:
-                convertRGB565ToRGBA8888(data, width, height, buffer_);
-                break;
-            case RETRO_PIXEL_FORMAT_0RGB1555:
-                convert0RGB1555ToRGBA8888(data, width, height, buffer_);
-                break;
+        const auto *src = (const unsigned char *) data;
+        for (unsigned int y = 0; y < height; y++) {
+            memcpy(dst + y * rowBytes, src + y * pitch, rowBytes);
+        }
+        return true;
+    }
+
+    bool GLTextureObject::uploadWithPixelBuffer(const void *data, unsigned int width, unsigned int height, size_t pitch) {
+        unsigned int index = pbo_index_;
+        pbo_index_ = (pbo_index_ + 1) % kPBOCount;
+
+        //等待上一次使用这个PBO的上传完成, 环里有3个缓冲, 正常情况下不会等待
+        auto fence = (GLsync) pbo_fences_[index];
+        if (fence) {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED) {
+                pbo_waits_->fetch_add(1, std::memory_order_relaxed);
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100 * 1000 * 1000);
+            }
+            glDeleteSync(fence);
+            pbo_fences_[index] = nullptr;
+            if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED) {
+                LOGW_TB("wait pixel buffer fence failed: 0x%x", result);
+                return false;
+            }
+        }
+
+        size_t rowBytes = (size_t) width * bytes_per_pixel_;
+        //pitch 带填充时整块复制, 用 GL_UNPACK_ROW_LENGTH 跳过填充(PBO 只在 ES3 上使用, 一定支持), 最后一行不带填充
+        bool rowLength = upload_mode_ != kUploadConvert && pitch != rowBytes && pitch % bytes_per_pixel_ == 0;
+        size_t required = rowLength ? pitch * (height - 1) + rowBytes : rowBytes * height;
+        if (required > pbo_size_) {
+            createPixelBuffers(required);
+            if (!use_pbo_) return false;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos_[index]);
+        //fence 已经保证GPU不再读取, 不需要驱动再做同步
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) pbo_size_,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        bool written = true;
+        if (rowLength) {
+            memcpy(mapped, data, required);
+        } else {
+            written = writePixels(data, width, height, pitch, (unsigned char *) mapped, rowBytes);
+        }
+        //unmap 返回 false 时缓冲内容已损坏, 丢弃这一帧
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_TRUE || !written) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return written;
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textureId_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment(rowLength ? pitch : rowBytes));
+        if (rowLength) glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) (pitch / bytes_per_pixel_));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, gl_format_, gl_type_, nullptr);
+        if (rowLength) glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        pbo_fences_[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    void GLTextureObject::uploadFromClientMemory(const void *data, unsigned int width, unsigned int height, size_t pitch) {
+        const void *pixels = data;
+        size_t rowBytes = (size_t) width * bytes_per_pixel_;
+        GLint rowLength = 0;
+        //核心的pitch带有填充, 能用 GL_UNPACK_ROW_LENGTH 描述时直接上传, 否则写入 buffer_
+        if (upload_mode_ != kUploadConvert && pitch != rowBytes && unpack_row_length_ && pitch % bytes_per_pixel_ == 0) {
+            rowLength = (GLint) (pitch / bytes_per_pixel_);
+        } else if (upload_mode_ == kUploadConvert || pitch != rowBytes) {
+            if (!buffer_) {
+                buffer_ = new unsigned char[rowBytes * height];
+            }
+            if (!writePixels(data, width, height, pitch, buffer_, rowBytes)) {
+                return;
+            }
+            pixels = buffer_;
+            pitch = rowBytes;
         }
 
         glActiveTexture(GL_TEXTURE0);
 
         glBindTexture(GL_TEXTURE_2D, textureId_);
 
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment(pitch));
+        if (rowLength) glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, rowLength);
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, gl_format_, gl_type_, pixels);
+
+        if (rowLength) glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
         glBindTexture(GL_TEXTURE_2D, 0);
+    }
 
+    void GLTextureObject::WriteTextureData(const void *data, unsigned int width, unsigned int height, size_t pitch) {
+        if (width != this->texture_width_ || height != this->texture_height_) {
+            LOGW("[VIDEO] texture size changed: %d, width:%u, height:%u", textureId_, width, height);
+            return;
+        }
+        int64_t start = Statistics::NowMicros();
+        if (!use_pbo_ || !uploadWithPixelBuffer(data, width, height, pitch)) {
+            uploadFromClientMemory(data, width, height, pitch);
+        }
+        upload_time_->Record(Statistics::NowMicros() - start);
     }
 
     void GLTextureObject::Destroy() {
+        destroyPixelBuffers();
         if (buffer_) {
             delete[] buffer_;
             buffer_ = nullptr;
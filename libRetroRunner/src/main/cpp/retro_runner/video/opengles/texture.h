@@ -5,17 +5,30 @@
 #ifndef _TEXTURE_H
 #define _TEXTURE_H
 
+#include <stddef.h>
+#include <atomic>
 
 namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /**
+     * game texture for software rendering.
+     * RGB565 and XRGB8888 are uploaded in the core's native format, swizzle and alpha are fixed by
+     * the first shader pass(see NeedSwapRedBlue/NeedForceOpaque), other formats are converted on cpu.
+     * On GLES3 frames are written into a ring of pixel buffer objects and uploaded asynchronously.
+     */
     class GLTextureObject {
     public :
+        static constexpr unsigned kPBOCount = 3;
+
         GLTextureObject() = default;
 
         ~GLTextureObject();
 
-        void Create(unsigned int width, unsigned int height);
+        void Create(unsigned int width, unsigned int height, int pixelFormat);
 
-        void WriteTextureData(const void *data, unsigned int width, unsigned int height, int pixelFormat);
+        /* pitch: bytes between rows of data */
+        void WriteTextureData(const void *data, unsigned int width, unsigned int height, size_t pitch);
 
         void Destroy();
 
@@ -32,11 +45,62 @@ namespace libRetroRunner {
             return texture_height_;
         }
 
+        inline int GetPixelFormat() {
+            return pixel_format_;
+        }
+
+        /* texture holds BGRX bytes as RGBA, shader should sample .bgr */
+        inline bool NeedSwapRedBlue() {
+            return upload_mode_ == kUploadRawXRGB8888;
+        }
+
+        /* alpha channel of texture is undefined(X of XRGB8888), shader should output 1.0 */
+        inline bool NeedForceOpaque() {
+            return upload_mode_ == kUploadRawXRGB8888 || upload_mode_ == kUploadBGRA8888;
+        }
+
+    private:
+        enum UploadMode {
+            kUploadConvert,         //cpu转换为 RGBA8888
+            kUploadRGB565,          //GL_RGB + GL_UNSIGNED_SHORT_5_6_5
+            kUploadBGRA8888,        //GL_BGRA_EXT, 需要 GL_EXT_texture_format_BGRA8888
+            kUploadRawXRGB8888,     //按 GL_RGBA 上传, shader 交换 r/b
+        };
+
+        /* write the frame into dst with rowBytes per row, converting if needed */
+        bool writePixels(const void *data, unsigned int width, unsigned int height, size_t pitch, unsigned char *dst, size_t rowBytes);
+
+        /* size: bytes of each buffer, grown when the core pitch needs more than width * bytes_per_pixel_ */
+        void createPixelBuffers(size_t size);
+
+        void destroyPixelBuffers();
+
+        /* GLES3: write to the next PBO of the ring and upload from it, return false to fall back to client memory */
+        bool uploadWithPixelBuffer(const void *data, unsigned int width, unsigned int height, size_t pitch);
+
+        void uploadFromClientMemory(const void *data, unsigned int width, unsigned int height, size_t pitch);
+
     private:
         unsigned int texture_width_ = 0;
         unsigned int texture_height_ = 0;
+        int pixel_format_ = 0;
+        UploadMode upload_mode_ = kUploadConvert;
+        unsigned int bytes_per_pixel_ = 4;
+        unsigned int gl_format_ = 0;
+        unsigned int gl_type_ = 0;
+        bool unpack_row_length_ = false;    //ES3 或 GL_EXT_unpack_subimage
         unsigned char *buffer_ = nullptr;
         unsigned int textureId_ = 0;
+
+        /* pixel buffer ring, each with a fence of the upload that last read it */
+        bool use_pbo_ = false;
+        unsigned int pbos_[kPBOCount] = {0};
+        void *pbo_fences_[kPBOCount] = {nullptr};   //GLsync
+        unsigned int pbo_index_ = 0;
+        size_t pbo_size_ = 0;
+
+        std::atomic<int64_t> *pbo_waits_ = nullptr;
+        LatencyHistogram *upload_time_ = nullptr;
     };
 
 
@@ -3,6 +3,8 @@
 //
 
 #include <unistd.h>
+#include <string.h>
+#include <algorithm>
 
 #include <android/native_window_jni.h>
 #include <android/native_window.h>
@@ -18,6 +20,8 @@
 #include "../../app/environment.h"
 #include "../../app/setting.h"
 #include "../../types/retro_types.h"
+#include "../pixel_converter.h"
+#include "../../app/statistics.h"
 
 #define LOGD_GLVIDEO(...) LOGD("[VIDEO] " __VA_ARGS__)
 #define LOGW_GLVIDEO(...) LOGW("[VIDEO] " __VA_ARGS__)
@@ -63,6 +67,18 @@ namespace libRetroRunner {
 
 #endif
 
+    static bool hasGLExtension(const char *name) {
+        const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+        return extensions && strstr(extensions, name) != nullptr;
+    }
+
+    static void clearFrameBuffer(GLFrameBufferObject *frameBuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->GetFrameBuffer());
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
 }
 
 namespace libRetroRunner {
@@ -81,6 +97,9 @@ namespace libRetroRunner {
         egl_display_ = EGL_NO_DISPLAY;
         egl_surface_ = EGL_NO_SURFACE;
         egl_context_ = EGL_NO_CONTEXT;
+        gpu_wait_time_ = &Statistics::Current()->GetHistogram("video.gpu_wait_time");
+        swap_time_ = &Statistics::Current()->GetHistogram("video.swap_time");
+        frame_interval_ = &Statistics::Current()->GetHistogram("video.frame_interval");
     }
 
     GLESVideoContext::~GLESVideoContext() {
@@ -99,8 +118,16 @@ namespace libRetroRunner {
             pass->Destroy();
         }
         passes_.erase(passes_.begin(), passes_.end());
+        history_buffers_.clear();
+        history_textures_.clear();
+        history_depth_ = 0;
+        preset_pass_count_ = 0;
+        screen_pass_ = nullptr;
+        semantics_ = GLPassSemantics();
+        frame_buffer_pool_.Trim();
 
         if (egl_display_ != EGL_NO_DISPLAY) {
+            destroyFrameFences();
 
             if (egl_surface_ != EGL_NO_SURFACE) {
                 //LOGW("eglDestroySurface.");
@@ -128,27 +155,45 @@ namespace libRetroRunner {
                 LOGE_GLVIDEO("egl Initialize failed.%d", eglGetError());
                 return false;
             }
-            //2:EGL_OPENGL_ES2_BIT   3:EGL_OPENGL_ES3_BIT_KHR
-            const EGLint atrrs[] = {
-                    EGL_ALPHA_SIZE, 8,
-                    EGL_RED_SIZE, 8,
-                    EGL_BLUE_SIZE, 8,
-                    EGL_GREEN_SIZE, 8,
-                    EGL_DEPTH_SIZE, 16,
-                    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-                    EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-                    EGL_NONE
-            };
-            //opengl es2: EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-            EGLint numOfEglConfig;
-            if (eglChooseConfig(egl_display_, atrrs, &egl_config_, 1, &numOfEglConfig) != EGL_TRUE) {
-                LOGE_GLVIDEO("egl choose config failed.%d,", eglGetError());
-                return false;
+            const char *eglExtensions = eglQueryString(egl_display_, EGL_EXTENSIONS);
+            if (eglExtensions && strstr(eglExtensions, "EGL_KHR_fence_sync")) {
+                egl_create_sync_ = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+                egl_client_wait_sync_ = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+                egl_destroy_sync_ = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+            }
+            if (!egl_create_sync_ || !egl_client_wait_sync_ || !egl_destroy_sync_) {
+                LOGW_GLVIDEO("EGL_KHR_fence_sync not supported, use glFinish for frame latency control.");
+                egl_create_sync_ = nullptr;
             }
+            //优先使用 ES3 (PBO 异步上传等), 不支持时回退到 ES2, ES3 上下文兼容 ES2 核心
+            egl_context_ = EGL_NO_CONTEXT;
+            for (EGLint version = 3; version >= 2 && egl_context_ == EGL_NO_CONTEXT; version--) {
+                //2:EGL_OPENGL_ES2_BIT   3:EGL_OPENGL_ES3_BIT_KHR
+                const EGLint atrrs[] = {
+                        EGL_ALPHA_SIZE, 8,
+                        EGL_RED_SIZE, 8,
+                        EGL_BLUE_SIZE, 8,
+                        EGL_GREEN_SIZE, 8,
+                        EGL_DEPTH_SIZE, 16,
+                        EGL_RENDERABLE_TYPE, version == 3 ? EGL_OPENGL_ES3_BIT_KHR : EGL_OPENGL_ES2_BIT,
+                        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+                        EGL_NONE
+                };
+                EGLint numOfEglConfig = 0;
+                if (eglChooseConfig(egl_display_, atrrs, &egl_config_, 1, &numOfEglConfig) != EGL_TRUE || numOfEglConfig == 0) {
+                    LOGW_GLVIDEO("egl choose config for es%d failed.%d,", version, eglGetError());
+                    continue;
+                }
 
-            EGLint attributes[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
-            egl_context_ = eglCreateContext(egl_display_, egl_config_, nullptr, attributes);
-            if (!egl_context_) {
+                EGLint attributes[] = {EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE};
+                egl_context_ = eglCreateContext(egl_display_, egl_config_, nullptr, attributes);
+                if (egl_context_ == EGL_NO_CONTEXT) {
+                    LOGW_GLVIDEO("eglCreateContext for es%d failed.%d", version, eglGetError());
+                } else {
+                    gles_version_ = version;
+                }
+            }
+            if (egl_context_ == EGL_NO_CONTEXT) {
                 LOGE_GLVIDEO("eglCreateContext failed.");
                 return false;
             }
@@ -156,7 +201,7 @@ namespace libRetroRunner {
                 LOGE_GLVIDEO("egl get config attrib failed.");
                 return false;
             }
-            LOGI_GLVIDEO("egl initialized.");
+            LOGI_GLVIDEO("egl initialized, gles version: %d.", gles_version_);
             egl_initialized_ = true;
         }
 
@@ -183,6 +228,7 @@ namespace libRetroRunner {
             return false;
         }
         LOGD_GLVIDEO("eglMakeCurrent %p,  thread: %d", egl_surface_, gettid());
+        swap_interval_ = -1;
         GL_CHECK("GLESVideoContext::Init 0");
 #if defined(HAVE_GLES3) && (ENABLE_GL_DEBUG)
         initializeGLESLogCallbackIfNeeded();
@@ -196,6 +242,7 @@ namespace libRetroRunner {
         is_hardware_accelerated_ = coreCtx->GetRenderUseHardwareAcceleration();
 
         createPassChain();
+        resetFrameDedupe();
         if (is_hardware_accelerated_) {
             retro_hw_context_reset_t reset_func = coreCtx->GetRenderHWContextResetCallback();
             if (reset_func) reset_func();
@@ -211,6 +258,7 @@ namespace libRetroRunner {
         is_ready_ = false;
         enabled_ = false;
         surface_id_ = 0;
+        resetFrameDedupe();
 
         auto appContext = AppContext::Current();
         auto coreCtx = appContext->GetCoreRuntimeContext();
@@ -219,6 +267,7 @@ namespace libRetroRunner {
             retro_hw_context_reset_t destroy_func = coreCtx->GetRenderHWContextDestroyCallback();
             if (destroy_func) destroy_func();
         }
+        destroyFrameFences();
         egl_surface_ = EGL_NO_SURFACE;
         eglMakeCurrent(egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 
@@ -231,6 +280,8 @@ namespace libRetroRunner {
     void GLESVideoContext::UpdateVideoSize(unsigned width, unsigned height) {
         screen_width_ = width;
         screen_height_ = height;
+        //按屏幕尺寸缩放的 pass 需要在下一帧前重新分配 framebuffer
+        if (viewport_scaled_) frame_buffers_dirty_ = true;
         LOGD_GLVIDEO("screen size changed: %d x %d", width, height);
     }
 
@@ -243,52 +294,116 @@ namespace libRetroRunner {
          * when core use hardware renderer, data will be null for frame may not render complete.
          *      or RETRO_HW_FRAME_BUFFER_VALID for frame render complete.
          */
-        if (data != nullptr) {
-            if (data != RETRO_HW_FRAME_BUFFER_VALID) {
-                auto appContext = AppContext::Current();
-                // create a texture buffer at  right size
-                if (software_render_tex_ == nullptr || software_render_tex_->GetWidth() != width || software_render_tex_->GetHeight() != height) {
-                    software_render_tex_ = std::make_unique<GLTextureObject>();
-                    software_render_tex_->Create(width, height);
+        if (data == nullptr) {
+            //核心重复上一帧(GET_CAN_DUPE), 直接把上一次pass链的输出重新显示到屏幕
+            dupe_frames_->fetch_add(1, std::memory_order_relaxed);
+            if (has_last_output_) drawFrame(false);
+            return;
+        }
+        if (data != RETRO_HW_FRAME_BUFFER_VALID) {
+            // create a texture buffer at  right size
+            if (software_render_tex_ == nullptr || software_render_tex_->GetWidth() != width || software_render_tex_->GetHeight() != height
+                || software_render_tex_->GetPixelFormat() != core_pixel_format_) {
+                software_render_tex_ = std::make_unique<GLTextureObject>();
+                software_render_tex_->Create(width, height, core_pixel_format_);
+                //尺寸或像素格式变了, 旧的 hash 对应的是另一种格式的数据
+                resetFrameDedupe();
+            }
+            //核心报告的 max_width/max_height 比实际帧小, 按实际帧重新分配
+            if (width > passes_[0]->GetWidth() || height > passes_[0]->GetHeight()) {
+                input_max_width_ = std::max(width, input_max_width_);
+                input_max_height_ = std::max(height, input_max_height_);
+                LOGW_GLVIDEO("frame %u x %u is larger than the framebuffer, reallocate.", width, height);
+                if (!allocatePassFrameBuffers()) {
+                    destroyPresetPasses();
+                    allocatePassFrameBuffers();
                 }
-                //render the data to our game texture, then use it as a texture for the first pass.
-                software_render_tex_->WriteTextureData(data, width, height, core_pixel_format_);
-                passes_[0]->FillTexture(software_render_tex_->GetTexture());
             }
-            DrawFrame();
+            if (Setting::Current()->UseVideoFrameDedupe()) {
+                uint64_t hash = HashFrame(data, (size_t) width * GetPixelFormatBytes(core_pixel_format_), height, pitch);
+                if (has_last_output_ && hash == last_frame_hash_) {
+                    unchanged_frames_->fetch_add(1, std::memory_order_relaxed);
+                    drawFrame(false);
+                    return;
+                }
+                last_frame_hash_ = hash;
+            } else {
+                //关闭后不再更新 hash, 之后重新打开时不能和过期的 hash 比较
+                resetFrameDedupe();
+            }
+            //render the data to our game texture, then use it as a texture for the first pass.
+            software_render_tex_->WriteTextureData(data, width, height, pitch);
+            passes_[0]->SetInputSwizzle(software_render_tex_->NeedSwapRedBlue(), software_render_tex_->NeedForceOpaque());
+            passes_[0]->FillTexture(software_render_tex_->GetTexture(), width, height);
+        } else {
+            //硬件核心直接渲染到 pass 0 的 framebuffer, 有效区域为本帧的尺寸
+            passes_[0]->SetOutputSize(width, height);
         }
+        DrawFrame();
     }
 
     void GLESVideoContext::DrawFrame() {
+        drawFrame(true);
+    }
+
+    void GLESVideoContext::resetFrameDedupe() {
+        has_last_output_ = false;
+        last_frame_hash_ = 0;
+    }
+
+    void GLESVideoContext::drawFrame(bool runPasses) {
         if (!enabled_)return;
         if (screen_width_ == 0 || screen_height_ == 0) {
             LOGW_GLVIDEO("draw frame failed: screen_width_ or screen_height_ is 0.");
             return;
         }
         do {
-            /* we draw the passes_ in order, and fill the texture of the next pass with the texture of the previous pass.
-             * this is prepared for shader processing.
+            /* pass 0 holds the game frame, the preset passes render it in order,
+             * each pass samples the output of the previous one.
              */
-            std::vector<std::unique_ptr<GLShaderPass> >::iterator pass;
-            GLShaderPass *prePass = nullptr;
-            for (pass = passes_.begin(); pass != passes_.end(); pass++) {
-                if (prePass != nullptr) {
-                    (*pass)->FillTexture(prePass->GetTexture());
-                }
-                prePass = pass->get();
-            }
+            if (runPasses) runPassChain();
+            has_last_output_ = !passes_.empty();
 
             //check if we need to dump the frame to file
             if (!next_screenshot_store_path_.empty()) {
-                passes_.rbegin()->get()->DrawToFile(next_screenshot_store_path_);
+                GLShaderPass *output = outputPass();
+                if (output) output->DrawToFile(next_screenshot_store_path_);
                 next_screenshot_store_path_.clear();
             }
 
-            //draw the last pass to screen
-            if (!passes_.empty())
-                passes_.rbegin()->get()->DrawOnScreen(screen_width_, screen_height_);
-            glFinish();
+            //draw the output of the chain to screen, the last preset pass without scale draws to screen itself
+            if (screen_pass_) {
+                screen_pass_->RenderOnScreen(screen_source_, &semantics_, screen_width_, screen_height_);
+            } else if (!passes_.empty()) {
+                passes_[0]->RenderOnScreen(screen_source_, nullptr, screen_width_, screen_height_);
+            }
+
+            auto setting = Setting::Current();
+            int swapInterval = setting->GetVideoSwapInterval();
+            if (swapInterval != swap_interval_) {
+                eglSwapInterval(egl_display_, swapInterval);
+                swap_interval_ = swapInterval;
+            }
+            //允许GPU落后CPU的帧数, 0: 等待这一帧完成后再交换(与原来的glFinish相同)
+            size_t framesInFlight = setting->GetVideoFramesInFlight();
+            if (egl_create_sync_) {
+                EGLSyncKHR fence = egl_create_sync_(egl_display_, EGL_SYNC_FENCE_KHR, nullptr);
+                if (fence != EGL_NO_SYNC_KHR) frame_fences_.push_back(fence);
+                if (framesInFlight == 0) waitFrameFences(0);
+            } else if (framesInFlight == 0) {
+                int64_t waitStart = Statistics::NowMicros();
+                glFinish();
+                gpu_wait_time_->Record(Statistics::NowMicros() - waitStart);
+            }
+
+            int64_t swapStart = Statistics::NowMicros();
             eglSwapBuffers(egl_display_, egl_surface_);
+            int64_t now = Statistics::NowMicros();
+            swap_time_->Record(now - swapStart);
+            if (last_present_time_ > 0) frame_interval_->Record(now - last_present_time_);
+            last_present_time_ = now;
+
+            waitFrameFences(framesInFlight);
 
             //reset opengl es context for hardware acceleration
             if (is_hardware_accelerated_) {
@@ -309,6 +424,29 @@ namespace libRetroRunner {
 
     }
 
+    void GLESVideoContext::waitFrameFences(size_t maxPending) {
+        if (frame_fences_.size() <= maxPending) return;
+        int64_t waitStart = Statistics::NowMicros();
+        while (frame_fences_.size() > maxPending) {
+            EGLSyncKHR fence = frame_fences_.front();
+            frame_fences_.pop_front();
+            EGLint result = egl_client_wait_sync_(egl_display_, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+            if (result == EGL_FALSE) {
+                LOGW_GLVIDEO("eglClientWaitSyncKHR failed: 0x%x", eglGetError());
+            }
+            egl_destroy_sync_(egl_display_, fence);
+        }
+        gpu_wait_time_->Record(Statistics::NowMicros() - waitStart);
+    }
+
+    void GLESVideoContext::destroyFrameFences() {
+        for (auto fence: frame_fences_) {
+            egl_destroy_sync_(egl_display_, fence);
+        }
+        frame_fences_.clear();
+        last_present_time_ = 0;
+    }
+
     unsigned int GLESVideoContext::GetCurrentFramebuffer() {
         if (passes_.empty()) {
             return 0;
@@ -324,40 +462,342 @@ namespace libRetroRunner {
                 if (passes_.empty()) {
                     createPassChain();
                 } else {
-                    auto coreCtx = AppContext::Current()->GetCoreRuntimeContext();
-                    auto setting = Setting::Current();
-                    std::unique_ptr<GLShaderPass> *pass = &passes_[0];
-                    (*pass)->CreateFrameBuffer(gameCtx->GetGeometryWidth(), gameCtx->GetGeometryHeight(), setting->GetVideoUseLinear(), coreCtx->GetRenderUseDepth(), coreCtx->GetRenderUseStencil());
+                    //framebuffer 按 max_width/max_height 分配, 只有放不下新的尺寸时才重新分配
+                    unsigned width = std::max(gameCtx->GetGeometryMaxWidth(), gameCtx->GetGeometryWidth());
+                    unsigned height = std::max(gameCtx->GetGeometryMaxHeight(), gameCtx->GetGeometryHeight());
+                    if (width > passes_[0]->GetWidth() || height > passes_[0]->GetHeight()) {
+                        frame_buffers_dirty_ = true;
+                    } else {
+                        passes_[0]->SetOutputSize(gameCtx->GetGeometryWidth(), gameCtx->GetGeometryHeight());
+                    }
                 }
                 gameCtx->SetGeometryChanged(false);
             }
         }
+        if (frame_buffers_dirty_ && !passes_.empty()) {
+            if (!allocatePassFrameBuffers()) {
+                LOGE_GLVIDEO("reallocate framebuffers of shader preset failed, use default shader.");
+                destroyPresetPasses();
+                allocatePassFrameBuffers();
+            }
+        }
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 
     void GLESVideoContext::createPassChain() {
         if (passes_.empty()) {
-            auto gameCtx = AppContext::Current()->GetGameRuntimeContext();
-            auto coreCtx = AppContext::Current()->GetCoreRuntimeContext();
             auto setting = Setting::Current();
 
             std::unique_ptr<GLShaderPass> pass = std::make_unique<GLShaderPass>(nullptr, nullptr);
             pass->SetPixelFormat(core_pixel_format_);
             pass->SetHardwareAccelerated(is_hardware_accelerated_);
-            pass->CreateFrameBuffer(gameCtx->GetGeometryWidth(), gameCtx->GetGeometryHeight(), setting->GetVideoUseLinear(), coreCtx->GetRenderUseDepth(), coreCtx->GetRenderUseStencil());
+            pass->SetSampler(setting->GetVideoUseLinear(), GL_CLAMP_TO_EDGE);
             passes_.push_back(std::move(pass));
+
+            const std::string &preset = setting->GetVideoShaderPreset();
+            if (!preset.empty() && !loadPresetPasses(preset)) {
+                LOGE_GLVIDEO("load shader preset failed, use default shader: %s", preset.c_str());
+            }
+            if (!allocatePassFrameBuffers()) {
+                LOGE_GLVIDEO("create framebuffers of shader preset failed, use default shader.");
+                destroyPresetPasses();
+                allocatePassFrameBuffers();
+            }
             LOGD_GLVIDEO("create pass chain, pass size: %zu", passes_.size());
         }
     }
 
+    bool GLESVideoContext::loadPresetPasses(const std::string &path) {
+        GLShaderPreset preset;
+        if (!preset.Load(path)) return false;
+
+        auto setting = Setting::Current();
+        const std::vector<GLShaderPassConfig> &configs = preset.GetPasses();
+        std::vector<std::string> aliases;
+        for (auto &config: configs) aliases.push_back(config.alias);
+
+        for (unsigned i = 0; i < configs.size(); i++) {
+            const GLShaderPassConfig &config = configs[i];
+            if (!config.enabled) continue;
+
+            std::string vertex = GLShaderPreset::BuildStageSource(config.source, true, gles_version_);
+            std::string fragment = GLShaderPreset::BuildStageSource(config.source, false, gles_version_);
+            std::unique_ptr<GLShaderPass> pass = std::make_unique<GLShaderPass>(vertex.c_str(), fragment.c_str());
+            if (!pass->IsValid()) {
+                LOGE_GLVIDEO("compile shader%u failed: %s", i, config.path.c_str());
+                destroyPresetPasses();
+                return false;
+            }
+            pass->SetPresetIndex((int) i);
+            pass->SetPixelFormat(core_pixel_format_);
+            pass->SetHardwareAccelerated(is_hardware_accelerated_);
+            pass->BindSemantics(i, aliases);
+
+            GLenum wrap = GL_CLAMP_TO_EDGE;
+            if (config.wrapMode == kWrapRepeat || config.wrapMode == kWrapMirroredRepeat) {
+                //ES2 中非 2 的幂的纹理只支持 clamp_to_edge
+                if (gles_version_ >= 3) {
+                    wrap = config.wrapMode == kWrapRepeat ? GL_REPEAT : GL_MIRRORED_REPEAT;
+                } else {
+                    LOGW_GLVIDEO("wrap mode of shader%u needs GLES3, use clamp_to_edge.", i);
+                }
+            }
+            bool linear = config.filterLinear < 0 ? setting->GetVideoUseLinear() : config.filterLinear == 1;
+            pass->SetSampler(linear, wrap);
+            pass->SetScale(config.hasScale, config.scaleTypeX, config.scaleTypeY, config.scaleX, config.scaleY);
+            pass->SetFrameCountMod(config.frameCountMod);
+
+            GLFrameBufferFormat format = kFrameBufferRGBA8;
+            if (config.floatFramebuffer) {
+                if (gles_version_ >= 3 && (hasGLExtension("GL_EXT_color_buffer_half_float") || hasGLExtension("GL_EXT_color_buffer_float"))) {
+                    format = kFrameBufferRGBA16F;
+                } else {
+                    LOGW_GLVIDEO("float framebuffer of shader%u is not supported, use RGBA8.", i);
+                }
+            } else if (config.srgbFramebuffer) {
+                if (gles_version_ >= 3) {
+                    format = kFrameBufferSRGB8A8;
+                } else {
+                    LOGW_GLVIDEO("srgb framebuffer of shader%u needs GLES3, use RGBA8.", i);
+                }
+            }
+            pass->SetFrameBufferFormat(format);
+
+            history_depth_ = std::max(history_depth_, pass->GetHistoryDepth());
+            passes_.push_back(std::move(pass));
+        }
+        preset_pass_count_ = (unsigned) configs.size();
+
+        //被某个 pass 作为 PassFeedback 采样的 pass 需要保留上一帧的输出
+        for (size_t i = 1; i < passes_.size(); i++) {
+            unsigned index = (unsigned) passes_[i]->GetPresetIndex();
+            for (size_t j = 1; j < passes_.size(); j++) {
+                if (passes_[j]->UsesFeedback(index)) {
+                    passes_[i]->SetNeedFeedback(true);
+                    break;
+                }
+            }
+        }
+        semantics_.passes.assign(preset_pass_count_, GLPassTexture());
+        semantics_.feedback.assign(preset_pass_count_, GLPassTexture());
+        semantics_.history.assign(history_depth_, GLPassTexture());
+        LOGD_GLVIDEO("shader preset loaded: %s, %u passes, %zu enabled, history: %u", path.c_str(), preset_pass_count_, passes_.size() - 1, history_depth_);
+        return true;
+    }
+
+    void GLESVideoContext::destroyPresetPasses() {
+        while (passes_.size() > 1) {
+            std::unique_ptr<GLShaderPass> &pass = passes_.back();
+            frame_buffer_pool_.Release(pass->ReleaseFrameBuffer());
+            frame_buffer_pool_.Release(pass->ReleaseFeedbackBuffer());
+            pass->Destroy();
+            passes_.pop_back();
+        }
+        for (auto &frameBuffer: history_buffers_) {
+            frame_buffer_pool_.Release(std::move(frameBuffer));
+        }
+        history_buffers_.clear();
+        history_textures_.clear();
+        history_depth_ = 0;
+        history_pending_ = false;
+        preset_pass_count_ = 0;
+        screen_pass_ = nullptr;
+        viewport_scaled_ = false;
+        semantics_ = GLPassSemantics();
+    }
+
+    bool GLESVideoContext::allocatePassFrameBuffers() {
+        auto gameCtx = AppContext::Current()->GetGameRuntimeContext();
+        auto coreCtx = AppContext::Current()->GetCoreRuntimeContext();
+        unsigned width = std::max({gameCtx->GetGeometryMaxWidth(), gameCtx->GetGeometryWidth(), input_max_width_, 1u});
+        unsigned height = std::max({gameCtx->GetGeometryMaxHeight(), gameCtx->GetGeometryHeight(), input_max_height_, 1u});
+        bool depth = coreCtx->GetRenderUseDepth();
+        bool stencil = coreCtx->GetRenderUseStencil();
+
+        frame_buffers_dirty_ = false;
+        viewport_scaled_ = false;
+        screen_pass_ = nullptr;
+        has_last_output_ = false;
+
+        //pass 0 的 framebuffer 尺寸不变时保留, 硬件核心可能缓存了它的 id
+        GLShaderPass *input = passes_[0].get();
+        std::unique_ptr<GLFrameBufferObject> inputBuffer = input->ReleaseFrameBuffer();
+        GLFrameBufferObject *current = inputBuffer.get();
+        if (current == nullptr || current->GetWidth() != width || current->GetHeight() != height ||
+            current->HasDepth() != depth || current->HasStencil() != (depth && stencil)) {
+            frame_buffer_pool_.Release(std::move(inputBuffer));
+        }
+        //其余 framebuffer 全部放回池中, 尺寸和格式相同的会被重新取出
+        for (size_t i = 1; i < passes_.size(); i++) {
+            frame_buffer_pool_.Release(passes_[i]->ReleaseFrameBuffer());
+            frame_buffer_pool_.Release(passes_[i]->ReleaseFeedbackBuffer());
+        }
+        for (auto &frameBuffer: history_buffers_) {
+            frame_buffer_pool_.Release(std::move(frameBuffer));
+        }
+        history_buffers_.clear();
+        history_textures_.clear();
+        history_head_ = 0;
+        history_pending_ = false;
+
+        if (!inputBuffer) {
+            inputBuffer = frame_buffer_pool_.Acquire(width, height, kFrameBufferRGBA8, depth, depth && stencil);
+            if (inputBuffer) {
+                clearFrameBuffer(inputBuffer.get());
+            } else {
+                LOGE_GLVIDEO("create framebuffer of pass 0 failed: %u x %u", width, height);
+            }
+        }
+        input->SetFrameBuffer(std::move(inputBuffer));
+        input->SetOutputSize(gameCtx->GetGeometryWidth(), gameCtx->GetGeometryHeight());
+
+        //按各 pass 可能输出的最大尺寸分配, 游戏分辨率变化时不需要重新分配
+        bool ok = true;
+        unsigned sourceWidth = width;
+        unsigned sourceHeight = height;
+        for (size_t i = 1; i < passes_.size() && ok; i++) {
+            GLShaderPass *pass = passes_[i].get();
+            if (i == passes_.size() - 1 && !pass->HasScale() && !pass->NeedFeedback()) {
+                screen_pass_ = pass;
+                break;
+            }
+            unsigned passWidth, passHeight;
+            pass->ComputeOutputSize(sourceWidth, sourceHeight, screen_width_, screen_height_, &passWidth, &passHeight);
+            viewport_scaled_ = viewport_scaled_ || pass->IsViewportScaled();
+
+            std::unique_ptr<GLFrameBufferObject> frameBuffer = frame_buffer_pool_.Acquire(passWidth, passHeight, pass->GetFrameBufferFormat(), false, false);
+            if (!frameBuffer && pass->GetFrameBufferFormat() != kFrameBufferRGBA8) {
+                LOGW_GLVIDEO("framebuffer format %d of shader%d is not supported, use RGBA8.", pass->GetFrameBufferFormat(), pass->GetPresetIndex());
+                pass->SetFrameBufferFormat(kFrameBufferRGBA8);
+                frameBuffer = frame_buffer_pool_.Acquire(passWidth, passHeight, kFrameBufferRGBA8, false, false);
+            }
+            if (!frameBuffer) {
+                LOGE_GLVIDEO("create framebuffer of shader%d failed: %u x %u", pass->GetPresetIndex(), passWidth, passHeight);
+                ok = false;
+                break;
+            }
+            clearFrameBuffer(frameBuffer.get());
+            pass->SetFrameBuffer(std::move(frameBuffer));
+
+            if (pass->NeedFeedback()) {
+                std::unique_ptr<GLFrameBufferObject> feedback = frame_buffer_pool_.Acquire(passWidth, passHeight, pass->GetFrameBufferFormat(), false, false);
+                if (!feedback) {
+                    LOGE_GLVIDEO("create feedback framebuffer of shader%d failed: %u x %u", pass->GetPresetIndex(), passWidth, passHeight);
+                    ok = false;
+                    break;
+                }
+                clearFrameBuffer(feedback.get());
+                pass->SetFeedbackBuffer(std::move(feedback));
+            }
+            sourceWidth = passWidth;
+            sourceHeight = passHeight;
+        }
+
+        //history_depth_ 帧历史, 多一个用于写入本帧
+        for (unsigned i = 0; ok && history_depth_ > 0 && i <= history_depth_; i++) {
+            std::unique_ptr<GLFrameBufferObject> frameBuffer = frame_buffer_pool_.Acquire(width, height, kFrameBufferRGBA8, false, false);
+            if (!frameBuffer) {
+                LOGE_GLVIDEO("create history framebuffer failed: %u x %u", width, height);
+                ok = false;
+                break;
+            }
+            clearFrameBuffer(frameBuffer.get());
+            GLPassTexture texture;
+            texture.texture = frameBuffer->GetTexture();
+            texture.width = texture.textureWidth = width;
+            texture.height = texture.textureHeight = height;
+            history_textures_.push_back(texture);
+            history_buffers_.push_back(std::move(frameBuffer));
+        }
+
+        frame_buffer_pool_.Trim();
+        LOGD_GLVIDEO("pass framebuffers allocated: %u x %u, passes: %zu, history: %u, draw screen by preset: %d", width, height,
+                     passes_.size(), history_depth_, screen_pass_ != nullptr);
+        return ok;
+    }
+
+    void GLESVideoContext::runPassChain() {
+        if (passes_.empty()) return;
+        GLShaderPass *input = passes_[0].get();
+        semantics_.original = input->GetOutput();
+        semantics_.frameCount = frame_count_++;
+
+        if (history_depth_ > 0 && !history_textures_.empty()) {
+            //上一帧的 original 写在 history_head_, 到下一次运行时才前移, 重复帧不改变历史
+            size_t count = history_textures_.size();
+            if (history_pending_) {
+                history_head_ = (unsigned) ((history_head_ + 1) % count);
+                history_pending_ = false;
+            }
+            for (unsigned i = 0; i < history_depth_; i++) {
+                semantics_.history[i] = history_textures_[(history_head_ + count - 1 - i) % count];
+            }
+        }
+        for (size_t i = 1; i < passes_.size(); i++) {
+            GLShaderPass *pass = passes_[i].get();
+            if (pass->NeedFeedback()) {
+                pass->SwapFeedback();
+                semantics_.feedback[pass->GetPresetIndex()] = pass->GetFeedback();
+            }
+        }
+
+        GLPassTexture source = semantics_.original;
+        size_t next = 1;
+        for (unsigned index = 0; index < preset_pass_count_; index++) {
+            GLShaderPass *pass = nullptr;
+            if (next < passes_.size() && passes_[next]->GetPresetIndex() == (int) index) {
+                pass = passes_[next++].get();
+            }
+            if (pass != nullptr && pass == screen_pass_) break;
+            //禁用的 pass 输出等于输入
+            if (pass != nullptr) {
+                unsigned width, height;
+                pass->ComputeOutputSize(source.width, source.height, screen_width_, screen_height_, &width, &height);
+                pass->SetOutputSize(width, height);
+                pass->Render(source, &semantics_);
+                source = pass->GetOutput();
+            }
+            semantics_.passes[index] = source;
+        }
+        screen_source_ = source;
+
+        if (history_depth_ > 0 && !history_buffers_.empty()) {
+            input->CopyTo(semantics_.original, history_buffers_[history_head_].get());
+            history_textures_[history_head_].width = semantics_.original.width;
+            history_textures_[history_head_].height = semantics_.original.height;
+            history_pending_ = true;
+        }
+    }
+
+    GLShaderPass *GLESVideoContext::outputPass() {
+        for (auto pass = passes_.rbegin(); pass != passes_.rend(); pass++) {
+            if ((*pass)->GetFrameBuffer() != 0) return pass->get();
+        }
+        return nullptr;
+    }
+
+    bool GLESVideoContext::LoadShaderPreset(const std::string &path) {
+        //pass 链还没有创建时, 在 Load 中按设置加载
+        if (passes_.empty()) return true;
+        destroyPresetPasses();
+        bool loaded = path.empty() || loadPresetPasses(path);
+        if (!allocatePassFrameBuffers()) {
+            LOGE_GLVIDEO("create framebuffers of shader preset failed, use default shader.");
+            destroyPresetPasses();
+            allocatePassFrameBuffers();
+            loaded = false;
+        }
+        return loaded;
+    }
+
     bool GLESVideoContext::TakeScreenshot(const std::string &path) {
-        if (passes_.empty() || !is_ready_ || !enabled_) {
+        GLShaderPass *output = outputPass();
+        if (output == nullptr || !is_ready_ || !enabled_) {
             LOGE_GLVIDEO("Can't write data to screenshot file since the video context is not valid.");
             return false;
         }
-        passes_.rbegin()->get()->DrawToFile(path);
+        output->DrawToFile(path);
         return true;
     }
 
-
 }
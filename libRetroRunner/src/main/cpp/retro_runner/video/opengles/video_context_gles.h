@@ -6,15 +6,17 @@
 #define _VIDEO_CONTEXT_GLES_H
 
 #include <vector>
+#include <deque>
 #include <memory>
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include "../video_context.h"
 #include "shader_pass.h"
 #include "texture.h"
 
 namespace libRetroRunner {
-
+    class LatencyHistogram;
 
     class GLESVideoContext : public VideoContext {
 
@@ -43,11 +45,44 @@ namespace libRetroRunner {
 
         bool TakeScreenshot(const std::string &path) override;
 
+        bool LoadShaderPreset(const std::string &path) override;
+
 
     private:
 
+        /* pass 0 and the passes of the preset in setting, framebuffers are allocated */
         void createPassChain();
 
+        /* compile enabled passes of a preset and append them after pass 0 */
+        bool loadPresetPasses(const std::string &path);
+
+        /* remove passes of the preset, their framebuffers go back to the pool */
+        void destroyPresetPasses();
+
+        /**
+         * size framebuffers from the core's max geometry, the screen and the scale of each pass,
+         * framebuffers of the same size and format are taken from the pool.
+         * return false if a framebuffer of a preset pass can't be created.
+         */
+        bool allocatePassFrameBuffers();
+
+        /* run pass 0 output through the preset passes, sets screen_source_ */
+        void runPassChain();
+
+        /* the last pass rendering to a framebuffer, used for screenshots */
+        GLShaderPass *outputPass();
+
+        /* runPasses: false to present the last output of the pass chain again, used for duplicated frames */
+        void drawFrame(bool runPasses);
+
+        /* forget the last output and its hash, the next software frame is always uploaded */
+        void resetFrameDedupe();
+
+        /* wait until at most maxPending submitted frames are still running on GPU */
+        void waitFrameFences(size_t maxPending);
+
+        void destroyFrameFences();
+
     private:
         int screen_width_;
         int screen_height_;
@@ -70,20 +105,65 @@ namespace libRetroRunner {
          * game frame data is rendered into the [0] GLShaderPass, and then passes render
          * the framebuffer to the next, eg: [0] -> [1] -> [2] -> ...
          * at last, the end one of the passes will render the texture to screen.
+         * [0] uses the default shader, [1]... are the enabled passes of the shader preset.
          */
         std::vector<std::unique_ptr<GLShaderPass> > passes_ = std::vector<std::unique_ptr<GLShaderPass>>();
 
+        GLFrameBufferPool frame_buffer_pool_;
+        /* passes in the preset, including disabled ones */
+        unsigned preset_pass_count_ = 0;
+        /* the last preset pass when it has no scale and draws to screen directly, otherwise null */
+        GLShaderPass *screen_pass_ = nullptr;
+        /* source of the pass drawing to screen, kept for presenting duplicated frames again */
+        GLPassTexture screen_source_;
+        GLPassSemantics semantics_;
+        unsigned frame_count_ = 0;
+        /* some pass is scaled to the viewport, framebuffers are resized with the screen */
+        bool viewport_scaled_ = false;
+        bool frame_buffers_dirty_ = false;
+
+        /* history of pass 0 output, history_depth_ + 1 framebuffers, the one at history_head_ is written after a frame */
+        std::vector<std::unique_ptr<GLFrameBufferObject>> history_buffers_;
+        std::vector<GLPassTexture> history_textures_;
+        unsigned history_depth_ = 0;
+        unsigned history_head_ = 0;
+        bool history_pending_ = false;
+
+        /* largest software frame received, framebuffers are at least this size when the core reports a smaller max geometry */
+        unsigned input_max_width_ = 0;
+        unsigned input_max_height_ = 0;
+
         EGLDisplay egl_display_;
         EGLSurface egl_surface_;
         EGLContext egl_context_;
         EGLConfig egl_config_;
         bool egl_initialized_;
         EGLint egl_format_;
+        /* client version of egl_context_, 3 or 2 */
+        EGLint gles_version_ = 2;
 
         bool is_ready_ = false;
 
         long surface_id_ = 0;
 
+        /* EGL_KHR_fence_sync, null when not supported, glFinish is used instead */
+        PFNEGLCREATESYNCKHRPROC egl_create_sync_ = nullptr;
+        PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync_ = nullptr;
+        PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync_ = nullptr;
+        /* fences of frames submitted to GPU, oldest first */
+        std::deque<EGLSyncKHR> frame_fences_;
+        /* swap interval applied to egl_surface_, -1 for not applied */
+        int swap_interval_ = -1;
+        int64_t last_present_time_ = 0;
+
+        LatencyHistogram *gpu_wait_time_;
+        LatencyHistogram *swap_time_;
+        LatencyHistogram *frame_interval_;
+
+        /* the pass chain holds a complete frame which can be presented again */
+        bool has_last_output_ = false;
+        uint64_t last_frame_hash_ = 0;
+
     };
 }
 #endif
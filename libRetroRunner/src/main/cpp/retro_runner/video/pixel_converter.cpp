@@ -0,0 +1,382 @@
+//
+// Created by Aidoo.TK on 2024/12/9.
+//
+
+#include "pixel_converter.h"
+#include <string.h>
+#include <libretro-common/include/libretro.h>
+#include <features/features_cpu.h>
+#include "../types/log.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RR_PIXEL_NEON 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RR_PIXEL_X86 1
+#define RR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace libRetroRunner {
+
+    /*----- scalar --------------------------------------------------------------*/
+
+    /* 5/6 bit 分量扩展到 8 bit 时复制高位, 0x1f 得到 0xff */
+    static inline uint32_t expand5(uint32_t value) { return (value << 3) | (value >> 2); }
+
+    static inline uint32_t expand6(uint32_t value) { return (value << 2) | (value >> 4); }
+
+    static void convertXRGB8888Scalar(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint32_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        for (unsigned int idx = 0; idx < width; idx++) {
+            uint32_t pixel = in[idx];
+            out[0] = pixel >> 16;
+            out[1] = pixel >> 8;
+            out[2] = pixel;
+            out[3] = 0xff;
+            out += 4;
+        }
+    }
+
+    static void convertRGB565Scalar(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        for (unsigned int idx = 0; idx < width; idx++) {
+            uint32_t pixel = in[idx];
+            out[0] = expand5(pixel >> 11);
+            out[1] = expand6((pixel >> 5) & 0x3f);
+            out[2] = expand5(pixel & 0x1f);
+            out[3] = 0xff;
+            out += 4;
+        }
+    }
+
+    static void convert0RGB1555Scalar(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        for (unsigned int idx = 0; idx < width; idx++) {
+            uint32_t pixel = in[idx];
+            out[0] = expand5((pixel >> 10) & 0x1f);
+            out[1] = expand5((pixel >> 5) & 0x1f);
+            out[2] = expand5(pixel & 0x1f);
+            out[3] = 0xff;
+            out += 4;
+        }
+    }
+
+#if defined(RR_PIXEL_NEON)
+
+    /*----- NEON --------------------------------------------------------------*/
+
+    static void convertXRGB8888Neon(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint8_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        unsigned int idx = 0;
+        for (; idx + 16 <= width; idx += 16) {
+            uint8x16x4_t pixels = vld4q_u8(in + idx * 4);   //B, G, R, X
+            uint8x16x4_t rgba;
+            rgba.val[0] = pixels.val[2];
+            rgba.val[1] = pixels.val[1];
+            rgba.val[2] = pixels.val[0];
+            rgba.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(out + idx * 4, rgba);
+        }
+        convertXRGB8888Scalar(in + idx * 4, out + idx * 4, width - idx);
+    }
+
+    static void convertRGB565Neon(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        unsigned int idx = 0;
+        for (; idx + 8 <= width; idx += 8) {
+            uint16x8_t pixels = vld1q_u16(in + idx);
+            //把分量移到高位取出, 再用 vsri 把高位复制到低位
+            uint8x8_t r = vshrn_n_u16(pixels, 8);
+            uint8x8_t g = vshrn_n_u16(vshlq_n_u16(pixels, 5), 8);
+            uint8x8_t b = vshrn_n_u16(vshlq_n_u16(pixels, 11), 8);
+            uint8x8x4_t rgba;
+            rgba.val[0] = vsri_n_u8(r, r, 5);
+            rgba.val[1] = vsri_n_u8(g, g, 6);
+            rgba.val[2] = vsri_n_u8(b, b, 5);
+            rgba.val[3] = vdup_n_u8(0xff);
+            vst4_u8(out + idx * 4, rgba);
+        }
+        convertRGB565Scalar(in + idx, out + idx * 4, width - idx);
+    }
+
+    static void convert0RGB1555Neon(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        unsigned int idx = 0;
+        for (; idx + 8 <= width; idx += 8) {
+            uint16x8_t pixels = vld1q_u16(in + idx);
+            uint8x8_t r = vshrn_n_u16(vshlq_n_u16(pixels, 1), 8);
+            uint8x8_t g = vshrn_n_u16(vshlq_n_u16(pixels, 6), 8);
+            uint8x8_t b = vshrn_n_u16(vshlq_n_u16(pixels, 11), 8);
+            uint8x8x4_t rgba;
+            rgba.val[0] = vsri_n_u8(r, r, 5);
+            rgba.val[1] = vsri_n_u8(g, g, 5);
+            rgba.val[2] = vsri_n_u8(b, b, 5);
+            rgba.val[3] = vdup_n_u8(0xff);
+            vst4_u8(out + idx * 4, rgba);
+        }
+        convert0RGB1555Scalar(in + idx, out + idx * 4, width - idx);
+    }
+
+#elif defined(RR_PIXEL_X86)
+
+    /*----- SSE2 --------------------------------------------------------------*/
+
+    static inline __m128i expand5SSE2(__m128i value) {
+        return _mm_or_si128(_mm_slli_epi16(value, 3), _mm_srli_epi16(value, 2));
+    }
+
+    /* r, g, b: 8 bit value in each 16 bit lane, stores 8 RGBA pixels */
+    static inline void storeRGBA8SSE2(uint8_t *out, __m128i r, __m128i g, __m128i b) {
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, _mm_set1_epi16((short) 0xff00));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    static void convertXRGB8888SSE2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint8_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m128i maskGreen = _mm_set1_epi32(0x0000ff00);
+        const __m128i maskRedBlue = _mm_set1_epi32(0x00ff00ff);
+        const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+        unsigned int idx = 0;
+        for (; idx + 4 <= width; idx += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + idx * 4));
+            __m128i ga = _mm_or_si128(_mm_and_si128(pixels, maskGreen), alpha);
+            //交换每个像素的两个16位, R 和 B 互换位置
+            __m128i rb = _mm_and_si128(pixels, maskRedBlue);
+            rb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + idx * 4), _mm_or_si128(ga, rb));
+        }
+        convertXRGB8888Scalar(in + idx * 4, out + idx * 4, width - idx);
+    }
+
+    static void convertRGB565SSE2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m128i mask5 = _mm_set1_epi16(0x1f);
+        const __m128i mask6 = _mm_set1_epi16(0x3f);
+        unsigned int idx = 0;
+        for (; idx + 8 <= width; idx += 8) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + idx));
+            __m128i r = expand5SSE2(_mm_srli_epi16(pixels, 11));
+            __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask6);
+            g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+            __m128i b = expand5SSE2(_mm_and_si128(pixels, mask5));
+            storeRGBA8SSE2(out + idx * 4, r, g, b);
+        }
+        convertRGB565Scalar(in + idx, out + idx * 4, width - idx);
+    }
+
+    static void convert0RGB1555SSE2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m128i mask5 = _mm_set1_epi16(0x1f);
+        unsigned int idx = 0;
+        for (; idx + 8 <= width; idx += 8) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + idx));
+            __m128i r = expand5SSE2(_mm_and_si128(_mm_srli_epi16(pixels, 10), mask5));
+            __m128i g = expand5SSE2(_mm_and_si128(_mm_srli_epi16(pixels, 5), mask5));
+            __m128i b = expand5SSE2(_mm_and_si128(pixels, mask5));
+            storeRGBA8SSE2(out + idx * 4, r, g, b);
+        }
+        convert0RGB1555Scalar(in + idx, out + idx * 4, width - idx);
+    }
+
+    /*----- AVX2 --------------------------------------------------------------*/
+
+    RR_TARGET_AVX2 static inline __m256i expand5AVX2(__m256i value) {
+        return _mm256_or_si256(_mm256_slli_epi16(value, 3), _mm256_srli_epi16(value, 2));
+    }
+
+    /* r, g, b: 8 bit value in each 16 bit lane, stores 16 RGBA pixels */
+    RR_TARGET_AVX2 static inline void storeRGBA8AVX2(uint8_t *out, __m256i r, __m256i g, __m256i b) {
+        __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+        __m256i ba = _mm256_or_si256(b, _mm256_set1_epi16((short) 0xff00));
+        //unpack 在每个128位内进行, lo: 0-3, 8-11  hi: 4-7, 12-15
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    RR_TARGET_AVX2 static void convertXRGB8888AVX2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint8_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+                                                 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+        const __m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+        unsigned int idx = 0;
+        for (; idx + 8 <= width; idx += 8) {
+            __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + idx * 4));
+            __m256i rgba = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + idx * 4), rgba);
+        }
+        convertXRGB8888SSE2(in + idx * 4, out + idx * 4, width - idx);
+    }
+
+    RR_TARGET_AVX2 static void convertRGB565AVX2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m256i mask5 = _mm256_set1_epi16(0x1f);
+        const __m256i mask6 = _mm256_set1_epi16(0x3f);
+        unsigned int idx = 0;
+        for (; idx + 16 <= width; idx += 16) {
+            __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + idx));
+            __m256i r = expand5AVX2(_mm256_srli_epi16(pixels, 11));
+            __m256i g = _mm256_and_si256(_mm256_srli_epi16(pixels, 5), mask6);
+            g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+            __m256i b = expand5AVX2(_mm256_and_si256(pixels, mask5));
+            storeRGBA8AVX2(out + idx * 4, r, g, b);
+        }
+        convertRGB565SSE2(in + idx, out + idx * 4, width - idx);
+    }
+
+    RR_TARGET_AVX2 static void convert0RGB1555AVX2(const void *src, void *dst, unsigned int width) {
+        auto in = static_cast<const uint16_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        const __m256i mask5 = _mm256_set1_epi16(0x1f);
+        unsigned int idx = 0;
+        for (; idx + 16 <= width; idx += 16) {
+            __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + idx));
+            __m256i r = expand5AVX2(_mm256_and_si256(_mm256_srli_epi16(pixels, 10), mask5));
+            __m256i g = expand5AVX2(_mm256_and_si256(_mm256_srli_epi16(pixels, 5), mask5));
+            __m256i b = expand5AVX2(_mm256_and_si256(pixels, mask5));
+            storeRGBA8AVX2(out + idx * 4, r, g, b);
+        }
+        convert0RGB1555SSE2(in + idx, out + idx * 4, width - idx);
+    }
+
+#endif
+
+    /*----- dispatch --------------------------------------------------------------*/
+
+    struct PixelConverters {
+        PixelRowConverter xrgb8888 = nullptr;
+        PixelRowConverter rgb565 = nullptr;
+        PixelRowConverter rgb1555 = nullptr;
+
+        PixelRowConverter get(int pixelFormat) const {
+            switch (pixelFormat) {
+                case RETRO_PIXEL_FORMAT_XRGB8888:
+                    return xrgb8888;
+                case RETRO_PIXEL_FORMAT_RGB565:
+                    return rgb565;
+                case RETRO_PIXEL_FORMAT_0RGB1555:
+                    return rgb1555;
+                default:
+                    return nullptr;
+            }
+        }
+    };
+
+    /* 当前 abi 编译了并且 cpu 支持的实现, 其余为空 */
+    struct PixelKernels {
+        PixelConverters kernels[kPixelKernelAVX2 + 1];
+        PixelKernel best = kPixelKernelScalar;
+
+        PixelKernels() {
+            uint64_t features = cpu_features_get();
+            (void) features;
+            kernels[kPixelKernelScalar] = {convertXRGB8888Scalar, convertRGB565Scalar, convert0RGB1555Scalar};
+#if defined(RR_PIXEL_NEON)
+#if !defined(__aarch64__)
+            //armv7 上 NEON 是可选的
+            if (features & RETRO_SIMD_NEON)
+#endif
+            {
+                kernels[kPixelKernelNeon] = {convertXRGB8888Neon, convertRGB565Neon, convert0RGB1555Neon};
+                best = kPixelKernelNeon;
+            }
+#elif defined(RR_PIXEL_X86)
+            if (features & RETRO_SIMD_SSE2) {
+                kernels[kPixelKernelSSE2] = {convertXRGB8888SSE2, convertRGB565SSE2, convert0RGB1555SSE2};
+                best = kPixelKernelSSE2;
+            }
+            if (features & RETRO_SIMD_AVX2) {
+                kernels[kPixelKernelAVX2] = {convertXRGB8888AVX2, convertRGB565AVX2, convert0RGB1555AVX2};
+                best = kPixelKernelAVX2;
+            }
+#endif
+            kernels[kPixelKernelAuto] = kernels[best];
+            static const char *names[] = {"auto", "scalar", "neon", "sse2", "avx2"};
+            LOGD("[VIDEO] pixel converter: %s", names[best]);
+        }
+    };
+
+    PixelRowConverter GetRGBA8888RowConverter(int pixelFormat, PixelKernel kernel) {
+        static const PixelKernels kernels;
+        if (kernel < kPixelKernelAuto || kernel > kPixelKernelAVX2) return nullptr;
+        return kernels.kernels[kernel].get(pixelFormat);
+    }
+
+    PixelRowConverter GetRGBA8888RowConverter(int pixelFormat) {
+        return GetRGBA8888RowConverter(pixelFormat, kPixelKernelAuto);
+    }
+
+    bool ConvertToRGBA8888(int pixelFormat, const void *src, unsigned int width, unsigned int height, size_t srcPitch, void *dst, size_t dstPitch) {
+        PixelRowConverter converter = GetRGBA8888RowConverter(pixelFormat);
+        if (converter == nullptr) return false;
+        auto in = static_cast<const uint8_t *>(src);
+        auto out = static_cast<uint8_t *>(dst);
+        for (unsigned int row = 0; row < height; row++) {
+            converter(in, out, width);
+            in += srcPitch;
+            out += dstPitch;
+        }
+        return true;
+    }
+
+    unsigned int GetPixelFormatBytes(int pixelFormat) {
+        return pixelFormat == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+    }
+
+    /* xxhash64 的 round, 4条独立的累加链可以充分利用乘法流水线 */
+    static const uint64_t kHashPrime1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t kHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+    static inline uint64_t hashRound(uint64_t acc, uint64_t value) {
+        acc += value * kHashPrime2;
+        acc = (acc << 31) | (acc >> 33);
+        return acc * kHashPrime1;
+    }
+
+    static inline uint64_t load64(const uint8_t *p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint64_t HashFrame(const void *src, size_t rowBytes, unsigned int height, size_t srcPitch) {
+        uint64_t a = kHashPrime1 + kHashPrime2, b = kHashPrime2, c = 0, d = 0 - kHashPrime1;
+        const auto *row = (const uint8_t *) src;
+        for (unsigned int y = 0; y < height; y++, row += srcPitch) {
+            size_t x = 0;
+            for (; x + 32 <= rowBytes; x += 32) {
+                a = hashRound(a, load64(row + x));
+                b = hashRound(b, load64(row + x + 8));
+                c = hashRound(c, load64(row + x + 16));
+                d = hashRound(d, load64(row + x + 24));
+            }
+            for (; x + 8 <= rowBytes; x += 8) {
+                a = hashRound(a, load64(row + x));
+            }
+            for (; x < rowBytes; x++) {
+                b = hashRound(b, row[x]);
+            }
+        }
+        uint64_t h = ((a << 1) | (a >> 63)) + ((b << 7) | (b >> 57)) + ((c << 12) | (c >> 52)) + ((d << 18) | (d >> 46));
+        h ^= (uint64_t) rowBytes * height;
+        h ^= h >> 33;
+        h *= kHashPrime2;
+        h ^= h >> 29;
+        return h;
+    }
+}
@@ -0,0 +1,55 @@
+//
+// Created by Aidoo.TK on 2024/12/9.
+//
+
+#ifndef _PIXEL_CONVERTER_H
+#define _PIXEL_CONVERTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace libRetroRunner {
+
+    /* convert one row of `width` pixels to RGBA8888 (bytes R, G, B, A in memory), alpha is always 0xff */
+    typedef void (*PixelRowConverter)(const void *src, void *dst, unsigned int width);
+
+    /* 行转换的实现, 所有实现的输出逐字节相同 */
+    enum PixelKernel {
+        kPixelKernelAuto = 0,       //按 cpu features 选择最快的
+        kPixelKernelScalar = 1,
+        kPixelKernelNeon = 2,
+        kPixelKernelSSE2 = 3,
+        kPixelKernelAVX2 = 4,
+    };
+
+    /**
+     * row converter for the core pixel format, NEON/SSE2/AVX2 is selected by cpu features at the first call.
+     * @return nullptr for unknown pixel format
+     */
+    PixelRowConverter GetRGBA8888RowConverter(int pixelFormat);
+
+    /**
+     * row converter of a specific kernel, used by tests and benchmarks to compare the kernels.
+     * @return nullptr for unknown pixel format, or when the kernel is not built for this abi or not supported by the cpu
+     */
+    PixelRowConverter GetRGBA8888RowConverter(int pixelFormat, PixelKernel kernel);
+
+    /**
+     * convert a frame from core pixel format to RGBA8888.
+     * @param srcPitch  bytes between rows of src, the pitch passed by retro_video_refresh
+     * @param dstPitch  bytes between rows of dst
+     */
+    bool ConvertToRGBA8888(int pixelFormat, const void *src, unsigned int width, unsigned int height, size_t srcPitch, void *dst, size_t dstPitch);
+
+    /* bytes per pixel of core pixel format */
+    unsigned int GetPixelFormatBytes(int pixelFormat);
+
+    /**
+     * 64bit hash of the visible pixels of a frame, padding bytes of each row are ignored.
+     * used to detect frames which are identical to the previous one.
+     * @param rowBytes  bytes of pixels in a row, width * GetPixelFormatBytes()
+     */
+    uint64_t HashFrame(const void *src, size_t rowBytes, unsigned int height, size_t srcPitch);
+}
+
+#endif
@@ -6,11 +6,14 @@
 #include "opengles/video_context_gles.h"
 #include "vulkan/video_context_vulkan.h"
 #include "../types/log.h"
+#include "../app/statistics.h"
 
 namespace libRetroRunner {
 
     VideoContext::VideoContext() {
         enabled_ = false;
+        dupe_frames_ = &Statistics::Current()->GetCounter("video.dupe_frames");
+        unchanged_frames_ = &Statistics::Current()->GetCounter("video.unchanged_frames");
     }
 
     VideoContext::~VideoContext() {}
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <atomic>
 #include <jni.h>
 
 #include <retro_runner/runtime_contexts/game_context.h>
@@ -47,6 +48,9 @@ namespace libRetroRunner {
         /* dump video frame into a file, may fail, this should run on emu thread. */
         virtual bool TakeScreenshot(const std::string &path) = 0;
 
+        /* apply a shader preset(.glslp/.glsl), empty path for none, only GLES supports presets, this should run on emu thread. */
+        virtual bool LoadShaderPreset(const std::string &path) { return false; }
+
         /** provide hardware render interface, return false if no interface .  */
         virtual bool getRetroHardwareRenderInterface(void **) { return false; };
 
@@ -62,6 +66,11 @@ namespace libRetroRunner {
         bool enabled_;
         std::string next_screenshot_store_path_;
         std::weak_ptr<GameRuntimeContext> game_runtime_ctx_;
+
+        /* frames core passed as NULL (RETRO_ENVIRONMENT_GET_CAN_DUPE) */
+        std::atomic<int64_t> *dupe_frames_;
+        /* software frames identical to the previous one, upload and passes are skipped */
+        std::atomic<int64_t> *unchanged_frames_;
     };
 }
 #endif
@@ -4,12 +4,11 @@
 
 #include "rr_draws.h"
 #include "rr_vulkan.h"
+#include "../pixel_converter.h"
 #include <libretro.h>
 
 namespace libRetroRunner {
 
-    extern void convertRGB565ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer);
-
     VulkanSamplerTexture::VulkanSamplerTexture(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex) {
         physicalDevice_ = physicalDevice;
         device_ = device;
@@ -18,7 +17,6 @@ namespace libRetroRunner {
 
     bool VulkanSamplerTexture::create(uint32_t width, uint32_t height, VkFormat format) {
         format_ = format;
-        convertBuffer = new unsigned char[width * height * 4];
 
         VkImageCreateInfo imageInfo{};
         {
@@ -120,11 +118,9 @@ namespace libRetroRunner {
         // 2. 更新 Staging Buffer 数据
         void *mappedData;
         vkMapMemory(device_, stagingBufferMemory, 0, imageSize, 0, &mappedData);
-        if (pixelFormat == RETRO_PIXEL_FORMAT_RGB565) {
-            convertRGB565ToRGBA8888(data, width, height, convertBuffer);
-            memcpy(mappedData, convertBuffer, (size_t) imageSize);
-        } else {
-            memcpy(mappedData, data, (size_t) imageSize);
+        //直接转换到 staging buffer, 不需要中间缓冲
+        if (!ConvertToRGBA8888(pixelFormat, data, width, height, pitch, mappedData, width * 4)) {
+            LOGE_VC("unsupported pixel format: %d", pixelFormat);
         }
         vkUnmapMemory(device_, stagingBufferMemory);
         // 3. 记录命令缓冲区
@@ -39,8 +39,6 @@ namespace libRetroRunner {
 
         VkImageLayout layout_;
         VkSampler sampler_{};
-
-        unsigned char *convertBuffer;
     };
 }
 #endif //LIBRETRORUNNER_RR_DRAWS_H
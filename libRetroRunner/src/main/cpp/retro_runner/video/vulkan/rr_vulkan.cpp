@@ -141,27 +141,4 @@ namespace VkUtil {
         }
         return false;
     }
-
-    void convertRGB565ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer) {
-        //LOGD_TB("convertRGB565ToRGBA8888: %d x %d", width, height);
-
-        const unsigned short *src = (const unsigned short *) data;
-        unsigned char *dst = buffer;
-        for (unsigned int heightIdx = 0; heightIdx < height; heightIdx++) {
-            for (unsigned int rowIdx = 0; rowIdx < width; rowIdx++) {
-                unsigned short pixel = src[heightIdx * width + rowIdx];
-                dst = buffer + (heightIdx * width + rowIdx) * 4;
-                //Red
-                *dst = ((pixel & 0xF800) >> 11) << 3;
-                dst++;
-                //Green
-                *dst = (((pixel & 0x7E0) >> 5) << 2);
-                dst++;
-                //Blue
-                *dst = (((pixel & 0x1F)) << 3);
-                dst++;
-                *dst = 0xFF;
-            }
-        }
-    }
 }
\ No newline at end of file
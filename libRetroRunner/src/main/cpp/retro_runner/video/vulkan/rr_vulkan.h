@@ -42,8 +42,6 @@ namespace VkUtil {
     void updateDescriptorSet(VkDevice logicalDevice, VkDescriptorSet descriptorSet, VkImageView imageView, VkSampler sampler);
 
     bool MapMemoryTypeToIndex(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
-
-    void convertRGB565ToRGBA8888(const void *data, unsigned int width, unsigned int height, unsigned char *buffer);
 }
 
 #endif
@@ -10,12 +10,15 @@
 #include <libretro.h>
 #include <libretro_vulkan.h>
 #include <dlfcn.h>
+#include <algorithm>
 
 #include "../../types/log.h"
 #include "../../app/app_context.h"
 #include "../../app/environment.h"
 #include "../../app/setting.h"
+#include "../../app/statistics.h"
 #include "../../types/retro_types.h"
+#include "../../utils/utils.h"
 
 #include "rr_vulkan_instance.h"
 #include "rr_vulkan_pipeline.h"
@@ -23,6 +26,7 @@
 #include "rr_draws.h"
 #include "vk_sampling_texture.h"
 #include "vk_read_write_buffer.h"
+#include "../pixel_converter.h"
 
 #include "shader_code_frag.h"
 #include "shader_code_vert.h"
@@ -40,7 +44,6 @@
 #define VK_BIT_TEST(flag, bit) (((flag) & (bit)) == (bit))
 #define VK_BIT_SET(flag, bit) ((flag) |= (bit))
 #define VK_BIT_CLEAR(flag, bit) ((flag) &= ~(bit))
-#define min(a, b) ((a) < (b) ? (a) : (b))
 
 
 extern rr_hardware_render_proc_address_t getHWProcAddress;
@@ -110,55 +113,50 @@ namespace libRetroRunner {
 /** hardware rendering interface implementation */
 namespace libRetroRunner {
 
-    //TODO: 当前没有处理核心传出的信号量，当其不为空时，需要在绘制的时候处理
     void VulkanVideoContext::retro_vulkan_set_image_t_impl(const struct retro_vulkan_image *image, uint32_t num_semaphores, const VkSemaphore *semaphores, uint32_t src_queue_family) {
-        negotiationImage_ = image;
-        if (!negotiationSemaphores_) {
-            negotiationSemaphores_ = new VkSemaphore[20];
+        //核心只保证 image 在下一次 set_image 之前有效, 这里保存一份拷贝
+        negotiationImageValid_ = image != nullptr && image->image_view != VK_NULL_HANDLE;
+        if (negotiationImageValid_) {
+            negotiationImage_ = *image;
         }
-        if (!negotiationWaitStages_) {
-            negotiationWaitStages_ = new VkPipelineStageFlags[20];
-        }
-        negotiationSemaphoreCount_ = num_semaphores;
+
+        negotiationSemaphores_.clear();
+        negotiationWaitStages_.clear();
         if (semaphores) {
             for (uint32_t i = 0; i < num_semaphores; ++i) {
-                if (i > 19) {
-                    LOGE_VVC("semaphores count %u is too large, max is 20", num_semaphores);
-                    break;
-                }
-                negotiationSemaphores_[i] = semaphores[i];
-                negotiationWaitStages_[i] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                negotiationSemaphores_.push_back(semaphores[i]);
+                negotiationWaitStages_.push_back(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
             }
         }
         negotiationQueueFamily_ = src_queue_family;
-
-        //TODO: check line:3080 vk->flags |= VK_FLAG_HW_VALID_SEMAPHORE;
-        if (image && image->image_view) {
-            videoContentNeedUpdate_ = true;
-            //LOGW_VVC("HW callback, frame: %lu, retro_vulkan_set_image_t_impl, image view: %p, layout: %d, flags: %d, semaphore count: %u, semaphore: %p, queue family: %u", frameCount_, image->image_view, image->image_layout, image->create_info.flags, num_semaphores, semaphores, src_queue_family);
-        } else {
-            //LOGW_VVC("HW callback, frame: %lu, retro_vulkan_set_image_t_impl empty: %p, %u, %p, %u", frameCount_, image, num_semaphores, semaphores, src_queue_family);
-        }
+        //LOGW_VVC("HW callback, frame: %lu, retro_vulkan_set_image_t_impl, image view: %p, layout: %d, semaphore count: %u, queue family: %u", frameCount_, image ? image->image_view : nullptr, image ? image->image_layout : 0, num_semaphores, src_queue_family);
     }
 
     uint32_t VulkanVideoContext::retro_vulkan_get_sync_index_t_impl() const {
+        //下一次提交使用的帧, 核心用它选择自己的每帧资源
         uint32_t ret = renderContext_.current_frame;
         //LOGW_VVC("frame: %lu, call retro_vulkan_get_sync_index_t_impl : %u", frameCount_, ret);
         return ret;
     }
 
     uint32_t VulkanVideoContext::retro_vulkan_get_sync_index_mask_t_impl() const {
-        uint32_t mask = (1 << framesInFlight_) - 1;
-        LOGW_VVC("frame: %lu, retro_vulkan_get_sync_index_mask_t_impl : %u", frameCount_, mask);
+        uint32_t count = renderContext_.frames.empty() ? framesInFlight_ : (uint32_t) renderContext_.frames.size();
+        uint32_t mask = (1 << count) - 1;
+        //LOGW_VVC("frame: %lu, retro_vulkan_get_sync_index_mask_t_impl : %u", frameCount_, mask);
         return mask;
     }
 
-    void VulkanVideoContext::retro_vulkan_set_command_buffers_t_impl(uint32_t num_cmd, const VkCommandBuffer *cmd) const {
-        LOGW_VVC("frame: %lu, retro_vulkan_set_command_buffers_t_impl", frameCount_);
+    void VulkanVideoContext::retro_vulkan_set_command_buffers_t_impl(uint32_t num_cmd, const VkCommandBuffer *cmd) {
+        negotiationCommandBuffers_.assign(cmd, cmd + num_cmd);
     }
 
     void VulkanVideoContext::retro_vulkan_wait_sync_index_t_impl() {
-        //LOGW_VVC("need to implement retro_vulkan_wait_sync_index_t_impl");
+        //等待当前帧上一次的提交完成, 之后核心可以安全地重用该 sync index 的资源
+        if (renderContext_.frames.empty()) return;
+        auto &frame = renderContext_.frames[renderContext_.current_frame];
+        if (frame.fence != VK_NULL_HANDLE) {
+            vulkanWaitFrameFence(frame);
+        }
     }
 
     void VulkanVideoContext::retro_vulkan_lock_queue_t_impl() {
@@ -166,12 +164,10 @@ namespace libRetroRunner {
     }
 
     void VulkanVideoContext::retro_vulkan_unlock_queue_t_impl() {
-        //LOGW_VVC("need to implement retro_vulkan_unlock_queue_t_impl");
         pthread_mutex_unlock(queue_lock);
     }
 
     void VulkanVideoContext::retro_vulkan_set_signal_semaphore_t_impl(VkSemaphore semaphore) {
-        LOGW_VVC("frame: %lu, retro_vulkan_set_signal_semaphore_t_impl", frameCount_);
         negotiationSemaphore_ = semaphore;
     }
 }
@@ -257,6 +253,10 @@ namespace libRetroRunner {
 
         is_vulkan_debug_ = true;
 
+        submitToFence_ = &Statistics::Current()->GetHistogram("vulkan.submit_to_fence");
+        acquireTime_ = &Statistics::Current()->GetHistogram("vulkan.acquire_time");
+        presentTime_ = &Statistics::Current()->GetHistogram("vulkan.present_time");
+
         screen_width_ = 1;
         screen_height_ = 100;
 
@@ -270,8 +270,6 @@ namespace libRetroRunner {
         logicalDevice_ = VK_NULL_HANDLE;
 
         destroyDeviceImpl_ = nullptr;
-        negotiationSemaphores_ = nullptr;
-        negotiationWaitStages_ = nullptr;
         queue_lock = new pthread_mutex_t;
         pthread_mutex_init(queue_lock, nullptr);
     }
@@ -319,6 +317,9 @@ namespace libRetroRunner {
 
         //创建显示设备
         if (!vulkanCreateDeviceIfNeeded()) return false;
+        if (memoryAllocator_ == nullptr) {
+            memoryAllocator_ = new VulkanMemoryAllocator(physicalDevice_, logicalDevice_);
+        }
 
         //查询绘制面的能力，以确定飞行帧的数量等
         if (!vulkanGetSurfaceCapabilitiesIfNeeded()) return false;
@@ -361,12 +362,19 @@ namespace libRetroRunner {
         if (logicalDevice_) {
             vkDeviceWaitIdle(logicalDevice_);
         }
+        vulkanSavePipelineCache();
 
         if(VK_BIT_TEST(surfaceContext_.flags, RRVULKAN_SURFACE_STATE_CORE_CONTEXT_LOADED)) {
             retro_hw_context_reset_t destroy_func = coreCtx->GetRenderHWContextDestroyCallback();
             if (destroy_func) destroy_func();
             VK_BIT_CLEAR(surfaceContext_.flags, RRVULKAN_SURFACE_STATE_CORE_CONTEXT_LOADED);
         }
+        //核心的图像与信号量已随上下文销毁
+        negotiationImageValid_ = false;
+        negotiationSemaphores_.clear();
+        negotiationWaitStages_.clear();
+        negotiationCommandBuffers_.clear();
+        negotiationSemaphore_ = VK_NULL_HANDLE;
 
         vulkanClearSwapchainResourcesIfNeeded();
         vulkanClearFrameResourcesIfNeeded();
@@ -381,6 +389,19 @@ namespace libRetroRunner {
     void VulkanVideoContext::Destroy() {
         Unload();
         vulkanClearRenderContextIfNeeded();
+        if (vertexBuffer_) {
+            delete vertexBuffer_;
+            vertexBuffer_ = nullptr;
+        }
+        if (sampler_ != VK_NULL_HANDLE) {
+            vkDestroySampler(logicalDevice_, sampler_, nullptr);
+            sampler_ = VK_NULL_HANDLE;
+        }
+        if (memoryAllocator_) {
+            memoryAllocator_->logStatistics();
+            delete memoryAllocator_;
+            memoryAllocator_ = nullptr;
+        }
         if(logicalDevice_){
             vkDestroyDevice(logicalDevice_, nullptr);
             logicalDevice_ = VK_NULL_HANDLE;
@@ -408,10 +429,13 @@ namespace libRetroRunner {
 
     void VulkanVideoContext::OnNewFrame(const void *data, unsigned int width, unsigned int height, size_t pitch) {
         if (data) {
-            vulkanCreateDrawingResourceIfNeeded(width, height);
             if (data == RETRO_HW_FRAME_BUFFER_VALID) {
-                //LOGD_VVC("OnNewFrame called with RETRO_HW_FRAME_BUFFER_VALID, this is a hardware render frame.");
+                //硬件帧直接采样核心的图像, 不需要软件纹理
+                vulkanCreateDrawingResourceIfNeeded(0, 0);
+                if (negotiationImageValid_) videoContentNeedUpdate_ = true;
             } else {
+                negotiationImageValid_ = false;
+                vulkanCreateDrawingResourceIfNeeded(width, height);
                 fillFrameTexture(data, width, height, pitch);
                 //DRAW_LOGD_VVC("OnNewFrame called with data: %p, width: %u, height: %u, pitch: %zu, sw: %u, sh: %u", data, width, height, pitch, screen_width_, screen_height_);
             }
@@ -420,7 +444,8 @@ namespace libRetroRunner {
             }
 
         } else {
-            LOGW_VVC("OnNewFrame called with null data, this is not a valid frame.");
+            //核心重复上一帧, 上一帧的画面仍在屏幕上, 不需要重新提交
+            dupe_frames_->fetch_add(1, std::memory_order_relaxed);
         }
     }
 
@@ -472,30 +497,58 @@ namespace libRetroRunner {
         if (!videoContentNeedUpdate_) return;
         auto &frame = renderContext_.frames[renderContext_.current_frame];
 
-        vkWaitForFences(logicalDevice_, 1, &frame.fence, VK_TRUE, UINT64_MAX);
-        vkResetFences(logicalDevice_, 1, &frame.fence);
+        vulkanWaitFrameFence(frame);
 
         uint32_t image_index;
-        vkAcquireNextImageKHR(logicalDevice_, swapchainContext_.swapchain, UINT64_MAX, frame.imageAcquireSemaphore, VK_NULL_HANDLE, &image_index);
+        int64_t acquireStart = Statistics::NowMicros();
+        VkResult acquireResult = vkAcquireNextImageKHR(logicalDevice_, swapchainContext_.swapchain, UINT64_MAX, frame.imageAcquireSemaphore, VK_NULL_HANDLE, &image_index);
+        acquireTime_->Record(Statistics::NowMicros() - acquireStart);
+        if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+            //在 Prepare 中重建 swapchain, 这一帧丢弃
+            VK_BIT_SET(swapchainContext_.flag, RRVULKAN_SWAPCHAIN_STATE_NEED_RECREATE);
+            return;
+        } else if (acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR) {
+            LOGE_VC("frame: %lu, Failed to acquire swapchain image: %d", frameCount_, acquireResult);
+            return;
+        }
 
         recordCommandBufferForSoftwareRender(frame.commandBuffer, image_index, frame.descriptorSet);
+        //紧挨提交前重置, 提交失败时fence不会一直处于未触发状态
+        vkResetFences(logicalDevice_, 1, &frame.fence);
 
         VkQueue queue = presentationQueue_;
 
 
-        VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        //硬件核心: 等待核心渲染完成的信号量, 先提交核心的命令, 完成时触发核心要求的信号量
+        std::vector<VkSemaphore> waitSemaphores{frame.imageAcquireSemaphore};
+        std::vector<VkPipelineStageFlags> waitStages{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        waitSemaphores.insert(waitSemaphores.end(), negotiationSemaphores_.begin(), negotiationSemaphores_.end());
+        waitStages.insert(waitStages.end(), negotiationWaitStages_.begin(), negotiationWaitStages_.end());
+
+        std::vector<VkCommandBuffer> commandBuffers(negotiationCommandBuffers_);
+        commandBuffers.push_back(frame.commandBuffer);
+
+        std::vector<VkSemaphore> signalSemaphores{frame.renderSemaphore};
+        if (negotiationSemaphore_ != VK_NULL_HANDLE) signalSemaphores.push_back(negotiationSemaphore_);
+
         VkSubmitInfo submit_info = {
                 .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
                 .pNext = nullptr,
-                .waitSemaphoreCount = 1,
-                .pWaitSemaphores = &frame.imageAcquireSemaphore,
-                .pWaitDstStageMask = &waitStageMask,
-                .commandBufferCount = 1,
-                .pCommandBuffers = &frame.commandBuffer,
-                .signalSemaphoreCount = 1,
-                .pSignalSemaphores = &frame.renderSemaphore
+                .waitSemaphoreCount = (uint32_t) waitSemaphores.size(),
+                .pWaitSemaphores = waitSemaphores.data(),
+                .pWaitDstStageMask = waitStages.data(),
+                .commandBufferCount = (uint32_t) commandBuffers.size(),
+                .pCommandBuffers = commandBuffers.data(),
+                .signalSemaphoreCount = (uint32_t) signalSemaphores.size(),
+                .pSignalSemaphores = signalSemaphores.data()
         };
         VkResult submitResult = vkQueueSubmit(queue, 1, &submit_info, frame.fence);
+        frame.submitTime = Statistics::NowMicros();
+        //核心的信号量与命令只使用一次, 重复显示同一图像时不再等待
+        negotiationSemaphores_.clear();
+        negotiationWaitStages_.clear();
+        negotiationCommandBuffers_.clear();
+        negotiationSemaphore_ = VK_NULL_HANDLE;
 
 
         if (submitResult != VK_SUCCESS) {
@@ -517,7 +570,17 @@ namespace libRetroRunner {
                 .pImageIndices = &image_index,
                 .pResults = &result,
         };
-        vkQueuePresentKHR(queue, &presentInfo);
+        int64_t presentStart = Statistics::NowMicros();
+        VkResult presentResult = vkQueuePresentKHR(queue, &presentInfo);
+        presentTime_->Record(Statistics::NowMicros() - presentStart);
+        if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR) {
+            VK_BIT_SET(swapchainContext_.flag, RRVULKAN_SWAPCHAIN_STATE_NEED_RECREATE);
+        }
+
+        //低延迟模式: 等待这一帧完成再返回, 下一帧的输入在画面提交之后才采样
+        if (waitEachFrame_) {
+            vulkanWaitFrameFence(frame);
+        }
 
         //LOGI_VVC("frame: %lu, Queue present complete, image index: %u, result: %d", frameCount_, renderContext_.current_frame, result);
         renderContext_.current_frame = (renderContext_.current_frame + 1) % renderContext_.frames.size();
@@ -532,6 +595,20 @@ namespace libRetroRunner {
                 .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
         };
         vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        //软件帧: 在渲染通道之前把 staging buffer 拷贝到纹理
+        auto &currentFrame = renderContext_.frames[renderContext_.current_frame];
+        if (currentFrame.textureNeedUpload) {
+            recordFrameTextureUpload(commandBuffer, currentFrame);
+        }
+        //硬件帧: 核心的图像来自其他队列族时需要先获取所有权
+        bool transferOwnership = negotiationImageValid_ &&
+                                 negotiationQueueFamily_ != VK_QUEUE_FAMILY_IGNORED &&
+                                 negotiationQueueFamily_ != presentationQueueFamilyIndex_;
+        if (transferOwnership) {
+            recordHWImageOwnershipTransfer(commandBuffer, true);
+        }
+
         VkRenderPassBeginInfo renderPassInfo{};
         {
             renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -561,14 +638,13 @@ namespace libRetroRunner {
 
         VkImageView imageViewToBePresent = VK_NULL_HANDLE;
         VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        if(negotiationImage_ && negotiationImage_->image_view){
-            imageViewToBePresent = negotiationImage_->image_view;
-            imageLayout = negotiationImage_->image_layout;
+        if(negotiationImageValid_){
+            imageViewToBePresent = negotiationImage_.image_view;
+            imageLayout = negotiationImage_.image_layout;
         }
         if(imageViewToBePresent == VK_NULL_HANDLE){
-            auto& frame = renderContext_.frames[renderContext_.current_frame];
-            imageViewToBePresent = frame.texture.imageView;
-            imageLayout = frame.texture.layout;
+            imageViewToBePresent = currentFrame.texture.imageView;
+            imageLayout = currentFrame.texture.layout;
         }
         if (imageViewToBePresent) {
 
@@ -603,12 +679,37 @@ namespace libRetroRunner {
 
         }
 
-        negotiationImage_ = nullptr; // reset after draw
-
         vkCmdEndRenderPass(commandBuffer);
+        if (transferOwnership) {
+            recordHWImageOwnershipTransfer(commandBuffer, false);
+        }
         vkEndCommandBuffer(commandBuffer);
     }
 
+    void VulkanVideoContext::recordHWImageOwnershipTransfer(VkCommandBuffer commandBuffer, bool acquire) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = negotiationImage_.image_layout;
+        barrier.newLayout = negotiationImage_.image_layout;
+        barrier.srcQueueFamilyIndex = acquire ? negotiationQueueFamily_ : presentationQueueFamilyIndex_;
+        barrier.dstQueueFamilyIndex = acquire ? presentationQueueFamilyIndex_ : negotiationQueueFamily_;
+        barrier.image = negotiationImage_.create_info.image;
+        barrier.subresourceRange = negotiationImage_.create_info.subresourceRange;
+        if (acquire) {
+            //与核心信号量的等待阶段(FRAGMENT_SHADER)构成依赖链
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        } else {
+            //采样结束后把所有权还给核心的队列族
+            barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+    }
+
     //=== VULKAN methods ==============================
 
     const retro_hw_render_context_negotiation_interface_vulkan *VulkanVideoContext::getNegotiationInterface() {
@@ -957,16 +1058,29 @@ namespace libRetroRunner {
             return false;
         }
 
-        framesInFlight_ = surfaceCapabilities.minImageCount;
-        if (framesInFlight_ < 2) {
-            LOGW_VVC("Surface minImageCount is less than 2, this may cause issues.");
-            framesInFlight_ = 2; // 飞行帧的数量至少为2
-        }
-        if (surfaceCapabilities.maxImageCount >= framesInFlight_ + 1) {
-            surfaceContext_.imageCount = framesInFlight_ + 1;
-        } else {
-            surfaceContext_.imageCount = framesInFlight_;
+        //飞行帧: 允许GPU落后的帧数, 0 时只保留一帧并在每帧提交后等待完成
+        auto setting = Setting::Current();
+        waitEachFrame_ = setting->GetVideoFramesInFlight() == 0;
+        framesInFlight_ = std::max(1u, std::min(2u, setting->GetVideoFramesInFlight()));
+
+        surfaceContext_.presentMode = vulkanChoosePresentMode();
+
+        //swapchain 图像数量, maxImageCount 为 0 表示没有上限
+        uint32_t imageCount = setting->GetVideoSwapchainImages();
+        if (imageCount == 0) {
+            imageCount = framesInFlight_ + 1;
+            if (surfaceContext_.presentMode == VK_PRESENT_MODE_MAILBOX_KHR) imageCount = std::max(imageCount, 3u);
         }
+        imageCount = std::max(imageCount, surfaceCapabilities.minImageCount);
+        if (surfaceCapabilities.maxImageCount > 0) imageCount = std::min(imageCount, surfaceCapabilities.maxImageCount);
+        surfaceContext_.imageCount = imageCount;
+
+        Statistics::Current()->GetCounter("vulkan.present_mode").store(surfaceContext_.presentMode);
+        Statistics::Current()->GetCounter("vulkan.swapchain_images").store(surfaceContext_.imageCount);
+        Statistics::Current()->GetCounter("vulkan.frames_in_flight").store(waitEachFrame_ ? 0 : framesInFlight_);
+        LOGD_VVC("present mode: %d, swapchain images: %u (min %u, max %u), frames in flight: %u%s", surfaceContext_.presentMode, surfaceContext_.imageCount,
+                 surfaceCapabilities.minImageCount, surfaceCapabilities.maxImageCount, framesInFlight_, waitEachFrame_ ? ", wait each frame" : "");
+
         surfaceContext_.format = surfaceFormats[chosenIndex].format;
         surfaceContext_.colorSpace = surfaceFormats[chosenIndex].colorSpace;
         surfaceContext_.extent = {screen_width_, screen_height_};
@@ -977,6 +1091,51 @@ namespace libRetroRunner {
         return true;
     }
 
+    VkPresentModeKHR VulkanVideoContext::vulkanChoosePresentMode() {
+        uint32_t modeCount = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surfaceContext_.surface, &modeCount, nullptr);
+        std::vector<VkPresentModeKHR> modes(modeCount);
+        if (modeCount > 0) vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surfaceContext_.surface, &modeCount, modes.data());
+        auto supported = [&modes](VkPresentModeKHR mode) {
+            return std::find(modes.begin(), modes.end(), mode) != modes.end();
+        };
+
+        //FIFO 所有设备都支持
+        VkPresentModeKHR wanted = VK_PRESENT_MODE_FIFO_KHR;
+        switch (Setting::Current()->GetVideoPresentMode()) {
+            case kPresentModeFifoRelaxed:
+                wanted = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                break;
+            case kPresentModeMailbox:
+                wanted = VK_PRESENT_MODE_MAILBOX_KHR;
+                break;
+            case kPresentModeImmediate:
+                wanted = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                break;
+            case kPresentModeAuto:
+                //不等待垂直同步时优先 MAILBOX(不撕裂)
+                if (Setting::Current()->GetVideoSwapInterval() == 0) {
+                    wanted = supported(VK_PRESENT_MODE_MAILBOX_KHR) ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_IMMEDIATE_KHR;
+                }
+                break;
+            default:
+                break;
+        }
+        if (!supported(wanted)) {
+            LOGW_VVC("present mode %d is not supported by surface, use FIFO.", wanted);
+            wanted = VK_PRESENT_MODE_FIFO_KHR;
+        }
+        return wanted;
+    }
+
+    void VulkanVideoContext::vulkanWaitFrameFence(RRVulkanFrameContext &frame) {
+        vkWaitForFences(logicalDevice_, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+        if (frame.submitTime > 0) {
+            submitToFence_->Record(Statistics::NowMicros() - frame.submitTime);
+            frame.submitTime = 0;
+        }
+    }
+
     bool VulkanVideoContext::vulkanCreateCommandPoolIfNeeded() {
         if (renderContext_.commandPool) return true;
 
@@ -1020,7 +1179,7 @@ namespace libRetroRunner {
                 .pQueueFamilyIndices = nullptr,
                 .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
                 .compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,                   //android: VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,  windows: VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR
-                .presentMode = VK_PRESENT_MODE_FIFO_KHR,                                //MAILBOX, FIFO? i think we need to check which to be use.
+                .presentMode = surfaceContext_.presentMode,
                 .clipped = VK_TRUE,
                 .oldSwapchain = swapchainContext_.swapchain,                             //TODO: check maybe we need to pass the old swapchain here.
         };
@@ -1289,17 +1448,22 @@ namespace libRetroRunner {
 
         //管线缓存
         if (!VK_BIT_TEST(renderContext_.flag, RRVULKAN_RENDER_STATE_PIPELINE_CACHE_VALID)) {
+            //使用上一次运行保存的缓存, 避免重复编译着色器
+            std::vector<unsigned char> cacheData = vulkanLoadPipelineCacheData();
             VkPipelineCacheCreateInfo pipelineCacheCreateInfo{
                     .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-                    .flags = 0
+                    .flags = 0,
+                    .initialDataSize = cacheData.size(),
+                    .pInitialData = cacheData.empty() ? nullptr : cacheData.data()
             };
             VkResult pipelineCacheCreateResult = vkCreatePipelineCache(logicalDevice_, &pipelineCacheCreateInfo, nullptr, &renderContext_.pipelineCache);
             if (pipelineCacheCreateResult != VK_SUCCESS || renderContext_.pipelineCache == VK_NULL_HANDLE) {
                 LOGE_VC("pipeline cache create failed: %d", pipelineCacheCreateResult);
                 return false;
             } else {
-                LOGD_VC("pipeline cache:\t%p", renderContext_.pipelineCache);
+                LOGD_VC("pipeline cache:\t%p, initial data: %zu bytes", renderContext_.pipelineCache, cacheData.size());
             }
+            pipelineCacheSavedSize_ = cacheData.size();
             VK_BIT_SET(renderContext_.flag, RRVULKAN_RENDER_STATE_PIPELINE_CACHE_VALID);
         }
 
@@ -1378,7 +1542,7 @@ namespace libRetroRunner {
             {
                 fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
                 fenceCreateInfo.pNext = nullptr;
-                fenceCreateInfo.flags = 0;
+                fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;   //初始为已触发, 帧资源在第一次提交前即可使用
             }
 
             VkResult createFenceResult = vkCreateFence(logicalDevice_, &fenceCreateInfo, nullptr, &frame.fence);
@@ -1387,7 +1551,6 @@ namespace libRetroRunner {
                 resourceValid = false;
                 break;
             }
-            vkResetFences(logicalDevice_, 1, &frame.fence);
 
             VkSemaphoreCreateInfo imageAcquireSemaphoreCreateInfo{};
             {
@@ -1516,6 +1679,9 @@ namespace libRetroRunner {
             auto &frame = renderContext_.frames[renderContext_.current_frame];
             if (frame.texture.imageView == VK_NULL_HANDLE || frame.texture.width != width || frame.texture.height != height) {
                 LOGD_VVC("create frame texture if needed: %d x %d", width, height);
+                //旧纹理可能仍被该帧上一次提交的命令使用
+                vulkanWaitFrameFence(frame);
+                frame.textureNeedUpload = false;
                 if (frame.texture.imageView != VK_NULL_HANDLE) {
                     vkDestroyImageView(logicalDevice_, frame.texture.imageView, nullptr);
                     frame.texture.imageView = VK_NULL_HANDLE;
@@ -1524,10 +1690,7 @@ namespace libRetroRunner {
                     vkDestroyImage(logicalDevice_, frame.texture.image, nullptr);
                     frame.texture.image = VK_NULL_HANDLE;
                 }
-                if (frame.texture.memory != VK_NULL_HANDLE) {
-                    vkFreeMemory(logicalDevice_, frame.texture.memory, nullptr);
-                    frame.texture.memory = VK_NULL_HANDLE;
-                }
+                memoryAllocator_->free(&frame.texture.memory);
 
                 frame.texture.width = 0;
                 frame.texture.height = 0;
@@ -1556,26 +1719,11 @@ namespace libRetroRunner {
                     frame.texture.layout = imageCreateInfo.initialLayout;
 
                     LOGD_VC("Texture image created: %p", frame.texture.image);
-                    VkMemoryRequirements memoryRequirements{};
-                    vkGetImageMemoryRequirements(logicalDevice_, frame.texture.image, &memoryRequirements);
-                    VkMemoryAllocateInfo memoryAllocateInfo{};
-                    {
-                        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                        memoryAllocateInfo.allocationSize = memoryRequirements.size;
-                        memoryAllocateInfo.memoryTypeIndex = VkUtil::findMemoryType(physicalDevice_, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);;
-                    }
-                    VkResult memoryAllocateResult = vkAllocateMemory(logicalDevice_, &memoryAllocateInfo, nullptr, &frame.texture.memory);
-                    if (memoryAllocateResult != VK_SUCCESS || frame.texture.memory == VK_NULL_HANDLE) {
-                        LOGE_VC("Failed to allocate texture memory: %d", memoryAllocateResult);
+                    if (!memoryAllocator_->bindImage(frame.texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame.texture.memory)) {
+                        LOGE_VC("Failed to allocate texture memory");
                         break;
                     }
-                    LOGD_VC("Texture memory allocated: %p", frame.texture.memory);
-                    VkResult bindImageMemoryResult = vkBindImageMemory(logicalDevice_, frame.texture.image, frame.texture.memory, 0);
-                    if (bindImageMemoryResult != VK_SUCCESS) {
-                        LOGE_VC("Failed to bind texture image memory: %d", bindImageMemoryResult);
-                        break;
-                    }
-                    LOGD_VC("Texture image memory bound: %p", frame.texture.memory);
+                    LOGD_VC("Texture image memory bound: %p + %llu", frame.texture.memory.memory, (unsigned long long) frame.texture.memory.offset);
                     VkImageViewCreateInfo imageViewCreateInfo{};
                     {
                         imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1606,7 +1754,7 @@ namespace libRetroRunner {
             }
         }
         if (vertexBuffer_ == nullptr) {
-            vertexBuffer_ = new VulkanRWBuffer(physicalDevice_, logicalDevice_, presentationQueueFamilyIndex_);
+            vertexBuffer_ = new VulkanRWBuffer(physicalDevice_, logicalDevice_, presentationQueueFamilyIndex_, memoryAllocator_);
             //如果核心没有提供渲染接口，那么软件渲染一般使用的是opengl生成的图片, 图片则需要使用opengl的坐标
             if(retro_render_interface_ == nullptr){
                 vertexBuffer_->create(sizeof(verticesOpenGL), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
@@ -1672,6 +1820,53 @@ namespace libRetroRunner {
         VK_BIT_CLEAR(swapchainContext_.flag, RRVULKAN_SWAPCHAIN_STATE_NEED_RECREATE);
     }
 
+    std::string VulkanVideoContext::pipelineCachePath() {
+        auto environment = AppContext::Current()->GetEnvironment();
+        if (environment == nullptr || environment->GetAppSandBoxPath().empty()) return "";
+        return environment->GetAppSandBoxPath() + "/vulkan_pipeline_cache.bin";
+    }
+
+    std::vector<unsigned char> VulkanVideoContext::vulkanLoadPipelineCacheData() {
+        std::string path = pipelineCachePath();
+        if (path.empty() || access(path.c_str(), R_OK) != 0) return {};
+        std::vector<unsigned char> data = Utils::readFileAsBytes(path);
+
+        //缓存头: headerSize, headerVersion, vendorID, deviceID, pipelineCacheUUID, 换了GPU或驱动后缓存无效
+        const size_t headerSize = 16 + VK_UUID_SIZE;
+        if (data.size() < headerSize) return {};
+        uint32_t header[4];
+        memcpy(header, data.data(), sizeof(header));
+        if (header[0] < headerSize || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header[2] != physicalDeviceProperties_.vendorID || header[3] != physicalDeviceProperties_.deviceID ||
+            memcmp(data.data() + 16, physicalDeviceProperties_.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            LOGW_VVC("pipeline cache %s was created by another device or driver, ignored.", path.c_str());
+            return {};
+        }
+        return data;
+    }
+
+    void VulkanVideoContext::vulkanSavePipelineCache() {
+        if (!VK_BIT_TEST(renderContext_.flag, RRVULKAN_RENDER_STATE_PIPELINE_CACHE_VALID) || renderContext_.pipelineCache == VK_NULL_HANDLE) return;
+        std::string path = pipelineCachePath();
+        if (path.empty()) return;
+
+        size_t size = 0;
+        if (vkGetPipelineCacheData(logicalDevice_, renderContext_.pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+        if (size == pipelineCacheSavedSize_) return;
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(logicalDevice_, renderContext_.pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+
+        //先写临时文件再替换, 避免进程被杀时留下损坏的缓存
+        std::string tempPath = path + ".tmp";
+        if (Utils::writeBytesToFile(tempPath, data.data(), size) != (int) size || rename(tempPath.c_str(), path.c_str()) != 0) {
+            LOGE_VVC("failed to save pipeline cache to %s", path.c_str());
+            remove(tempPath.c_str());
+            return;
+        }
+        pipelineCacheSavedSize_ = size;
+        LOGD_VVC("pipeline cache saved: %zu bytes", size);
+    }
+
     bool VulkanVideoContext::createShader(void *source, size_t sourceLength, VulkanShaderType shaderType, VkShaderModule *shader) {
         VkShaderModuleCreateInfo createInfo{
                 .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -1691,6 +1886,20 @@ namespace libRetroRunner {
     void VulkanVideoContext::fillFrameTexture(const void *data, unsigned int width, unsigned int height, size_t pitch) {
         if (!vulkanIsReady_) return;
         auto frame = &renderContext_.frames[renderContext_.current_frame];
+        if (frame->texture.image == VK_NULL_HANDLE || frame->texture.width != width || frame->texture.height != height) {
+            return;
+        }
+
+        //staging buffer 可能仍被该帧上一次提交的拷贝命令读取
+        vulkanWaitFrameFence(*frame);
+
+        //staging buffer 太小时重新创建(核心修改了分辨率)
+        if (frame->stagingBuffer.buffer != VK_NULL_HANDLE && frame->stagingBuffer.size < (VkDeviceSize) width * height * 4) {
+            vkDestroyBuffer(logicalDevice_, (VkBuffer) frame->stagingBuffer.buffer, nullptr);
+            frame->stagingBuffer.buffer = VK_NULL_HANDLE;
+            memoryAllocator_->free(&frame->stagingBuffer.memory);
+            frame->stagingBuffer.size = 0;
+        }
 
         if (frame->stagingBuffer.buffer == VK_NULL_HANDLE) {
             VkBufferCreateInfo createBufferInfo{
@@ -1708,64 +1917,68 @@ namespace libRetroRunner {
                 LOGE_VC("failed to create staging buffer, error %d", result);
                 return;
             }
-            VkMemoryRequirements memRequirements;
-            vkGetBufferMemoryRequirements(logicalDevice_, (VkBuffer) frame->stagingBuffer.buffer, &memRequirements);
-
-            VkMemoryAllocateInfo allocInfo{};
-            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            allocInfo.allocationSize = memRequirements.size;
-            VkUtil::MapMemoryTypeToIndex(
-                    physicalDevice_,
-                    memRequirements.memoryTypeBits,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    &allocInfo.memoryTypeIndex);
-            result = vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, (VkDeviceMemory *) &frame->stagingBuffer.memory);
-            if (result != VK_SUCCESS) {
-                LOGE_VC("failed to allocate staging buffer memory, error %d", result);
+            //HOST_VISIBLE 的块常驻映射, 提交时主机写入自动可见(COHERENT)
+            if (!memoryAllocator_->bindBuffer(frame->stagingBuffer.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame->stagingBuffer.memory)) {
+                LOGE_VC("failed to allocate staging buffer memory");
+                vkDestroyBuffer(logicalDevice_, (VkBuffer) frame->stagingBuffer.buffer, nullptr);
+                frame->stagingBuffer.buffer = VK_NULL_HANDLE;
+                return;
             }
-            frame->stagingBuffer.size = allocInfo.allocationSize;
-            vkBindBufferMemory(logicalDevice_, (VkBuffer) frame->stagingBuffer.buffer, (VkDeviceMemory) frame->stagingBuffer.memory, 0);
-        }
-
-        //使用data填充frame的纹理
-        const void *finalData = data;
-        if (core_pixel_format_ == RETRO_PIXEL_FORMAT_RGB565) {
-            convertingBuffer.resize(width * height * 4);
-            VkUtil::convertRGB565ToRGBA8888(data, width, height, convertingBuffer.data());
-            finalData = convertingBuffer.data();
-        } else if (core_pixel_format_ == RETRO_PIXEL_FORMAT_0RGB1555) {
-            //TODO: 检测pixel格式转换 RETRO_PIXEL_FORMAT_0RGB1555
-            LOGE_VVC("0RGB1555 pixel format is not supported yet, please use RGB565 or RGBA8888.");
-        }
-        //copy data to staging buffer
-        void *toData;
-        vkMapMemory(logicalDevice_, frame->stagingBuffer.memory, 0, frame->stagingBuffer.size, 0, &toData);
-        //TODO: 这里需要检测pitch, 拷贝数据的长度，数据超出范围或者拷贝不全
-        //size_t  copySize = min(frame->stagingBuffer.size, pitch * height);
-        memcpy(toData, finalData,frame->stagingBuffer.size );
-        vkUnmapMemory(logicalDevice_, frame->stagingBuffer.memory);
-
-        // 转换图像布局为 `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL`
-        VkUtil::transitionImageLayout(logicalDevice_, renderContext_.commandPool, presentationQueue_, frame->texture.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &frame->texture.layout);
-
-
-        //copy staging buffer to texture image
-        VkCommandBuffer commandBuffer = VkUtil::beginSingleTimeCommands(logicalDevice_, renderContext_.commandPool);
+            frame->stagingBuffer.size = createBufferInfo.size;
+        }
+        if (frame->stagingBuffer.memory.mapped == nullptr) return;
+
+        //按pitch逐行转换为 R8G8B8A8 直接写入 staging buffer, 拷贝和布局转换在 recordFrameTextureUpload 中录制
+        if (!ConvertToRGBA8888(core_pixel_format_, data, width, height, pitch, frame->stagingBuffer.memory.mapped, width * 4)) {
+            LOGE_VVC("unsupported pixel format: %d", core_pixel_format_);
+            return;
+        }
+
+        //LOGD_VVC("Frame texture updated: %d x %d, core pixel format: %d", width, height, core_pixel_format_);
+        frame->textureNeedUpload = true;
+        videoContentNeedUpdate_ = true;
+    }
+
+    void VulkanVideoContext::recordFrameTextureUpload(VkCommandBuffer commandBuffer, RRVulkanFrameContext &frame) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = frame.texture.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        //整张纹理都会被覆盖, 旧内容可以丢弃(UNDEFINED), 上一次的采样已经由 fence 等待完成
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
         VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;     //紧密排列, width * 4
+        region.bufferImageHeight = 0;
         region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         region.imageSubresource.mipLevel = 0;
         region.imageSubresource.baseArrayLayer = 0;
         region.imageSubresource.layerCount = 1;
-        region.imageExtent = {width, height, 1};
-        vkCmdCopyBufferToImage(commandBuffer, frame->stagingBuffer.buffer, frame->texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-        VkUtil::endSingleTimeCommands(logicalDevice_, renderContext_.commandPool, presentationQueue_, commandBuffer);
-
-        //转换图像布局回 `VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL`
-        VkUtil::transitionImageLayout(logicalDevice_, renderContext_.commandPool, presentationQueue_, frame->texture.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &frame->texture.layout);
-
-        //LOGD_VVC("Frame texture updated: %d x %d, core pixel format: %d", width, height, core_pixel_format_);
-        videoContentNeedUpdate_ = true;
+        region.imageExtent = {frame.texture.width, frame.texture.height, 1};
+        vkCmdCopyBufferToImage(commandBuffer, frame.stagingBuffer.buffer, frame.texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        frame.texture.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        frame.textureNeedUpload = false;
     }
 
 }
@@ -1799,10 +2012,8 @@ namespace libRetroRunner {
                 vkDestroyBuffer(logicalDevice_, (VkBuffer) frame.stagingBuffer.buffer, nullptr);
                 frame.stagingBuffer.buffer = VK_NULL_HANDLE;
             }
-            if(frame.stagingBuffer.memory != VK_NULL_HANDLE) {
-                vkFreeMemory(logicalDevice_, (VkDeviceMemory) frame.stagingBuffer.memory, nullptr);
-                frame.stagingBuffer.memory = VK_NULL_HANDLE;
-            }
+            memoryAllocator_->free(&frame.stagingBuffer.memory);
+            frame.stagingBuffer.size = 0;
 
             if (frame.texture.imageView != VK_NULL_HANDLE) {
                 vkDestroyImageView(logicalDevice_, frame.texture.imageView, nullptr);
@@ -1812,10 +2023,7 @@ namespace libRetroRunner {
                 vkDestroyImage(logicalDevice_, frame.texture.image, nullptr);
                 frame.texture.image = VK_NULL_HANDLE;
             }
-            if (frame.texture.memory != VK_NULL_HANDLE) {
-                vkFreeMemory(logicalDevice_, frame.texture.memory, nullptr);
-                frame.texture.memory = VK_NULL_HANDLE;
-            }
+            memoryAllocator_->free(&frame.texture.memory);
             frame.texture.width = 0;
             frame.texture.height = 0;
 
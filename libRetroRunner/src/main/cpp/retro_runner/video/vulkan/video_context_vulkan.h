@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "../video_context.h"
+#include "vk_memory_allocator.h"
 
 #include <libretro-common/include/libretro_vulkan.h>
 #include <libretro-common/include/rthreads/rthreads.h>
@@ -18,6 +19,16 @@ class VulkanSamplingTexture;
 class VulkanRWBuffer;
 
 namespace libRetroRunner {
+    class LatencyHistogram;
+
+    /* Setting::GetVideoPresentMode */
+    enum VulkanPresentMode {
+        kPresentModeAuto = 0,
+        kPresentModeFifo = 1,
+        kPresentModeFifoRelaxed = 2,
+        kPresentModeMailbox = 3,
+        kPresentModeImmediate = 4,
+    };
     enum VulkanShaderType {
         SHADER_VERTEX, SHADER_FRAGMENT
     };
@@ -45,7 +56,7 @@ namespace libRetroRunner {
         VkImage image = VK_NULL_HANDLE;
         VkImageView imageView = VK_NULL_HANDLE;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VulkanMemoryAllocation memory{};
 
         size_t stride;  //size of one line pixel in bytes
         size_t size;    //size of the whole texture in bytes
@@ -58,7 +69,7 @@ namespace libRetroRunner {
     struct RRVulkanBuffer {
         VkDeviceSize size = 0;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VulkanMemoryAllocation memory{};    //HOST_VISIBLE, 通过 memory.mapped 直接写入
     };
 
     enum RRVulkanSurfaceState {
@@ -75,7 +86,8 @@ namespace libRetroRunner {
 
         VkSurfaceKHR surface = VK_NULL_HANDLE;
 
-        uint32_t imageCount = 2;   //飞行帧的数量
+        uint32_t imageCount = 2;   //swapchain 图像数量
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
         VkExtent2D extent{0, 0};
         VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
@@ -85,7 +97,7 @@ namespace libRetroRunner {
     struct RRVulkanFrameContext {
         struct RRVulkanTexture texture{};
         struct RRVulkanBuffer stagingBuffer{};
-
+        bool textureNeedUpload = false;     //stagingBuffer 中有新的画面, 录制命令时拷贝到 texture
 
         VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 
@@ -94,6 +106,8 @@ namespace libRetroRunner {
         VkFence fence = VK_NULL_HANDLE;
         VkSemaphore renderSemaphore = VK_NULL_HANDLE;
         VkSemaphore imageAcquireSemaphore = VK_NULL_HANDLE;
+
+        int64_t submitTime = 0;     //提交时间(us), 等待 fence 时统计延迟
     };
 
     enum RRVulkanRenderState {
@@ -191,7 +205,7 @@ namespace libRetroRunner {
 
         uint32_t retro_vulkan_get_sync_index_mask_t_impl() const;
 
-        void retro_vulkan_set_command_buffers_t_impl(uint32_t num_cmd, const VkCommandBuffer *cmd) const;
+        void retro_vulkan_set_command_buffers_t_impl(uint32_t num_cmd, const VkCommandBuffer *cmd);
 
         void retro_vulkan_wait_sync_index_t_impl();
 
@@ -216,6 +230,12 @@ namespace libRetroRunner {
 
         bool vulkanGetSurfaceCapabilitiesIfNeeded();
 
+        /* present mode from setting, falls back to FIFO when not supported by the surface */
+        VkPresentModeKHR vulkanChoosePresentMode();
+
+        /* wait for the frame's last submission and record its latency */
+        void vulkanWaitFrameFence(RRVulkanFrameContext &frame);
+
         bool vulkanCreateCommandPoolIfNeeded();
 
         bool vulkanCreateSwapchainIfNeeded();
@@ -226,6 +246,14 @@ namespace libRetroRunner {
 
         bool vulkanCreateGraphicsPipelineIfNeeded();
 
+        /* pipeline cache file in the app sandbox, empty if sandbox path is not set */
+        std::string pipelineCachePath();
+
+        /* read the cache file, returns empty data if it was created by another device/driver */
+        std::vector<unsigned char> vulkanLoadPipelineCacheData();
+
+        void vulkanSavePipelineCache();
+
         bool vulkanCreateDescriptorPoolIfNeeded();
 
         bool vulkanCreateFrameResourcesIfNeeded();
@@ -239,6 +267,12 @@ namespace libRetroRunner {
         bool createShader(void *source, size_t sourceLength, VulkanShaderType shaderType, VkShaderModule *shader);
 
         void fillFrameTexture(const void *data, unsigned int width, unsigned int height, size_t pitch);
+
+        /* record staging buffer -> texture copy with layout barriers into the frame command buffer */
+        void recordFrameTextureUpload(VkCommandBuffer commandBuffer, RRVulkanFrameContext &frame);
+
+        /* queue family ownership transfer of the core image, acquire before sampling and release after */
+        void recordHWImageOwnershipTransfer(VkCommandBuffer commandBuffer, bool acquire);
     public:
 
         void vulkanClearRenderContextIfNeeded();
@@ -280,6 +314,12 @@ namespace libRetroRunner {
         pthread_mutex_t *queue_lock = nullptr;
 
         uint32_t framesInFlight_ = 2;
+        bool waitEachFrame_ = false;    //低延迟: 每帧提交后等待GPU完成, 只有一帧在队列中
+
+        //提交到再次使用这一帧时 fence 等待返回, 包含队列中其他帧的时间(约 framesInFlight_ 帧), 不是显示延迟
+        LatencyHistogram *submitToFence_ = nullptr;
+        LatencyHistogram *acquireTime_ = nullptr;
+        LatencyHistogram *presentTime_ = nullptr;
 
 
         RRVulkanSurfaceContext surfaceContext_{};
@@ -289,21 +329,23 @@ namespace libRetroRunner {
 
         retro_vulkan_destroy_device_t destroyDeviceImpl_ = nullptr;
 
-        const retro_vulkan_image *negotiationImage_ = nullptr;
-        uint32_t negotiationSemaphoreCount_ = 0;
-        VkSemaphore *negotiationSemaphores_ = nullptr;
-        VkPipelineStageFlags *negotiationWaitStages_= nullptr;
-        uint32_t negotiationQueueFamily_ = 0;
-        VkSemaphore negotiationSemaphore_ =VK_NULL_HANDLE ;
-        std::vector<VkCommandBuffer> negotiationCommandBuffers_{};
-
+        //硬件核心通过 set_image 提交的图像(拷贝一份), 在下一次 set_image 之前可以重复显示
+        retro_vulkan_image negotiationImage_{};
+        bool negotiationImageValid_ = false;
+        std::vector<VkSemaphore> negotiationSemaphores_{};         //下一次提交时等待, 只等待一次
+        std::vector<VkPipelineStageFlags> negotiationWaitStages_{};
+        uint32_t negotiationQueueFamily_ = VK_QUEUE_FAMILY_IGNORED;
+        VkSemaphore negotiationSemaphore_ = VK_NULL_HANDLE;       //下一次提交完成时触发
+        std::vector<VkCommandBuffer> negotiationCommandBuffers_{}; //在帧命令之前提交
+
+        size_t pipelineCacheSavedSize_ = 0;     //磁盘上缓存的大小, 未变化时不重复写入
+        VulkanMemoryAllocator *memoryAllocator_ = nullptr;     //纹理与缓冲区的显存都从这里子分配
         VulkanRWBuffer *vertexBuffer_ = nullptr;
         VkSampler sampler_ = VK_NULL_HANDLE;
         uint64_t frameCount_ = 0;
 
         bool videoContentNeedUpdate_ = false;
 
-        std::vector<unsigned char> convertingBuffer;
     };
 }
 
@@ -0,0 +1,233 @@
+//
+// Created by aidoo on 3/20/2025.
+//
+
+#include "vk_memory_allocator.h"
+#include "../../app/statistics.h"
+#include <algorithm>
+
+using libRetroRunner::Statistics;
+
+static inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice logicalDevice) :
+        physicalDevice_(physicalDevice), logicalDevice_(logicalDevice) {
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memoryProperties_);
+    deviceAllocations_ = &Statistics::Current()->GetCounter("vulkan.memory_device_allocations");
+    liveBlocks_ = &Statistics::Current()->GetCounter("vulkan.memory_blocks");
+    blockBytes_ = &Statistics::Current()->GetCounter("vulkan.memory_block_bytes");
+    subAllocations_ = &Statistics::Current()->GetCounter("vulkan.memory_suballocations");
+    usedBytes_ = &Statistics::Current()->GetCounter("vulkan.memory_used_bytes");
+}
+
+VulkanMemoryAllocator::~VulkanMemoryAllocator() {
+    destroy();
+}
+
+bool VulkanMemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear, VulkanMemoryAllocation *allocation) {
+    uint32_t memoryType = 0;
+    if (!VkUtil::MapMemoryTypeToIndex(physicalDevice_, requirements.memoryTypeBits, properties, &memoryType)) {
+        LOGE_VC("no memory type for bits 0x%x with properties 0x%x", requirements.memoryTypeBits, properties);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t poolIndex = 0;
+    for (; poolIndex < pools_.size(); poolIndex++) {
+        if (pools_[poolIndex].memoryType == memoryType && pools_[poolIndex].linear == linear) break;
+    }
+    if (poolIndex == pools_.size()) {
+        pools_.push_back(Pool{memoryType, linear});
+    }
+    Pool &pool = pools_[poolIndex];
+
+    VkDeviceSize offset = 0;
+    uint32_t blockIndex = 0;
+    for (; blockIndex < pool.blocks.size(); blockIndex++) {
+        Block &block = pool.blocks[blockIndex];
+        if (block.memory != VK_NULL_HANDLE && allocateFromBlock(block, requirements.size, requirements.alignment, &offset)) break;
+    }
+    if (blockIndex == pool.blocks.size()) {
+        //没有空闲空间, 新建一个块(超过块大小的请求独占一个块)
+        if (!createBlock(pool, std::max(kBlockSize, requirements.size), properties)) return false;
+        for (blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++) {
+            Block &block = pool.blocks[blockIndex];
+            if (block.memory != VK_NULL_HANDLE && block.allocations == 0 && allocateFromBlock(block, requirements.size, requirements.alignment, &offset)) break;
+        }
+        if (blockIndex == pool.blocks.size()) return false;
+    }
+
+    Block &block = pool.blocks[blockIndex];
+    block.allocations++;
+    allocation->memory = block.memory;
+    allocation->offset = offset;
+    allocation->size = requirements.size;
+    allocation->mapped = block.mapped ? (unsigned char *) block.mapped + offset : nullptr;
+    allocation->pool = poolIndex;
+    allocation->block = blockIndex;
+
+    subAllocations_->fetch_add(1, std::memory_order_relaxed);
+    usedBytes_->fetch_add((int64_t) requirements.size, std::memory_order_relaxed);
+    return true;
+}
+
+void VulkanMemoryAllocator::free(VulkanMemoryAllocation *allocation) {
+    if (allocation == nullptr || allocation->memory == VK_NULL_HANDLE) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (allocation->pool >= pools_.size() || allocation->block >= pools_[allocation->pool].blocks.size() ||
+        pools_[allocation->pool].blocks[allocation->block].memory != allocation->memory) {
+        //块已经随 destroy() 释放
+        *allocation = VulkanMemoryAllocation{};
+        return;
+    }
+    Block &block = pools_[allocation->pool].blocks[allocation->block];
+
+    //插入空闲区间并与相邻区间合并
+    auto &ranges = block.freeRanges;
+    size_t idx = 0;
+    while (idx < ranges.size() && ranges[idx].offset < allocation->offset) idx++;
+    ranges.insert(ranges.begin() + (long) idx, FreeRange{allocation->offset, allocation->size});
+    if (idx + 1 < ranges.size() && ranges[idx].offset + ranges[idx].size == ranges[idx + 1].offset) {
+        ranges[idx].size += ranges[idx + 1].size;
+        ranges.erase(ranges.begin() + (long) idx + 1);
+    }
+    if (idx > 0 && ranges[idx - 1].offset + ranges[idx - 1].size == ranges[idx].offset) {
+        ranges[idx - 1].size += ranges[idx].size;
+        ranges.erase(ranges.begin() + (long) idx);
+    }
+    block.allocations--;
+    usedBytes_->fetch_sub((int64_t) allocation->size, std::memory_order_relaxed);
+
+    //每个池保留一个空块供下次使用, 多余的空块还给驱动
+    if (block.allocations == 0) {
+        for (auto &other: pools_[allocation->pool].blocks) {
+            if (&other != &block && other.memory != VK_NULL_HANDLE && other.allocations == 0) {
+                destroyBlock(block);
+                break;
+            }
+        }
+    }
+    *allocation = VulkanMemoryAllocation{};
+}
+
+bool VulkanMemoryAllocator::bindBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, VulkanMemoryAllocation *allocation) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(logicalDevice_, buffer, &requirements);
+    if (!allocate(requirements, properties, true, allocation)) return false;
+    VkResult result = vkBindBufferMemory(logicalDevice_, buffer, allocation->memory, allocation->offset);
+    if (result != VK_SUCCESS) {
+        LOGE_VC("failed to bind buffer memory, error %d", result);
+        free(allocation);
+        return false;
+    }
+    return true;
+}
+
+bool VulkanMemoryAllocator::bindImage(VkImage image, VkMemoryPropertyFlags properties, VulkanMemoryAllocation *allocation) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(logicalDevice_, image, &requirements);
+    if (!allocate(requirements, properties, false, allocation)) return false;
+    VkResult result = vkBindImageMemory(logicalDevice_, image, allocation->memory, allocation->offset);
+    if (result != VK_SUCCESS) {
+        LOGE_VC("failed to bind image memory, error %d", result);
+        free(allocation);
+        return false;
+    }
+    return true;
+}
+
+void VulkanMemoryAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &pool: pools_) {
+        for (auto &block: pool.blocks) {
+            if (block.allocations > 0) {
+                LOGW_VC("memory block %p destroyed with %u live allocations", block.memory, block.allocations);
+            }
+            destroyBlock(block);
+        }
+    }
+    pools_.clear();
+}
+
+void VulkanMemoryAllocator::logStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &pool: pools_) {
+        uint32_t blocks = 0, allocations = 0;
+        VkDeviceSize size = 0, freeSize = 0;
+        for (auto &block: pool.blocks) {
+            if (block.memory == VK_NULL_HANDLE) continue;
+            blocks++;
+            allocations += block.allocations;
+            size += block.size;
+            for (auto &range: block.freeRanges) freeSize += range.size;
+        }
+        LOGD_VC("memory pool type %u(%s): %u blocks, %u allocations, %llu/%llu bytes used", pool.memoryType, pool.linear ? "linear" : "optimal",
+                blocks, allocations, (unsigned long long) (size - freeSize), (unsigned long long) size);
+    }
+    LOGD_VC("memory: %lld device allocations, %lld sub allocations", (long long) deviceAllocations_->load(), (long long) subAllocations_->load());
+}
+
+bool VulkanMemoryAllocator::allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset) {
+    auto &ranges = block.freeRanges;
+    for (size_t idx = 0; idx < ranges.size(); idx++) {
+        FreeRange range = ranges[idx];
+        VkDeviceSize aligned = alignUp(range.offset, alignment);
+        if (aligned + size > range.offset + range.size) continue;
+
+        //切出 [aligned, aligned + size), 前面的对齐填充与剩余部分继续保留为空闲区间
+        ranges.erase(ranges.begin() + (long) idx);
+        VkDeviceSize tail = range.offset + range.size - (aligned + size);
+        if (tail > 0) ranges.insert(ranges.begin() + (long) idx, FreeRange{aligned + size, tail});
+        if (aligned > range.offset) ranges.insert(ranges.begin() + (long) idx, FreeRange{range.offset, aligned - range.offset});
+        *offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+bool VulkanMemoryAllocator::createBlock(Pool &pool, VkDeviceSize size, VkMemoryPropertyFlags properties) {
+    Block block{};
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = pool.memoryType;
+    VkResult result = vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, &block.memory);
+    if (result != VK_SUCCESS) {
+        LOGE_VC("failed to allocate memory block of %llu bytes, type %u, error %d", (unsigned long long) size, pool.memoryType, result);
+        return false;
+    }
+    block.size = size;
+    block.freeRanges.push_back(FreeRange{0, size});
+    if (memoryProperties_.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        result = vkMapMemory(logicalDevice_, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+        if (result != VK_SUCCESS) {
+            LOGE_VC("failed to map memory block, error %d", result);
+            vkFreeMemory(logicalDevice_, block.memory, nullptr);
+            return false;
+        }
+    }
+    deviceAllocations_->fetch_add(1, std::memory_order_relaxed);
+    liveBlocks_->fetch_add(1, std::memory_order_relaxed);
+    blockBytes_->fetch_add((int64_t) size, std::memory_order_relaxed);
+
+    //复用已释放块的位置, 已有分配记录的块下标保持不变
+    for (auto &slot: pool.blocks) {
+        if (slot.memory == VK_NULL_HANDLE) {
+            slot = std::move(block);
+            return true;
+        }
+    }
+    pool.blocks.push_back(std::move(block));
+    return true;
+}
+
+void VulkanMemoryAllocator::destroyBlock(Block &block) {
+    if (block.memory == VK_NULL_HANDLE) return;
+    if (block.mapped) vkUnmapMemory(logicalDevice_, block.memory);
+    vkFreeMemory(logicalDevice_, block.memory, nullptr);
+    liveBlocks_->fetch_sub(1, std::memory_order_relaxed);
+    blockBytes_->fetch_sub((int64_t) block.size, std::memory_order_relaxed);
+    block = Block{};
+}
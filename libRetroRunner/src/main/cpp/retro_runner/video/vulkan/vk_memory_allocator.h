@@ -0,0 +1,92 @@
+//
+// Created by aidoo on 3/20/2025.
+//
+
+#ifndef LIBRETRORUNNER_VK_MEMORY_ALLOCATOR_H
+#define LIBRETRORUNNER_VK_MEMORY_ALLOCATOR_H
+
+#include "rr_vulkan.h"
+#include <atomic>
+#include <mutex>
+
+/* A range of device memory handed out by VulkanMemoryAllocator */
+struct VulkanMemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;     //HOST_VISIBLE 的块常驻映射, 指向本次分配的起始位置
+
+    uint32_t pool = 0;
+    uint32_t block = 0;
+};
+
+/**
+ * Device memory sub-allocator, one pool of large blocks per memory type.
+ * Buffers(linear) and images(optimal) are kept in separate pools so bufferImageGranularity never applies.
+ * Empty blocks are kept(one per pool) and reused across geometry changes and swapchain recreation.
+ * HOST_VISIBLE blocks are mapped once, users must write through VulkanMemoryAllocation::mapped instead of vkMapMemory.
+ */
+class VulkanMemoryAllocator {
+public:
+    static constexpr VkDeviceSize kBlockSize = 8 * 1024 * 1024;
+
+    VulkanMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice logicalDevice);
+
+    ~VulkanMemoryAllocator();
+
+    bool allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear, VulkanMemoryAllocation *allocation);
+
+    void free(VulkanMemoryAllocation *allocation);
+
+    /* allocate memory for the buffer/image and bind it */
+    bool bindBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, VulkanMemoryAllocation *allocation);
+
+    bool bindImage(VkImage image, VkMemoryPropertyFlags properties, VulkanMemoryAllocation *allocation);
+
+    /* free every block, all allocations must have been released */
+    void destroy();
+
+    void logStatistics();
+
+private:
+    struct FreeRange {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr;
+        uint32_t allocations = 0;
+        std::vector<FreeRange> freeRanges{};    //按 offset 排序
+    };
+
+    struct Pool {
+        uint32_t memoryType = 0;
+        bool linear = true;
+        std::vector<Block> blocks{};
+    };
+
+    bool allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset);
+
+    bool createBlock(Pool &pool, VkDeviceSize size, VkMemoryPropertyFlags properties);
+
+    void destroyBlock(Block &block);
+
+private:
+    VkPhysicalDevice physicalDevice_;
+    VkDevice logicalDevice_;
+    VkPhysicalDeviceMemoryProperties memoryProperties_{};
+
+    std::mutex mutex_;
+    std::vector<Pool> pools_{};
+
+    std::atomic<int64_t> *deviceAllocations_ = nullptr;    //vkAllocateMemory 调用次数
+    std::atomic<int64_t> *liveBlocks_ = nullptr;
+    std::atomic<int64_t> *blockBytes_ = nullptr;
+    std::atomic<int64_t> *subAllocations_ = nullptr;       //分配请求次数
+    std::atomic<int64_t> *usedBytes_ = nullptr;
+};
+
+#endif //LIBRETRORUNNER_VK_MEMORY_ALLOCATOR_H
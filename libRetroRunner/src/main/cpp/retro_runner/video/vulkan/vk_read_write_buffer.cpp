@@ -4,10 +4,13 @@
 
 #include "vk_read_write_buffer.h"
 
-VulkanRWBuffer::VulkanRWBuffer(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex) :
+VulkanRWBuffer::VulkanRWBuffer(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex, VulkanMemoryAllocator *allocator) :
         physicalDevice_(physicalDevice),
         logicalDevice_(logicalDevice),
         queueFamilyIndex_(queueFamilyIndex),
+        allocator_(allocator),
+        size_(0),
+        buffer_(VK_NULL_HANDLE),
         isReady_(false) {
 }
 
@@ -31,44 +34,29 @@ bool VulkanRWBuffer::create(VkDeviceSize size, VkBufferUsageFlags usage) {
         LOGE_VC("failed to create buffer, error %d", result);
         return false;
     }
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(logicalDevice_, (VkBuffer) buffer_, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    VkUtil::MapMemoryTypeToIndex(
-            physicalDevice_,
-            memRequirements.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            &allocInfo.memoryTypeIndex);
-    result = vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, (VkDeviceMemory *) &memory_);
-    if (result != VK_SUCCESS) {
-        LOGE_VC("failed to allocate buffer memory, error %d", result);
+    if (!allocator_->bindBuffer(buffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memory_)) {
+        LOGE_VC("failed to allocate buffer memory");
+        vkDestroyBuffer(logicalDevice_, buffer_, nullptr);
+        buffer_ = VK_NULL_HANDLE;
         return false;
     }
-    size_ = allocInfo.allocationSize;
-    vkBindBufferMemory(logicalDevice_, (VkBuffer) buffer_, (VkDeviceMemory) memory_, 0);
+    size_ = size;
     isReady_ = true;
     return true;
 }
 
 void VulkanRWBuffer::destroy() {
-    if (memory_) {
-        vkFreeMemory(logicalDevice_, memory_, nullptr);
-        memory_ = VK_NULL_HANDLE;
-    }
     if (buffer_) {
         vkDestroyBuffer(logicalDevice_, buffer_, nullptr);
         buffer_ = VK_NULL_HANDLE;
     }
+    allocator_->free(&memory_);
     size_ = 0;
+    isReady_ = false;
 }
 
 void VulkanRWBuffer::update(const void *data, VkDeviceSize size) {
-    void *toData;
-    vkMapMemory(logicalDevice_, memory_, 0, size_, 0, &toData);
-    memcpy(toData, data, size > size_ ? size_ : size);
-    vkUnmapMemory(logicalDevice_, memory_);
+    //子分配的内存块常驻映射, 不能再调用 vkMapMemory
+    if (memory_.mapped == nullptr) return;
+    memcpy(memory_.mapped, data, size > size_ ? size_ : size);
 }
@@ -6,10 +6,11 @@
 #define LIBRETRORUNNER_VK_READ_WRITE_BUFFER_H
 
 #include "rr_vulkan.h"
+#include "vk_memory_allocator.h"
 
 class VulkanRWBuffer {
 public:
-    VulkanRWBuffer(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex);
+    VulkanRWBuffer(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex, VulkanMemoryAllocator *allocator);
 
     ~VulkanRWBuffer();
 
@@ -22,7 +23,10 @@ public:
 public:
     inline VkBuffer getBuffer() const { return buffer_; }
 
-    inline VkDeviceMemory getMemory() const { return memory_; }
+    inline VkDeviceMemory getMemory() const { return memory_.memory; }
+
+    /* persistently mapped host memory of the buffer */
+    inline void *getMapped() const { return memory_.mapped; }
 
     inline bool isReady() { return isReady_; }
 
@@ -30,11 +34,12 @@ private:
     VkPhysicalDevice physicalDevice_;
     VkDevice logicalDevice_;
     uint32_t queueFamilyIndex_;
+    VulkanMemoryAllocator *allocator_;
     VkDeviceSize size_;
 
 
     VkBuffer buffer_;
-    VkDeviceMemory memory_;
+    VulkanMemoryAllocation memory_;
 
     bool isReady_;
 };
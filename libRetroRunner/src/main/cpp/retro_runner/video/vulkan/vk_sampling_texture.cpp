@@ -4,11 +4,12 @@
 
 #include "vk_sampling_texture.h"
 #include "vk_read_write_buffer.h"
+#include "../pixel_converter.h"
 
-VulkanSamplingTexture::VulkanSamplingTexture(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex) :
-        physicalDevice_(physicalDevice), logicalDevice_(logicalDevice), queueFamilyIndex_(queueFamilyIndex),
-        width_(0), height_(0), image_(VK_NULL_HANDLE), imageView_(VK_NULL_HANDLE), memory_(VK_NULL_HANDLE), sampler_(VK_NULL_HANDLE),
-        stagingBuffer_(nullptr), convertBuffer(nullptr) {}
+VulkanSamplingTexture::VulkanSamplingTexture(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex, VulkanMemoryAllocator *allocator) :
+        physicalDevice_(physicalDevice), logicalDevice_(logicalDevice), queueFamilyIndex_(queueFamilyIndex), allocator_(allocator),
+        width_(0), height_(0), image_(VK_NULL_HANDLE), imageView_(VK_NULL_HANDLE), sampler_(VK_NULL_HANDLE),
+        stagingBuffer_(nullptr) {}
 
 VulkanSamplingTexture::~VulkanSamplingTexture() {
     destroy();
@@ -36,16 +37,10 @@ bool VulkanSamplingTexture::create(uint32_t width, uint32_t height) {
         return false;
     }
     layout_ = VK_IMAGE_LAYOUT_UNDEFINED;
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(logicalDevice_, image_, &memRequirements);
-    VkMemoryAllocateInfo allocInfo{};
-    {
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = VkUtil::findMemoryType(physicalDevice_, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!allocator_->bindImage(image_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_)) {
+        LOGE_VC("Failed to allocate image memory");
+        return false;
     }
-    vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, &memory_);
-    vkBindImageMemory(logicalDevice_, image_, memory_, 0);
 
     VkImageViewCreateInfo imageViewCreateInfo{};
     {
@@ -109,21 +104,20 @@ bool VulkanSamplingTexture::create(uint32_t width, uint32_t height) {
 bool VulkanSamplingTexture::update(VkQueue queue, VkCommandPool commandPool, const void *data, size_t size, int pixelFormat) {
     VkDeviceSize imageSize = width_ * height_ * 4;  //for R8G8B8A8
     if (!stagingBuffer_) {
-        stagingBuffer_ = new VulkanRWBuffer(physicalDevice_, logicalDevice_, queueFamilyIndex_);
+        stagingBuffer_ = new VulkanRWBuffer(physicalDevice_, logicalDevice_, queueFamilyIndex_, allocator_);
     }
     if (!stagingBuffer_->isReady()) {
         if (!stagingBuffer_->create(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT)) {
             return false;
         }
     }
-    if (pixelFormat == PIXEL_FORMAT_RGB565) {
-        if (!convertBuffer) {
-            convertBuffer = new unsigned char[imageSize];
-        }
-        VkUtil::convertRGB565ToRGBA8888(data, width_, height_, convertBuffer);
-        stagingBuffer_->update(convertBuffer, imageSize);
-    } else {
-        stagingBuffer_->update(data, size);
+    if (stagingBuffer_->getMapped() == nullptr) {
+        return false;
+    }
+    //size = pitch * height, 直接转换到常驻映射的 staging buffer
+    if (!libRetroRunner::ConvertToRGBA8888(pixelFormat, data, width_, height_, size / height_, stagingBuffer_->getMapped(), width_ * 4)) {
+        LOGE_VC("unsupported pixel format: %d", pixelFormat);
+        return false;
     }
 
     VkCommandBuffer commandBuffer = VkUtil::beginSingleTimeCommands(logicalDevice_, commandPool);
@@ -157,10 +151,7 @@ void VulkanSamplingTexture::destroy() {
         vkDestroyImage(logicalDevice_, image_, nullptr);
         image_ = VK_NULL_HANDLE;
     }
-    if (memory_) {
-        vkFreeMemory(logicalDevice_, memory_, nullptr);
-        memory_ = VK_NULL_HANDLE;
-    }
+    allocator_->free(&memory_);
     if (sampler_) {
         vkDestroySampler(logicalDevice_, sampler_, nullptr);
         sampler_ = VK_NULL_HANDLE;
@@ -169,10 +160,6 @@ void VulkanSamplingTexture::destroy() {
         delete stagingBuffer_;
         stagingBuffer_ = nullptr;
     }
-    if (convertBuffer) {
-        delete[] convertBuffer;
-        convertBuffer = nullptr;
-    }
 }
 
 void VulkanSamplingTexture::updateToDescriptorSet(VkDescriptorSet descriptorSet) {
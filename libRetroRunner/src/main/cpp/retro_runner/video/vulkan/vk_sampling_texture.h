@@ -6,11 +6,12 @@
 #define LIBRETRORUNNER_VK_SAMPLING_TEXTURE_H
 
 #include "rr_vulkan.h"
+#include "vk_memory_allocator.h"
 
 /* Helper class, always in VK_FORMAT_R8G8B8A8_UNORM format*/
 class VulkanSamplingTexture {
 public:
-    VulkanSamplingTexture(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex);
+    VulkanSamplingTexture(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamilyIndex, VulkanMemoryAllocator *allocator);
 
     ~VulkanSamplingTexture();
 
@@ -38,21 +39,20 @@ private:
     VkPhysicalDevice physicalDevice_;
     VkDevice logicalDevice_;
     uint32_t queueFamilyIndex_;
+    VulkanMemoryAllocator *allocator_;
 
     uint32_t width_;
     uint32_t height_;
 
     VkImage image_;
     VkImageView imageView_;
-    VkDeviceMemory memory_;
+    VulkanMemoryAllocation memory_;
 
     VkSampler sampler_;
 
     VkImageLayout layout_;
 
     class VulkanRWBuffer *stagingBuffer_;
-
-    unsigned char *convertBuffer;
 };
 
 #endif
@@ -0,0 +1,226 @@
+//
+// Created by Aidoo.TK on 2024/12/24.
+//
+// The 'null' and 'file' audio drivers without AppContext. NullAudioContext runs on a manual clock: the test
+// plays the emu thread (ApplyPendingLatency, samples of one frame, Flush) and the device (RunCallback) in the
+// order of their times on the device clock, so every run gives the same result. The null driver shares the
+// FIFO, rate control and resampler with the oboe driver, the scenarios cover clock drift, a core stall that
+// empties the FIFO and a latency change from the core.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "test_util.h"
+#include "retro_runner/app/statistics.h"
+#include "retro_runner/audio/null_audio_context.h"
+#include "retro_runner/audio/file_audio_context.h"
+#include "retro_runner/audio/resampler/resampler.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    const double kCoreRate = 44100.0;
+    const double kFps = 60.0;
+    const double kFrequency = 1000.0;
+    const double kAmplitude = 0.5 * 32767.0;
+
+    struct Scenario {
+        const char *name;
+        double drift;           //核心时钟相对设备时钟的偏差
+        int jitterUs;           //回调时间的随机偏移
+        double stallAt;         //核心在这个时间停止输出, 0 为不停止
+        double stallSeconds;
+        double latencyAt;       //核心在这个时间设置 RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY, 0 为不设置
+        unsigned latencyMs;
+        double checkFrom;       //从这个时间开始检查欠载和水位
+        double seconds;
+    };
+
+    const Scenario kScenarios[] = {
+            {"no drift",            0.0,    0,    0,  0,   0,  0,   30, 60},
+            {"core +0.5%, jitter",  0.005,  1000, 0,  0,   0,  0,   30, 60},
+            {"core -1%, jitter",    -0.01,  1000, 0,  0,   0,  0,   30, 60},
+            {"stall 300ms",         0.002,  500,  20, 0.3, 0,  0,   35, 60},
+            //FIFO 变大后水位的误差按容量标准化, 变小了, 积分项收敛得更慢, 有一次约 15% 的超调
+            {"latency 200ms",       -0.002, 500,  0,  0,   20, 200, 80, 120},
+    };
+
+    struct Result {
+        int64_t stallUnderrunFrames = 0;   //停止期间缺少的输入帧
+        int64_t underruns = 0;              //checkFrom 之后的欠载次数
+        int64_t overrunSamples = 0;         //checkFrom 之后 FIFO 满时丢弃的采样
+        double meanOccupancy = 0;
+        double maxStep = 0;
+    };
+
+    Result simulate(const Scenario &scenario) {
+        Random random(7);
+        NullAudioContext audio(true);
+        AudioConfig config;
+        config.sampleRate = kCoreRate;
+        config.resamplerQuality = kResamplerMedium;
+        audio.Init(config);
+        audio.Start();
+
+        auto &overrunCounter = Statistics::Current()->GetCounter("audio.fifo_overrun_samples");
+        auto &underrunCounter = Statistics::Current()->GetCounter("audio.null_underruns");
+        int64_t underrunsAtCheck = 0, overrunsAtCheck = 0;
+        bool checking = false;
+
+        const unsigned burst = audio.GetBurstFrames();
+        const double framePeriod = 1.0 / (kFps * (1.0 + scenario.drift));
+        const double callbackPeriod = burst / NullAudioContext::kDeviceSampleRate;
+        std::vector<int16_t> frame;
+        double coreTime = 0, fractionalFrames = 0;
+        uint64_t callbackIndex = 0, producedFrames = 0;
+        bool stalled = false, latencySet = false;
+        int16_t lastOutput = 0;
+        bool hasLastOutput = false;
+        double occupancySum = 0;
+        int64_t occupancyCount = 0;
+
+        //按累计的帧数计算回调时间, 抖动不会累积成时钟漂移
+        auto nextCallbackTime = [&]() {
+            return (callbackIndex + 1) * callbackPeriod + random.Range(-scenario.jitterUs, scenario.jitterUs) / 1000000.0;
+        };
+        double callbackTime = nextCallbackTime();
+
+        Result result;
+        while (callbackTime < scenario.seconds) {
+            if (coreTime <= callbackTime) {
+                //AppContext::Step
+                audio.ApplyPendingLatency();
+                audio.SetPlaybackSpeed(1.0);
+                if (scenario.stallAt > 0 && !stalled && coreTime >= scenario.stallAt) {
+                    //retro_run 卡住了 stallSeconds, 之后按正常节奏继续, 不补上错过的帧
+                    stalled = true;
+                    coreTime += scenario.stallSeconds;
+                    continue;
+                }
+                if (scenario.latencyAt > 0 && !latencySet && coreTime >= scenario.latencyAt) {
+                    //核心在 retro_run 里面通过环境回调设置, 下一帧才生效
+                    latencySet = true;
+                    audio.SetMinimumLatency(scenario.latencyMs);
+                }
+                fractionalFrames += kCoreRate / kFps;
+                int frames = (int) fractionalFrames;
+                fractionalFrames -= frames;
+                frame.resize((size_t) frames * 2);
+                for (int idx = 0; idx < frames; idx++) {
+                    auto value = (int16_t) lround(kAmplitude * sin(2.0 * M_PI * kFrequency * (double) (producedFrames + idx) / kCoreRate));
+                    frame[idx * 2] = value;
+                    frame[idx * 2 + 1] = (int16_t) -value;
+                }
+                producedFrames += frames;
+                //前一部分用单采样回调写入暂存区, 其余批量写入
+                int single = frames / 4;
+                for (int idx = 0; idx < single; idx++) audio.OnAudioSample(frame[idx * 2], frame[idx * 2 + 1]);
+                audio.OnAudioSampleBatch(frame.data() + single * 2, frames - single);
+                audio.Flush();
+                coreTime += framePeriod;
+                continue;
+            }
+
+            if (!checking && callbackTime >= scenario.checkFrom) {
+                checking = true;
+                underrunsAtCheck = underrunCounter.load();
+                overrunsAtCheck = overrunCounter.load();
+            }
+            unsigned occupancy = audio.GetBufferOccupancy();
+            int32_t missing = audio.RunCallback();
+            callbackIndex++;
+            callbackTime = nextCallbackTime();
+            if (stalled && !checking) result.stallUnderrunFrames += missing;
+            if (!checking) continue;
+
+            occupancySum += occupancy;
+            occupancyCount++;
+            const int16_t *output = audio.GetBurstBuffer();
+            for (unsigned idx = 0; idx < burst; idx++) {
+                int16_t value = output[idx * 2];
+                if (hasLastOutput) result.maxStep = std::max(result.maxStep, (double) abs(value - lastOutput));
+                lastOutput = value;
+                hasLastOutput = true;
+            }
+        }
+        result.underruns = underrunCounter.load() - underrunsAtCheck;
+        result.overrunSamples = overrunCounter.load() - overrunsAtCheck;
+        result.meanOccupancy = occupancyCount > 0 ? occupancySum / occupancyCount : 0;
+        audio.Destroy();
+        return result;
+    }
+
+    void testScenario(const Scenario &scenario) {
+        Result result = simulate(scenario);
+        printf("  %-20s occupancy %4.1f%%, underruns %lld, overrun samples %lld, stall underrun frames %lld, max step %.0f LSB\n",
+               scenario.name, result.meanOccupancy, (long long) result.underruns, (long long) result.overrunSamples,
+               (long long) result.stallUnderrunFrames, result.maxStep);
+
+        RR_EXPECT(result.underruns == 0, "%s: %lld underruns after %.0fs", scenario.name, (long long) result.underruns, scenario.checkFrom);
+        RR_EXPECT(result.overrunSamples == 0, "%s: %lld samples dropped after %.0fs", scenario.name, (long long) result.overrunSamples,
+                  scenario.checkFrom);
+        RR_EXPECT(fabs(result.meanOccupancy - 50.0) < 10.0, "%s: mean occupancy %.1f%%, expected about 50%%", scenario.name,
+                  result.meanOccupancy);
+        //补 0 或者丢弃采样会让正弦跳变, 连续的正弦相邻采样最多相差 A * 2pi * f / rate
+        double maxStep = kAmplitude * 2.0 * M_PI * kFrequency * (1.0 + fabs(scenario.drift) + 0.005) / NullAudioContext::kDeviceSampleRate + 4.0;
+        RR_EXPECT(result.maxStep <= maxStep, "%s: output jumps by %.0f LSB, a continuous sine moves at most %.0f", scenario.name,
+                  result.maxStep, maxStep);
+        if (scenario.stallAt > 0) {
+            //停止期间 FIFO 被取空, 缺少的输入大约是停止时间减去缓冲的一半(64ms FIFO)
+            double expected = (scenario.stallSeconds - NullAudioContext::kDefaultLatency / 2000.0) * kCoreRate;
+            RR_EXPECT(result.stallUnderrunFrames > expected * 0.8 && result.stallUnderrunFrames < expected * 1.2,
+                      "%s: %lld input frames missing during the stall, expected about %.0f", scenario.name,
+                      (long long) result.stallUnderrunFrames, expected);
+        }
+    }
+
+    /* 'file' driver: samples written from the emu thread come back from the wav file unchanged */
+    void testFileDriver() {
+        const char *path = "audio_driver_test.wav";
+        const int frames = 44100;
+        std::vector<int16_t> samples((size_t) frames * 2);
+        for (int idx = 0; idx < frames; idx++) {
+            samples[idx * 2] = (int16_t) lround(kAmplitude * sin(2.0 * M_PI * kFrequency * idx / kCoreRate));
+            samples[idx * 2 + 1] = (int16_t) (idx - frames / 2);
+        }
+        {
+            FileAudioContext audio;
+            AudioConfig config;
+            config.sampleRate = kCoreRate;
+            config.dumpPath = path;
+            audio.Init(config);
+            audio.Start();
+            for (int idx = 0; idx < 1000; idx++) audio.OnAudioSample(samples[idx * 2], samples[idx * 2 + 1]);
+            for (int idx = 1000; idx < frames; idx += 735) {
+                audio.OnAudioSampleBatch(samples.data() + idx * 2, std::min(735, frames - idx));
+            }
+            audio.Destroy();
+        }
+
+        FILE *file = fopen(path, "rb");
+        RR_EXPECT(file != nullptr, "can't open %s", path);
+        if (file == nullptr) return;
+        uint8_t header[44];
+        std::vector<int16_t> data((size_t) frames * 2 + 1);
+        size_t headerRead = fread(header, 1, sizeof(header), file);
+        size_t dataRead = fread(data.data(), sizeof(int16_t), data.size(), file);
+        fclose(file);
+        remove(path);
+
+        auto le32 = [&](int offset) { return (uint32_t) header[offset] | header[offset + 1] << 8 | header[offset + 2] << 16 | (uint32_t) header[offset + 3] << 24; };
+        RR_EXPECT(headerRead == sizeof(header) && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVEfmt ", 8) == 0, "bad wav header");
+        RR_EXPECT(le32(24) == (uint32_t) kCoreRate, "wav sample rate %u", le32(24));
+        RR_EXPECT(le32(40) == (uint32_t) frames * 4, "wav data size %u, expected %u", le32(40), (uint32_t) frames * 4);
+        RR_EXPECT(dataRead == (size_t) frames * 2, "read %zu samples from the wav, expected %d", dataRead, frames * 2);
+        RR_EXPECT(memcmp(data.data(), samples.data(), std::min(dataRead, samples.size()) * sizeof(int16_t)) == 0, "wav samples differ");
+    }
+}
+
+int main() {
+    printf("null audio driver, 44100 -> 48000, 256 frames per callback, 64ms FIFO:\n");
+    for (const Scenario &scenario: kScenarios) testScenario(scenario);
+    testFileDriver();
+    return Finish("audio_driver_test");
+}
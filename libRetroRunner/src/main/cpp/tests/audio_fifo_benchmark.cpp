@@ -0,0 +1,124 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+// Cost of feeding a core's single-sample audio (retro_audio_sample_t) into the oboe FifoBuffer:
+// one FIFO write per sample, as before, against the staging buffer of OboeAudioContext::OnAudioSample.
+//   audio_fifo_benchmark [--quick]
+//
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "test_util.h"
+#include "oboe/FifoBuffer.h"
+
+using namespace rr_test;
+
+namespace {
+    /* 与 OboeAudioContext 一致: FifoBuffer(2, samples), 一个 "frame" 是一个 int16 采样 */
+    const size_t kStagingBufferSize = 2048;
+    const uint32_t kFifoSamples = 5644;          //44100Hz 64ms, bufferSizeForLatency
+    const int kFramesPerVideoFrame = 735;        //44100 / 60
+
+    class DirectWriter {
+    public:
+        explicit DirectWriter(oboe::FifoBuffer &fifo) : fifo(fifo) {}
+
+        inline void OnAudioSample(int16_t left, int16_t right) {
+            int16_t pair[2] = {left, right};
+            fifo.write(pair, 2);
+            writes++;
+        }
+
+        inline void Flush() {}
+
+        oboe::FifoBuffer &fifo;
+        int64_t writes = 0;
+    };
+
+    /* OboeAudioContext::OnAudioSample / flushStagingBuffer */
+    class StagingWriter {
+    public:
+        explicit StagingWriter(oboe::FifoBuffer &fifo) : fifo(fifo) {}
+
+        inline void OnAudioSample(int16_t left, int16_t right) {
+            staging[staged++] = left;
+            staging[staged++] = right;
+            if (staged >= kStagingBufferSize) Flush();
+        }
+
+        inline void Flush() {
+            if (staged == 0) return;
+            fifo.write(staging, (int32_t) staged);
+            writes++;
+            staged = 0;
+        }
+
+        oboe::FifoBuffer &fifo;
+        int16_t staging[kStagingBufferSize];
+        size_t staged = 0;
+        int64_t writes = 0;
+    };
+
+    struct Result {
+        double nanosPerFrame;       //每个视频帧
+        double writesPerFrame;
+    };
+
+    /**
+     * run videoFrames emulated retro_run calls. with a reader the audio callback drains the FIFO on another thread
+     * like oboe does, the atomic counters are then shared between cores; without it the FIFO is drained between frames.
+     */
+    template<typename Writer>
+    Result run(int videoFrames, bool withReader) {
+        oboe::FifoBuffer fifo(2, kFifoSamples);
+        Writer writer(fifo);
+        std::atomic<bool> running(true);
+        std::thread reader;
+        if (withReader) {
+            reader = std::thread([&]() {
+                int16_t block[192 * 2];
+                while (running.load(std::memory_order_relaxed)) {
+                    if (fifo.read(block, 192 * 2) == 0) std::this_thread::yield();
+                }
+            });
+        }
+        std::vector<int16_t> drain(kFifoSamples);
+        int64_t elapsed = 0;
+        int16_t value = 0;
+        for (int frame = 0; frame < videoFrames; frame++) {
+            int64_t start = NowNanos();
+            for (int idx = 0; idx < kFramesPerVideoFrame; idx++) {
+                value += 7;
+                writer.OnAudioSample(value, (int16_t) -value);
+            }
+            //AppContext::Step 在 retro_run 之后调用 Flush
+            writer.Flush();
+            elapsed += NowNanos() - start;
+            if (!withReader) fifo.read(drain.data(), kFifoSamples);
+        }
+        running = false;
+        if (reader.joinable()) reader.join();
+        return {(double) elapsed / videoFrames, (double) writer.writes / videoFrames};
+    }
+}
+
+int main(int argc, char **argv) {
+    bool quick = IsQuickRun(argc, argv);
+    int videoFrames = quick ? 600 : 60 * 120;
+
+    printf("single-sample audio, %d stereo frames per video frame, %d video frames\n", kFramesPerVideoFrame, videoFrames);
+    printf("  %-26s  %16s  %14s\n", "", "ns / video frame", "writes / frame");
+    for (int withReader = 0; withReader < 2; withReader++) {
+        Result direct = run<DirectWriter>(videoFrames, withReader);
+        Result staged = run<StagingWriter>(videoFrames, withReader);
+        const char *suffix = withReader ? "reader thread" : "no reader";
+        char label[64];
+        snprintf(label, sizeof(label), "per sample, %s", suffix);
+        printf("  %-26s  %16.0f  %14.1f\n", label, direct.nanosPerFrame, direct.writesPerFrame);
+        snprintf(label, sizeof(label), "staging, %s", suffix);
+        printf("  %-26s  %16.0f  %14.1f\n", label, staged.nanosPerFrame, staged.writesPerFrame);
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+//
+// Created by Aidoo.TK on 2024/12/23.
+//
+// The audio output path of OboeAudioContext on a simulated clock: the core writes a sine into oboe::FifoBuffer
+// in random blocks, the device callback asks for random block sizes, AudioRateControl picks the ratio from
+// the FIFO fill and the resampler produces the output. The core clock drifts against the device clock,
+// after the controller settles the FIFO must stay around half full, without underrun or overrun,
+// and the output must be a continuous sine.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "test_util.h"
+#include "oboe/FifoBuffer.h"
+#include "retro_runner/audio/rate_control.h"
+#include "retro_runner/audio/resampler/resampler.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    const double kCoreRate = 44100.0;
+    const double kDeviceRate = 48000.0;
+    /* OboeAudioContext::bufferSizeForLatency 低延迟时的默认值, 66.7ms, int16 采样数 */
+    const uint32_t kFifoSamples = 5880;
+    const double kFrequency = 1000.0;
+    const double kAmplitude = 0.5 * 32767.0;
+
+    struct Scenario {
+        const char *name;
+        double drift;           //核心时钟相对设备时钟的偏差
+        int producerMin;        //每次写入的帧数
+        int producerMax;
+        int consumerMin;        //每次回调的帧数
+        int consumerMax;
+    };
+
+    const Scenario kScenarios[] = {
+            {"no drift",            0.0,    300, 1100, 64, 480},
+            {"core +0.5%",          0.005,  300, 1100, 64, 480},
+            {"core -0.5%",          -0.005, 300, 1100, 64, 480},
+            {"core +1.5%",          0.015,  300, 1100, 64, 480},
+            {"core -1.5%, small",   -0.015, 1,   64,   32, 192},
+            {"59.94 fps, 735/frame", -0.001, 735, 735,  192, 192},
+    };
+
+    struct Result {
+        int64_t underruns = 0;      //回调时 FIFO 不够, 输出中有补 0 的部分
+        int64_t overruns = 0;       //写入时 FIFO 满, 丢弃了采样
+        double minFill = 1.0;
+        double maxFill = 0.0;
+        double meanFill = 0.0;
+        double maxStep = 0.0;       //相邻输出采样的最大差, LSB
+        double finalRatio = 0.0;    //最后一段时间 ratio 的平均值相对标称值
+    };
+
+    /**
+     * simulate seconds of audio, statistics are taken after settle seconds.
+     * events of the core and the device are ordered by their time on the device clock.
+     */
+    Result simulate(const Scenario &scenario, double seconds, double settle, uint32_t seed) {
+        Random random(seed);
+        oboe::FifoBuffer fifo(2, kFifoSamples);
+        const double ratio = kCoreRate / kDeviceRate;
+        AudioRateControl rateControl;
+        rateControl.Reset(ratio);
+        auto resampler = Resampler::Create(kResamplerMedium, ratio);
+
+        std::vector<int16_t> block((size_t) scenario.producerMax * 2);
+        std::vector<int16_t> streamBuffer(kFifoSamples);
+        std::vector<int16_t> output((size_t) scenario.consumerMax * 2);
+
+        const double coreRate = kCoreRate * (1.0 + scenario.drift);
+        double producerTime = 0, deviceTime = 0;
+        uint64_t producedFrames = 0;
+        int16_t lastOutput = 0;
+        bool hasLastOutput = false;
+        double fillSum = 0, ratioSum = 0;
+        int64_t callbacks = 0;
+
+        Result result;
+        while (deviceTime < seconds) {
+            bool settled = deviceTime >= settle;
+            if (producerTime <= deviceTime) {
+                int frames = random.Range(scenario.producerMin, scenario.producerMax);
+                for (int idx = 0; idx < frames; idx++) {
+                    auto value = (int16_t) lround(kAmplitude * sin(2.0 * M_PI * kFrequency * (double) (producedFrames + idx) / kCoreRate));
+                    block[idx * 2] = value;
+                    block[idx * 2 + 1] = (int16_t) -value;
+                }
+                producedFrames += frames;
+                int32_t written = fifo.write(block.data(), frames * 2);
+                if (settled && written < frames * 2) result.overruns++;
+                //核心按自己的时钟产生音频
+                producerTime += frames / coreRate;
+                continue;
+            }
+
+            //OboeAudioContext::onAudioReady
+            int32_t numFrames = random.Range(scenario.consumerMin, scenario.consumerMax);
+            uint32_t available = fifo.getFullFramesAvailable();
+            double callbackRatio = rateControl.NextRatio(available, fifo.getBufferCapacityInFrames(), numFrames);
+            int32_t inputFrames = rateControl.InputFrames(numFrames, callbackRatio, kFifoSamples / 2);
+            int32_t read = fifo.readNow(streamBuffer.data(), inputFrames * 2);
+            resampler->resample(streamBuffer.data(), inputFrames, output.data(), numFrames, callbackRatio);
+            deviceTime += numFrames / kDeviceRate;
+            if (!settled) continue;
+
+            if (read < inputFrames * 2) result.underruns++;
+            double fill = (double) available / kFifoSamples;
+            result.minFill = std::min(result.minFill, fill);
+            result.maxFill = std::max(result.maxFill, fill);
+            fillSum += fill;
+            ratioSum += callbackRatio / ratio;
+            callbacks++;
+            for (int32_t idx = 0; idx < numFrames; idx++) {
+                int16_t value = output[idx * 2];
+                if (hasLastOutput) result.maxStep = std::max(result.maxStep, (double) abs(value - lastOutput));
+                lastOutput = value;
+                hasLastOutput = true;
+            }
+        }
+        result.meanFill = callbacks > 0 ? fillSum / callbacks : 0;
+        result.finalRatio = callbacks > 0 ? ratioSum / callbacks : 0;
+        return result;
+    }
+
+    void testScenario(const Scenario &scenario, uint32_t seed) {
+        const double seconds = 60.0;
+        const double settle = 30.0;
+        Result result = simulate(scenario, seconds, settle, seed);
+        printf("  %-22s fill %4.1f%% [%4.1f%%, %4.1f%%], ratio %+.3f%%, underruns %lld, overruns %lld, max step %.0f LSB\n",
+               scenario.name, result.meanFill * 100, result.minFill * 100, result.maxFill * 100, (result.finalRatio - 1.0) * 100,
+               (long long) result.underruns, (long long) result.overruns, result.maxStep);
+
+        RR_EXPECT(result.underruns == 0, "%s: %lld underruns after the controller settled", scenario.name, (long long) result.underruns);
+        RR_EXPECT(result.overruns == 0, "%s: %lld overruns after the controller settled", scenario.name, (long long) result.overruns);
+        RR_EXPECT(fabs(result.meanFill - 0.5) < 0.1, "%s: mean fill %.1f%%, expected about 50%%", scenario.name, result.meanFill * 100);
+        //控制器补偿了时钟偏差: 消耗输入的速度等于核心产生的速度
+        RR_EXPECT(fabs(result.finalRatio - (1.0 + scenario.drift)) < 0.001, "%s: ratio %+.3f%%, drift %+.3f%%", scenario.name,
+                  (result.finalRatio - 1.0) * 100, scenario.drift * 100);
+        //补 0 或者丢弃采样会让正弦跳变, 连续的正弦相邻采样最多相差 A * 2pi * f / rate
+        double maxStep = kAmplitude * 2.0 * M_PI * kFrequency * (1.0 + fabs(scenario.drift) + 0.005) / kDeviceRate + 4.0;
+        RR_EXPECT(result.maxStep <= maxStep, "%s: output jumps by %.0f LSB, a continuous sine moves at most %.0f", scenario.name,
+                  result.maxStep, maxStep);
+    }
+
+    /* the controller alone: a FIFO fill below half lowers the ratio, above half raises it, bounded by kMaxP + kMaxI */
+    void testControllerDirection() {
+        AudioRateControl rateControl;
+        rateControl.Reset(1.0);
+        double low = rateControl.NextRatio(1000, 10000, 192);
+        rateControl.Reset(1.0);
+        double high = rateControl.NextRatio(9000, 10000, 192);
+        RR_EXPECT(low < 1.0 && high > 1.0, "fill 10%% gives ratio %.5f, fill 90%% gives %.5f", low, high);
+
+        rateControl.Reset(1.0);
+        double ratio = 1.0;
+        for (int idx = 0; idx < 100000; idx++) ratio = rateControl.NextRatio(0, 10000, 192);
+        double bound = 1.0 - AudioRateControl::kMaxP - AudioRateControl::kMaxI;
+        RR_EXPECT(fabs(ratio - bound) < 1e-9, "empty FIFO for a long time gives ratio %.5f, bound %.5f", ratio, bound);
+
+        //取整的误差留到下一次, 累计的输入帧数等于 ratio 的累计
+        rateControl.Reset(1.0);
+        int64_t total = 0;
+        for (int idx = 0; idx < 1000; idx++) total += rateControl.InputFrames(97, 0.9187, 4096);
+        RR_EXPECT(llabs(total - lround(97 * 0.9187 * 1000)) <= 1, "1000 callbacks of 97 frames read %lld input frames", (long long) total);
+    }
+}
+
+int main() {
+    testControllerDirection();
+    printf("FIFO -> rate control -> resampler, 44100 -> 48000, 66.7ms FIFO:\n");
+    uint32_t seed = 1;
+    for (const Scenario &scenario: kScenarios) testScenario(scenario, seed++);
+    return Finish("audio_rate_control_test");
+}
@@ -0,0 +1,147 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+
+#ifndef _RR_AUDIO_SIGNAL_H
+#define _RR_AUDIO_SIGNAL_H
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "retro_runner/audio/resampler/resampler.h"
+
+namespace rr_test {
+
+    /* interleaved stereo sine, right channel is the inverted left one so swapped channels are detected */
+    inline std::vector<int16_t> MakeSine(double frequency, double sampleRate, size_t frames, double amplitude = 0.5) {
+        std::vector<int16_t> samples(frames * 2);
+        for (size_t idx = 0; idx < frames; idx++) {
+            double value = amplitude * 32767.0 * sin(2.0 * M_PI * frequency * idx / sampleRate);
+            samples[idx * 2] = (int16_t) lround(value);
+            samples[idx * 2 + 1] = (int16_t) -lround(value);
+        }
+        return samples;
+    }
+
+    /**
+     * phase(radians) at input frame position of a linear sweep from f0 to f1 Hz over totalFrames,
+     * position may be fractional or outside of the sweep, used for the expected output of a resampler.
+     */
+    inline double SweepPhase(double f0, double f1, double sampleRate, double totalFrames, double position) {
+        double t = position / sampleRate;
+        double duration = totalFrames / sampleRate;
+        return 2.0 * M_PI * (f0 * t + (f1 - f0) / (2.0 * duration) * t * t);
+    }
+
+    /* instantaneous frequency(Hz) of the sweep at an input frame position */
+    inline double SweepFrequency(double f0, double f1, double totalFrames, double position) {
+        return f0 + (f1 - f0) * position / totalFrames;
+    }
+
+    /* interleaved stereo linear sweep, right channel inverted like MakeSine */
+    inline std::vector<int16_t> MakeSweep(double f0, double f1, double sampleRate, size_t frames, double amplitude = 0.5) {
+        std::vector<int16_t> samples(frames * 2);
+        for (size_t idx = 0; idx < frames; idx++) {
+            double value = amplitude * 32767.0 * sin(SweepPhase(f0, f1, sampleRate, (double) frames, (double) idx));
+            samples[idx * 2] = (int16_t) lround(value);
+            samples[idx * 2 + 1] = (int16_t) -lround(value);
+        }
+        return samples;
+    }
+
+    /**
+     * drive a resampler the way OboeAudioContext::onAudioReady does: the output is pulled in blocks,
+     * the input frame count of each block is sinkFrames * ratio rounded with the error carried to the next block.
+     * @param ratioAt    ratio for the block starting at an output frame
+     * @param nextBlock  output frames of the next block
+     * @param consumed   input frames consumed in total
+     */
+    inline std::vector<int16_t> ResampleStream(libRetroRunner::Resampler &resampler, const std::vector<int16_t> &input, size_t outputFrames,
+                                               const std::function<double(size_t)> &ratioAt, const std::function<int32_t()> &nextBlock,
+                                               size_t *consumed = nullptr) {
+        std::vector<int16_t> output(outputFrames * 2);
+        size_t inputFrames = input.size() / 2;
+        size_t inputPos = 0;
+        size_t outputPos = 0;
+        double carry = 0;
+        while (outputPos < outputFrames) {
+            int32_t frames = (int32_t) std::min<size_t>(nextBlock(), outputFrames - outputPos);
+            double ratio = ratioAt(outputPos);
+            carry += frames * ratio;
+            auto submit = (int32_t) lround(carry);
+            carry -= submit;
+            submit = (int32_t) std::min<size_t>(submit, inputFrames - inputPos);
+            resampler.resample(input.data() + inputPos * 2, submit, output.data() + outputPos * 2, frames, ratio);
+            inputPos += submit;
+            outputPos += frames;
+        }
+        if (consumed) *consumed = inputPos;
+        return output;
+    }
+
+    struct SineFit {
+        double thdnDb = 0;      //残差(噪声+失真)相对正弦的能量, dB
+        double maxError = 0;    //最大残差, LSB
+        double amplitude = 0;
+    };
+
+    /**
+     * least squares fit of a sine with a known frequency(cycles per sample) and DC on [begin, end) of one channel,
+     * everything else is counted as THD+N.
+     */
+    inline SineFit FitSine(const std::vector<int16_t> &samples, int channel, size_t begin, size_t end, double cyclesPerSample) {
+        //正规方程, 基为 sin, cos, 1
+        double m[3][3] = {{0}};
+        double v[3] = {0};
+        for (size_t idx = begin; idx < end; idx++) {
+            double w = 2.0 * M_PI * cyclesPerSample * idx;
+            double basis[3] = {sin(w), cos(w), 1.0};
+            double y = samples[idx * 2 + channel];
+            for (int row = 0; row < 3; row++) {
+                v[row] += basis[row] * y;
+                for (int col = 0; col < 3; col++) m[row][col] += basis[row] * basis[col];
+            }
+        }
+        //高斯消元
+        for (int col = 0; col < 3; col++) {
+            for (int row = col + 1; row < 3; row++) {
+                double factor = m[row][col] / m[col][col];
+                for (int k = col; k < 3; k++) m[row][k] -= factor * m[col][k];
+                v[row] -= factor * v[col];
+            }
+        }
+        double c[3];
+        for (int row = 2; row >= 0; row--) {
+            double sum = v[row];
+            for (int k = row + 1; k < 3; k++) sum -= m[row][k] * c[k];
+            c[row] = sum / m[row][row];
+        }
+
+        SineFit fit;
+        double residual = 0;
+        for (size_t idx = begin; idx < end; idx++) {
+            double w = 2.0 * M_PI * cyclesPerSample * idx;
+            double error = samples[idx * 2 + channel] - (c[0] * sin(w) + c[1] * cos(w) + c[2]);
+            residual += error * error;
+            fit.maxError = std::max(fit.maxError, fabs(error));
+        }
+        fit.amplitude = sqrt(c[0] * c[0] + c[1] * c[1]);
+        double signal = fit.amplitude * fit.amplitude / 2.0 * (double) (end - begin);
+        fit.thdnDb = 10.0 * log10(std::max(residual, 1e-9) / signal);
+        return fit;
+    }
+
+    /* rms of one channel on [begin, end) relative to full scale, dB */
+    inline double RmsDb(const std::vector<int16_t> &samples, int channel, size_t begin, size_t end) {
+        double sum = 0;
+        for (size_t idx = begin; idx < end; idx++) {
+            double value = samples[idx * 2 + channel] / 32768.0;
+            sum += value * value;
+        }
+        return 10.0 * log10(std::max(sum / (double) (end - begin), 1e-20));
+    }
+}
+
+#endif
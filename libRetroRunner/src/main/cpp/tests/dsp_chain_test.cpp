@@ -0,0 +1,119 @@
+//
+// Created by Aidoo.TK on 2024/12/24.
+//
+// AudioDspChain with the builtin libretro filters. eq only outputs whole FFT blocks, the chain must still return
+// exactly the requested frames on every callback: a sine pushed through with odd callback sizes must come out
+// continuous, without zero gaps, delayed by one block, and the same as with a fixed callback size.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "test_util.h"
+#include "retro_runner/audio/dsp_chain.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    const float kRate = 48000.0f;
+    const double kFrequency = 1000.0;
+    const double kAmplitude = 0.5;
+    const size_t kMaxFrames = 1024;
+    const size_t kTotalFrames = 48000 * 4;
+
+    struct Preset {
+        const char *name;
+        std::vector<std::string> files;
+        size_t latency;         //eq 的块大小减一
+        bool flat;              //频响平坦, 输出与输入的能量相同
+    };
+
+    /* eq 的块 512 帧, 1kHz 提升 3dB, 后面接 IIR.dsp 的低通 */
+    const char *kBoostPreset = "dsp_chain_test_eq.dsp";
+
+    void writeBoostPreset() {
+        FILE *file = fopen(kBoostPreset, "w");
+        if (file == nullptr) return;
+        fprintf(file, "filters = 1\nfilter0 = eq\neq_block_size_log2 = 9\neq_frequencies = \"500 1000 2000\"\neq_gains = \"0 3 0\"\n");
+        fclose(file);
+    }
+
+    /* fixedFrames 为 0 时每次回调的帧数是随机的奇数 */
+    std::vector<float> run(const Preset &preset, uint32_t seed, size_t fixedFrames) {
+        AudioDspChain chain;
+        size_t loaded = chain.Load(preset.files, kRate, kMaxFrames);
+        RR_EXPECT(loaded == preset.files.size(), "%s: %zu of %zu presets loaded", preset.name, loaded, preset.files.size());
+        RR_EXPECT(chain.GetLatency() == preset.latency, "%s: latency %zu frames, expected %zu", preset.name, chain.GetLatency(), preset.latency);
+
+        Random random(seed);
+        std::vector<float> output(kTotalFrames * 2);
+        std::vector<float> block((kMaxFrames * 2 + 1) * 2);
+        size_t position = 0;
+        while (position < kTotalFrames) {
+            //奇数大小, 偶尔超过 kMaxFrames, 由 Process 拆开
+            size_t frames = fixedFrames > 0 ? fixedFrames : (size_t) random.Range(0, (int) kMaxFrames) * 2 + 1;
+            frames = std::min(frames, kTotalFrames - position);
+            for (size_t idx = 0; idx < frames; idx++) {
+                auto value = (float) (kAmplitude * sin(2.0 * M_PI * kFrequency * (double) (position + idx) / kRate));
+                block[idx * 2] = value;
+                block[idx * 2 + 1] = -value;
+            }
+            chain.Process(block.data(), frames);
+            std::copy(block.data(), block.data() + frames * 2, output.data() + position * 2);
+            position += frames;
+        }
+        return output;
+    }
+
+    void testPreset(const Preset &preset) {
+        std::vector<float> output = run(preset, 11, 0);
+
+        //滤镜的延迟之后再留一个块给 eq 的重叠相加
+        size_t start = preset.latency * 2 + 2048;
+        size_t longestQuiet = 0, quiet = 0;
+        double maxStep = 0, energy = 0;
+        for (size_t idx = start; idx < kTotalFrames; idx++) {
+            float value = output[idx * 2];
+            quiet = fabsf(value) < 1e-3f && fabsf(output[idx * 2 + 1]) < 1e-3f ? quiet + 1 : 0;
+            longestQuiet = std::max(longestQuiet, quiet);
+            maxStep = std::max(maxStep, (double) fabsf(value - output[idx * 2 - 2]));
+            energy += value * value;
+        }
+        double rms = sqrt(energy / (kTotalFrames - start));
+        printf("  %-16s latency %4zu frames, rms %.4f, longest quiet run %zu frames, max step %.4f\n", preset.name,
+               preset.latency, rms, longestQuiet, maxStep);
+
+        //1kHz 正弦只在过零点附近有一个采样接近 0, 补 0 的空隙至少是一个块
+        RR_EXPECT(longestQuiet <= 1, "%s: %zu frames of silence in the output", preset.name, longestQuiet);
+        //连续的正弦相邻采样最多相差 A * 2pi * f / rate, A 用实际的振幅
+        double stepLimit = sqrt(2.0) * rms * 2.0 * M_PI * kFrequency / kRate * 1.1;
+        RR_EXPECT(maxStep <= stepLimit, "%s: output jumps by %.4f, a continuous sine moves at most %.4f", preset.name, maxStep, stepLimit);
+        if (preset.flat) {
+            double gain = 20.0 * log10(rms / (kAmplitude / sqrt(2.0)));
+            RR_EXPECT(fabs(gain) < 0.5, "%s: gain %.2f dB through a flat eq", preset.name, gain);
+        }
+
+        //输出只取决于输入, 与每次回调的帧数无关
+        std::vector<float> fixed = run(preset, 0, 480);
+        size_t mismatch = 0;
+        for (size_t idx = 0; idx < output.size(); idx++) {
+            if (output[idx] != fixed[idx]) mismatch++;
+        }
+        RR_EXPECT(mismatch == 0, "%s: %zu samples differ between odd callback sizes and 480 frames per callback", preset.name, mismatch);
+    }
+}
+
+int main() {
+    writeBoostPreset();
+    const std::string presetDir = RR_DSP_PRESET_DIR;
+    const Preset presets[] = {
+            {"EQ.dsp",           {presetDir + "/EQ.dsp"},                   255, true},
+            {"eq boost + IIR",   {kBoostPreset, presetDir + "/IIR.dsp"},    511, false},
+    };
+    printf("AudioDspChain, 1kHz sine at 48000Hz, odd callback sizes up to %zu frames:\n", kMaxFrames * 2 + 1);
+    for (const Preset &preset: presets) testPreset(preset);
+    remove(kBoostPreset);
+    return Finish("dsp_chain_test");
+}
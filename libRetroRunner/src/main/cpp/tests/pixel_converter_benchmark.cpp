@@ -0,0 +1,137 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+// Frame conversion to RGBA8888 with each pixel converter kernel at common core resolutions,
+// and HashFrame (video frame dedupe) against comparing with a shadow copy of the last frame.
+//   pixel_converter_benchmark [--quick]
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <libretro-common/include/libretro.h>
+#include "test_util.h"
+#include "retro_runner/video/pixel_converter.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    struct Resolution {
+        unsigned int width;
+        unsigned int height;
+    };
+
+    /* SNES, PSX 高分辨率/DOS, 720p (N64/PSP 高倍内部分辨率) */
+    const Resolution kResolutions[] = {{256, 224}, {640, 480}, {1280, 720}};
+
+    struct Format {
+        int pixelFormat;
+        const char *name;
+    };
+
+    const Format kFormats[] = {
+            {RETRO_PIXEL_FORMAT_0RGB1555, "0RGB1555"},
+            {RETRO_PIXEL_FORMAT_RGB565,   "RGB565"},
+            {RETRO_PIXEL_FORMAT_XRGB8888, "XRGB8888"},
+    };
+
+    const char *kKernelNames[] = {"auto", "scalar", "neon", "sse2", "avx2"};
+
+    /* 最快一次的耗时, us */
+    double convertFrame(PixelRowConverter converter, const std::vector<uint8_t> &src, size_t srcPitch, std::vector<uint8_t> &dst,
+                        const Resolution &resolution, int repeats) {
+        double best = 1e30;
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            int64_t start = NowNanos();
+            const uint8_t *in = src.data();
+            uint8_t *out = dst.data();
+            for (unsigned int row = 0; row < resolution.height; row++) {
+                converter(in, out, resolution.width);
+                in += srcPitch;
+                out += resolution.width * 4;
+            }
+            best = std::min(best, (NowNanos() - start) / 1000.0);
+        }
+        return best;
+    }
+
+    /* 防止结果没有被使用时编译器把 hash 和 memcmp 优化掉 */
+    volatile uint64_t gSink;
+
+    /**
+     * dedupe cost per frame, us: HashFrame of the frame, or memcmp with a shadow copy plus the memcpy
+     * which keeps the shadow copy up to date when the frame changed.
+     */
+    void dedupeCost(const Format &format, const Resolution &resolution, int repeats, Random &random) {
+        size_t rowBytes = resolution.width * GetPixelFormatBytes(format.pixelFormat);
+        size_t pitch = (rowBytes + 63) / 64 * 64;
+        std::vector<uint8_t> frame(pitch * resolution.height);
+        for (uint8_t &value: frame) value = (uint8_t) random.Next();
+        std::vector<uint8_t> shadow(frame);
+
+        double hash = 1e30, compare = 1e30, copy = 1e30;
+        uint64_t sink = 0;
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            int64_t start = NowNanos();
+            sink += HashFrame(frame.data(), rowBytes, resolution.height, pitch);
+            hash = std::min(hash, (NowNanos() - start) / 1000.0);
+
+            //相同的帧, memcmp 要比较完整个帧
+            start = NowNanos();
+            for (unsigned int row = 0; row < resolution.height; row++) {
+                sink += memcmp(frame.data() + row * pitch, shadow.data() + row * pitch, rowBytes) == 0;
+            }
+            compare = std::min(compare, (NowNanos() - start) / 1000.0);
+
+            start = NowNanos();
+            memcpy(shadow.data(), frame.data(), frame.size());
+            copy = std::min(copy, (NowNanos() - start) / 1000.0);
+        }
+        gSink = sink;
+        printf("  %4ux%-4u %-9s  %8.1f  %8.1f  %8.1f\n", resolution.width, resolution.height, format.name, hash, compare, copy);
+    }
+}
+
+int main(int argc, char **argv) {
+    int repeats = IsQuickRun(argc, argv) ? 2 : 200;
+    Random random(1);
+    //第一次调用时选择 kernel 并打印日志
+    GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_XRGB8888);
+
+    printf("convert to RGBA8888, us per frame, best of %d\n", repeats);
+    for (const Resolution &resolution: kResolutions) {
+        printf("\n%ux%u\n  %-9s", resolution.width, resolution.height, "");
+        for (int kernel = kPixelKernelScalar; kernel <= kPixelKernelAVX2; kernel++) printf("  %8s", kKernelNames[kernel]);
+        printf("\n");
+        for (const Format &format: kFormats) {
+            //核心的 pitch 一般按 32 字节以上对齐
+            size_t srcPitch = (resolution.width * GetPixelFormatBytes(format.pixelFormat) + 63) / 64 * 64;
+            std::vector<uint8_t> src(srcPitch * resolution.height);
+            for (uint8_t &value: src) value = (uint8_t) random.Next();
+            std::vector<uint8_t> dst(resolution.width * 4 * resolution.height);
+
+            printf("  %-9s", format.name);
+            for (int kernel = kPixelKernelScalar; kernel <= kPixelKernelAVX2; kernel++) {
+                PixelRowConverter converter = GetRGBA8888RowConverter(format.pixelFormat, (PixelKernel) kernel);
+                if (converter == nullptr) {
+                    printf("  %8s", "-");
+                    continue;
+                }
+                printf("  %8.1f", convertFrame(converter, src, srcPitch, dst, resolution, repeats));
+            }
+            printf("\n");
+        }
+    }
+
+    printf("\nframe dedupe, us per frame, best of %d\n", repeats);
+    printf("  %-9s %-9s  %8s  %8s  %8s\n", "", "", "hash", "memcmp", "memcpy");
+    for (const Resolution &resolution: kResolutions) {
+        for (const Format &format: kFormats) {
+            if (format.pixelFormat == RETRO_PIXEL_FORMAT_0RGB1555) continue;
+            dedupeCost(format, resolution, repeats, random);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+// Every pixel converter kernel built for this abi must give the same bytes as the scalar one.
+// NEON is only covered when the test runs on an arm host, kernels the cpu does not support are skipped.
+// HashFrame must ignore the pitch padding and change with any bit of the visible pixels.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <libretro-common/include/libretro.h>
+#include "test_util.h"
+#include "retro_runner/video/pixel_converter.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    struct Format {
+        int pixelFormat;
+        const char *name;
+    };
+
+    const Format kFormats[] = {
+            {RETRO_PIXEL_FORMAT_0RGB1555, "0RGB1555"},
+            {RETRO_PIXEL_FORMAT_RGB565,   "RGB565"},
+            {RETRO_PIXEL_FORMAT_XRGB8888, "XRGB8888"},
+    };
+
+    const PixelKernel kKernels[] = {kPixelKernelAuto, kPixelKernelNeon, kPixelKernelSSE2, kPixelKernelAVX2};
+    const char *kKernelNames[] = {"auto", "scalar", "neon", "sse2", "avx2"};
+
+    /* 宽度覆盖 16/32 像素的向量块以及剩余部分 */
+    const unsigned int kWidths[] = {1, 3, 7, 15, 17, 31, 33, 47, 63, 65, 255, 257, 321, 641};
+
+    /* 输出行后面留一段, 检查 kernel 不会写到行外 */
+    const size_t kGuardBytes = 64;
+    const uint8_t kGuardValue = 0xa5;
+
+    /* 分量扩展到 8 bit 时高位复制到低位, 0 -> 0, 最大值 -> 0xff */
+    uint8_t expand(uint32_t value, int bits) {
+        return (uint8_t) ((value << (8 - bits)) | (value >> (2 * bits - 8)));
+    }
+
+    /* scalar 按定义逐个检查所有 16bit 值 */
+    void testScalarExhaustive() {
+        std::vector<uint16_t> input(65536);
+        for (uint32_t idx = 0; idx < 65536; idx++) input[idx] = (uint16_t) idx;
+        std::vector<uint8_t> output(65536 * 4);
+
+        PixelRowConverter rgb565 = GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_RGB565, kPixelKernelScalar);
+        rgb565(input.data(), output.data(), 65536);
+        int errors = 0;
+        for (uint32_t idx = 0; idx < 65536; idx++) {
+            const uint8_t *p = &output[idx * 4];
+            if (p[0] != expand(idx >> 11, 5) || p[1] != expand((idx >> 5) & 0x3f, 6) || p[2] != expand(idx & 0x1f, 5) || p[3] != 0xff) errors++;
+        }
+        RR_EXPECT(errors == 0, "scalar RGB565: %d wrong pixels", errors);
+
+        PixelRowConverter rgb1555 = GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_0RGB1555, kPixelKernelScalar);
+        rgb1555(input.data(), output.data(), 65536);
+        errors = 0;
+        for (uint32_t idx = 0; idx < 65536; idx++) {
+            const uint8_t *p = &output[idx * 4];
+            if (p[0] != expand((idx >> 10) & 0x1f, 5) || p[1] != expand((idx >> 5) & 0x1f, 5) || p[2] != expand(idx & 0x1f, 5) || p[3] != 0xff) errors++;
+        }
+        RR_EXPECT(errors == 0, "scalar 0RGB1555: %d wrong pixels", errors);
+
+        const uint32_t pixels[3] = {0x00123456, 0xff000000, 0x80ffffff};
+        uint8_t rgba[12];
+        GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_XRGB8888, kPixelKernelScalar)(pixels, rgba, 3);
+        const uint8_t expected[12] = {0x12, 0x34, 0x56, 0xff, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0xff};
+        RR_EXPECT(memcmp(rgba, expected, 12) == 0, "scalar XRGB8888: wrong bytes");
+    }
+
+    /**
+     * a random frame with a padded pitch converted row by row with each kernel, compared with scalar.
+     * the source rows start at pitch offsets which are not 16/32 byte aligned.
+     */
+    void testKernel(const Format &format, PixelKernel kernel, Random &random) {
+        PixelRowConverter converter = GetRGBA8888RowConverter(format.pixelFormat, kernel);
+        PixelRowConverter scalar = GetRGBA8888RowConverter(format.pixelFormat, kPixelKernelScalar);
+        if (converter == nullptr) return;
+
+        unsigned int bytes = GetPixelFormatBytes(format.pixelFormat);
+        const unsigned int height = 5;
+        for (unsigned int width: kWidths) {
+            //pitch 比一行多出 bytes * 3, 每行的起点对齐不同
+            size_t pitch = width * bytes + bytes * 3;
+            std::vector<uint8_t> src(pitch * height + bytes);
+            for (uint8_t &value: src) value = (uint8_t) random.Next();
+            //整体偏移一个像素, 起点不是 16 字节对齐的
+            const uint8_t *frame = src.data() + bytes;
+
+            size_t rowBytes = width * 4;
+            std::vector<uint8_t> expected(rowBytes + kGuardBytes, kGuardValue);
+            std::vector<uint8_t> actual(rowBytes + kGuardBytes, kGuardValue);
+            for (unsigned int row = 0; row < height; row++) {
+                scalar(frame + row * pitch, expected.data(), width);
+                converter(frame + row * pitch, actual.data(), width);
+                size_t at = 0;
+                while (at < actual.size() && actual[at] == expected[at]) at++;
+                RR_EXPECT(at == actual.size(), "%s %s width %u row %u: byte %zu is %02x, scalar %02x%s", format.name, kKernelNames[kernel],
+                          width, row, at, actual[at], expected[at], at >= rowBytes ? " (written past the row)" : "");
+            }
+        }
+    }
+
+    /* ConvertToRGBA8888 steps rows by both pitches and leaves the padding of the destination alone */
+    void testConvertFrame(const Format &format, Random &random) {
+        unsigned int bytes = GetPixelFormatBytes(format.pixelFormat);
+        const unsigned int width = 37, height = 9;
+        size_t srcPitch = width * bytes + 22;
+        size_t dstPitch = width * 4 + 12;
+        std::vector<uint8_t> src(srcPitch * height);
+        for (uint8_t &value: src) value = (uint8_t) random.Next();
+        std::vector<uint8_t> dst(dstPitch * height, kGuardValue);
+        RR_EXPECT(ConvertToRGBA8888(format.pixelFormat, src.data(), width, height, srcPitch, dst.data(), dstPitch), "%s: convert failed", format.name);
+
+        PixelRowConverter scalar = GetRGBA8888RowConverter(format.pixelFormat, kPixelKernelScalar);
+        std::vector<uint8_t> row(width * 4);
+        for (unsigned int y = 0; y < height; y++) {
+            scalar(src.data() + y * srcPitch, row.data(), width);
+            RR_EXPECT(memcmp(row.data(), dst.data() + y * dstPitch, row.size()) == 0, "%s: frame row %u differs", format.name, y);
+            bool padding = true;
+            for (size_t idx = width * 4; idx < dstPitch; idx++) padding &= dst[y * dstPitch + idx] == kGuardValue;
+            RR_EXPECT(padding, "%s: padding of row %u was written", format.name, y);
+        }
+    }
+
+    /* 帧去重依赖的性质: padding 不影响 hash, 可见像素的任意一位变化都改变 hash */
+    void testHashFrame(Random &random) {
+        const unsigned int width = 123, height = 17;
+        const size_t rowBytes = width * 2;
+        const size_t pitch = rowBytes + 10;
+        std::vector<uint8_t> frame(pitch * height);
+        for (uint8_t &value: frame) value = (uint8_t) random.Next();
+        uint64_t hash = HashFrame(frame.data(), rowBytes, height, pitch);
+
+        std::vector<uint8_t> padded(frame);
+        for (unsigned int row = 0; row < height; row++) {
+            for (size_t idx = rowBytes; idx < pitch; idx++) padded[row * pitch + idx] ^= 0xff;
+        }
+        RR_EXPECT(HashFrame(padded.data(), rowBytes, height, pitch) == hash, "hash depends on the padding");
+
+        int unchanged = 0;
+        for (int flip = 0; flip < 2000; flip++) {
+            size_t offset = random.Range(0, height - 1) * pitch + random.Range(0, (int) rowBytes - 1);
+            uint8_t bit = (uint8_t) (1u << random.Range(0, 7));
+            frame[offset] ^= bit;
+            if (HashFrame(frame.data(), rowBytes, height, pitch) == hash) unchanged++;
+            frame[offset] ^= bit;
+        }
+        RR_EXPECT(unchanged == 0, "%d of 2000 single bit flips kept the hash", unchanged);
+
+        //同样的字节按不同尺寸解释是不同的帧
+        RR_EXPECT(HashFrame(frame.data(), rowBytes / 2, height * 2, rowBytes / 2) != HashFrame(frame.data(), rowBytes, height, rowBytes),
+                  "hash does not depend on the frame size");
+    }
+}
+
+int main() {
+    testScalarExhaustive();
+
+    printf("kernels:");
+    for (int kernel = kPixelKernelScalar; kernel <= kPixelKernelAVX2; kernel++) {
+        bool available = GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_RGB565, (PixelKernel) kernel) != nullptr;
+        printf(" %s%s", kKernelNames[kernel], available ? "" : "(skipped)");
+    }
+    printf("\n");
+
+    Random random(3);
+    for (const Format &format: kFormats) {
+        for (PixelKernel kernel: kKernels) testKernel(format, kernel, random);
+        testConvertFrame(format, random);
+    }
+    testHashFrame(random);
+    RR_EXPECT(GetRGBA8888RowConverter(RETRO_PIXEL_FORMAT_UNKNOWN, kPixelKernelScalar) == nullptr, "unknown pixel format has a converter");
+    return Finish("pixel_converter_test");
+}
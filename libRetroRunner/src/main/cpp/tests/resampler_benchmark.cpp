@@ -0,0 +1,143 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+// Cost per output frame of each resampler quality level, driven like OboeAudioContext::onAudioReady,
+// and quality / cost of SincResampler at 8 to 64 taps.
+//   resampler_benchmark [--quick]
+//
+
+#include <stdio.h>
+#include <vector>
+#include "test_util.h"
+#include "audio_signal.h"
+#include "retro_runner/audio/resampler/resampler.h"
+#include "retro_runner/audio/resampler/sinc_resampler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RR_HAVE_TSC 1
+#endif
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    const char *kQualityNames[] = {"linear", "polyphase 8", "polyphase 16", "polyphase 32", "sinc 64"};
+
+    struct RateCase {
+        const char *name;
+        double coreRate;
+        double deviceRate;
+    };
+
+    /* 常见的核心采样率到设备采样率 */
+    const RateCase kRates[] = {
+            {"44100 -> 48000", 44100.0, 48000.0},
+            {"32040 -> 48000", 32040.0, 48000.0},
+            {"48000 -> 44100", 48000.0, 44100.0},
+    };
+
+    /* 低延迟 AAudio 回调约 96-192 帧, OpenSL 约 480 帧 */
+    const int32_t kBlocks[] = {96, 192, 480};
+
+    struct Result {
+        double nanos;
+        double ticks;
+    };
+
+    Result run(int quality, const RateCase &rate, int32_t block, size_t outputFrames, int repeats) {
+        double ratio = rate.coreRate / rate.deviceRate;
+        auto input = MakeSine(1000.0, rate.coreRate, (size_t) (outputFrames * ratio) + 1024);
+        Result best = {1e30, 1e30};
+        //取多次中最快的一次, 减少调度的影响
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            auto resampler = Resampler::Create(quality, ratio);
+            int64_t start = NowNanos();
+#if defined(RR_HAVE_TSC)
+            uint64_t tickStart = __rdtsc();
+#endif
+            ResampleStream(*resampler, input, outputFrames, [ratio](size_t) { return ratio; }, [block]() { return block; });
+            double nanos = (double) (NowNanos() - start) / outputFrames;
+            double ticks = 0;
+#if defined(RR_HAVE_TSC)
+            ticks = (double) (__rdtsc() - tickStart) / outputFrames;
+#endif
+            if (nanos < best.nanos) best = {nanos, ticks};
+        }
+        return best;
+    }
+
+    /**
+     * SincResampler with other tap counts, not reachable through Resampler::Create:
+     * THD+N of 1k/10k at 44100 -> 48000, level of a 23k tone above the output nyquist at 48000 -> 44100
+     * with the ratio 2% above nominal like the rate control may drive it, and cost per output frame.
+     */
+    void sincTaps(bool quick) {
+        const int tapCounts[] = {8, 16, 32, 64};
+        const size_t outputFrames = quick ? 9600 : 48000;
+        const size_t settle = 256;
+        auto block = []() { return (int32_t) 192; };
+        printf("\nSincResampler taps\n");
+        printf("  %4s  %10s  %10s  %16s  %8s\n", "taps", "1k THD+N", "10k THD+N", "23k alias +2%", "ns");
+        for (int taps: tapCounts) {
+            double upRatio = 44100.0 / 48000.0;
+            double thdn[2];
+            const double frequencies[2] = {1000.0, 10000.0};
+            for (int idx = 0; idx < 2; idx++) {
+                auto input = MakeSine(frequencies[idx], 44100.0, (size_t) (outputFrames * upRatio) + 1024);
+                SincResampler resampler(taps, upRatio);
+                auto output = ResampleStream(resampler, input, outputFrames, [upRatio](size_t) { return upRatio; }, block);
+                thdn[idx] = FitSine(output, 0, settle, outputFrames, frequencies[idx] / 48000.0).thdnDb;
+            }
+
+            //23k 在 44100 的奈奎斯特频率以上, 输出中剩下的都是混叠
+            double downRatio = 48000.0 / 44100.0;
+            double drifted = downRatio * 1.02;
+            auto input = MakeSine(23000.0, 48000.0, (size_t) (outputFrames * drifted) + 1024);
+            SincResampler aliasResampler(taps, downRatio);
+            auto aliased = ResampleStream(aliasResampler, input, outputFrames, [drifted](size_t) { return drifted; }, block);
+            double alias = RmsDb(aliased, 0, settle, outputFrames) - RmsDb(input, 0, settle, outputFrames);
+
+            auto timed = MakeSine(1000.0, 44100.0, (size_t) (outputFrames * upRatio) + 1024);
+            double nanos = 1e30;
+            for (int repeat = 0; repeat < (quick ? 1 : 5); repeat++) {
+                SincResampler resampler(taps, upRatio);
+                int64_t start = NowNanos();
+                ResampleStream(resampler, timed, outputFrames, [upRatio](size_t) { return upRatio; }, block);
+                nanos = std::min(nanos, (double) (NowNanos() - start) / outputFrames);
+            }
+            printf("  %4d  %7.1f dB  %7.1f dB  %13.1f dB  %8.1f\n", taps, thdn[0], thdn[1], alias, nanos);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bool quick = IsQuickRun(argc, argv);
+    size_t outputFrames = quick ? 4800 : 48000 * 10;
+    int repeats = quick ? 1 : 5;
+
+    printf("resampler cost per output frame, stereo int16, best of %d runs of %zu frames\n", repeats, outputFrames);
+#if defined(RR_HAVE_TSC)
+    printf("tsc: time stamp counter ticks, about cpu cycles at the nominal frequency\n");
+#endif
+    for (const RateCase &rate: kRates) {
+        printf("\n%s\n", rate.name);
+        printf("  %-13s", "quality");
+        for (int32_t block: kBlocks) {
+            char label[32];
+            snprintf(label, sizeof(label), "block %d ns", block);
+            printf("  %12s %6s  ", label, "tsc");
+        }
+        printf("\n");
+        for (int quality = 0; quality < 5; quality++) {
+            printf("  %-13s", kQualityNames[quality]);
+            for (int32_t block: kBlocks) {
+                Result result = run(quality, rate, block, outputFrames, repeats);
+                printf("  %12.1f %6.0f  ", result.nanos, result.ticks);
+            }
+            printf("\n");
+        }
+    }
+    sincTaps(quick);
+    return 0;
+}
@@ -0,0 +1,341 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+// Streaming contract and quality of every Resampler quality level, and output length of TimeStretch.
+// Thresholds keep a few dB of margin over the measured values, see retro_runner/audio/resampler/readme.md.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <memory>
+#include <vector>
+#include "test_util.h"
+#include "audio_signal.h"
+#include "retro_runner/audio/resampler/resampler.h"
+#include "retro_runner/audio/time_stretch.h"
+
+using namespace libRetroRunner;
+using namespace rr_test;
+
+namespace {
+    const double kCoreRate = 44100.0;
+    const double kDeviceRate = 48000.0;
+    const double kRatio = kCoreRate / kDeviceRate;
+    const int kQualityCount = 5;
+
+    struct QualityLimits {
+        const char *name;
+        double thdn1k;          //1kHz, dB
+        double thdn10k;         //10kHz, dB
+        double latency;         //群延迟, 输入帧, taps / 2 + 1
+        double sweepLow;        //扫频 20-8k 与理想输出的误差, dB
+        double sweepHigh;       //扫频 8k-16k, 滤波器在输入的奈奎斯特频率前开始衰减
+        double impulseGain;     //冲激响应的和与 1 / ratio 的误差, 线性插值的三角形按输出间隔采样时和不固定
+    };
+
+    /* 10kHz 由滤波器决定, taps 越多越好; 16 taps 以上 1kHz 已经接近 int16 输出和 Q15 系数的量化噪声 */
+    const QualityLimits kLimits[kQualityCount] = {
+            {"linear",        -58, -18, 1,  -22, -8,  0.06},
+            {"polyphase 8",   -75, -60, 5,  -52, -16, 0.01},
+            {"polyphase 16",  -82, -77, 9,  -75, -32, 0.01},
+            {"polyphase 32",  -82, -82, 17, -82, -77, 0.01},
+            {"sinc 64",       -85, -85, 33, -85, -84, 0.01},
+    };
+
+    /* skip the start of the output, it contains the filter delay */
+    const size_t kSettleFrames = 256;
+
+    std::function<int32_t()> fixedBlocks(int32_t frames) {
+        return [frames]() { return frames; };
+    }
+
+    std::function<int32_t()> randomBlocks(uint32_t seed) {
+        auto random = std::make_shared<Random>(seed);
+        return [random]() { return (int32_t) random->Range(64, 463); };
+    }
+
+    std::function<double(size_t)> constantRatio(double ratio) {
+        return [ratio](size_t) { return ratio; };
+    }
+
+    /* a sine must come out as the same sine, the right channel as its inverse */
+    void testSineQuality(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        const size_t outputFrames = 48000;
+        const double frequencies[2] = {1000.0, 10000.0};
+        for (int idx = 0; idx < 2; idx++) {
+            double frequency = frequencies[idx];
+            auto input = MakeSine(frequency, kCoreRate, (size_t) (outputFrames * kRatio) + 1024);
+            auto resampler = Resampler::Create(quality, kRatio);
+            auto output = ResampleStream(*resampler, input, outputFrames, constantRatio(kRatio), randomBlocks(quality * 7 + idx));
+
+            double cycles = frequency / kDeviceRate;
+            SineFit left = FitSine(output, 0, kSettleFrames, outputFrames, cycles);
+            SineFit right = FitSine(output, 1, kSettleFrames, outputFrames, cycles);
+            double limit = idx == 0 ? limits.thdn1k : limits.thdn10k;
+            printf("  %-13s %5.0f Hz  THD+N %7.1f dB, max error %6.1f LSB\n", limits.name, frequency, left.thdnDb, left.maxError);
+            RR_EXPECT(left.thdnDb < limit, "%s %.0f Hz: THD+N %.1f dB, limit %.1f dB", limits.name, frequency, left.thdnDb, limit);
+            RR_EXPECT(right.thdnDb < limit, "%s %.0f Hz right: THD+N %.1f dB, limit %.1f dB", limits.name, frequency, right.thdnDb, limit);
+            //1kHz 在通带内, 增益应该接近 1
+            if (idx == 0) {
+                double gain = left.amplitude / (0.5 * 32767.0);
+                RR_EXPECT(fabs(gain - 1.0) < 0.01, "%s: passband gain %.4f", limits.name, gain);
+            }
+        }
+    }
+
+    /**
+     * output must not depend on how the stream is cut into callbacks: random block lengths and fixed ones
+     * give the same samples, so there is no jump at block edges.
+     */
+    void testBlockContinuity(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        const size_t outputFrames = 24000;
+        auto input = MakeSine(3000.0, kCoreRate, (size_t) (outputFrames * kRatio) + 1024, 0.8);
+
+        auto reference = Resampler::Create(quality, kRatio);
+        auto expected = ResampleStream(*reference, input, outputFrames, constantRatio(kRatio), fixedBlocks(192));
+        for (uint32_t seed = 1; seed <= 3; seed++) {
+            auto resampler = Resampler::Create(quality, kRatio);
+            auto output = ResampleStream(*resampler, input, outputFrames, constantRatio(kRatio), randomBlocks(seed));
+            int maxDiff = 0;
+            size_t at = 0;
+            for (size_t idx = 0; idx < output.size(); idx++) {
+                int diff = abs(output[idx] - expected[idx]);
+                if (diff > maxDiff) {
+                    maxDiff = diff;
+                    at = idx / 2;
+                }
+            }
+            RR_EXPECT(maxDiff <= 2, "%s: random blocks(seed %u) differ from fixed blocks by %d at frame %zu", limits.name, seed, maxDiff, at);
+        }
+
+        //一帧一帧地调用也一样
+        auto single = Resampler::Create(quality, kRatio);
+        auto output = ResampleStream(*single, input, 4096, constantRatio(kRatio), fixedBlocks(1));
+        int maxDiff = 0;
+        for (size_t idx = 0; idx < output.size(); idx++) maxDiff = std::max(maxDiff, abs(output[idx] - expected[idx]));
+        RR_EXPECT(maxDiff <= 2, "%s: single frame blocks differ from fixed blocks by %d", limits.name, maxDiff);
+    }
+
+    /**
+     * the rate controller moves the ratio a little every callback, the output must follow it:
+     * each segment is a clean sine at the frequency of its ratio and the input is consumed at that ratio.
+     */
+    void testRatioTracking(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        const double ratios[3] = {kRatio * 0.98, kRatio * 1.02, kRatio};
+        const size_t segmentFrames = 16000;
+        const size_t outputFrames = segmentFrames * 3;
+        const double frequency = 1000.0;
+        auto input = MakeSine(frequency, kCoreRate, (size_t) (outputFrames * kRatio * 1.05) + 1024);
+
+        auto ratioAt = [&](size_t frame) { return ratios[std::min<size_t>(frame / segmentFrames, 2)]; };
+        auto resampler = Resampler::Create(quality, kRatio);
+        size_t consumed = 0;
+        auto output = ResampleStream(*resampler, input, outputFrames, ratioAt, fixedBlocks(160), &consumed);
+
+        double expectedInput = 0;
+        for (double ratio: ratios) expectedInput += ratio * segmentFrames;
+        RR_EXPECT(fabs((double) consumed - expectedInput) <= 1.0, "%s: consumed %zu input frames, expected %.1f", limits.name, consumed, expectedInput);
+
+        for (int segment = 0; segment < 3; segment++) {
+            //每段的相位不连续, 单独拟合, 跳过切换处
+            size_t begin = segment * segmentFrames + kSettleFrames;
+            size_t end = (segment + 1) * segmentFrames;
+            double cycles = frequency * ratios[segment] / kCoreRate;
+            SineFit fit = FitSine(output, 0, begin, end, cycles);
+            RR_EXPECT(fit.thdnDb < limits.thdn1k, "%s: segment %d with ratio %.4f, THD+N %.1f dB", limits.name, segment, ratios[segment], fit.thdnDb);
+        }
+    }
+
+    /**
+     * the sinc table is built once for the nominal ratio, when downsampling the rate control may raise the ratio by ~2%,
+     * a tone above the output nyquist must still be rejected.
+     */
+    void testSincAliasRejection() {
+        const double coreRate = 48000.0;
+        const double ratio = coreRate / 44100.0;
+        const double drifted = ratio * 1.02;
+        const size_t outputFrames = 24000;
+        auto input = MakeSine(23000.0, coreRate, (size_t) (outputFrames * drifted) + 1024);
+        auto resampler = Resampler::Create(4, ratio);
+        auto output = ResampleStream(*resampler, input, outputFrames, constantRatio(drifted), randomBlocks(5));
+        double alias = RmsDb(output, 0, kSettleFrames, outputFrames) - RmsDb(input, 0, kSettleFrames, outputFrames);
+        printf("  sinc 64       23 kHz alias at ratio +2%% %.1f dB\n", alias);
+        RR_EXPECT(alias < -75.0, "sinc 64: 23 kHz alias %.1f dB", alias);
+    }
+
+    /* group delay of an impulse, in input frames */
+    void testLatency(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        //用整数比 1:1 测延迟, 峰值位置不受插值影响
+        const size_t frames = 256;
+        std::vector<int16_t> input(frames * 2, 0);
+        input[64 * 2] = 16384;
+        input[64 * 2 + 1] = 16384;
+        auto resampler = Resampler::Create(quality, 1.0);
+        auto output = ResampleStream(*resampler, input, frames - 64, constantRatio(1.0), fixedBlocks(64));
+
+        //加权重心, 对称的 FIR 重心就是群延迟
+        double sum = 0, weighted = 0;
+        for (size_t idx = 0; idx < output.size() / 2; idx++) {
+            sum += output[idx * 2];
+            weighted += (double) output[idx * 2] * idx;
+        }
+        double delay = weighted / sum - 64;
+        printf("  %-13s latency %.2f input frames\n", limits.name, delay);
+        RR_EXPECT(fabs(delay - limits.latency) < 0.05, "%s: latency %.2f, expected %.0f", limits.name, delay, limits.latency);
+    }
+
+    /**
+     * a linear sweep 20 Hz - 20 kHz at 44100 -> 48000 with random blocks, compared with the ideal sweep at the output rate
+     * delayed by the group delay. the error is measured in bands of the instantaneous frequency, the filters roll off
+     * towards the input nyquist so the upper band has looser limits. the output must never overshoot the input level.
+     */
+    void testSweep(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        const double f0 = 20.0, f1 = 20000.0;
+        const size_t inputFrames = (size_t) kCoreRate * 2;
+        const double amplitude = 0.5;
+        auto input = MakeSweep(f0, f1, kCoreRate, inputFrames, amplitude);
+        const size_t outputFrames = (size_t) ((inputFrames - 1024) / kRatio);
+        auto resampler = Resampler::Create(quality, kRatio);
+        auto output = ResampleStream(*resampler, input, outputFrames, constantRatio(kRatio), randomBlocks(quality * 13 + 1));
+
+        //输出帧 n 对应输入位置 n * ratio - 群延迟
+        const double bands[3] = {20.0, 8000.0, 16000.0};
+        double error[2] = {0}, signal[2] = {0};
+        int16_t peak = 0;
+        for (size_t idx = kSettleFrames; idx < outputFrames; idx++) {
+            double position = idx * kRatio - limits.latency;
+            double frequency = SweepFrequency(f0, f1, (double) inputFrames, position);
+            peak = std::max<int16_t>(peak, (int16_t) abs(output[idx * 2]));
+            if (frequency < bands[0] || frequency >= bands[2]) continue;
+            int band = frequency < bands[1] ? 0 : 1;
+            double expected = amplitude * 32767.0 * sin(SweepPhase(f0, f1, kCoreRate, (double) inputFrames, position));
+            double diff = output[idx * 2] - expected;
+            error[band] += diff * diff;
+            signal[band] += expected * expected;
+        }
+        double low = 10.0 * log10(std::max(error[0], 1e-9) / signal[0]);
+        double high = 10.0 * log10(std::max(error[1], 1e-9) / signal[1]);
+        printf("  %-13s sweep error 20-8k %6.1f dB, 8k-16k %6.1f dB, peak %.3f\n", limits.name, low, high, peak / (amplitude * 32767.0));
+        RR_EXPECT(low < limits.sweepLow, "%s: sweep error 20-8k %.1f dB, limit %.1f dB", limits.name, low, limits.sweepLow);
+        RR_EXPECT(high < limits.sweepHigh, "%s: sweep error 8k-16k %.1f dB, limit %.1f dB", limits.name, high, limits.sweepHigh);
+        RR_EXPECT(peak <= amplitude * 32767.0 * 1.01 + 2, "%s: sweep peak %d overshoots the input level", limits.name, peak);
+    }
+
+    /**
+     * impulses at 44100 -> 48000 land on different phases of the filter: the response of each one
+     * sums to 1 / ratio (unity dc gain), peaks at (position + group delay) / ratio and is zero outside of the filter length.
+     */
+    void testImpulse(int quality) {
+        const QualityLimits &limits = kLimits[quality];
+        const int impulses = 16;
+        const size_t spacing = 200;
+        const size_t inputFrames = spacing * (impulses + 1);
+        const int16_t height = 16384;
+        std::vector<int16_t> input(inputFrames * 2, 0);
+        for (int idx = 1; idx <= impulses; idx++) {
+            input[idx * spacing * 2] = height;
+            input[idx * spacing * 2 + 1] = (int16_t) -height;
+        }
+        const size_t outputFrames = (size_t) ((inputFrames - spacing / 2) / kRatio);
+        auto resampler = Resampler::Create(quality, kRatio);
+        auto output = ResampleStream(*resampler, input, outputFrames, constantRatio(kRatio), randomBlocks(quality * 17 + 3));
+
+        //滤波器在输入帧上的半宽, 换算到输出帧
+        double reach = (limits.latency + 1) / kRatio;
+        double worstSum = 0, worstPeak = 0, leak = 0;
+        for (int impulse = 1; impulse <= impulses; impulse++) {
+            double center = (impulse * spacing + limits.latency) / kRatio;
+            double sum = 0;
+            size_t peakAt = 0;
+            for (size_t idx = (size_t) (center - spacing / 2 / kRatio); idx < (size_t) (center + spacing / 2 / kRatio) && idx < outputFrames; idx++) {
+                int16_t value = output[idx * 2];
+                if (fabs(idx - center) > reach) {
+                    leak = std::max(leak, (double) abs(value));
+                    continue;
+                }
+                sum += value;
+                if (abs(value) > abs(output[peakAt * 2])) peakAt = idx;
+                //右声道是反相的同一个冲激
+                leak = std::max(leak, (double) abs(value + output[idx * 2 + 1]));
+            }
+            worstSum = std::max(worstSum, fabs(sum * kRatio / height - 1.0));
+            worstPeak = std::max(worstPeak, fabs(peakAt - center));
+        }
+        printf("  %-13s impulse gain error %.4f, peak offset %.2f output frames, outside %.0f LSB\n", limits.name, worstSum, worstPeak, leak);
+        RR_EXPECT(worstSum < limits.impulseGain, "%s: impulse response sums to 1 / ratio with error %.4f", limits.name, worstSum);
+        RR_EXPECT(worstPeak <= 0.5 + 1e-9, "%s: impulse peak %.2f output frames away from the group delay", limits.name, worstPeak);
+        RR_EXPECT(leak <= 2, "%s: %.0f LSB outside of the filter length or between the channels", limits.name, leak);
+    }
+
+    /* time stretch keeps the length at input / speed, minus the frames held in its window */
+    void testTimeStretchLength() {
+        const double sampleRate = 48000.0;
+        const double speeds[5] = {0.5, 0.8, 1.0, 1.25, 2.0};
+        const size_t inputFrames = 96000;
+        auto input = MakeSine(440.0, sampleRate, inputFrames);
+        std::vector<int16_t> output(TimeStretch::kMaxHopFrames * 4 * 2);
+
+        for (double speed: speeds) {
+            TimeStretch stretch;
+            stretch.Init(sampleRate);
+            stretch.SetSpeed(speed);
+            Random random(11);
+            size_t fed = 0, produced = 0;
+            while (fed < inputFrames) {
+                //和 OboeAudioContext::writeFifo 一样, 每次写入的帧数不固定, 输出空间不够时分多次
+                size_t frames = std::min<size_t>(random.Range(1, 2048), inputFrames - fed);
+                const int16_t *data = input.data() + fed * 2;
+                while (frames > 0) {
+                    size_t consumed = 0;
+                    produced += stretch.Process(data, frames, consumed, output.data(), output.size() / 2);
+                    data += consumed * 2;
+                    frames -= consumed;
+                    fed += consumed;
+                }
+            }
+            double expected = inputFrames / speed;
+            //窗口 20ms 加上搜索范围 5ms 的输入留在内部, 按速度换算成输出, 输出以 10ms 的 hop 为单位
+            double tolerance = sampleRate * 0.030 / speed + sampleRate * 0.010;
+            printf("  time stretch %.2fx: %zu frames, expected %.0f\n", speed, produced, expected);
+            RR_EXPECT(produced <= expected + 1 && produced + tolerance >= expected, "speed %.2f: produced %zu frames, expected %.0f - %.0f",
+                      speed, produced, expected - tolerance, expected);
+        }
+    }
+
+    void timeQuality(int quality) {
+        const size_t outputFrames = 48000 * 4;
+        auto input = MakeSine(1000.0, kCoreRate, (size_t) (outputFrames * kRatio) + 1024);
+        auto resampler = Resampler::Create(quality, kRatio);
+        int64_t start = NowNanos();
+        ResampleStream(*resampler, input, outputFrames, constantRatio(kRatio), fixedBlocks(192));
+        double nanos = (double) (NowNanos() - start) / outputFrames;
+        printf("  %-13s %6.1f ns / output frame\n", kLimits[quality].name, nanos);
+    }
+}
+
+int main() {
+    printf("sine 44100 -> 48000, random blocks:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testSineQuality(quality);
+    printf("block continuity:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testBlockContinuity(quality);
+    printf("ratio tracking:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testRatioTracking(quality);
+    printf("alias:\n");
+    testSincAliasRejection();
+    printf("latency:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testLatency(quality);
+    printf("sweep:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testSweep(quality);
+    printf("impulse:\n");
+    for (int quality = 0; quality < kQualityCount; quality++) testImpulse(quality);
+    printf("time stretch:\n");
+    testTimeStretchLength();
+    printf("cost (not checked, see resampler_benchmark):\n");
+    for (int quality = 0; quality < kQualityCount; quality++) timeQuality(quality);
+    return Finish("resampler_test");
+}
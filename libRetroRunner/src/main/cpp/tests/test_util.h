@@ -0,0 +1,75 @@
+//
+// Created by Aidoo.TK on 2024/12/22.
+//
+
+#ifndef _RR_TEST_UTIL_H
+#define _RR_TEST_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+namespace rr_test {
+
+    inline int &Failures() {
+        static int failures = 0;
+        return failures;
+    }
+
+    /* exit code of a test program, prints the summary */
+    inline int Finish(const char *name) {
+        if (Failures() == 0) {
+            printf("[%s] all checks passed\n", name);
+            return 0;
+        }
+        printf("[%s] %d checks failed\n", name, Failures());
+        return 1;
+    }
+
+    inline int64_t NowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /* benchmarks accept --quick, used by ctest to keep them building and running */
+    inline bool IsQuickRun(int argc, char **argv) {
+        for (int idx = 1; idx < argc; idx++) {
+            if (strcmp(argv[idx], "--quick") == 0) return true;
+        }
+        return false;
+    }
+
+    /* small deterministic generator, tests must not depend on the platform rand() */
+    class Random {
+    public:
+        explicit Random(uint32_t seed) : state_(seed ? seed : 1) {}
+
+        inline uint32_t Next() {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 17;
+            state_ ^= state_ << 5;
+            return state_;
+        }
+
+        /* [min, max] */
+        inline int Range(int min, int max) {
+            return min + (int) (Next() % (uint32_t) (max - min + 1));
+        }
+
+    private:
+        uint32_t state_;
+    };
+}
+
+/* a failed check is reported and counted, the test keeps running to show every failure */
+#define RR_EXPECT(cond, ...)                                                    \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            rr_test::Failures()++;                                              \
+            printf("FAILED %s:%d: %s\n    ", __FILE__, __LINE__, #cond);        \
+            printf(__VA_ARGS__);                                                \
+            printf("\n");                                                       \
+        }                                                                       \
+    } while (0)
+
+#endif
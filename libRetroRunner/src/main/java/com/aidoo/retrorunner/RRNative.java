@@ -59,6 +59,25 @@ public class RRNative {
      */
     public static native void addVariable(String key, String value, boolean notifyCore);
 
+    /**
+     * load core variables from an option file (key = "value" per line), later files override earlier ones.
+     * {system}/{core name}.opt, {game path}.opt (older versions) and {system}/{core name}/{rom name}.opt
+     * are loaded automatically when the core is loaded.
+     *
+     * @param path       option file path
+     * @param notifyCore if true, notify core to update the variables
+     * @return false if the file can't be read
+     */
+    public static native boolean loadVariables(String path, boolean notifyCore);
+
+    /**
+     * save current core variables to an option file
+     *
+     * @param path the path to save, if path is empty, save to default path {system}/{core name}/{rom name}.opt
+     * @return 0: success , other: failed error code
+     */
+    public static native int saveVariables(String path, boolean waitForResult);
+
     public static native boolean isEmuStarted();
     public static native int startEmuThread();
     public static native void waitEmuThreadStop();
@@ -94,6 +113,111 @@ public class RRNative {
     /*set emu speed multiplier， > 0.1, 1.0 = 60fps */
     public static native void setFastForward(float multiplier);
 
+    /**
+     * set when input is latched in a frame, core may override it with RETRO_ENVIRONMENT_POLL_TYPE_OVERRIDE
+     *
+     * @param pollType 1: early, before retro_run; 2: normal, at input_poll; 3: late, at the first input_state in a frame
+     */
+    public static native void setInputPollType(int pollType);
+
+    /**
+     * skip texture upload and shader passes when a software frame is identical to the previous one,
+     * costs a hash of each frame, disabled by default
+     */
+    public static native void setVideoFrameDedupe(boolean enable);
+
+    /**
+     * set frame latency of the video driver, takes effect on the next frame for gl, when the surface is created for vulkan
+     *
+     * @param framesInFlight frames the GPU may lag behind, 0: wait for each frame (lowest latency), 1(default) or 2: higher throughput
+     * @param swapInterval   0: present without vsync, 1(default): every vblank, 2: every other vblank
+     */
+    public static native void setVideoFrameLatency(int framesInFlight, int swapInterval);
+
+    /**
+     * set swapchain of the vulkan video driver, takes effect when the surface is created,
+     * unsupported values fall back to FIFO and the surface image limits
+     *
+     * @param presentMode 0(default): auto, 1: FIFO, 2: FIFO_RELAXED, 3: MAILBOX, 4: IMMEDIATE
+     * @param imageCount  swapchain images, 0(default): frames in flight + 1
+     */
+    public static native void setVulkanSwapchain(int presentMode, int imageCount);
+
+    /**
+     * set shader preset of the gl video driver, applied on the emu thread when the game is running.
+     * shaders use the RetroArch GLSL interface, lookup textures and parameters are not supported.
+     *
+     * @param presetPath .glslp preset or single pass .glsl shader, empty string to disable
+     * @return 0 if the preset is set or queued, see RRError
+     */
+    public static native int setVideoShaderPreset(String presetPath);
+
+    /**
+     * set audio driver, takes effect when audio is initialized
+     *
+     * @param driver "android": oboe output, "file": write to the dump path, "null": simulated device without output
+     */
+    public static native void setAudioDriver(String driver);
+
+    /**
+     * set output file of the "file" audio driver
+     *
+     * @param path file path, ends with .wav for wav, otherwise raw 16bit stereo pcm
+     */
+    public static native void setAudioDumpPath(String path);
+
+    /**
+     * set timing of the "null" audio driver, the simulated device consumes burstFrames at core sample rate
+     *
+     * @param burstFrames frames consumed by each callback
+     * @param jitterMicros max random offset of each callback in microseconds, 0 for none
+     */
+    public static native void setNullAudioTiming(int burstFrames, int jitterMicros);
+
+    /**
+     * set audio resampler quality, takes effect when audio is initialized
+     *
+     * @param quality 0: linear, 1: low(8 taps), 2: medium(16 taps), 3: high(32 taps), 4: best(float sinc, 64 taps)
+     */
+    public static native void setAudioResamplerQuality(int quality);
+
+    /**
+     * output float audio when the device supports it, takes effect when audio is initialized
+     */
+    public static native void setAudioFloatOutput(boolean enable);
+
+    /**
+     * keep audio pitch when game speed is not 1.0, enabled by default, takes effect when audio is initialized
+     *
+     * @param enable false to drop the extra audio in fast forward
+     */
+    public static native void setAudioTimeStretch(boolean enable);
+
+    /**
+     * append a libretro .dsp preset (EQ, IIR, Echo, Chorus...) to the audio filter chain,
+     * takes effect when audio is initialized, filters enable the float audio pipeline
+     *
+     * @param presetPath path of the .dsp file
+     */
+    public static native void addAudioDspFilter(String presetPath);
+
+    /**
+     * remove all audio dsp filters
+     */
+    public static native void clearAudioDspFilters();
+
+    /**
+     * get runtime statistics, such as input latency distribution
+     *
+     * @return json string: {"counters":{name: value}, "histograms":{name: {count, mean_us, p50_us, p90_us, p99_us, max_us}}}
+     */
+    public static native String getStatistics();
+
+    /**
+     * reset all runtime statistics
+     */
+    public static native void resetStatistics();
+
     /**
      * update button state
      *
@@ -114,6 +238,42 @@ public class RRNative {
      */
     public static native void updateAxisState(int player, int analog, int axisButton, float value);
 
+    /**
+     * update keyboard key state, keyboard/mouse/pointer events should be sent from the same thread
+     *
+     * @param keyCode   android key code
+     * @param character unicode character of the key, 0 for none
+     * @param metaState android meta state
+     * @param down      true: down, false: up
+     */
+    public static native void updateKeyState(int keyCode, int character, int metaState, boolean down);
+
+    /**
+     * update mouse relative motion
+     *
+     * @param dx delta x in pixels
+     * @param dy delta y in pixels
+     */
+    public static native void updateMouseMotion(int dx, int dy);
+
+    /**
+     * update mouse button state
+     *
+     * @param button RETRO_DEVICE_ID_MOUSE_*, wheel buttons only need down events
+     * @param down   true: down, false: up
+     */
+    public static native void updateMouseButton(int button, boolean down);
+
+    /**
+     * update touch pointer state
+     *
+     * @param pointerId android pointer id [0-9]
+     * @param x         x in game screen, [-1, 1]
+     * @param y         y in game screen, [-1, 1]
+     * @param down      true: down or move, false: up
+     */
+    public static native void updatePointerState(int pointerId, float x, float y, boolean down);
+
     /**
      * get the aspect ratio of the game
      *